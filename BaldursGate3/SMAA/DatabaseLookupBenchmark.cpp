@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseLookupBenchmark.cpp
+//
+// Microbenchmark of resolving database handles to their pages.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DatabaseBackend.h"
+#include "DatabaseLayout.h"
+#include "PagedReadOnlyDatabase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Every handle is resolved this many times per measurement, so that a database with
+// few blobs still runs long enough to time
+constexpr size_t MIN_LOOKUPS = 10000000;
+
+//------------------------------------------------------------------------------
+// MeasureNanosecondsPerLookup - runs resolve over the handles until at least
+// MIN_LOOKUPS have been made, and returns the mean time of one
+//------------------------------------------------------------------------------
+template <typename Resolve>
+double MeasureNanosecondsPerLookup(const std::vector<Serialization::DATABASE_HANDLE>& handles, Resolve resolve)
+{
+    const size_t passes = std::max<size_t>(MIN_LOOKUPS / handles.size(), 1);
+
+    // The sum keeps the lookups from being optimized away
+    uint64_t checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < passes; ++pass)
+    {
+        for (const auto& handle : handles)
+        {
+            checksum += resolve(handle);
+        }
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    static volatile uint64_t s_sink = 0;
+    s_sink = s_sink + checksum;
+    return elapsed / static_cast<double>(passes * handles.size());
+}
+
+//------------------------------------------------------------------------------
+// RunDatabaseLookupBenchmark
+//------------------------------------------------------------------------------
+void RunDatabaseLookupBenchmark()
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+
+    DatabaseLayout layout;
+    const auto result = layout.Load(DATABASE_BIN_FILE, options.PageSizeThreshold);
+    NV_THROW_IF(result != ReadOnlyDatabase::InitResult::Ok, "Failed to load the database records for the lookup benchmark");
+
+    std::vector<DATABASE_HANDLE> handles;
+    for (size_t i = 0; i < layout.GetBlobCount(); ++i)
+    {
+        const DATABASE_HANDLE handle(static_cast<int32_t>(i));
+        if (layout.GetBlob(handle)->Size > 0)
+        {
+            handles.push_back(handle);
+        }
+    }
+    NV_THROW_IF(handles.empty(), "The database has no blobs to run the lookup benchmark on");
+
+    // Frame code reads handles roughly in capture order, but resources are shared
+    // between frames, so measure a shuffled order as well
+    std::vector<DATABASE_HANDLE> shuffledHandles = handles;
+    std::shuffle(shuffledHandles.begin(), shuffledHandles.end(), std::mt19937(12345));
+
+    // The page cache is unlimited so that every read after the first is a hit
+    const PagedReadOnlyDatabase::CacheSettings settings = { options.PageSizeThreshold, 0, 0, options.CacheShardCount, options.EvictionPolicy, options.ReadEngine, options.ReadQueueDepth, 0, false, 0, false, options.HugePages, options.MaxCachedBufferBytes, false };
+    PagedReadOnlyDatabase database(settings);
+    NV_THROW_IF(database.Init(DATABASE_BIN_FILE) != ReadOnlyDatabase::InitResult::Ok, "Failed to open the database for the lookup benchmark");
+    for (const auto& handle : handles)
+    {
+        NV_THROW_IF(!database.Read<const void*>(handle).Get(), "Failed to read a blob for the lookup benchmark");
+    }
+
+    // How handles were resolved before the location table: the blob record, then a
+    // binary search of the pages for the one holding it
+    auto searchPages = [&](const DATABASE_HANDLE& handle) -> uint64_t {
+        const DatabaseBlobRecord* pBlob = layout.GetBlob(handle);
+        const size_t pageIndex = layout.FindPage(pBlob->Offset);
+        return pageIndex + (pBlob->Offset - layout.GetPage(pageIndex).PageOffset);
+    };
+    auto lookUpLocation = [&](const DATABASE_HANDLE& handle) -> uint64_t {
+        const DatabaseBlobLocation* pLocation = layout.GetBlobLocation(handle);
+        return pLocation->PageIndex + pLocation->OffsetInPage;
+    };
+    auto readBlob = [&](const DATABASE_HANDLE& handle) -> uint64_t {
+        return reinterpret_cast<uintptr_t>(database.Read<const void*>(handle).Get());
+    };
+
+    NV_MESSAGE("Database lookup benchmark: %zu blobs in %zu pages", handles.size(), layout.GetPageCount());
+    NV_MESSAGE("%-10s %14s %14s %14s", "order", "search ns", "table ns", "paged read ns");
+
+    const std::vector<DATABASE_HANDLE>* orders[] = { &handles, &shuffledHandles };
+    const char* orderNames[] = { "handle", "shuffled" };
+    for (size_t i = 0; i < 2; ++i)
+    {
+        NV_MESSAGE("%-10s %14.2f %14.2f %14.2f",
+            orderNames[i],
+            MeasureNanosecondsPerLookup(*orders[i], searchPages),
+            MeasureNanosecondsPerLookup(*orders[i], lookUpLocation),
+            MeasureNanosecondsPerLookup(*orders[i], readBlob));
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Times resolving every handle of " DATABASE_BIN_FILE " to its page by searching the pages and through the location table, and a warm read through the paged backend", []() {
+        RunDatabaseLookupBenchmark();
+        return true;
+    });
+}
@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseTrace.cpp
+//
+// On-disk record of the order in which database pages and blobs are first used.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseTrace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace Serialization {
+
+namespace {
+
+struct DatabaseTraceHeader
+{
+    static const uint32_t MAGIC = 0x5444564E; // "NVDT"
+    static const uint32_t CURRENT_VERSION = 3;
+    static const uint32_t NO_PHASES_VERSION = 2;
+    static const uint32_t PAGES_ONLY_VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t entryCount;
+};
+
+//------------------------------------------------------------------------------
+// ReadArray - reads count elements incrementally rather than trusting the count
+// for the allocation
+//------------------------------------------------------------------------------
+template <typename T>
+bool ReadArray(FILE* pFile, uint64_t count, std::vector<T>& elements)
+{
+    T chunk[1024];
+    size_t chunkCount = 0;
+    while (elements.size() < count && (chunkCount = fread(chunk, sizeof(T), static_cast<size_t>(std::min<uint64_t>(1024, count - elements.size())), pFile)) > 0)
+    {
+        elements.insert(elements.end(), chunk, chunk + chunkCount);
+    }
+    return elements.size() == count;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// SaveDatabaseTrace
+//------------------------------------------------------------------------------
+bool SaveDatabaseTrace(const char* pFileName, const std::vector<DatabaseTraceEntry>& entries, const std::vector<uint32_t>& blobs, const std::vector<uint8_t>& blobPhases)
+{
+    if (blobPhases.size() != blobs.size())
+    {
+        return false;
+    }
+
+    FILE* pFile = fopen(pFileName, "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    DatabaseTraceHeader header = { DatabaseTraceHeader::MAGIC, DatabaseTraceHeader::CURRENT_VERSION, entries.size() };
+    bool success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    if (success && !entries.empty())
+    {
+        success = fwrite(entries.data(), sizeof(DatabaseTraceEntry), entries.size(), pFile) == entries.size();
+    }
+
+    // The blobs follow the pages and their phases follow the blobs, so traces of
+    // earlier versions are a prefix of this one
+    const uint64_t blobCount = blobs.size();
+    success = success && fwrite(&blobCount, sizeof(blobCount), 1, pFile) == 1;
+    if (success && !blobs.empty())
+    {
+        success = fwrite(blobs.data(), sizeof(uint32_t), blobs.size(), pFile) == blobs.size()
+            && fwrite(blobPhases.data(), sizeof(uint8_t), blobPhases.size(), pFile) == blobPhases.size();
+    }
+
+    return (fclose(pFile) == 0) && success;
+}
+
+//------------------------------------------------------------------------------
+// LoadDatabaseTrace
+//------------------------------------------------------------------------------
+bool LoadDatabaseTrace(const char* pFileName, std::vector<DatabaseTraceEntry>& entries, std::vector<uint32_t>* pBlobs, std::vector<uint8_t>* pBlobPhases)
+{
+    entries.clear();
+    if (pBlobs)
+    {
+        pBlobs->clear();
+    }
+    if (pBlobPhases)
+    {
+        pBlobPhases->clear();
+    }
+
+    FILE* pFile = fopen(pFileName, "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    DatabaseTraceHeader header = {};
+    bool success = fread(&header, sizeof(header), 1, pFile) == 1
+        && header.magic == DatabaseTraceHeader::MAGIC
+        && header.version >= DatabaseTraceHeader::PAGES_ONLY_VERSION
+        && header.version <= DatabaseTraceHeader::CURRENT_VERSION;
+
+    success = success && ReadArray(pFile, header.entryCount, entries);
+
+    std::vector<uint32_t> blobs;
+    if (success && (pBlobs || pBlobPhases) && header.version != DatabaseTraceHeader::PAGES_ONLY_VERSION)
+    {
+        uint64_t blobCount = 0;
+        success = fread(&blobCount, sizeof(blobCount), 1, pFile) == 1 && ReadArray(pFile, blobCount, blobs);
+        if (success && pBlobPhases && header.version != DatabaseTraceHeader::NO_PHASES_VERSION)
+        {
+            success = ReadArray(pFile, blobCount, *pBlobPhases);
+        }
+    }
+    if (success && pBlobs)
+    {
+        pBlobs->swap(blobs);
+    }
+
+    fclose(pFile);
+    if (!success)
+    {
+        entries.clear();
+        if (pBlobs)
+        {
+            pBlobs->clear();
+        }
+        if (pBlobPhases)
+        {
+            pBlobPhases->clear();
+        }
+    }
+    return success;
+}
+
+} // namespace Serialization
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: StoreDatabase.cpp
+//
+// Resolves a capture's DATABASE_HANDLEs to blobs in a shared blob store.
+//--------------------------------------------------------------------------------------
+
+#include "StoreDatabase.h"
+
+#include "BlobStore.h"
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// StoreDatabase
+//------------------------------------------------------------------------------
+StoreDatabase::StoreDatabase(IReadOnlyDatabase& database)
+    : m_Database(database)
+    , m_StoreHandles()
+{
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+StoreDatabase::InitResult StoreDatabase::Init(const char* pMapFileName, const char* pStoreFileName)
+{
+    if (!pMapFileName || !pStoreFileName)
+    {
+        return InitResult::BadArgument;
+    }
+
+    return LoadBlobStoreMap(pMapFileName, pStoreFileName, m_StoreHandles) ? InitResult::Ok : InitResult::FailedToOpenDatabaseRecords;
+}
+
+//------------------------------------------------------------------------------
+// GetSize
+//------------------------------------------------------------------------------
+uint64_t StoreDatabase::GetSize(const DATABASE_HANDLE& handle)
+{
+    return m_Database.GetSize(MapHandle(handle));
+}
+
+//------------------------------------------------------------------------------
+// Lock
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle StoreDatabase::Lock(uint64_t pageOffset)
+{
+    return m_Database.Lock(pageOffset);
+}
+
+//------------------------------------------------------------------------------
+// Unlock
+//------------------------------------------------------------------------------
+void StoreDatabase::Unlock(DataScope::LockedPageHandle pPageHandle)
+{
+    m_Database.Unlock(pPageHandle);
+}
+
+//------------------------------------------------------------------------------
+// Prefetch
+//------------------------------------------------------------------------------
+void StoreDatabase::Prefetch(uint64_t pageOffset)
+{
+    m_Database.Prefetch(pageOffset);
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* StoreDatabase::DoRead(const DATABASE_HANDLE& handle)
+{
+    return m_Database.DoRead(MapHandle(handle));
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* StoreDatabase::DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker)
+{
+    return m_Database.DoRead(MapHandle(handle), scopeTracker);
+}
+
+//------------------------------------------------------------------------------
+// DoReadStatic
+//------------------------------------------------------------------------------
+void* StoreDatabase::DoReadStatic(const DATABASE_HANDLE& handle)
+{
+    return m_Database.DoReadStatic(MapHandle(handle));
+}
+
+} // namespace Serialization
@@ -4,6 +4,8 @@
 
 #include "CommonReplay.h"
 
+#include <cstdlib>
+#include <exception>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -26,4 +28,52 @@ struct AutoRegisterArgument
     }
 };
 
-#define REGISTER_ARGUMENTS(fnptr) static AutoRegisterArgument const NV_ANONYMOUS_VARIABLE(autoRegisterArgument, __LINE__)(fnptr)
\ No newline at end of file
+#define REGISTER_ARGUMENTS(fnptr) static AutoRegisterArgument const NV_ANONYMOUS_VARIABLE(autoRegisterArgument, __LINE__)(fnptr)
+
+//------------------------------------------------------------------------------
+// RunWithExternalArguments - entry point of the benchmark and test executables
+// linked against the replay library.  Parses the registered arguments, so that
+// options such as --database-eviction apply, then runs the tool and returns its
+// exit code.
+//------------------------------------------------------------------------------
+inline int RunWithExternalArguments(int argc, char** argv, const char* pDescription, const std::function<bool()>& fnRun)
+{
+    args::ArgumentParser parser(pDescription);
+    args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
+
+    std::vector<FnParseResults> vecFnParseResults;
+    for (const auto& fnAddArgument : GetExternalArguments())
+    {
+        vecFnParseResults.push_back(fnAddArgument(parser));
+    }
+
+    try
+    {
+        parser.ParseCLI(argc, argv);
+    }
+    catch (const args::Help&)
+    {
+        WriteMessage(parser.Help().c_str());
+        return EXIT_SUCCESS;
+    }
+    catch (const args::Error& e)
+    {
+        WriteMessage(e.what());
+        WriteMessage(parser.Help().c_str());
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        for (const auto& fnParseResults : vecFnParseResults)
+        {
+            fnParseResults();
+        }
+        return fnRun() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (const std::exception& e)
+    {
+        WriteMessage(e.what());
+        return EXIT_FAILURE;
+    }
+}
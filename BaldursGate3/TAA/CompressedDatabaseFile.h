@@ -0,0 +1,119 @@
+//--------------------------------------------------------------------------------------
+// File: CompressedDatabaseFile.h
+//
+// Compressed, seekable container for the pages of a database file.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DatabaseLayout.h"
+#include "DatabaseSource.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Serialization {
+
+enum class CompressionCodec : uint32_t
+{
+    Stored, // Uncompressed; used for frames which do not compress
+    Lz4,
+    Zstd,
+};
+
+//----------------------------------------------------------------------------------
+// CompressedDatabaseFile
+//
+// Each page of the database (as grouped by DatabaseLayout) is split into frames
+// of at most FRAME_SIZE bytes, measured from the start of the page, and every
+// frame is compressed on its own.  An index of frames at the end of the file maps
+// offsets in the original database to compressed frames, so any range of a page
+// can be read by decompressing only the frames it covers.  Bytes of the database
+// which belong to no blob are not stored.
+//
+// The page size threshold used to split the database is stored in the header.
+// Pages read with the same threshold start on a frame boundary; with any other
+// threshold reads still work, but frames which are only partly needed are
+// decompressed through a copy.
+//----------------------------------------------------------------------------------
+class CompressedDatabaseFile : public IDatabaseSource
+{
+public:
+    static constexpr uint64_t FRAME_SIZE = 1 << 20;
+
+    CompressedDatabaseFile();
+    virtual ~CompressedDatabaseFile();
+
+    //------------------------------------------------------------------------------
+    // Write - Compresses the database file pDatabaseFileName into pFileName.
+    // Frames are compressed on the thread pool.  level is codec specific; zero
+    // selects the codec's default.
+    //------------------------------------------------------------------------------
+    static bool Write(const char* pDatabaseFileName, const char* pFileName, uint64_t pageSizeThreshold, CompressionCodec codec, int level);
+
+    //------------------------------------------------------------------------------
+    // Open - Opens a container and loads its index
+    //------------------------------------------------------------------------------
+    bool Open(const char* pFileName);
+    void Close();
+
+    // Size of the original database file
+    virtual uint64_t GetDatabaseSize() const override
+    {
+        return m_DatabaseSize;
+    }
+
+    // Page size threshold the container was written with
+    uint64_t GetPageSizeThreshold() const
+    {
+        return m_PageSizeThreshold;
+    }
+
+    uint64_t GetCompressedSize() const
+    {
+        return m_CompressedSize;
+    }
+
+    //------------------------------------------------------------------------------
+    // Read - Reads size bytes at offset in the original database into pDestination.
+    // The range must lie within stored frames.  Safe to call from several threads
+    // at once.
+    //------------------------------------------------------------------------------
+    virtual bool Read(uint64_t offset, uint64_t size, uint8_t* pDestination) const override;
+
+    static bool IsCodecAvailable(CompressionCodec codec);
+    static const char* CodecToString(CompressionCodec codec);
+
+private:
+    struct Frame
+    {
+        uint64_t Offset; // In the original database
+        uint64_t CompressedOffset; // In the container
+        uint32_t Size;
+        uint32_t CompressedSize;
+        CompressionCodec Codec;
+        uint32_t Reserved;
+    };
+
+    // This class is non-copyable
+    CompressedDatabaseFile(const CompressedDatabaseFile&) = delete;
+    CompressedDatabaseFile& operator=(const CompressedDatabaseFile&) = delete;
+
+    bool ReadFromFile(uint64_t offset, uint64_t size, uint8_t* pDestination) const;
+    bool DecompressFrame(const Frame& frame, uint8_t* pDestination) const;
+
+    static void CompressFrame(CompressionCodec codec, int level, const uint8_t* pSource, size_t size, std::vector<uint8_t>& compressed, CompressionCodec& usedCodec);
+
+    std::vector<Frame> m_Frames; // Sorted by offset
+    uint64_t m_DatabaseSize;
+    uint64_t m_PageSizeThreshold;
+    uint64_t m_CompressedSize;
+
+#if defined(_WIN32)
+    void* m_hFile;
+#else
+    int m_fd;
+#endif
+};
+
+} // namespace Serialization
@@ -0,0 +1,404 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseBackend.cpp
+//
+// Selection of the IReadOnlyDatabase implementation used by the replay.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseBackend.h"
+
+#include "Arguments.h"
+#include "BlobStore.h"
+#include "CommonReplay.h"
+#include "DatabaseTelemetry.h"
+#include "MappedReadOnlyDatabase.h"
+#include "PrefetchingDatabase.h"
+#include "StoreDatabase.h"
+#include "ZipDatabaseArchive.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace {
+
+//------------------------------------------------------------------------------
+// GetBackendFileName - the file the backend reads blobs from: the blob store if
+// one is used, otherwise the capture's own database file
+//------------------------------------------------------------------------------
+const char* GetBackendFileName()
+{
+    const auto& options = Serialization::GetDatabaseOptions();
+    return options.StoreFile.empty() ? DATABASE_BIN_FILE : options.StoreFile.c_str();
+}
+
+//------------------------------------------------------------------------------
+// GetArchiveEntryName - the backend file is read from the entry of the archive
+// with the same file name
+//------------------------------------------------------------------------------
+const char* GetArchiveEntryName()
+{
+    const char* pFileName = GetBackendFileName();
+    for (const char* pCharacter = pFileName; *pCharacter; ++pCharacter)
+    {
+        if (*pCharacter == '/' || *pCharacter == '\\')
+        {
+            pFileName = pCharacter + 1;
+        }
+    }
+    return pFileName;
+}
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+FnParseResults AddDatabaseArguments(args::ArgumentParser& parser)
+{
+    using Serialization::DatabaseBackend;
+    using EvictionPolicy = Serialization::PagedReadOnlyDatabase::EvictionPolicy;
+    using ReadEngine = Serialization::DatabaseReadQueue::Engine;
+    using HugePages = Serialization::DatabasePageAllocator::HugePages;
+
+    const std::unordered_map<std::string, DatabaseBackend> backends = {
+        { "file", DatabaseBackend::File },
+        { "mmap", DatabaseBackend::Mapped },
+        { "paged", DatabaseBackend::Paged },
+    };
+
+    const std::unordered_map<std::string, EvictionPolicy> evictionPolicies = {
+        { "clock", EvictionPolicy::Clock },
+        { "lru", EvictionPolicy::LeastRecentlyUsed },
+    };
+
+    const std::unordered_map<std::string, ReadEngine> readEngines = {
+        { "uring", ReadEngine::IoUring },
+        { "pread", ReadEngine::Synchronous },
+    };
+
+    const std::unordered_map<std::string, HugePages> hugePages = {
+        { "none", HugePages::None },
+        { "transparent", HugePages::Transparent },
+        { "explicit", HugePages::Explicit },
+    };
+
+    // A byte budget is a hard ceiling on page memory unless every resident page is
+    // locked.  With verbose output the paged cache reports its misses, evictions and
+    // contended shard locks on exit.
+    auto spBackend = std::make_shared<args::MapFlag<std::string, DatabaseBackend>>(parser, "backend", "Database backend used to read " DATABASE_BIN_FILE ": 'file' (default) reads pages into memory, 'mmap' reads blobs in place from a file mapping, 'paged' reads pages into memory through a sharded cache", args::Matcher{ "database-backend" }, backends, DatabaseBackend::File);
+    auto spPrefault = std::make_shared<args::Flag>(parser, "prefault", "Fault in the whole database at startup so timed frames never page in database memory (mmap backend)", args::Matcher{ "database-prefault" });
+    auto spMaxResidentPages = std::make_shared<args::ValueFlag<size_t>>(parser, "count", "Maximum number of database pages kept in memory, 0 for no limit (paged backend)", args::Matcher{ "database-max-resident-pages" }, 0);
+    auto spMaxResidentMegabytes = std::make_shared<args::ValueFlag<uint64_t>>(parser, "MB", "Maximum megabytes of database pages kept in memory, 0 for no limit (paged backend).  The resident high-water mark is reported on exit.", args::Matcher{ "database-max-resident-mb" }, 0);
+    auto spCacheShards = std::make_shared<args::ValueFlag<size_t>>(parser, "count", "Number of independently locked shards in the page cache (paged backend, default 16)", args::Matcher{ "database-cache-shards" }, 16);
+    auto spEvictionPolicy = std::make_shared<args::MapFlag<std::string, EvictionPolicy>>(parser, "policy", "Page cache eviction policy (paged backend): 'clock' (default) or 'lru'", args::Matcher{ "database-eviction" }, evictionPolicies, EvictionPolicy::Clock);
+    // Residency by phase.  Frames are counted by the replay's frame loop through
+    // My_frame in function_overrides.h, so an override must keep its
+    // BeginDatabaseFrame call.  A frame reset which needs a released init page
+    // reads it back.  Pinning reads evicted pages back whole, pins pages first used
+    // after warm-up too, and reports the first 32 reads of a pinned frame with the
+    // reading thread's Frame<N>Part<M>.cpp file; --database-pin-mlock needs a large
+    // enough locked-memory limit (ulimit -l).
+    auto spFrameResidentMegabytes = std::make_shared<args::ValueFlag<uint64_t>>(parser, "MB", "Keep pages of small blobs read by frames and frame resets in a pool of their own with this budget, so startup loads never evict them, 0 for no pool (paged backend)", args::Matcher{ "database-frame-resident-mb" }, 0);
+    auto spReleaseInitPages = std::make_shared<args::Flag>(parser, "release", "Evict database pages used only by resource init and frame setup when the first frame starts, and report the drop in resident memory (paged backend)", args::Matcher{ "database-release-init-pages" });
+    auto spPinWarmupFrames = std::make_shared<args::ValueFlag<uint64_t>>(parser, "frames", "Record the database pages frames use over this many warm-up frames, then keep them resident and report every page-in of a later frame as a contaminated measurement, 0 to not pin (paged backend)", args::Matcher{ "database-pin-working-set" }, 0);
+    auto spPinWithMlock = std::make_shared<args::Flag>(parser, "mlock", "Also lock the working set pinned by --database-pin-working-set in physical memory", args::Matcher{ "database-pin-mlock" });
+    // The shared object is named after the file's identity and size, and the last
+    // process to detach unlinks it.  Shared pages still count in each process's RSS;
+    // the saving shows in PSS and /dev/shm.  Explicit huge pages must be reserved up
+    // front with vm.nr_hugepages, and buffers which get none are counted on exit.
+    auto spSharedCache = std::make_shared<args::Flag>(parser, "shared", "Hold database pages in named shared memory which other replay processes reading the same file attach to, so each page is read and held once (paged backend)", args::Matcher{ "database-shared-cache" });
+    auto spHugePages = std::make_shared<args::MapFlag<std::string, HugePages>>(parser, "pages", "Backing of database pages of 2 MB and more (paged backend): 'none' (default), 'transparent' to advise transparent huge pages, or 'explicit' for reserved huge pages, falling back to ordinary pages when none are available", args::Matcher{ "database-huge-pages" }, hugePages, HugePages::None);
+    auto spBufferCacheMegabytes = std::make_shared<args::ValueFlag<uint64_t>>(parser, "MB", "Megabytes of memory of evicted database pages of 2 MB and more kept for reuse by later loads, 0 to unmap it (paged backend, default 64)", args::Matcher{ "database-buffer-cache-mb" }, 64);
+    // Verification, telemetry and epoch unlocking.  The checksums are written by
+    // DatabaseChecksumTool when the capture is packaged, and the replay never writes
+    // them, so a missing or stale sidecar leaves the file unverified.  In the
+    // statistics, a high frame miss rate or long waits point to a residency budget
+    // which is too small, and large misses with few hits to a PageSizeThreshold
+    // which is too high.  Epoch unlocking needs the budget to hold a frame's working
+    // set, since held pages cannot be evicted until every thread has moved on.
+    auto spVerify = std::make_shared<args::Flag>(parser, "verify", "Check database pages on the thread pool against the CRC-32C checksums DatabaseChecksumTool wrote in " DATABASE_BIN_FILE ".sum as they are read; a file which has passed every check is not checked again (paged backend)", args::Matcher{ "database-verify" });
+    auto spTelemetry = std::make_shared<args::Flag>(parser, "stats", "Count database reads, page locks and hits, misses with a latency histogram, and evictions for resource init, frame setup, frames (SUBMIT), frame resets (RESET) and prefetching, and report them on exit (paged backend)", args::Matcher{ "database-stats" });
+    auto spEpochUnlock = std::make_shared<args::Flag>(parser, "epoch", "Keep database pages locked by frames and frame resets until the thread which locked them starts on the next frame, instead of unlocking them at the end of every data scope, so scopes using a page again in the same frame touch no shared counters (paged backend)", args::Matcher{ "database-epoch-unlock" });
+    // Traces record the order and the phase in which blobs are first used.
+    // DatabaseRelayoutTool rewrites the file in that order; after it, record a new
+    // trace, since page offsets change.  Traces cannot be used with a blob store.
+    auto spTraceRecord = std::make_shared<args::ValueFlag<std::string>>(parser, "file", "Record the order in which database pages are first used and write it to this file on exit", args::Matcher{ "database-trace-record" });
+    auto spTraceReplay = std::make_shared<args::ValueFlag<std::string>>(parser, "file", "Prefetch database pages on the thread pool in the order recorded by --database-trace-record", args::Matcher{ "database-trace-replay" });
+    auto spPrefetchWindow = std::make_shared<args::ValueFlag<uint64_t>>(parser, "MB", "How far ahead of the replay --database-trace-replay prefetches, in megabytes (default 256)", args::Matcher{ "database-prefetch-window" }, 256);
+    auto spCompressed = std::make_shared<args::ValueFlag<std::string>>(parser, "file", "Read database pages from this container, written by DatabaseCompressTool, instead of " DATABASE_BIN_FILE " (selects the paged backend)", args::Matcher{ "database-compressed" });
+    auto spPreload = std::make_shared<args::Flag>(parser, "preload", "Load database pages on the thread pool at startup, up to the residency limits (paged backend)", args::Matcher{ "database-preload" });
+    // Containers read in place of the capture's database file.  The replay's startup
+    // and FreeCachedMemory still read the extracted data.bin and data.bin.rec through
+    // GetDatabase(), so keep them.  A deflated zip entry is indexed once into
+    // data.zip.index; the mmap backend maps only stored entries and falls back to
+    // paged for deflated ones.
+    auto spStore = std::make_shared<args::ValueFlag<std::string>>(parser, "file", "Read blobs from this blob store through the " DATABASE_BIN_FILE ".map written by BlobStoreTool instead of from " DATABASE_BIN_FILE " (selects the paged backend unless mmap is chosen)", args::Matcher{ "database-store" });
+    auto spArchive = std::make_shared<args::ValueFlag<std::string>>(parser, "file", "Read " DATABASE_BIN_FILE " from this zip archive without extracting it (selects the paged backend unless mmap is chosen)", args::Matcher{ "database-zip" });
+    // io_uring falls back to pread, with a message, when the kernel or a sandbox
+    // refuses it or the build did not find linux/io_uring.h.  Large reads are split
+    // into 512 KB chunks read in parallel.
+    auto spReadEngine = std::make_shared<args::MapFlag<std::string, ReadEngine>>(parser, "engine", "How the paged backend reads " DATABASE_BIN_FILE ": 'uring' (default) batches reads through io_uring where available, 'pread' reads one page at a time", args::Matcher{ "database-io" }, readEngines, ReadEngine::IoUring);
+    auto spReadQueueDepth = std::make_shared<args::ValueFlag<size_t>>(parser, "count", "Database reads kept in flight at once by --database-io uring (default 32)", args::Matcher{ "database-queue-depth" }, 32);
+
+    return [=]() {
+        auto& options = Serialization::GetDatabaseOptions();
+        options.Backend = args::get(*spBackend);
+        options.Prefault = args::get(*spPrefault);
+        options.MaxResidentPages = args::get(*spMaxResidentPages);
+        options.MaxResidentBytes = args::get(*spMaxResidentMegabytes) * 1024 * 1024;
+        options.CacheShardCount = args::get(*spCacheShards);
+        options.EvictionPolicy = args::get(*spEvictionPolicy);
+        options.TraceRecordFile = args::get(*spTraceRecord);
+        options.TraceReplayFile = args::get(*spTraceReplay);
+        options.PrefetchWindowSize = args::get(*spPrefetchWindow) * 1024 * 1024;
+        options.CompressedFile = args::get(*spCompressed);
+        options.Preload = args::get(*spPreload);
+        options.StoreFile = args::get(*spStore);
+        options.ArchiveFile = args::get(*spArchive);
+        options.ReadEngine = args::get(*spReadEngine);
+        options.ReadQueueDepth = args::get(*spReadQueueDepth);
+        options.MaxFrameResidentBytes = args::get(*spFrameResidentMegabytes) * 1024 * 1024;
+        options.ReleaseInitPages = args::get(*spReleaseInitPages);
+        options.PinWarmupFrames = args::get(*spPinWarmupFrames);
+        options.PinWithMlock = args::get(*spPinWithMlock);
+        options.SharedCache = args::get(*spSharedCache);
+        options.HugePages = args::get(*spHugePages);
+        options.MaxCachedBufferBytes = args::get(*spBufferCacheMegabytes) * 1024 * 1024;
+        options.Verify = args::get(*spVerify);
+        options.Telemetry = args::get(*spTelemetry);
+        options.EpochUnlock = args::get(*spEpochUnlock);
+
+        NV_THROW_IF(!options.CompressedFile.empty() && !options.ArchiveFile.empty(), "--database-compressed and --database-zip cannot be combined");
+        NV_THROW_IF(options.PinWithMlock && options.PinWarmupFrames == 0, "--database-pin-mlock requires --database-pin-working-set");
+
+        // Only the paged backend can read a compressed container, and the file
+        // backend can only read the capture's own database from disk
+        const bool redirected = !options.StoreFile.empty() || !options.ArchiveFile.empty();
+        if (!options.CompressedFile.empty() || (redirected && options.Backend == DatabaseBackend::File))
+        {
+            options.Backend = DatabaseBackend::Paged;
+        }
+    };
+}
+REGISTER_ARGUMENTS(AddDatabaseArguments);
+
+//------------------------------------------------------------------------------
+// CreateBackendDatabase
+//------------------------------------------------------------------------------
+std::unique_ptr<Serialization::MappedReadOnlyDatabase> s_spMappedDatabase;
+std::unique_ptr<Serialization::PagedReadOnlyDatabase> s_spPagedDatabase;
+
+Serialization::IReadOnlyDatabase* CreateBackendDatabase()
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+    DatabaseBackend backend = options.Backend;
+
+    std::unique_ptr<ZipDatabaseArchive> spArchive;
+    if (!options.ArchiveFile.empty())
+    {
+        spArchive.reset(new ZipDatabaseArchive());
+        if (!spArchive->Open(options.ArchiveFile.c_str(), GetArchiveEntryName()))
+        {
+            char message[512] = {};
+            snprintf(message, sizeof(message), "Failed to open '%s' in the zip archive '%s'", GetArchiveEntryName(), options.ArchiveFile.c_str());
+            ThrowErrorWithMessage(message, __FILE__, __LINE__);
+        }
+
+        // Only stored entries lie in the archive as-is
+        if (backend == DatabaseBackend::Mapped && !spArchive->IsStored())
+        {
+            NV_MESSAGE("'%s' is compressed in '%s' and cannot be mapped; using the paged backend", GetArchiveEntryName(), options.ArchiveFile.c_str());
+            backend = DatabaseBackend::Paged;
+        }
+    }
+
+    NV_MESSAGE_VERBOSE("Database backend: %s", DatabaseBackendToString(backend));
+
+    switch (backend)
+    {
+    case DatabaseBackend::Mapped:
+    {
+        s_spMappedDatabase.reset(new MappedReadOnlyDatabase(options.PageSizeThreshold));
+
+        const auto result = spArchive
+            ? s_spMappedDatabase->Init(GetBackendFileName(), options.Prefault, options.ArchiveFile.c_str(), spArchive->GetEntryOffset(), spArchive->GetDatabaseSize())
+            : s_spMappedDatabase->Init(GetBackendFileName(), options.Prefault);
+        if (result != ReadOnlyDatabase::InitResult::Ok)
+        {
+            char message[512] = {};
+            snprintf(message, sizeof(message), "Failed to map database '%s': %s", spArchive ? options.ArchiveFile.c_str() : GetBackendFileName(), ReadOnlyDatabase::InitResultToString(result));
+            ThrowErrorWithMessage(message, __FILE__, __LINE__);
+        }
+        return s_spMappedDatabase.get();
+    }
+
+    case DatabaseBackend::Paged:
+    {
+        // Counted from the start so that preloads and setup are included
+        EnableDatabaseTelemetry(options.Telemetry);
+
+        const PagedReadOnlyDatabase::CacheSettings settings = { options.PageSizeThreshold, options.MaxResidentPages, options.MaxResidentBytes, options.CacheShardCount, options.EvictionPolicy, options.ReadEngine, options.ReadQueueDepth, options.MaxFrameResidentBytes, options.ReleaseInitPages, options.PinWarmupFrames, options.PinWithMlock, options.HugePages, options.MaxCachedBufferBytes, options.EpochUnlock };
+        s_spPagedDatabase.reset(new PagedReadOnlyDatabase(settings));
+
+        const char* pCompressedFileName = options.CompressedFile.empty() ? nullptr : options.CompressedFile.c_str();
+        const char* pSourceFileName = spArchive ? options.ArchiveFile.c_str() : pCompressedFileName;
+        const auto result = spArchive
+            ? s_spPagedDatabase->Init(GetBackendFileName(), std::move(spArchive))
+            : s_spPagedDatabase->Init(GetBackendFileName(), pCompressedFileName);
+        if (result != ReadOnlyDatabase::InitResult::Ok)
+        {
+            char message[512] = {};
+            snprintf(message, sizeof(message), "Failed to open database '%s': %s", pSourceFileName ? pSourceFileName : GetBackendFileName(), ReadOnlyDatabase::InitResultToString(result));
+            ThrowErrorWithMessage(message, __FILE__, __LINE__);
+        }
+
+        // Pages must go to the shared cache before any is loaded, preloaded ones too
+        const char* pSharedFileName = pSourceFileName ? pSourceFileName : GetBackendFileName();
+        if (options.SharedCache && !s_spPagedDatabase->AttachSharedCache(pSharedFileName))
+        {
+            NV_MESSAGE("Could not attach a shared database cache for '%s'; pages are held by this process only", pSharedFileName);
+        }
+
+        // Checked pages include preloaded ones
+        if (options.Verify && !s_spPagedDatabase->EnableVerification(GetBackendFileName(), pSharedFileName))
+        {
+            NV_MESSAGE("The database '%s' is not verified", pSharedFileName);
+        }
+
+        if (options.Preload)
+        {
+            s_spPagedDatabase->Preload();
+        }
+        return s_spPagedDatabase.get();
+    }
+
+    case DatabaseBackend::File:
+    default:
+        return &GetDatabase();
+    }
+}
+
+//------------------------------------------------------------------------------
+// CreateStoreDatabase - resolves the capture's handles through its handle map
+//------------------------------------------------------------------------------
+Serialization::IReadOnlyDatabase* CreateStoreDatabase(Serialization::IReadOnlyDatabase* pDatabase)
+{
+    using namespace Serialization;
+
+    static std::unique_ptr<StoreDatabase> s_spStoreDatabase;
+    s_spStoreDatabase.reset(new StoreDatabase(*pDatabase));
+
+    const std::string mapFileName = GetBlobStoreMapFileName(DATABASE_BIN_FILE);
+    const auto result = s_spStoreDatabase->Init(mapFileName.c_str(), GetBackendFileName());
+    if (result != ReadOnlyDatabase::InitResult::Ok)
+    {
+        char message[512] = {};
+        snprintf(message, sizeof(message), "Failed to load blob store map '%s' for '%s': %s", mapFileName.c_str(), GetBackendFileName(), ReadOnlyDatabase::InitResultToString(result));
+        ThrowErrorWithMessage(message, __FILE__, __LINE__);
+    }
+    return s_spStoreDatabase.get();
+}
+
+//------------------------------------------------------------------------------
+// CreateActiveDatabase
+//------------------------------------------------------------------------------
+std::unique_ptr<Serialization::PrefetchingDatabase> s_spPrefetchingDatabase;
+
+Serialization::IReadOnlyDatabase* CreateActiveDatabase()
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+    const bool tracing = !options.TraceRecordFile.empty() || !options.TraceReplayFile.empty();
+
+    // Traces are recorded against the layout of the capture's own database file
+    NV_THROW_IF(tracing && !options.StoreFile.empty(), "--database-store cannot be combined with database traces");
+
+    IReadOnlyDatabase* pDatabase = CreateBackendDatabase();
+    if (!options.StoreFile.empty())
+    {
+        return CreateStoreDatabase(pDatabase);
+    }
+
+    if (!tracing)
+    {
+        return pDatabase;
+    }
+
+    NV_THROW_IF(!options.TraceRecordFile.empty() && !options.TraceReplayFile.empty(), "--database-trace-record and --database-trace-replay cannot be combined");
+
+    const bool record = !options.TraceRecordFile.empty();
+    const std::string& traceFile = record ? options.TraceRecordFile : options.TraceReplayFile;
+    s_spPrefetchingDatabase.reset(new PrefetchingDatabase(*pDatabase, options.PageSizeThreshold));
+
+    uint64_t databaseSize = 0;
+    if (s_spPagedDatabase)
+    {
+        databaseSize = s_spPagedDatabase->GetDatabaseSize();
+    }
+    else if (s_spMappedDatabase)
+    {
+        databaseSize = s_spMappedDatabase->GetDatabaseSize();
+    }
+    else
+    {
+        DatabaseLayout::GetFileSize(DATABASE_BIN_FILE, databaseSize);
+    }
+
+    const auto result = s_spPrefetchingDatabase->Init(DATABASE_BIN_FILE, databaseSize, record ? PrefetchingDatabase::Mode::Record : PrefetchingDatabase::Mode::Replay, traceFile.c_str(), options.PrefetchWindowSize);
+    if (result != ReadOnlyDatabase::InitResult::Ok)
+    {
+        char message[512] = {};
+        snprintf(message, sizeof(message), "Failed to initialize database trace '%s': %s", traceFile.c_str(), ReadOnlyDatabase::InitResultToString(result));
+        ThrowErrorWithMessage(message, __FILE__, __LINE__);
+    }
+
+    // The prefetch tasks run on the thread pool, which is a function-local static
+    // created after this one; stop them before it is destroyed
+    std::atexit([]() {
+        s_spPrefetchingDatabase->Finish();
+    });
+
+    return s_spPrefetchingDatabase.get();
+}
+
+} // namespace
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// GetDatabaseOptions
+//------------------------------------------------------------------------------
+DatabaseOptions& GetDatabaseOptions()
+{
+    static DatabaseOptions s_options;
+    return s_options;
+}
+
+//------------------------------------------------------------------------------
+// DatabaseBackendToString
+//------------------------------------------------------------------------------
+const char* DatabaseBackendToString(DatabaseBackend backend)
+{
+    switch (backend)
+    {
+    case DatabaseBackend::File:
+        return "file";
+    case DatabaseBackend::Mapped:
+        return "mmap";
+    case DatabaseBackend::Paged:
+        return "paged";
+    }
+    return "unknown";
+}
+
+} // namespace Serialization
+
+//------------------------------------------------------------------------------
+// GetActiveDatabase
+//------------------------------------------------------------------------------
+Serialization::IReadOnlyDatabase& GetActiveDatabase()
+{
+    static Serialization::IReadOnlyDatabase* const s_pDatabase = CreateActiveDatabase();
+    return *s_pDatabase;
+}
@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseHash.h
+//
+// Content hash of database blobs.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// HashBlob - XXH64 of a blob.  Fast enough to hash a database at disk speed; not
+// collision resistant against deliberate attack, so equal hashes are confirmed by
+// comparing bytes wherever blobs are merged.
+//------------------------------------------------------------------------------
+inline uint64_t HashBlob(const void* pData, size_t size, uint64_t seed = 0)
+{
+    const uint64_t PRIME1 = 11400714785074694791ULL;
+    const uint64_t PRIME2 = 14029467366897019727ULL;
+    const uint64_t PRIME3 = 1609587929392839161ULL;
+    const uint64_t PRIME4 = 9650029242287828579ULL;
+    const uint64_t PRIME5 = 2870177450012600261ULL;
+
+    auto rotl = [](uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    };
+    auto read64 = [](const uint8_t* p) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    };
+    auto read32 = [](const uint8_t* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    };
+    auto round = [&](uint64_t accumulator, uint64_t input) {
+        accumulator += input * PRIME2;
+        accumulator = rotl(accumulator, 31);
+        return accumulator * PRIME1;
+    };
+    auto mergeRound = [&](uint64_t accumulator, uint64_t value) {
+        accumulator ^= round(0, value);
+        return accumulator * PRIME1 + PRIME4;
+    };
+
+    const uint8_t* p = static_cast<const uint8_t*>(pData);
+    const uint8_t* const pEnd = p + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        const uint8_t* const pLimit = pEnd - 32;
+        do
+        {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= pLimit);
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + PRIME5;
+    }
+
+    hash += static_cast<uint64_t>(size);
+
+    while (p + 8 <= pEnd)
+    {
+        hash ^= round(0, read64(p));
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= pEnd)
+    {
+        hash ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        hash = rotl(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < pEnd)
+    {
+        hash ^= (*p) * PRIME5;
+        hash = rotl(hash, 11) * PRIME1;
+        ++p;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+} // namespace Serialization
@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseRelayout.h
+//
+// Rewrites a database file with its blobs in the order the replay uses them.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace Serialization {
+
+enum class DatabaseRelayoutOrder
+{
+    FirstUse, // Blobs in order of first use
+    Packed, // Blobs grouped by the phases they are read in, then by size, then in order of first use
+};
+
+struct DatabaseRelayoutStats
+{
+    uint64_t Blobs; // Blobs in the database
+    uint64_t TracedBlobs; // Blobs placed by their order in the trace
+    uint64_t Regions; // Runs of overlapping blobs moved as a unit
+    uint64_t Bytes; // Size of the rewritten database file
+    uint64_t PaddingBytes; // Bytes added to keep blobs aligned
+
+    // Packed - bytes of blobs read in every frame, only in frame resets, and only
+    // while starting up
+    uint64_t FrameBytes;
+    uint64_t ResetBytes;
+    uint64_t InitBytes;
+};
+
+//------------------------------------------------------------------------------
+// RelayoutDatabase - Copies pDatabaseFileName to pOutputFileName with its blobs
+// in order of first use in a trace written by --database-trace-record, followed
+// by blobs the trace never used in their original order, and writes the output's
+// records file.  Blobs used together then share pages, and the pages of the output
+// are in the order the replay reaches them.
+//
+// Handles are unchanged, so the capture's code reads the output as it did the
+// original.  Blobs which overlap in the original (duplicates are stored once) are
+// moved together, and every blob keeps its offset modulo 16.
+//
+// With DatabaseRelayoutOrder::Packed the traced blobs are first grouped by the
+// phases the trace saw them read in: blobs read by frames, then blobs read only by
+// frame resets, then blobs read only while starting up.  Within a group blobs are
+// grouped by size class, so the small blobs a frame reads share pages with each
+// other rather than with large blobs of the same moment that are only needed at
+// startup.  A page can still straddle the boundary between two groups.  The trace
+// must have been recorded with phases.
+//------------------------------------------------------------------------------
+bool RelayoutDatabase(const char* pDatabaseFileName, const char* pTraceFileName, const char* pOutputFileName, DatabaseRelayoutOrder order, DatabaseRelayoutStats& stats);
+
+} // namespace Serialization
@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseTelemetry.h
+//
+// Counters of database activity by the part of the replay which caused it.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DatabasePhase.h"
+#include "DllCommon.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// Database telemetry
+//
+// Counts reads, page locks and their hits, misses with their latency, and
+// evictions, by the DatabasePhase of the thread which caused them.  Frames and
+// frame resets are what the application times as CpuTimingPhase::SUBMIT and
+// CpuTimingPhase::RESET, so their rows show how much of those phases was spent
+// waiting for the database.  Reads made while prefetching on behalf of the replay
+// are counted in a row of their own rather than in the phase of the prefetching
+// thread.
+//
+// Each thread counts into its own block, which is only written by that thread, so
+// counting is a thread-local lookup and an unshared store.  Blocks are summed when
+// the counters are read, and outlive their thread.  Nothing is counted unless
+// EnableDatabaseTelemetry has been called.
+//----------------------------------------------------------------------------------
+enum class DatabaseCounter : uint8_t
+{
+    Reads, // DoRead calls
+    Locks, // Pages locked
+    Hits, // Of those, pages which were already resident
+    Unlocks,
+    Misses, // Reads from the file a thread waited for
+    MissBytes,
+    MissNanoseconds,
+    Evictions,
+    EvictedBytes,
+    EvictionNanoseconds,
+    COUNT
+};
+
+// A row for each DatabasePhase, then one for prefetching
+constexpr size_t DATABASE_TELEMETRY_PREFETCH_ROW = static_cast<size_t>(DatabasePhase::COUNT);
+constexpr size_t DATABASE_TELEMETRY_ROW_COUNT = DATABASE_TELEMETRY_PREFETCH_ROW + 1;
+
+// Miss latency buckets: under 1 us, then [2^(i-1), 2^i) us, the last open-ended
+constexpr size_t DATABASE_MISS_HISTOGRAM_BUCKETS = 24;
+
+struct DatabaseTelemetry
+{
+    uint64_t Counters[DATABASE_TELEMETRY_ROW_COUNT][static_cast<size_t>(DatabaseCounter::COUNT)];
+    uint64_t MissHistogram[DATABASE_TELEMETRY_ROW_COUNT][DATABASE_MISS_HISTOGRAM_BUCKETS];
+};
+
+NV_REPLAY_EXPORT void EnableDatabaseTelemetry(bool enable);
+NV_REPLAY_EXPORT bool IsDatabaseTelemetryEnabled();
+
+// Adds to a counter of the calling thread's row
+NV_REPLAY_EXPORT void CountDatabaseEvent(DatabaseCounter counter, uint64_t amount = 1);
+
+// Counts a read from the file the calling thread waited for
+NV_REPLAY_EXPORT void CountDatabaseMiss(uint64_t bytes, uint64_t nanoseconds);
+
+// Sums the counters of every thread
+NV_REPLAY_EXPORT void GetDatabaseTelemetry(DatabaseTelemetry& telemetry);
+
+//------------------------------------------------------------------------------
+// ReportDatabaseTelemetry - prints a line per row which has counted anything,
+// with per-frame figures for frames and frame resets, and the miss latency
+// histograms in verbose output
+//------------------------------------------------------------------------------
+NV_REPLAY_EXPORT void ReportDatabaseTelemetry();
+
+//------------------------------------------------------------------------------
+// DatabaseTelemetryPrefetchScope - counts the calling thread's activity in the
+// prefetch row for the lifetime of the scope
+//------------------------------------------------------------------------------
+class DatabaseTelemetryPrefetchScope
+{
+public:
+    NV_REPLAY_EXPORT DatabaseTelemetryPrefetchScope();
+    NV_REPLAY_EXPORT ~DatabaseTelemetryPrefetchScope();
+
+private:
+    DatabaseTelemetryPrefetchScope(const DatabaseTelemetryPrefetchScope&) = delete;
+    DatabaseTelemetryPrefetchScope& operator=(const DatabaseTelemetryPrefetchScope&) = delete;
+
+    bool m_Previous;
+};
+
+} // namespace Serialization
@@ -0,0 +1,484 @@
+//--------------------------------------------------------------------------------------
+// File: MappedReadOnlyDatabase.cpp
+//
+// Memory-mapped implementation of IReadOnlyDatabase.
+//--------------------------------------------------------------------------------------
+
+#include "MappedReadOnlyDatabase.h"
+
+#include "CommonReplay.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Serialization {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// GetOsPageSize
+//------------------------------------------------------------------------------
+uint64_t GetOsPageSize()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO systemInfo = {};
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+#else
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    return pageSize > 0 ? static_cast<uint64_t>(pageSize) : 4096;
+#endif
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// MappedReadOnlyDatabase
+//------------------------------------------------------------------------------
+MappedReadOnlyDatabase::MappedReadOnlyDatabase(uint64_t PageSizeThreshold)
+    : m_Layout()
+    , m_Pages()
+    , m_pMapping(nullptr)
+    , m_MappingSize(0)
+    , m_pBase(nullptr)
+    , m_FileSize(0)
+#if defined(_WIN32)
+    , m_hFile(INVALID_HANDLE_VALUE)
+    , m_hMapping(nullptr)
+#else
+    , m_fd(-1)
+#endif
+    , m_PageSizeThreshold(PageSizeThreshold)
+    , m_Prefaulted(false)
+    , m_StaticBlobs(0)
+    , m_StaticBlobBytes(0)
+    , m_StaticPages(0)
+    , m_StaticPageBytes(0)
+    , m_lastInitResult(InitResult::NeverInitialized)
+{
+}
+
+//------------------------------------------------------------------------------
+// ~MappedReadOnlyDatabase
+//------------------------------------------------------------------------------
+MappedReadOnlyDatabase::~MappedReadOnlyDatabase()
+{
+    if (m_StaticBlobs > 0)
+    {
+        const double megabyte = 1024.0 * 1024.0;
+        NV_MESSAGE("Database mapping: %llu static entries (%.1f MB) read in place from %llu locked pages (%.1f MB)",
+            static_cast<unsigned long long>(m_StaticBlobs.load()),
+            m_StaticBlobBytes.load() / megabyte,
+            static_cast<unsigned long long>(m_StaticPages.load()),
+            m_StaticPageBytes.load() / megabyte);
+    }
+
+    UnmapFile();
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+MappedReadOnlyDatabase::InitResult MappedReadOnlyDatabase::Init(const char* pFileName, bool prefault)
+{
+    if (!pFileName)
+    {
+        m_lastInitResult = InitResult::BadArgument;
+        return m_lastInitResult;
+    }
+
+    uint64_t fileSize = 0;
+    if (!DatabaseLayout::GetFileSize(pFileName, fileSize))
+    {
+        m_lastInitResult = InitResult::FailedToOpenDatabase;
+        return m_lastInitResult;
+    }
+
+    return Init(pFileName, prefault, pFileName, 0, fileSize);
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+MappedReadOnlyDatabase::InitResult MappedReadOnlyDatabase::Init(const char* pFileName, bool prefault, const char* pMappedFileName, uint64_t offset, uint64_t size)
+{
+    if (!pFileName || !pMappedFileName)
+    {
+        m_lastInitResult = InitResult::BadArgument;
+        return m_lastInitResult;
+    }
+
+    UnmapFile();
+    m_Prefaulted = prefault;
+
+    if (!MapFile(pMappedFileName, offset, size))
+    {
+        m_lastInitResult = InitResult::FailedToOpenDatabase;
+        return m_lastInitResult;
+    }
+
+    m_lastInitResult = m_Layout.Load(pFileName, m_FileSize, m_PageSizeThreshold);
+    if (m_lastInitResult != InitResult::Ok)
+    {
+        UnmapFile();
+        return m_lastInitResult;
+    }
+
+    m_Pages.reset(new MappedPage[m_Layout.GetPageCount()]);
+    for (size_t i = 0; i < m_Layout.GetPageCount(); ++i)
+    {
+        m_Pages[i].pRecord = &m_Layout.GetPage(i);
+    }
+
+    if (m_Prefaulted)
+    {
+        Prefault();
+    }
+
+    return m_lastInitResult;
+}
+
+//------------------------------------------------------------------------------
+// MapFile - maps the whole file; the database is size bytes at offset in it
+//------------------------------------------------------------------------------
+bool MappedReadOnlyDatabase::MapFile(const char* pFileName, uint64_t offset, uint64_t size)
+{
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_hFile = hFile;
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart <= 0)
+    {
+        UnmapFile();
+        return false;
+    }
+    m_MappingSize = static_cast<uint64_t>(fileSize.QuadPart);
+
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!hMapping)
+    {
+        UnmapFile();
+        return false;
+    }
+    m_hMapping = hMapping;
+
+    m_pMapping = static_cast<uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_pMapping)
+    {
+        UnmapFile();
+        return false;
+    }
+#else
+    m_fd = open(pFileName, O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat = {};
+    if (fstat(m_fd, &fileStat) != 0 || fileStat.st_size <= 0)
+    {
+        UnmapFile();
+        return false;
+    }
+    m_MappingSize = static_cast<uint64_t>(fileStat.st_size);
+
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    if (m_Prefaulted)
+    {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* pMapping = mmap(nullptr, m_MappingSize, PROT_READ, flags, m_fd, 0);
+    if (pMapping == MAP_FAILED)
+    {
+        UnmapFile();
+        return false;
+    }
+    m_pMapping = static_cast<uint8_t*>(pMapping);
+#endif
+
+    if (size == 0 || offset > m_MappingSize || size > m_MappingSize - offset)
+    {
+        UnmapFile();
+        return false;
+    }
+
+    m_pBase = m_pMapping + offset;
+    m_FileSize = size;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// UnmapFile
+//------------------------------------------------------------------------------
+void MappedReadOnlyDatabase::UnmapFile()
+{
+#if defined(_WIN32)
+    if (m_pMapping)
+    {
+        UnmapViewOfFile(m_pMapping);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_pMapping)
+    {
+        munmap(m_pMapping, m_MappingSize);
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+
+    m_pMapping = nullptr;
+    m_MappingSize = 0;
+    m_pBase = nullptr;
+    m_FileSize = 0;
+    m_Pages.reset();
+    m_StaticBlobs = 0;
+    m_StaticBlobBytes = 0;
+    m_StaticPages = 0;
+    m_StaticPageBytes = 0;
+}
+
+//------------------------------------------------------------------------------
+// Prefault - Touch every page of the mapping so that the timed frames never
+// take a page fault on database memory
+//------------------------------------------------------------------------------
+void MappedReadOnlyDatabase::Prefault()
+{
+#if defined(MAP_POPULATE)
+    // Already populated by mmap
+    return;
+#else
+#if defined(_WIN32) && defined(_WIN32_WINNT_WIN8) && (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    WIN32_MEMORY_RANGE_ENTRY range = { m_pBase, static_cast<SIZE_T>(m_FileSize) };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+
+    const uint64_t osPageSize = GetOsPageSize();
+    volatile uint8_t sink = 0;
+    for (uint64_t offset = 0; offset < m_FileSize; offset += osPageSize)
+    {
+        sink ^= m_pBase[offset];
+    }
+    (void)sink;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// AdviseWillNeed
+//------------------------------------------------------------------------------
+void MappedReadOnlyDatabase::AdviseWillNeed(const DatabasePageRecord& page)
+{
+    if (page.PageSize == 0)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT_WIN8) && (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    WIN32_MEMORY_RANGE_ENTRY range = { m_pBase + page.PageOffset, static_cast<SIZE_T>(page.PageSize) };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+    // madvise requires a page-aligned start address; the database need not start
+    // on a page boundary of the mapping
+    static const uint64_t s_osPageSize = GetOsPageSize();
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(m_pBase + page.PageOffset) & ~static_cast<uintptr_t>(s_osPageSize - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(m_pBase + page.PageOffset + page.PageSize);
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// AdviseCold
+//------------------------------------------------------------------------------
+void MappedReadOnlyDatabase::AdviseCold(const DatabasePageRecord& page)
+{
+#if !defined(_WIN32) && defined(MADV_COLD)
+    // Only hint the OS pages that lie entirely within this database page, so
+    // neighbouring pages which may still be in use are not deactivated
+    static const uintptr_t s_osPageMask = static_cast<uintptr_t>(GetOsPageSize() - 1);
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(m_pBase + page.PageOffset) + s_osPageMask) & ~s_osPageMask;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(m_pBase + page.PageOffset + page.PageSize) & ~s_osPageMask;
+    if (end > begin)
+    {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_COLD);
+    }
+#else
+    (void)page;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// GetSize
+//------------------------------------------------------------------------------
+uint64_t MappedReadOnlyDatabase::GetSize(const DATABASE_HANDLE& handle)
+{
+    const DatabaseBlobRecord* pBlob = m_Layout.GetBlob(handle);
+    return pBlob ? pBlob->Size : 0;
+}
+
+//------------------------------------------------------------------------------
+// Lock
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle MappedReadOnlyDatabase::Lock(uint64_t pageOffset)
+{
+    const size_t pageIndex = m_Layout.FindPageStart(pageOffset);
+    if (pageIndex >= m_Layout.GetPageCount())
+    {
+        return nullptr;
+    }
+
+    MappedPage& page = m_Pages[pageIndex];
+    if (page.LockCount.fetch_add(1) == 0 && !m_Prefaulted)
+    {
+        // Small pages are hinted once, large single-blob pages on every use since
+        // they are released again when unlocked
+        const bool isLargePage = page.pRecord->PageSize >= m_PageSizeThreshold;
+        if (isLargePage || !page.Hinted.exchange(true))
+        {
+            AdviseWillNeed(*page.pRecord);
+        }
+    }
+
+    return &page;
+}
+
+//------------------------------------------------------------------------------
+// Unlock
+//------------------------------------------------------------------------------
+void MappedReadOnlyDatabase::Unlock(DataScope::LockedPageHandle pPageHandle)
+{
+    MappedPage* pPage = static_cast<MappedPage*>(pPageHandle);
+    if (!pPage)
+    {
+        return;
+    }
+
+    NV_DATABASE_WARN(pPage->LockCount > 0, "Unlocking a page which is not locked");
+    if (pPage->LockCount.fetch_sub(1) == 1 && !m_Prefaulted && pPage->pRecord->PageSize >= m_PageSizeThreshold)
+    {
+        AdviseCold(*pPage->pRecord);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Prefetch
+//------------------------------------------------------------------------------
+void MappedReadOnlyDatabase::Prefetch(uint64_t pageOffset)
+{
+    const size_t pageIndex = m_Layout.FindPageStart(pageOffset);
+    if (pageIndex >= m_Layout.GetPageCount() || m_Prefaulted)
+    {
+        return;
+    }
+
+    MappedPage& page = m_Pages[pageIndex];
+    if (page.pRecord->PageSize == 0)
+    {
+        return;
+    }
+
+    page.Hinted = true;
+    AdviseWillNeed(*page.pRecord);
+
+    // The hint is asynchronous; touch every OS page so that the page-ins happen
+    // here rather than on the thread which first reads the blobs
+    static const uint64_t s_osPageSize = GetOsPageSize();
+    const uint64_t end = page.pRecord->PageOffset + page.pRecord->PageSize;
+    volatile uint8_t sink = 0;
+    for (uint64_t offset = page.pRecord->PageOffset; offset < end; offset += s_osPageSize)
+    {
+        sink ^= m_pBase[offset];
+    }
+    sink ^= m_pBase[end - 1];
+    (void)sink;
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* MappedReadOnlyDatabase::DoRead(const DATABASE_HANDLE& handle)
+{
+    const DatabaseBlobRecord* pBlob = m_Layout.GetBlob(handle);
+    if (!pBlob || !m_pBase)
+    {
+        return nullptr;
+    }
+
+    return m_pBase + pBlob->Offset;
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* MappedReadOnlyDatabase::DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker)
+{
+    const DatabaseBlobRecord* pBlob = m_Layout.GetBlob(handle);
+    if (!pBlob || !m_pBase)
+    {
+        return nullptr;
+    }
+
+    // Empty blobs don't belong to any page
+    const uint32_t pageIndex = m_Layout.GetBlobLocation(handle)->PageIndex;
+    if (pageIndex != DatabaseBlobLocation::NO_PAGE)
+    {
+        scopeTracker.SetUsesPage(m_Layout.GetPage(pageIndex).PageOffset, *this);
+    }
+
+    return m_pBase + pBlob->Offset;
+}
+
+//------------------------------------------------------------------------------
+// DoReadStatic
+//------------------------------------------------------------------------------
+void* MappedReadOnlyDatabase::DoReadStatic(const DATABASE_HANDLE& handle)
+{
+    const DatabaseBlobRecord* pBlob = m_Layout.GetBlob(handle);
+    if (!pBlob || !m_pBase)
+    {
+        return nullptr;
+    }
+
+    // The lock count is never given back; the mapping outlives every static entry
+    const uint32_t pageIndex = m_Layout.GetBlobLocation(handle)->PageIndex;
+    if (pageIndex != DatabaseBlobLocation::NO_PAGE && !m_Pages[pageIndex].StaticPinned.exchange(true))
+    {
+        const DatabasePageRecord& page = *m_Pages[pageIndex].pRecord;
+        Lock(page.PageOffset);
+        m_StaticPages.fetch_add(1, std::memory_order_relaxed);
+        m_StaticPageBytes.fetch_add(page.PageSize, std::memory_order_relaxed);
+    }
+
+    m_StaticBlobs.fetch_add(1, std::memory_order_relaxed);
+    m_StaticBlobBytes.fetch_add(pBlob->Size, std::memory_order_relaxed);
+    return m_pBase + pBlob->Offset;
+}
+
+} // namespace Serialization
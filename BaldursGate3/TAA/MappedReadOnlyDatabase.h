@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+// File: MappedReadOnlyDatabase.h
+//
+// Memory-mapped implementation of IReadOnlyDatabase.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DatabaseLayout.h"
+#include "DllCommon.h"
+#include "ReadOnlyDatabase.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// MappedReadOnlyDatabase
+//
+// Maps the whole database file into the address space and returns pointers
+// directly into the mapping, so blobs are never copied into heap pages.  Locking
+// a page only hints the OS that it is about to be read; the kernel page cache
+// owns residency.  Static entries point into the mapping as well, and their
+// pages stay locked so that large ones are never hinted cold.
+//----------------------------------------------------------------------------------
+class MappedReadOnlyDatabase : public IReadOnlyDatabase
+{
+public:
+    using InitResult = ReadOnlyDatabase::InitResult;
+
+    //------------------------------------------------------------------------------
+    // Constructors
+    //------------------------------------------------------------------------------
+    MappedReadOnlyDatabase(uint64_t PageSizeThreshold);
+
+    //------------------------------------------------------------------------------
+    // Destructor - unmaps the database file
+    //------------------------------------------------------------------------------
+    virtual ~MappedReadOnlyDatabase();
+
+    //------------------------------------------------------------------------------
+    // Init - Maps the specified database file.  If prefault is set, every page of
+    // the mapping is faulted in up front so that no page-ins occur during timed
+    // frames.
+    //------------------------------------------------------------------------------
+    InitResult Init(const char* pFileName, bool prefault);
+
+    //------------------------------------------------------------------------------
+    // Init - As above, mapping the database file in place from size bytes at
+    // offset in pMappedFileName, such as a stored entry of a zip archive.  The
+    // database file's records file is still needed.
+    //------------------------------------------------------------------------------
+    InitResult Init(const char* pFileName, bool prefault, const char* pMappedFileName, uint64_t offset, uint64_t size);
+    InitResult GetLastInitResult() const
+    {
+        return m_lastInitResult;
+    }
+
+    // Size of the mapped database
+    uint64_t GetDatabaseSize() const
+    {
+        return m_FileSize;
+    }
+
+    //------------------------------------------------------------------------------
+    // GetSize - Get the size of a blob if it exists, or zero
+    //------------------------------------------------------------------------------
+    NV_REPLAY_EXPORT virtual uint64_t GetSize(const DATABASE_HANDLE& handle) override final;
+
+    // Helpers for Read - Lock will return null if a page cannot be found
+    NV_REPLAY_EXPORT virtual DataScope::LockedPageHandle Lock(uint64_t pageOffset) override final;
+    NV_REPLAY_EXPORT virtual void Unlock(DataScope::LockedPageHandle pPageHandle) override final;
+
+    // Prefetch - Hints the page and faults it in on the calling thread
+    NV_REPLAY_EXPORT virtual void Prefetch(uint64_t pageOffset) override final;
+
+    // DoReadStatic - Locks the blob's page until the database is unmapped
+    NV_REPLAY_EXPORT virtual void* DoReadStatic(const DATABASE_HANDLE& handle) override final;
+
+protected:
+    // This class is non-copyable
+    MappedReadOnlyDatabase(const MappedReadOnlyDatabase&) = delete;
+    MappedReadOnlyDatabase& operator=(const MappedReadOnlyDatabase&) = delete;
+
+    // Helpers for Read
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle) override final;
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker) override final;
+
+private:
+    struct MappedPage
+    {
+        MappedPage()
+            : pRecord()
+            , LockCount()
+            , Hinted()
+            , StaticPinned()
+        {
+        }
+
+        const DatabasePageRecord* pRecord;
+        std::atomic<int32_t> LockCount;
+        std::atomic<bool> Hinted;
+        std::atomic<bool> StaticPinned; // Holds a lock count for DoReadStatic
+    };
+
+    bool MapFile(const char* pFileName, uint64_t offset, uint64_t size);
+    void UnmapFile();
+    void Prefault();
+
+    // OS hints for a page which is about to be used, or which is no longer in use
+    void AdviseWillNeed(const DatabasePageRecord& page);
+    void AdviseCold(const DatabasePageRecord& page);
+
+    DatabaseLayout m_Layout;
+    std::unique_ptr<MappedPage[]> m_Pages;
+
+    // The mapping, and the database within it
+    uint8_t* m_pMapping;
+    uint64_t m_MappingSize;
+    uint8_t* m_pBase;
+    uint64_t m_FileSize;
+#if defined(_WIN32)
+    void* m_hFile;
+    void* m_hMapping;
+#else
+    int m_fd;
+#endif
+
+    uint64_t m_PageSizeThreshold;
+
+    // Pages stay mapped and hot for the whole run once they have been prefaulted
+    bool m_Prefaulted;
+
+    // Static entries, and the pages locked for them
+    std::atomic<uint64_t> m_StaticBlobs;
+    std::atomic<uint64_t> m_StaticBlobBytes;
+    std::atomic<uint64_t> m_StaticPages;
+    std::atomic<uint64_t> m_StaticPageBytes;
+
+    InitResult m_lastInitResult;
+};
+
+} // namespace Serialization
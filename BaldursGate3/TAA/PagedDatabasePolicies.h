@@ -0,0 +1,451 @@
+//--------------------------------------------------------------------------------------
+// File: PagedDatabasePolicies.h
+//
+// Optional policies of the paged database cache.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DataScope.h"
+#include "DatabaseChecksums.h"
+#include "DatabaseLayout.h"
+#include "DatabasePhase.h"
+#include "DatabaseTelemetry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// PagedPage
+//
+// A page of PagedReadOnlyDatabase
+//----------------------------------------------------------------------------------
+struct PagedPage
+{
+    PagedPage()
+        : pRecord()
+        , pMemory()
+        , LockCount()
+        , LastAccessCounter()
+        , Referenced()
+        , Phases()
+        , InFramePool()
+        , StaticPinned()
+    {
+    }
+
+    // Bytes of heap memory held by a resident page
+    static uint64_t GetCapacity(const DatabasePageRecord& record)
+    {
+        return record.PageSize > 0 ? record.PageSize : 1;
+    }
+
+    const DatabasePageRecord* pRecord;
+    std::atomic<uint8_t*> pMemory; // Null when not resident
+    std::atomic<int32_t> LockCount;
+    std::atomic<uint64_t> LastAccessCounter; // LeastRecentlyUsed
+    std::atomic<bool> Referenced; // Clock
+
+    // DatabasePhaseBit of each phase the page has been locked in; only tracked
+    // for the frame pool, the init-page release and the working-set pin
+    std::atomic<uint8_t> Phases;
+
+    // Pool the resident page is counted against.  Written when the page is
+    // published, or with the cache's eviction mutex held while it is locked.
+    std::atomic<bool> InFramePool;
+
+    // Set once the page holds a lock count for PagedStaticPin
+    std::atomic<bool> StaticPinned;
+};
+
+//----------------------------------------------------------------------------------
+// PagedFramePool
+//
+// A budget of its own for pages of small blobs which frames or frame resets (see
+// DatabasePhase.h) have locked.  Such pages are only evicted to keep the pool
+// within its budget, so loads during resource init can never push them out; the
+// cache's other limits apply to the remaining pages.
+//----------------------------------------------------------------------------------
+class PagedFramePool
+{
+public:
+    PagedFramePool(uint64_t maxResidentBytes, uint64_t pageSizeThreshold);
+
+    bool IsEnabled() const
+    {
+        return m_MaxResidentBytes > 0;
+    }
+
+    // Whether a page is small enough for the pool, which it joins once a frame uses it
+    bool Accepts(const PagedPage& page) const
+    {
+        return IsEnabled() && page.pRecord->PageSize <= m_PageSizeThreshold;
+    }
+
+    // Residency accounting - called with the cache's eviction mutex held
+    bool NeedsEviction(uint64_t bytes) const
+    {
+        return IsEnabled() && m_ResidentBytes + bytes > m_MaxResidentBytes;
+    }
+    void Reserve(uint64_t pages, uint64_t bytes);
+    void Release(uint64_t pages, uint64_t bytes);
+    void OnPromotion()
+    {
+        m_Promotions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t GetResidentPages() const
+    {
+        return m_ResidentPages;
+    }
+    uint64_t GetResidentBytes() const
+    {
+        return m_ResidentBytes;
+    }
+
+    void Report() const;
+    void Reset();
+
+private:
+    uint64_t m_MaxResidentBytes;
+    uint64_t m_PageSizeThreshold;
+    std::atomic<uint64_t> m_ResidentPages;
+    std::atomic<uint64_t> m_ResidentBytes;
+    std::atomic<uint64_t> m_ResidentBytesHighWater; // Only written with the eviction mutex held
+    std::atomic<uint64_t> m_Promotions; // Resident pages moved to the pool
+};
+
+//----------------------------------------------------------------------------------
+// PagedInitRelease
+//
+// Gives back the memory of pages only used by resource init and frame setup once
+// the first frame locks a page.  A frame reset which needs one again reads it back.
+//----------------------------------------------------------------------------------
+class PagedInitRelease
+{
+public:
+    explicit PagedInitRelease(bool enabled);
+
+    bool IsEnabled() const
+    {
+        return m_Enabled;
+    }
+
+    // True for the one lock which ends setup, the first by a frame
+    bool TakeFirstFrameLock(DatabasePhase phase)
+    {
+        return m_Enabled && phase == DatabasePhase::Frame && !m_SetupFinished.load(std::memory_order_relaxed) && !m_SetupFinished.exchange(true);
+    }
+
+    // Whether a page has been used, and only by setup
+    static bool IsInitPage(const PagedPage& page);
+
+    // Around the cache's eviction of the init pages.  EndRelease returns freed heap
+    // memory to the OS where the C runtime allows and reports the release.
+    void BeginRelease();
+    void EndRelease(uint64_t pages, uint64_t bytes);
+
+    void Reset();
+
+private:
+    bool m_Enabled;
+    std::atomic<bool> m_SetupFinished;
+    uint64_t m_ResidentSetBefore;
+};
+
+//----------------------------------------------------------------------------------
+// PagedWorkingSetPin
+//
+// The pages which frames and frame resets lock during the warm-up frames are the
+// frame working set.  When the next frame locks its first page they are locked
+// until the database is freed, and optionally mlock'ed, so timed frames read no
+// page from the file.  Any read a frame or reset makes after that is reported as
+// a measurement-contamination event; pages first used then are pinned as well so
+// that they are only reported once.
+//----------------------------------------------------------------------------------
+class PagedWorkingSetPin
+{
+public:
+    PagedWorkingSetPin(uint64_t warmupFrames, bool withMlock);
+
+    bool IsEnabled() const
+    {
+        return m_WarmupFrames > 0;
+    }
+
+    // True for the one lock by a frame or reset which starts pinning, once the
+    // warm-up frames have run
+    bool TakePinStart(DatabasePhase phase)
+    {
+        return IsEnabled() && (DatabasePhaseBit(phase) & DATABASE_PHASE_MASK_PER_FRAME) && !m_Started.load(std::memory_order_relaxed)
+            && GetDatabaseFrameCount() > m_WarmupFrames && !m_Started.exchange(true);
+    }
+
+    bool IsPinned() const
+    {
+        return m_Pinned.load(std::memory_order_relaxed);
+    }
+
+    // Keeps a page resident until Reset by taking over a lock count the caller
+    // holds, and mlocks what has been read of it if requested.  Returns false if
+    // the mlock failed.
+    bool Pin(PagedPage& page, uint32_t pageIndex);
+
+    // Called once the working set has been pinned
+    void OnPinned(uint64_t pages, uint64_t mlockFailedPages, uint64_t pagesReadBack, double seconds);
+
+    // Whether a read from the file by the calling thread is made by a timed frame
+    bool IsTimedPageIn() const
+    {
+        return IsPinned() && (DatabasePhaseBit(GetDatabasePhase()) & DATABASE_PHASE_MASK_PER_FRAME);
+    }
+    void OnTimedPageIn(const PagedPage& page);
+
+    void Report() const;
+
+    // Releases the pinned pages of pPages
+    void Reset(PagedPage* pPages);
+
+private:
+    uint64_t m_WarmupFrames;
+    bool m_WithMlock;
+    std::atomic<bool> m_Started; // Set by the first lock after the warm-up frames
+    std::atomic<bool> m_Pinned; // Set once the working set has been pinned
+    std::atomic<bool> m_MlockFailed;
+    mutable std::mutex m_Mutex; // Guards m_Pages
+    std::vector<uint32_t> m_Pages;
+    std::atomic<uint64_t> m_PinnedBytes;
+    std::atomic<uint64_t> m_TimedPageIns;
+    std::atomic<uint64_t> m_TimedPageInBytes;
+};
+
+//----------------------------------------------------------------------------------
+// PagedEpochUnlock
+//
+// The first lock of a page by a thread running a frame or frame reset holds the
+// page for the rest of the thread's epoch, and unlocking it does nothing.  Scopes
+// which use the page again in that epoch find it in the thread's epoch buffer and
+// touch nothing shared.
+//
+// A thread's epoch is the frame count when it last moved to a new one.  Each
+// thread unlocks only its own pages, on its first lock after a frame starts with
+// none of its data scopes open, so a thread still finishing the previous frame
+// keeps what its open scopes use.  Pages of a thread which has not moved on yet
+// stay locked, so eviction waits for the oldest live epoch.
+//----------------------------------------------------------------------------------
+class PagedEpochUnlock
+{
+public:
+    explicit PagedEpochUnlock(bool enabled);
+
+    // Whether locks by the calling thread are held by the epoch
+    bool Applies() const
+    {
+        return m_Enabled && (DatabasePhaseBit(GetDatabasePhase()) & DATABASE_PHASE_MASK_PER_FRAME);
+    }
+
+    // Called once the cache's pages exist
+    void Init(PagedPage* pPages, size_t pageCount);
+
+    // Whether the calling thread already holds the page in its epoch.  With no
+    // handle of the thread open, the first call after a frame starts moves the
+    // thread to the new epoch and unlocks what it held in the old one.
+    bool IsHeld(size_t pageIndex);
+
+    // Hands a lock count the caller took on the page to the calling thread's epoch
+    void Hold(size_t pageIndex);
+
+    // Called with every handle returned by TagHandle, and when it is unlocked
+    void OnHandleLocked();
+    void OnHandleUnlocked();
+
+    // Handles returned for locks held by an epoch, which Unlock ignores
+    static DataScope::LockedPageHandle TagHandle(PagedPage& page)
+    {
+        return reinterpret_cast<DataScope::LockedPageHandle>(reinterpret_cast<uintptr_t>(&page) | HANDLE_TAG);
+    }
+    static bool IsTagged(DataScope::LockedPageHandle pPageHandle)
+    {
+        return (reinterpret_cast<uintptr_t>(pPageHandle) & HANDLE_TAG) != 0;
+    }
+
+    void Report() const;
+
+    // Unlocks every held page
+    void Reset();
+
+private:
+    static constexpr uintptr_t HANDLE_TAG = 1;
+
+    // Pages one thread has locked in its epoch.  Only the owning thread adds and
+    // releases pages; Reset releases them once no thread uses the database.
+    struct EpochBuffer
+    {
+        std::mutex Mutex; // Held to add pages and to release them
+        uint64_t Epoch;
+        std::unique_ptr<uint64_t[]> Held; // Bit per page
+        std::vector<uint32_t> Pages;
+        uint64_t OpenHandles; // Tagged handles not unlocked yet
+
+        // Written only by the owning thread
+        std::atomic<uint64_t> Locks;
+        std::atomic<uint64_t> Hits;
+    };
+
+    // The calling thread's epoch buffer, created on its first lock
+    EpochBuffer& GetBuffer();
+
+    // Unlocks the pages of a buffer and moves it to epoch; called with the buffer's
+    // mutex held
+    void ReleaseBuffer(EpochBuffer& buffer, uint64_t epoch);
+
+    bool m_Enabled;
+    PagedPage* m_pPages;
+    size_t m_PageCount;
+    std::atomic<uint64_t> m_InstanceId; // Tells the thread-local epoch buffers of databases apart
+    mutable std::mutex m_Mutex; // Guards m_Buffers
+    std::vector<std::unique_ptr<EpochBuffer>> m_Buffers;
+    std::atomic<uint64_t> m_Releases; // Pages unlocked when threads moved to a new epoch
+    std::atomic<uint64_t> m_Epochs; // Moves of threads to a new epoch
+};
+
+//----------------------------------------------------------------------------------
+// PagedStaticPin
+//
+// Pages of the static entries which DoReadStatic returns in place, so that
+// NV_GET_RESOURCE_STATIC needs no copy of them.  They stay locked until the
+// database is freed, and still count against the residency limits.
+//----------------------------------------------------------------------------------
+class PagedStaticPin
+{
+public:
+    PagedStaticPin();
+
+    // Records a static entry in a page the caller has locked.  The first entry of
+    // a page keeps the caller's lock count until Reset; for the others this
+    // returns false and the caller unlocks.
+    bool Pin(PagedPage& page, uint32_t pageIndex, uint64_t blobSize);
+
+    void Report() const;
+
+    // Releases the pinned pages of pPages
+    void Reset(PagedPage* pPages);
+
+private:
+    mutable std::mutex m_Mutex; // Guards m_Pages
+    std::vector<uint32_t> m_Pages;
+    std::atomic<uint64_t> m_PinnedBytes;
+    std::atomic<uint64_t> m_Blobs;
+    std::atomic<uint64_t> m_BlobBytes;
+};
+
+//----------------------------------------------------------------------------------
+// PagedVerification
+//
+// Checks each block of a blob against the reference checksums in the database's
+// sidecar (see DatabaseChecksums.h) the first time a read covers it.  The reading
+// thread only queues the check of a page it has loaded; the page is hashed on the
+// thread pool, and stays locked until then.  Once every block has passed, the
+// sidecar records it and later launches skip the checks.
+//----------------------------------------------------------------------------------
+class PagedVerification
+{
+public:
+    PagedVerification();
+
+    // As PagedReadOnlyDatabase::EnableVerification
+    bool Enable(const char* pFileName, const char* pSourceFileName, const DatabaseLayout& layout, uint64_t databaseSize);
+
+    bool IsEnabled() const
+    {
+        return m_spChecksums != nullptr;
+    }
+
+    // Counts time spent in reads which are checked
+    void OnRead(uint64_t nanoseconds)
+    {
+        m_ReadNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    //------------------------------------------------------------------------------
+    // Check - Checks a page which was just loaded, at pData.  The caller takes a
+    // lock count on the page while it cannot be evicted, which the check releases
+    // once it is done.  A page which fails is still used; the mismatch is
+    // reported.
+    //------------------------------------------------------------------------------
+    void Check(PagedPage& page, const uint8_t* pData);
+
+    // Waits for every queued check
+    void Drain();
+
+    // Reports the checks, and records a complete verification in the sidecar
+    void Report();
+
+    void Reset();
+
+private:
+    void RunCheck(PagedPage& page, const uint8_t* pData);
+
+    std::unique_ptr<DatabaseChecksums> m_spChecksums;
+    uint64_t m_Identity[4]; // Of the file being checked
+    std::atomic<uint64_t> m_ReadNanoseconds;
+    std::atomic<uint64_t> m_QueueNanoseconds; // Spent by reading threads queueing checks
+
+    std::mutex m_PendingMutex; // Guards m_PendingChecks
+    std::condition_variable m_PendingCondition;
+    size_t m_PendingChecks;
+};
+
+//----------------------------------------------------------------------------------
+// PagedCacheTelemetry
+//
+// Counts the cache's page locks and their hits, misses and evictions into the
+// database telemetry (see DatabaseTelemetry.h) by the phase of the thread which
+// caused them, prefetches apart.
+//----------------------------------------------------------------------------------
+class PagedCacheTelemetry
+{
+public:
+    static bool IsEnabled()
+    {
+        return IsDatabaseTelemetryEnabled();
+    }
+
+    static void OnLock(bool hit)
+    {
+        if (IsEnabled())
+        {
+            CountDatabaseEvent(DatabaseCounter::Locks);
+            if (hit)
+            {
+                CountDatabaseEvent(DatabaseCounter::Hits);
+            }
+        }
+    }
+
+    static void OnEviction(uint64_t bytes)
+    {
+        if (IsEnabled())
+        {
+            CountDatabaseEvent(DatabaseCounter::Evictions);
+            CountDatabaseEvent(DatabaseCounter::EvictedBytes, bytes);
+        }
+    }
+
+    static void Report()
+    {
+        if (IsEnabled())
+        {
+            ReportDatabaseTelemetry();
+        }
+    }
+};
+
+} // namespace Serialization
@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+// File: PrefetchingDatabase.h
+//
+// Records the order in which database pages are first used, and replays that
+// order to stream pages in ahead of use.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DatabaseLayout.h"
+#include "DatabaseTrace.h"
+#include "DllCommon.h"
+#include "ReadOnlyDatabase.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// PrefetchingDatabase
+//
+// Wraps another IReadOnlyDatabase and observes every blob read.
+//
+// In Record mode the first use of each page, and of each blob, is appended to a
+// trace, which is written out by Finish along with the phases each blob was read
+// in.  The blob order and phases are what RelayoutDatabase rewrites the database
+// file by.  In Replay mode a trace from a previous run is loaded and
+// background tasks on the thread pool call PrefetchPages on the wrapped database
+// with batches of pages in trace order, staying at most windowSize bytes ahead of
+// the replay.
+//----------------------------------------------------------------------------------
+class PrefetchingDatabase : public IReadOnlyDatabase
+{
+public:
+    using InitResult = ReadOnlyDatabase::InitResult;
+
+    enum class Mode
+    {
+        Record,
+        Replay,
+    };
+
+    //------------------------------------------------------------------------------
+    // Constructors
+    //------------------------------------------------------------------------------
+    PrefetchingDatabase(IReadOnlyDatabase& database, uint64_t PageSizeThreshold);
+
+    //------------------------------------------------------------------------------
+    // Destructor - calls Finish
+    //------------------------------------------------------------------------------
+    virtual ~PrefetchingDatabase();
+
+    //------------------------------------------------------------------------------
+    // Init - Loads the page layout of the database file, whose size is given since
+    // it may be read from a compressed container.  In Replay mode the trace file is
+    // loaded and prefetching starts immediately.
+    //------------------------------------------------------------------------------
+    InitResult Init(const char* pFileName, uint64_t fileSize, Mode mode, const char* pTraceFileName, uint64_t windowSize);
+
+    //------------------------------------------------------------------------------
+    // Finish - Stops any prefetch tasks and waits for them, then writes the trace
+    // (Record mode) or reports prefetch statistics (Replay mode).  Safe to call more
+    // than once; must be called before the thread pool is destroyed.
+    //------------------------------------------------------------------------------
+    void Finish();
+
+    //------------------------------------------------------------------------------
+    // IReadOnlyDatabase - forwarded to the wrapped database
+    //------------------------------------------------------------------------------
+    NV_REPLAY_EXPORT virtual uint64_t GetSize(const DATABASE_HANDLE& handle) override final;
+    NV_REPLAY_EXPORT virtual DataScope::LockedPageHandle Lock(uint64_t pageOffset) override final;
+    NV_REPLAY_EXPORT virtual void Unlock(DataScope::LockedPageHandle pPageHandle) override final;
+    NV_REPLAY_EXPORT virtual void Prefetch(uint64_t pageOffset) override final;
+    NV_REPLAY_EXPORT virtual void PrefetchPages(const uint64_t* pPageOffsets, size_t count) override final;
+    NV_REPLAY_EXPORT virtual void* DoReadStatic(const DATABASE_HANDLE& handle) override final;
+
+protected:
+    // This class is non-copyable
+    PrefetchingDatabase(const PrefetchingDatabase&) = delete;
+    PrefetchingDatabase& operator=(const PrefetchingDatabase&) = delete;
+
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle) override final;
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker) override final;
+
+private:
+    static constexpr size_t NOT_IN_TRACE = SIZE_MAX;
+
+    // Trace pages handed to PrefetchPages at once by each prefetch task
+    static constexpr size_t PREFETCH_BATCH_SIZE = 16;
+
+    enum PrefetchState : uint8_t
+    {
+        NotPrefetched,
+        Prefetching,
+        Prefetched,
+    };
+
+    // Called for every blob read, once the blob's page is known to exist
+    void OnRead(const DATABASE_HANDLE& handle);
+    void OnFirstUse(size_t pageIndex);
+
+    // Replay
+    void StartPrefetching();
+    void PrefetchLoop();
+
+    IReadOnlyDatabase& m_Database;
+    DatabaseLayout m_Layout;
+    uint64_t m_PageSizeThreshold;
+    Mode m_Mode;
+    std::string m_TraceFileName;
+    bool m_Finished;
+
+    // Set once a page has been read through this database
+    std::unique_ptr<std::atomic<bool>[]> m_Used;
+
+    // Record mode - pages and blobs in order of first use, and a mask of the phases
+    // each blob has been read in, zero until its first use
+    std::mutex m_RecordMutex;
+    std::vector<DatabaseTraceEntry> m_Recorded;
+    std::vector<uint32_t> m_RecordedBlobs;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_BlobPhases;
+
+    // Replay mode - page index of each trace entry, the cumulative byte offset at
+    // which each entry begins, and the first trace entry of each page
+    std::vector<uint32_t> m_TracePages;
+    std::vector<uint64_t> m_TraceStart;
+    std::vector<size_t> m_PageTraceIndex;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_PrefetchState;
+    uint64_t m_WindowSize;
+    std::atomic<size_t> m_NextTraceIndex;
+    std::vector<std::future<void>> m_Tasks;
+
+    // Replay mode - prefetch tasks wait here until the replay catches up
+    std::mutex m_WindowMutex;
+    std::condition_variable m_WindowCondition;
+    uint64_t m_ConsumedBytes; // guarded by m_WindowMutex
+    bool m_Stopping; // guarded by m_WindowMutex
+
+    // Replay mode - statistics
+    std::atomic<uint64_t> m_PrefetchedPages;
+    std::atomic<uint64_t> m_HitPages;
+    std::atomic<uint64_t> m_LatePages;
+    std::atomic<uint64_t> m_UntracedPages;
+};
+
+} // namespace Serialization
@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// File: StoreDatabase.h
+//
+// Resolves a capture's DATABASE_HANDLEs to blobs in a shared blob store.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DllCommon.h"
+#include "ReadOnlyDatabase.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// StoreDatabase
+//
+// Wraps an IReadOnlyDatabase opened on a blob store (see BlobStore.h) and maps
+// every handle through the capture's handle map before forwarding the read.
+// Page offsets passed to Lock, Unlock and Prefetch are offsets in the store and
+// are forwarded unchanged.
+//----------------------------------------------------------------------------------
+class StoreDatabase : public IReadOnlyDatabase
+{
+public:
+    using InitResult = ReadOnlyDatabase::InitResult;
+
+    //------------------------------------------------------------------------------
+    // Constructors
+    //------------------------------------------------------------------------------
+    explicit StoreDatabase(IReadOnlyDatabase& database);
+
+    //------------------------------------------------------------------------------
+    // Init - Loads the capture's handle map, checking it against the store
+    //------------------------------------------------------------------------------
+    InitResult Init(const char* pMapFileName, const char* pStoreFileName);
+
+    //------------------------------------------------------------------------------
+    // IReadOnlyDatabase - forwarded to the wrapped database
+    //------------------------------------------------------------------------------
+    NV_REPLAY_EXPORT virtual uint64_t GetSize(const DATABASE_HANDLE& handle) override final;
+    NV_REPLAY_EXPORT virtual DataScope::LockedPageHandle Lock(uint64_t pageOffset) override final;
+    NV_REPLAY_EXPORT virtual void Unlock(DataScope::LockedPageHandle pPageHandle) override final;
+    NV_REPLAY_EXPORT virtual void Prefetch(uint64_t pageOffset) override final;
+    NV_REPLAY_EXPORT virtual void* DoReadStatic(const DATABASE_HANDLE& handle) override final;
+
+protected:
+    // This class is non-copyable
+    StoreDatabase(const StoreDatabase&) = delete;
+    StoreDatabase& operator=(const StoreDatabase&) = delete;
+
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle) override final;
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker) override final;
+
+private:
+    // Store handle of a capture handle, invalid if the handle is out of range
+    DATABASE_HANDLE MapHandle(const DATABASE_HANDLE& handle) const
+    {
+        const auto index = static_cast<uint32_t>(handle.value);
+        return index < m_StoreHandles.size() ? DATABASE_HANDLE(static_cast<int32_t>(m_StoreHandles[index])) : DATABASE_HANDLE_INVALID;
+    }
+
+    IReadOnlyDatabase& m_Database;
+    std::vector<uint32_t> m_StoreHandles; // Indexed by capture handle
+};
+
+} // namespace Serialization
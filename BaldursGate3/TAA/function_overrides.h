@@ -3,9 +3,12 @@
 //
 // Copyright (c) NVIDIA Corporation.  All rights reserved.
 //--------------------------------------------------------------------------------------
+#include "DatabasePhase.h"
+
 #define My_init()\
     init()
 #define My_frame(frame_number, frame_functions)\
+    Serialization::BeginDatabaseFrame();\
     frame_functions
 #define My_done()\
     done()
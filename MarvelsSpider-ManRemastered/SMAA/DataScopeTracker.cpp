@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// File: DataScopeTracker.cpp
+//
+// Per-thread data scope trackers.
+//--------------------------------------------------------------------------------------
+
+#include "DataScope.h"
+
+#include <memory>
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// DataScopeTracker::ForCurrentThread - created on the first scope a thread opens.
+// The pages of a scope are unlocked when it closes, on the thread which opened
+// it, so a tracker holds no pages by the time its thread exits.
+//------------------------------------------------------------------------------
+DataScopeTracker& DataScopeTracker::ForCurrentThread()
+{
+    thread_local std::unique_ptr<DataScopeTracker> t_spTracker;
+    if (!t_spTracker)
+    {
+        t_spTracker.reset(new DataScopeTracker());
+    }
+    return *t_spTracker;
+}
+
+} // namespace Serialization
@@ -0,0 +1,160 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseLayout.h
+//
+// Blob and page records shared by the ReadOnlyDatabase backends.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DllCommon.h"
+#include "ReadOnlyDatabase.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// DatabaseBlobRecord
+//
+// Location of a single blob inside the database file.  The records file
+// (<database>.rec) is a flat array of these, indexed by DATABASE_HANDLE.
+//----------------------------------------------------------------------------------
+struct DatabaseBlobRecord
+{
+    uint64_t Size;
+    uint64_t Offset;
+};
+
+//----------------------------------------------------------------------------------
+// DatabasePageRecord
+//
+// A span of the database file which is made resident as a unit.  A page contains
+// either a single blob which is larger than the page size threshold, or multiple
+// adjacent blobs that total less than the threshold.
+//----------------------------------------------------------------------------------
+struct DatabasePageRecord
+{
+    uint64_t PageOffset;
+    uint64_t PageSize;
+};
+
+//----------------------------------------------------------------------------------
+// DatabaseBlobLocation
+//
+// Where a blob is held in the page table, precomputed for every handle so that
+// resolving a handle on the read path is one array lookup rather than a search of
+// the pages.
+//----------------------------------------------------------------------------------
+struct DatabaseBlobLocation
+{
+    static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
+    uint64_t Size;
+    uint64_t OffsetInPage;
+    uint32_t PageIndex; // NO_PAGE for empty blobs
+};
+
+//----------------------------------------------------------------------------------
+// DatabaseLayout
+//
+// Loads the blob records for a database file and groups them into pages.
+//----------------------------------------------------------------------------------
+class DatabaseLayout
+{
+public:
+    DatabaseLayout();
+
+    //------------------------------------------------------------------------------
+    // Load - Read <pFileName>.rec and build the page table.  fileSize is the size
+    // of the database file, used to validate the records.
+    //------------------------------------------------------------------------------
+    ReadOnlyDatabase::InitResult Load(const char* pFileName, uint64_t fileSize, uint64_t pageSizeThreshold);
+    ReadOnlyDatabase::InitResult Load(const char* pFileName, uint64_t pageSizeThreshold);
+
+    // Get the record for a blob, or null if the handle is out of range
+    const DatabaseBlobRecord* GetBlob(const DATABASE_HANDLE& handle) const
+    {
+        const auto index = static_cast<uint32_t>(handle.value);
+        return index < m_Blobs.size() ? &m_Blobs[index] : nullptr;
+    }
+
+    // Get the page and offset of a blob, or null if the handle is out of range
+    const DatabaseBlobLocation* GetBlobLocation(const DATABASE_HANDLE& handle) const
+    {
+        const auto index = static_cast<uint32_t>(handle.value);
+        return index < m_BlobLocations.size() ? &m_BlobLocations[index] : nullptr;
+    }
+
+    // Get the index of the page containing a file offset, or GetPageCount() if none does
+    size_t FindPage(uint64_t offset) const;
+
+    // As FindPage, in constant time when offset is the start of a page
+    size_t FindPageStart(uint64_t offset) const
+    {
+        for (size_t slot = HashPageOffset(offset);; slot = (slot + 1) & (m_PageStartTable.size() - 1))
+        {
+            const uint32_t pageIndex = m_PageStartTable[slot];
+            if (pageIndex == DatabaseBlobLocation::NO_PAGE)
+            {
+                return FindPage(offset);
+            }
+            if (m_Pages[pageIndex].PageOffset == offset)
+            {
+                return pageIndex;
+            }
+        }
+    }
+
+    size_t GetBlobCount() const
+    {
+        return m_Blobs.size();
+    }
+
+    size_t GetPageCount() const
+    {
+        return m_Pages.size();
+    }
+
+    const DatabasePageRecord& GetPage(size_t index) const
+    {
+        return m_Pages[index];
+    }
+
+    uint64_t GetPageSizeThreshold() const
+    {
+        return m_PageSizeThreshold;
+    }
+
+    // Name of the records file which accompanies a database file
+    static std::string GetRecordsFileName(const char* pFileName);
+
+    // Size of a file on disk, false if it cannot be queried
+    static bool GetFileSize(const char* pFileName, uint64_t& fileSize);
+
+    // What distinguishes a file on disk from any other, or from another version of
+    // itself: its volume, file index, size and modification time
+    static bool GetFileIdentity(const char* pFileName, uint64_t (&identity)[4]);
+
+private:
+    void BuildPages();
+    void BuildPageStartTable();
+
+    size_t HashPageOffset(uint64_t offset) const
+    {
+        return static_cast<size_t>((offset * 0x9E3779B97F4A7C15ull) >> m_PageStartShift);
+    }
+
+    std::vector<DatabaseBlobRecord> m_Blobs;
+    std::vector<DatabaseBlobLocation> m_BlobLocations; // Indexed by handle, like m_Blobs
+    std::vector<DatabasePageRecord> m_Pages; // Sorted by offset, non-overlapping
+    uint64_t m_PageSizeThreshold;
+
+    // Open-addressed table of page indices hashed by page offset; a power of two in
+    // size and at most half full
+    std::vector<uint32_t> m_PageStartTable;
+    unsigned m_PageStartShift;
+};
+
+} // namespace Serialization
@@ -0,0 +1,320 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseRelayout.cpp
+//
+// Rewrites a database file with its blobs in the order the replay uses them.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseRelayout.h"
+
+#include "DatabaseLayout.h"
+#include "DatabasePhase.h"
+#include "DatabaseTrace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+namespace {
+
+const uint64_t RELAYOUT_BLOB_ALIGNMENT = 16;
+const size_t RELAYOUT_COPY_SIZE = 4 * 1024 * 1024;
+
+const size_t NOT_USED = SIZE_MAX;
+
+// Upper bounds of the size classes of a packed relayout; regions above the last
+// bound form the final class
+const uint64_t PACKED_SIZE_CLASS_LIMITS[] = { 4 * 1024, 64 * 1024, 1024 * 1024 };
+
+// Groups of a packed relayout, in file order
+enum PackedGroup
+{
+    FrameGroup,
+    ResetGroup,
+    InitGroup,
+    UntracedGroup,
+};
+
+//------------------------------------------------------------------------------
+// Region - a run of blobs which overlap in the original file
+//------------------------------------------------------------------------------
+struct Region
+{
+    uint64_t OldOffset;
+    uint64_t Size;
+    uint64_t NewOffset;
+    size_t FirstUse; // Position in the trace of the first blob used, NOT_USED if none
+    uint8_t Phases; // DatabasePhaseBit of every phase any of its blobs was read in
+};
+
+//------------------------------------------------------------------------------
+// GetPackedGroup
+//------------------------------------------------------------------------------
+PackedGroup GetPackedGroup(const Region& region)
+{
+    if (region.FirstUse == NOT_USED)
+    {
+        return UntracedGroup;
+    }
+    if (region.Phases & DatabasePhaseBit(DatabasePhase::Frame))
+    {
+        return FrameGroup;
+    }
+    return (region.Phases & DatabasePhaseBit(DatabasePhase::FrameReset)) ? ResetGroup : InitGroup;
+}
+
+//------------------------------------------------------------------------------
+// GetSizeClass
+//------------------------------------------------------------------------------
+size_t GetSizeClass(uint64_t size)
+{
+    size_t sizeClass = 0;
+    while (sizeClass < sizeof(PACKED_SIZE_CLASS_LIMITS) / sizeof(PACKED_SIZE_CLASS_LIMITS[0]) && size > PACKED_SIZE_CLASS_LIMITS[sizeClass])
+    {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+//------------------------------------------------------------------------------
+// SeekFile - 64-bit seek, since databases are usually larger than 2GB
+//------------------------------------------------------------------------------
+bool SeekFile(FILE* pFile, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(pFile, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(pFile, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// CopyRange - appends a range of the input to the output
+//------------------------------------------------------------------------------
+bool CopyRange(FILE* pInput, FILE* pOutput, uint64_t offset, uint64_t size, std::vector<uint8_t>& buffer)
+{
+    if (!SeekFile(pInput, offset))
+    {
+        return false;
+    }
+
+    while (size > 0)
+    {
+        const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(size, buffer.size()));
+        if (fread(buffer.data(), 1, chunkSize, pInput) != chunkSize || fwrite(buffer.data(), 1, chunkSize, pOutput) != chunkSize)
+        {
+            return false;
+        }
+        size -= chunkSize;
+    }
+    return true;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// RelayoutDatabase
+//------------------------------------------------------------------------------
+bool RelayoutDatabase(const char* pDatabaseFileName, const char* pTraceFileName, const char* pOutputFileName, DatabaseRelayoutOrder order, DatabaseRelayoutStats& stats)
+{
+    stats = {};
+    if (!pDatabaseFileName || !pTraceFileName || !pOutputFileName || std::string(pDatabaseFileName) == pOutputFileName)
+    {
+        return false;
+    }
+
+    // The page size threshold is irrelevant here; only the blob records are used
+    DatabaseLayout layout;
+    if (layout.Load(pDatabaseFileName, UINT64_MAX) != ReadOnlyDatabase::InitResult::Ok)
+    {
+        return false;
+    }
+
+    std::vector<DatabaseTraceEntry> pages;
+    std::vector<uint32_t> tracedBlobs;
+    std::vector<uint8_t> tracedPhases;
+    if (!LoadDatabaseTrace(pTraceFileName, pages, &tracedBlobs, &tracedPhases) || tracedBlobs.empty())
+    {
+        return false;
+    }
+    if (order == DatabaseRelayoutOrder::Packed && tracedPhases.size() != tracedBlobs.size())
+    {
+        return false;
+    }
+
+    // Group the blobs into regions of overlapping blobs, in original file order
+    const size_t blobCount = layout.GetBlobCount();
+    std::vector<uint32_t> sortedBlobs;
+    sortedBlobs.reserve(blobCount);
+    for (size_t i = 0; i < blobCount; ++i)
+    {
+        if (layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(i)))->Size > 0)
+        {
+            sortedBlobs.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    std::sort(sortedBlobs.begin(), sortedBlobs.end(), [&](uint32_t a, uint32_t b) {
+        return layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(a)))->Offset < layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(b)))->Offset;
+    });
+
+    std::vector<Region> regions;
+    std::vector<size_t> blobRegions(blobCount, NOT_USED);
+    for (uint32_t handle : sortedBlobs)
+    {
+        const DatabaseBlobRecord& blob = *layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(handle)));
+        if (regions.empty() || blob.Offset >= regions.back().OldOffset + regions.back().Size)
+        {
+            regions.push_back({ blob.Offset, blob.Size, 0, NOT_USED, 0 });
+        }
+        else
+        {
+            Region& region = regions.back();
+            region.Size = std::max(region.Size, blob.Offset + blob.Size - region.OldOffset);
+        }
+        blobRegions[handle] = regions.size() - 1;
+    }
+
+    // Order the regions by first use.  Handles which are out of range (a trace of
+    // another capture) are ignored.
+    for (size_t i = 0; i < tracedBlobs.size(); ++i)
+    {
+        const uint32_t handle = tracedBlobs[i];
+        if (handle >= blobCount || blobRegions[handle] == NOT_USED)
+        {
+            continue;
+        }
+
+        Region& region = regions[blobRegions[handle]];
+        if (region.FirstUse == NOT_USED)
+        {
+            region.FirstUse = i;
+        }
+        if (!tracedPhases.empty())
+        {
+            region.Phases |= tracedPhases[i];
+        }
+        ++stats.TracedBlobs;
+    }
+
+    std::vector<size_t> regionOrder(regions.size());
+    for (size_t i = 0; i < regionOrder.size(); ++i)
+    {
+        regionOrder[i] = i;
+    }
+    if (order == DatabaseRelayoutOrder::Packed)
+    {
+        std::stable_sort(regionOrder.begin(), regionOrder.end(), [&](size_t a, size_t b) {
+            const PackedGroup groupA = GetPackedGroup(regions[a]);
+            const PackedGroup groupB = GetPackedGroup(regions[b]);
+            if (groupA != groupB)
+            {
+                return groupA < groupB;
+            }
+            const size_t sizeClassA = GetSizeClass(regions[a].Size);
+            const size_t sizeClassB = GetSizeClass(regions[b].Size);
+            if (sizeClassA != sizeClassB)
+            {
+                return sizeClassA < sizeClassB;
+            }
+            return regions[a].FirstUse < regions[b].FirstUse;
+        });
+
+        for (const Region& region : regions)
+        {
+            switch (GetPackedGroup(region))
+            {
+            case FrameGroup:
+                stats.FrameBytes += region.Size;
+                break;
+            case ResetGroup:
+                stats.ResetBytes += region.Size;
+                break;
+            case InitGroup:
+                stats.InitBytes += region.Size;
+                break;
+            case UntracedGroup:
+                break;
+            }
+        }
+    }
+    else
+    {
+        std::stable_sort(regionOrder.begin(), regionOrder.end(), [&](size_t a, size_t b) {
+            return regions[a].FirstUse < regions[b].FirstUse;
+        });
+    }
+
+    // Place the regions one after another, padded to their original alignment
+    uint64_t outputSize = 0;
+    for (size_t index : regionOrder)
+    {
+        Region& region = regions[index];
+        const uint64_t padding = (region.OldOffset - outputSize) % RELAYOUT_BLOB_ALIGNMENT;
+        region.NewOffset = outputSize + padding;
+        outputSize = region.NewOffset + region.Size;
+        stats.PaddingBytes += padding;
+    }
+
+    FILE* pInput = fopen(pDatabaseFileName, "rb");
+    FILE* pOutput = pInput ? fopen(pOutputFileName, "wb") : nullptr;
+    if (!pOutput)
+    {
+        if (pInput)
+        {
+            fclose(pInput);
+        }
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(RELAYOUT_COPY_SIZE);
+    const uint8_t padding[RELAYOUT_BLOB_ALIGNMENT] = {};
+    uint64_t written = 0;
+    bool success = true;
+    for (size_t i = 0; success && i < regionOrder.size(); ++i)
+    {
+        const Region& region = regions[regionOrder[i]];
+        const size_t paddingSize = static_cast<size_t>(region.NewOffset - written);
+        success = (paddingSize == 0 || fwrite(padding, 1, paddingSize, pOutput) == paddingSize)
+            && CopyRange(pInput, pOutput, region.OldOffset, region.Size, buffer);
+        written = region.NewOffset + region.Size;
+    }
+
+    fclose(pInput);
+    success = (fclose(pOutput) == 0) && success;
+    if (!success)
+    {
+        return false;
+    }
+
+    // Records keep their handles; empty blobs belong to no region and are put at
+    // the start of the file
+    std::vector<DatabaseBlobRecord> records(blobCount);
+    for (size_t i = 0; i < blobCount; ++i)
+    {
+        const DatabaseBlobRecord& blob = *layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(i)));
+        records[i].Size = blob.Size;
+        if (blobRegions[i] != NOT_USED)
+        {
+            const Region& region = regions[blobRegions[i]];
+            records[i].Offset = region.NewOffset + (blob.Offset - region.OldOffset);
+        }
+    }
+
+    const std::string recordsFileName = DatabaseLayout::GetRecordsFileName(pOutputFileName);
+    FILE* pRecords = fopen(recordsFileName.c_str(), "wb");
+    if (!pRecords)
+    {
+        return false;
+    }
+    success = (records.empty() || fwrite(records.data(), sizeof(DatabaseBlobRecord), records.size(), pRecords) == records.size());
+    success = (fclose(pRecords) == 0) && success;
+
+    stats.Blobs = blobCount;
+    stats.Regions = regions.size();
+    stats.Bytes = outputSize;
+    return success;
+}
+
+} // namespace Serialization
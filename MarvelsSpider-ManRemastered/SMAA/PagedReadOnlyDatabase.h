@@ -0,0 +1,316 @@
+//--------------------------------------------------------------------------------------
+// File: PagedReadOnlyDatabase.h
+//
+// Heap-paged implementation of IReadOnlyDatabase with a sharded page cache.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CompressedDatabaseFile.h"
+#include "DatabaseLayout.h"
+#include "DatabasePageAllocator.h"
+#include "DatabaseReadQueue.h"
+#include "DatabaseSource.h"
+#include "DllCommon.h"
+#include "PagedDatabasePolicies.h"
+#include "ReadOnlyDatabase.h"
+#include "SharedDatabaseCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// PagedReadOnlyDatabase
+//
+// Reads pages of the database file into heap memory on first use, like
+// ReadOnlyDatabase, through a sharded cache which locks a resident page without
+// taking a mutex.  The optional parts of CacheSettings are the policies of
+// PagedDatabasePolicies.h.
+//----------------------------------------------------------------------------------
+class PagedReadOnlyDatabase : public IReadOnlyDatabase
+{
+public:
+    using InitResult = ReadOnlyDatabase::InitResult;
+
+    enum class EvictionPolicy
+    {
+        Clock, // Second chance: pages used since the hand last passed are skipped once
+        LeastRecentlyUsed, // Sort resident pages by last access, as ReadOnlyDatabase does
+    };
+
+    struct CacheSettings
+    {
+        uint64_t PageSizeThreshold;
+        size_t MaxResidentPages; // Zero for no limit
+        uint64_t MaxResidentBytes; // Zero for no limit
+        size_t ShardCount;
+        EvictionPolicy Policy;
+        DatabaseReadQueue::Engine ReadEngine;
+        size_t ReadQueueDepth; // Zero for one read at a time
+        uint64_t MaxFrameResidentBytes; // Zero for no frame pool
+        bool ReleaseInitPages; // Evict pages used only during setup when the first frame starts
+        uint64_t PinWarmupFrames; // Frames to record the working set over before pinning it, zero to not pin
+        bool PinWithMlock; // Also lock the pinned working set in physical memory
+        DatabasePageAllocator::HugePages HugePages; // Backing of large pages
+        uint64_t MaxCachedBufferBytes; // Memory of evicted large pages kept for reuse
+        bool EpochUnlock; // Hold pages locked by frames and resets until the thread's first lock of the next frame
+    };
+
+    //------------------------------------------------------------------------------
+    // CacheStats - counters since Init
+    //------------------------------------------------------------------------------
+    struct CacheStats
+    {
+        uint64_t Misses; // Pages loaded from the file
+        uint64_t Evictions; // Pages released to stay within the residency limits
+        uint64_t EvictionNanoseconds; // Time spent choosing and releasing victims
+        uint64_t ContendedLocks; // Shard lock acquisitions which had to wait
+        uint64_t ResidentPages;
+        uint64_t ResidentBytes;
+        uint64_t ResidentBytesHighWater;
+        uint64_t OverBudgetLoads; // Loads which exceeded a limit because every other page was locked
+    };
+
+    //------------------------------------------------------------------------------
+    // Constructors
+    //------------------------------------------------------------------------------
+    PagedReadOnlyDatabase(const CacheSettings& settings);
+
+    //------------------------------------------------------------------------------
+    // Destructor - frees all pages and closes the database file
+    //------------------------------------------------------------------------------
+    virtual ~PagedReadOnlyDatabase();
+
+    //------------------------------------------------------------------------------
+    // Init - Opens the specified database file and loads its page layout.  If
+    // pCompressedFileName is set, pages are decompressed from that container and
+    // the database file itself is not opened; its records file is still needed.
+    //------------------------------------------------------------------------------
+    InitResult Init(const char* pFileName, const char* pCompressedFileName = nullptr);
+
+    //------------------------------------------------------------------------------
+    // Init - As above, reading pages from spSource, such as an entry of a zip
+    // archive.  The database file's records file is still needed.
+    //------------------------------------------------------------------------------
+    InitResult Init(const char* pFileName, std::unique_ptr<IDatabaseSource> spSource);
+    InitResult GetLastInitResult() const
+    {
+        return m_lastInitResult;
+    }
+
+    //------------------------------------------------------------------------------
+    // Preload - Loads pages in file order on the thread pool until every page is
+    // resident or the residency limits are reached.  Must be called from the thread
+    // which submits work to the thread pool.
+    //------------------------------------------------------------------------------
+    void Preload();
+
+    // Size of the database file, or of the database a source holds
+    uint64_t GetDatabaseSize() const
+    {
+        return m_DatabaseSize;
+    }
+
+    CacheStats GetCacheStats() const;
+
+    //------------------------------------------------------------------------------
+    // AttachSharedCache - Reads pages through a SharedDatabaseCache named after
+    // pSourceFileName, the file Init read the database from, so that they are
+    // shared with other processes reading it.  Must be called after Init and before
+    // any page is loaded.  Returns false if the cache cannot be attached, in which
+    // case pages are kept in this process as before.
+    //------------------------------------------------------------------------------
+    bool AttachSharedCache(const char* pSourceFileName);
+
+    //------------------------------------------------------------------------------
+    // EnableVerification - Checks pages as they are read against the reference
+    // checksums in the sidecar of pFileName, the database file Init was given,
+    // which DatabaseChecksumTool writes.  pSourceFileName is the file pages are read
+    // from.  Nothing is checked if the sidecar records a verification of the file
+    // as it is now.  Must be called after Init and before any page is loaded.
+    // Returns false if there is no sidecar for these records.
+    //------------------------------------------------------------------------------
+    bool EnableVerification(const char* pFileName, const char* pSourceFileName);
+
+    static const char* EvictionPolicyToString(EvictionPolicy policy);
+
+    //------------------------------------------------------------------------------
+    // GetSize - Get the size of a blob if it exists, or zero
+    //------------------------------------------------------------------------------
+    NV_REPLAY_EXPORT virtual uint64_t GetSize(const DATABASE_HANDLE& handle) override final;
+
+    // Helpers for Read - Lock will return null if a page cannot be found or loaded
+    NV_REPLAY_EXPORT virtual DataScope::LockedPageHandle Lock(uint64_t pageOffset) override final;
+    NV_REPLAY_EXPORT virtual void Unlock(DataScope::LockedPageHandle pPageHandle) override final;
+
+    // Prefetch - Loads the page
+    NV_REPLAY_EXPORT virtual void Prefetch(uint64_t pageOffset) override final;
+
+    // PrefetchPages - Reads the missing pages of the file in one batch
+    NV_REPLAY_EXPORT virtual void PrefetchPages(const uint64_t* pPageOffsets, size_t count) override final;
+
+    // DoReadStatic - Pins the blob's page
+    NV_REPLAY_EXPORT virtual void* DoReadStatic(const DATABASE_HANDLE& handle) override final;
+
+protected:
+    // This class is non-copyable
+    PagedReadOnlyDatabase(const PagedReadOnlyDatabase&) = delete;
+    PagedReadOnlyDatabase& operator=(const PagedReadOnlyDatabase&) = delete;
+
+    // Helpers for Read
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle) override final;
+    NV_REPLAY_EXPORT virtual void* DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker) override final;
+
+private:
+    // LockCount of a page which is being evicted.  Large enough that concurrent
+    // increments from Lock can never make it non-negative.
+    static constexpr int32_t EVICTING = INT32_MIN / 2;
+
+    // The residency a page is counted against
+    enum class ResidencyPool
+    {
+        General,
+        Frame,
+    };
+
+    struct alignas(64) Shard
+    {
+        std::mutex Mutex;
+    };
+
+    InitResult InitPages(const char* pFileName);
+    bool OpenFile(const char* pFileName);
+    void CloseFile();
+    bool ReadFromFile(uint64_t offset, uint64_t size, uint8_t* pDestination);
+
+    // Memory of a page, in the shared cache if one is attached and otherwise from
+    // the allocator
+    uint8_t* AllocatePage(const DatabasePageRecord& record);
+    void FreePage(uint8_t* pMemory, const DatabasePageRecord& record);
+
+    // Reads a range of the database into the page memory it belongs at, through the
+    // shared cache if one is attached
+    bool ReadPageData(uint64_t offset, uint64_t size, uint8_t* pDestination);
+
+    Shard& GetShard(size_t pageIndex)
+    {
+        return m_Shards[pageIndex % m_ShardCount];
+    }
+    void LockShard(Shard& shard);
+
+    size_t GetPageIndex(const PagedPage& page) const
+    {
+        return static_cast<size_t>(&page - m_Pages.get());
+    }
+
+    // Lock for a page already found, as the read path does from the blob's location.
+    // Prefetches pass false for replayUse so that the page is not tagged with the
+    // prefetching thread's phase.
+    DataScope::LockedPageHandle LockPage(PagedPage& page, bool replayUse = true);
+
+    // Lock held by a data scope: LockInEpoch for frames and resets under
+    // PagedEpochUnlock, LockPage otherwise
+    DataScope::LockedPageHandle LockForScope(PagedPage& page);
+
+    // Lock for frames and resets under PagedEpochUnlock, returning a tagged handle
+    DataScope::LockedPageHandle LockInEpoch(PagedPage& page);
+
+    // Records the first lock of a page in a phase, called with a lock count held
+    void OnFirstUseInPhase(PagedPage& page, uint8_t phaseBit);
+
+    // Evicts every unlocked page which has only been used during resource init and
+    // frame setup, once the first frame starts.  Pages which have not been used yet
+    // are kept.
+    void ReleaseInitPages();
+
+    // Locks and reads whole every page used by the warm-up frames, and pins it
+    void PinWorkingSet();
+
+    // Moves a page locked by the caller to the frame pool once it has been used by a frame
+    void PromotePage(PagedPage& page);
+    ResidencyPool GetLoadPool(const PagedPage& page) const
+    {
+        const bool framePage = m_FramePool.Accepts(page) && (page.Phases.load(std::memory_order_relaxed) & DATABASE_PHASE_MASK_PER_FRAME);
+        return framePage ? ResidencyPool::Frame : ResidencyPool::General;
+    }
+
+    // Slow path of Lock - called with a lock count already held on the page
+    bool LoadPage(PagedPage& page);
+
+    // Residency accounting and eviction - called with m_EvictionMutex held.  Only
+    // pages of the pool being made room in are evicted.
+    bool NeedsEviction(ResidencyPool pool, uint64_t pages, uint64_t bytes) const;
+    void ReserveResidency(ResidencyPool pool, uint64_t pages, uint64_t bytes);
+    void ReleaseResidency(ResidencyPool pool, uint64_t pages, uint64_t bytes);
+    void EvictClock(ResidencyPool pool, uint64_t pages, uint64_t bytes);
+    void EvictLeastRecentlyUsed(ResidencyPool pool, uint64_t pages, uint64_t bytes);
+    bool TryEvictPage(size_t pageIndex);
+    void FreePages();
+
+    PagedPage* FindBlobPage(const DATABASE_HANDLE& handle, const DatabaseBlobLocation*& pLocation);
+
+    // Common to both DoReads
+    void* ReadBlob(const DATABASE_HANDLE& handle, DataScopeTracker* pScopeTracker);
+
+    DatabaseLayout m_Layout;
+    std::unique_ptr<PagedPage[]> m_Pages;
+    uint64_t m_DatabaseSize;
+
+    std::unique_ptr<Shard[]> m_Shards;
+    size_t m_ShardCount;
+
+    // Guards the resident ring, the clock hand and changes to residency.  Only
+    // taken when a page is loaded, never on the Lock fast path.
+    std::mutex m_EvictionMutex;
+    std::vector<uint32_t> m_ResidentRing;
+    size_t m_ClockHand;
+
+    // The file
+#if defined(_WIN32)
+    void* m_hFile;
+#else
+    int m_fd;
+#endif
+    std::unique_ptr<IDatabaseSource> m_spSource; // Replaces the file when set
+    std::unique_ptr<SharedDatabaseCache> m_spSharedCache; // Holds the pages when set
+    DatabasePageAllocator m_Allocator;
+    DatabaseReadQueue m_ReadQueue;
+    DatabaseReadQueue::Engine m_ReadEngine;
+    size_t m_ReadQueueDepth;
+
+    uint64_t m_PageSizeThreshold;
+    size_t m_MaxResidentPages;
+    uint64_t m_MaxResidentBytes;
+    EvictionPolicy m_Policy;
+
+    // Optional policies.  Phases of pages are tracked for the first three.
+    PagedFramePool m_FramePool;
+    PagedInitRelease m_InitRelease;
+    PagedWorkingSetPin m_WorkingSetPin;
+    PagedEpochUnlock m_EpochUnlock;
+    PagedStaticPin m_StaticPin;
+    PagedVerification m_Verification;
+    bool m_TrackPhases;
+
+    std::atomic<uint64_t> m_PageAccessCounter;
+    std::atomic<uint64_t> m_ResidentPages;
+    std::atomic<uint64_t> m_ResidentBytes;
+    std::atomic<uint64_t> m_ResidentBytesHighWater; // Only written with m_EvictionMutex held
+
+    // Statistics
+    std::atomic<uint64_t> m_Misses;
+    std::atomic<uint64_t> m_Evictions;
+    std::atomic<uint64_t> m_EvictionNanoseconds;
+    std::atomic<uint64_t> m_ContendedLocks;
+    std::atomic<uint64_t> m_OverBudgetLoads;
+
+    InitResult m_lastInitResult;
+};
+
+} // namespace Serialization
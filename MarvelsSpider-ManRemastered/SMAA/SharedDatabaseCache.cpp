@@ -0,0 +1,489 @@
+//--------------------------------------------------------------------------------------
+// File: SharedDatabaseCache.cpp
+//
+// Database pages held in named shared memory for every replay process reading them.
+//--------------------------------------------------------------------------------------
+
+#include "SharedDatabaseCache.h"
+
+#include "DatabaseHash.h"
+#include "DatabaseLayout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/statvfs.h>
+#endif
+#endif
+
+namespace Serialization {
+
+namespace {
+
+const uint64_t SHARED_CACHE_MAGIC = 0x4548434143424456ull; // "VDBCACHE"
+const uint64_t SHARED_CACHE_VERSION = 1;
+
+// Chunk states.  A chunk being read holds the reader's process id in its upper
+// 32 bits.
+const uint64_t CHUNK_EMPTY = 0;
+const uint64_t CHUNK_READY = 1;
+const uint64_t CHUNK_READING = 2;
+
+// How long to wait for the process which created the object to size and
+// initialize it
+const auto INIT_TIMEOUT = std::chrono::seconds(5);
+
+// How often a reader which is being waited for is checked for having died
+const auto READER_CHECK_INTERVAL = std::chrono::milliseconds(50);
+
+uint64_t RoundUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+//------------------------------------------------------------------------------
+// GetCurrentProcessId64
+//------------------------------------------------------------------------------
+uint64_t GetCurrentProcessId64()
+{
+#if defined(_WIN32)
+    return GetCurrentProcessId();
+#else
+    return static_cast<uint64_t>(getpid());
+#endif
+}
+
+//------------------------------------------------------------------------------
+// IsProcessAlive - processes which cannot be queried are assumed to be alive
+//------------------------------------------------------------------------------
+bool IsProcessAlive(uint64_t processId)
+{
+#if defined(_WIN32)
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(processId));
+    if (!hProcess)
+    {
+        return GetLastError() != ERROR_INVALID_PARAMETER;
+    }
+    const bool alive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+    CloseHandle(hProcess);
+    return alive;
+#else
+    return kill(static_cast<pid_t>(processId), 0) == 0 || errno == EPERM;
+#endif
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// Header - at the start of the shared memory object, followed by the chunk
+// states and then the database
+//------------------------------------------------------------------------------
+struct SharedDatabaseCache::Header
+{
+    std::atomic<uint64_t> Magic; // Written last by the process which creates the object
+    uint64_t Version;
+    uint64_t DatabaseSize;
+    uint64_t ChunkCount;
+    uint64_t DataOffset;
+    std::atomic<uint64_t> LoadedBytes;
+    std::atomic<uint64_t> Processes[MAX_PROCESSES]; // Ids of attached processes, zero for a free slot
+};
+
+//------------------------------------------------------------------------------
+// SharedDatabaseCache
+//------------------------------------------------------------------------------
+SharedDatabaseCache::SharedDatabaseCache()
+    : m_Name()
+#if defined(_WIN32)
+    , m_hMapping(nullptr)
+#endif
+    , m_pMapping(nullptr)
+    , m_MappingSize()
+    , m_pHeader(nullptr)
+    , m_pChunkStates(nullptr)
+    , m_pData(nullptr)
+    , m_DatabaseSize()
+    , m_ChunkCount()
+    , m_Slot()
+    , m_ProcessId(GetCurrentProcessId64())
+    , m_ChunksRead()
+    , m_ChunkWaits()
+    , m_ReclaimedChunks()
+{
+}
+
+//------------------------------------------------------------------------------
+// ~SharedDatabaseCache
+//------------------------------------------------------------------------------
+SharedDatabaseCache::~SharedDatabaseCache()
+{
+    Detach();
+}
+
+//------------------------------------------------------------------------------
+// Attach
+//------------------------------------------------------------------------------
+bool SharedDatabaseCache::Attach(const char* pSourceFileName, uint64_t databaseSize)
+{
+    Detach();
+
+    uint64_t fileIdentity[4] = {};
+    if (!pSourceFileName || !DatabaseLayout::GetFileIdentity(pSourceFileName, fileIdentity))
+    {
+        return false;
+    }
+    const uint64_t identity[] = { fileIdentity[0], fileIdentity[1], fileIdentity[2], fileIdentity[3], databaseSize, SHARED_CACHE_VERSION };
+
+    char name[64] = {};
+#if defined(_WIN32)
+    snprintf(name, sizeof(name), "Local\\nv-replay-db-%016llx", static_cast<unsigned long long>(HashBlob(identity, sizeof(identity))));
+#else
+    snprintf(name, sizeof(name), "/nv-replay-db-%016llx", static_cast<unsigned long long>(HashBlob(identity, sizeof(identity))));
+#endif
+    m_Name = name;
+
+    m_DatabaseSize = databaseSize;
+    m_ChunkCount = static_cast<size_t>((databaseSize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    const uint64_t statesOffset = RoundUp(sizeof(Header), 64);
+    const uint64_t dataOffset = RoundUp(statesOffset + m_ChunkCount * sizeof(uint64_t), 4096);
+    const uint64_t mappingSize = dataOffset + std::max<uint64_t>(databaseSize, 1);
+
+    // An object whose creator died before initializing it is replaced once
+    bool created = false;
+    for (int attempt = 0; attempt < 2 && !m_pMapping; ++attempt)
+    {
+        if (!Map(mappingSize, created))
+        {
+            return false;
+        }
+
+        m_pHeader = static_cast<Header*>(m_pMapping);
+        if (created)
+        {
+            m_pHeader->Version = SHARED_CACHE_VERSION;
+            m_pHeader->DatabaseSize = databaseSize;
+            m_pHeader->ChunkCount = m_ChunkCount;
+            m_pHeader->DataOffset = dataOffset;
+            m_pHeader->Magic.store(SHARED_CACHE_MAGIC, std::memory_order_release);
+            break;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        while (m_pHeader->Magic.load(std::memory_order_acquire) != SHARED_CACHE_MAGIC && std::chrono::steady_clock::now() - start < INIT_TIMEOUT)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (m_pHeader->Magic.load(std::memory_order_acquire) != SHARED_CACHE_MAGIC)
+        {
+            Unmap();
+#if !defined(_WIN32)
+            shm_unlink(m_Name.c_str());
+#endif
+        }
+    }
+    if (!m_pMapping)
+    {
+        return false;
+    }
+
+    if (m_pHeader->Version != SHARED_CACHE_VERSION || m_pHeader->DatabaseSize != databaseSize || m_pHeader->ChunkCount != m_ChunkCount
+        || m_pHeader->DataOffset != dataOffset)
+    {
+        Unmap();
+        return false;
+    }
+    m_pChunkStates = reinterpret_cast<std::atomic<uint64_t>*>(static_cast<uint8_t*>(m_pMapping) + statesOffset);
+    m_pData = static_cast<uint8_t*>(m_pMapping) + dataOffset;
+
+    // Reclaim the slots of processes which died without detaching, then take one
+    for (size_t i = 0; i < MAX_PROCESSES; ++i)
+    {
+        uint64_t processId = m_pHeader->Processes[i].load();
+        if (processId != 0 && processId != m_ProcessId && !IsProcessAlive(processId))
+        {
+            m_pHeader->Processes[i].compare_exchange_strong(processId, 0);
+        }
+    }
+    for (m_Slot = 0; m_Slot < MAX_PROCESSES; ++m_Slot)
+    {
+        uint64_t expected = 0;
+        if (m_pHeader->Processes[m_Slot].compare_exchange_strong(expected, m_ProcessId))
+        {
+            break;
+        }
+    }
+    if (m_Slot == MAX_PROCESSES)
+    {
+        Unmap();
+        return false;
+    }
+
+    m_ChunksRead = 0;
+    m_ChunkWaits = 0;
+    m_ReclaimedChunks = 0;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Detach
+//------------------------------------------------------------------------------
+void SharedDatabaseCache::Detach()
+{
+    if (!m_pMapping)
+    {
+        return;
+    }
+
+    m_pHeader->Processes[m_Slot].store(0);
+    bool last = true;
+    for (size_t i = 0; i < MAX_PROCESSES; ++i)
+    {
+        last = last && m_pHeader->Processes[i].load() == 0;
+    }
+    Unmap();
+
+    // Windows frees the mapping with its last handle
+#if !defined(_WIN32)
+    if (last)
+    {
+        shm_unlink(m_Name.c_str());
+    }
+#else
+    (void)last;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Map - opens the named object, creating it if it does not exist, and maps it
+//------------------------------------------------------------------------------
+bool SharedDatabaseCache::Map(uint64_t mappingSize, bool& created)
+{
+#if defined(_WIN32)
+    // Pagefile-backed; the commit charge is taken up front but pages only use
+    // memory once written
+    HANDLE hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize), m_Name.c_str());
+    if (!hMapping)
+    {
+        return false;
+    }
+    created = GetLastError() != ERROR_ALREADY_EXISTS;
+
+    void* pMapping = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(mappingSize));
+    if (!pMapping)
+    {
+        CloseHandle(hMapping);
+        return false;
+    }
+    m_hMapping = hMapping;
+#else
+    created = true;
+    int fd = shm_open(m_Name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST)
+    {
+        created = false;
+        fd = shm_open(m_Name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0)
+    {
+        return false;
+    }
+
+#if defined(__linux__)
+    // Writing to a tmpfs page which cannot be allocated raises SIGBUS rather than
+    // failing a call, so only create the cache when the whole database fits
+    struct statvfs fileSystemStat = {};
+    if (created && statvfs("/dev/shm", &fileSystemStat) == 0 && static_cast<uint64_t>(fileSystemStat.f_bavail) * fileSystemStat.f_frsize < mappingSize)
+    {
+        close(fd);
+        shm_unlink(m_Name.c_str());
+        return false;
+    }
+#endif
+
+    if (created && ftruncate(fd, static_cast<off_t>(mappingSize)) != 0)
+    {
+        close(fd);
+        shm_unlink(m_Name.c_str());
+        return false;
+    }
+
+    // The creator sizes the object right after creating it
+    const auto start = std::chrono::steady_clock::now();
+    struct stat objectStat = {};
+    while (fstat(fd, &objectStat) == 0 && static_cast<uint64_t>(objectStat.st_size) < mappingSize && std::chrono::steady_clock::now() - start < INIT_TIMEOUT)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (static_cast<uint64_t>(objectStat.st_size) < mappingSize)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* pMapping = mmap(nullptr, static_cast<size_t>(mappingSize), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMapping == MAP_FAILED)
+    {
+        return false;
+    }
+#endif
+
+    m_pMapping = pMapping;
+    m_MappingSize = mappingSize;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Unmap
+//------------------------------------------------------------------------------
+void SharedDatabaseCache::Unmap()
+{
+    if (m_pMapping)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_pMapping);
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+#else
+        munmap(m_pMapping, static_cast<size_t>(m_MappingSize));
+#endif
+    }
+
+    m_pMapping = nullptr;
+    m_MappingSize = 0;
+    m_pHeader = nullptr;
+    m_pChunkStates = nullptr;
+    m_pData = nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Load
+//------------------------------------------------------------------------------
+bool SharedDatabaseCache::Load(uint64_t offset, uint64_t size, const ReadFunction& read)
+{
+    if (!m_pMapping || offset > m_DatabaseSize || size > m_DatabaseSize - offset)
+    {
+        return false;
+    }
+    if (size == 0)
+    {
+        return true;
+    }
+
+    const uint64_t reading = CHUNK_READING | (m_ProcessId << 32);
+    const size_t last = static_cast<size_t>((offset + size - 1) / CHUNK_SIZE);
+    size_t chunk = static_cast<size_t>(offset / CHUNK_SIZE);
+    while (chunk <= last)
+    {
+        uint64_t state = m_pChunkStates[chunk].load(std::memory_order_acquire);
+        if (state == CHUNK_READY)
+        {
+            ++chunk;
+            continue;
+        }
+        if (state != CHUNK_EMPTY || !m_pChunkStates[chunk].compare_exchange_strong(state, reading))
+        {
+            // Look at the chunk again once its reader is done, in case it failed
+            WaitForChunk(chunk);
+            continue;
+        }
+
+        // Read the run of empty chunks which follows with the same request
+        size_t runEnd = chunk + 1;
+        for (uint64_t expected = CHUNK_EMPTY; runEnd <= last && m_pChunkStates[runEnd].compare_exchange_strong(expected, reading); expected = CHUNK_EMPTY)
+        {
+            ++runEnd;
+        }
+
+        const uint64_t runBegin = chunk * CHUNK_SIZE;
+        const uint64_t runLimit = std::min<uint64_t>(runEnd * CHUNK_SIZE, m_DatabaseSize);
+        const bool success = read(runBegin, runLimit - runBegin, m_pData + runBegin);
+        for (size_t i = chunk; i < runEnd; ++i)
+        {
+            m_pChunkStates[i].store(success ? CHUNK_READY : CHUNK_EMPTY, std::memory_order_release);
+        }
+        if (!success)
+        {
+            return false;
+        }
+
+        m_pHeader->LoadedBytes.fetch_add(runLimit - runBegin, std::memory_order_relaxed);
+        m_ChunksRead.fetch_add(runEnd - chunk, std::memory_order_relaxed);
+        chunk = runEnd;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// WaitForChunk
+//------------------------------------------------------------------------------
+void SharedDatabaseCache::WaitForChunk(size_t chunk)
+{
+    m_ChunkWaits.fetch_add(1, std::memory_order_relaxed);
+
+    auto lastCheck = std::chrono::steady_clock::now();
+    for (uint32_t spin = 0;; ++spin)
+    {
+        uint64_t state = m_pChunkStates[chunk].load(std::memory_order_acquire);
+        if (!(state & CHUNK_READING))
+        {
+            return;
+        }
+
+        // Reads are a chunk or a page, so most waits are short
+        if (spin < 64)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastCheck >= READER_CHECK_INTERVAL)
+        {
+            lastCheck = now;
+            const uint64_t readerId = state >> 32;
+            if (readerId != m_ProcessId && !IsProcessAlive(readerId) && m_pChunkStates[chunk].compare_exchange_strong(state, CHUNK_EMPTY))
+            {
+                m_ReclaimedChunks.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// GetStats
+//------------------------------------------------------------------------------
+SharedDatabaseCache::Stats SharedDatabaseCache::GetStats() const
+{
+    Stats stats = {};
+    stats.ChunksRead = m_ChunksRead;
+    stats.ChunkWaits = m_ChunkWaits;
+    stats.ReclaimedChunks = m_ReclaimedChunks;
+    if (m_pHeader)
+    {
+        stats.LoadedBytes = m_pHeader->LoadedBytes.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < MAX_PROCESSES; ++i)
+        {
+            stats.AttachedProcesses += m_pHeader->Processes[i].load(std::memory_order_relaxed) != 0 ? 1 : 0;
+        }
+    }
+    return stats;
+}
+
+} // namespace Serialization
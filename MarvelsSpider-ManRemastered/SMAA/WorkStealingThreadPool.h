@@ -0,0 +1,241 @@
+//-------------------------------------------------------------------------------
+// File: WorkStealingThreadPool.h
+//
+// Thread pool behind NvExecuteOnThreadPool.
+//-------------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// WorkStealingThreadPool
+//
+// Every worker has a deque of tasks.  Tasks run from a worker go to the back of its
+// own deque, which it takes from the back, and tasks run from any other thread go
+// to a shared injection queue.  A worker with nothing of its own takes from the
+// injection queue, then steals from the front of the other workers' deques, so a
+// burst of tasks queues up instead of waiting for idle workers.  Workers out of
+// work yield for a while and then sleep until a task is queued.
+//--------------------------------------------------------------------------------------
+class WorkStealingThreadPool
+{
+public:
+    explicit WorkStealingThreadPool(size_t threadCount)
+        : m_shutdown(false)
+        , m_vecWorkers(threadCount)
+        , m_injectionMutex()
+        , m_injected()
+        , m_queued(0)
+        , m_sleeping(0)
+        , m_steals(0)
+        , m_sleepMutex()
+        , m_cv()
+    {
+        for (size_t i = 0; i < m_vecWorkers.size(); ++i)
+        {
+            m_vecWorkers[i].reset(new PerWorker);
+        }
+        for (size_t i = 0; i < m_vecWorkers.size(); ++i)
+        {
+            m_vecWorkers[i]->m_thread = std::thread([this, i] {
+                workerLoop(i);
+            });
+        }
+    }
+
+    ~WorkStealingThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_shutdown = true;
+        }
+        m_cv.notify_all();
+
+        for (auto& spWorker : m_vecWorkers)
+        {
+            if (spWorker->m_thread.joinable())
+            {
+                spWorker->m_thread.join();
+            }
+        }
+    }
+
+    WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+    WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+
+    std::future<void> Run(std::function<void()>&& fn)
+    {
+        Task task;
+        task.m_work = std::move(fn);
+        std::future<void> future = task.m_promise.get_future();
+
+        // Without workers the caller does the work
+        if (m_vecWorkers.empty())
+        {
+            task.m_work();
+            task.m_promise.set_value();
+            return future;
+        }
+
+        // Counted before it is queued, so that a worker which sees the count and
+        // finds nothing yet only looks again
+        m_queued.fetch_add(1);
+
+        const CurrentWorker& current = getCurrentWorker();
+        if (current.pPool == this)
+        {
+            PerWorker& worker = *m_vecWorkers[current.index];
+            std::lock_guard<std::mutex> lock(worker.m_mutex);
+            worker.m_tasks.push_back(std::move(task));
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_injectionMutex);
+            m_injected.push_back(std::move(task));
+        }
+
+        // Wake a sleeper.  A worker going to sleep counts itself before checking
+        // m_queued, so either it sees the task or it is seen here.
+        if (m_sleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_cv.notify_one();
+        }
+        return future;
+    }
+
+    size_t GetThreadCount() const
+    {
+        return m_vecWorkers.size();
+    }
+
+    // Tasks taken from another worker's deque
+    uint64_t GetStealCount() const
+    {
+        return m_steals.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Yields of an idle worker before it sleeps
+    static const int IDLE_YIELDS = 64;
+
+    struct Task
+    {
+        std::function<void()> m_work;
+        std::promise<void> m_promise;
+    };
+
+    struct PerWorker
+    {
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+
+    struct CurrentWorker
+    {
+        const WorkStealingThreadPool* pPool;
+        size_t index;
+    };
+
+    static CurrentWorker& getCurrentWorker()
+    {
+        thread_local CurrentWorker t_current = { nullptr, 0 };
+        return t_current;
+    }
+
+    bool takeTask(size_t index, Task& task)
+    {
+        // Newest of our own, while its data is still in cache
+        {
+            PerWorker& worker = *m_vecWorkers[index];
+            std::lock_guard<std::mutex> lock(worker.m_mutex);
+            if (!worker.m_tasks.empty())
+            {
+                task = std::move(worker.m_tasks.back());
+                worker.m_tasks.pop_back();
+                return true;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_injectionMutex);
+            if (!m_injected.empty())
+            {
+                task = std::move(m_injected.front());
+                m_injected.pop_front();
+                return true;
+            }
+        }
+
+        // Oldest of another worker's, which is likely to spawn the most work
+        for (size_t i = 1; i < m_vecWorkers.size(); ++i)
+        {
+            PerWorker& victim = *m_vecWorkers[(index + i) % m_vecWorkers.size()];
+            std::lock_guard<std::mutex> lock(victim.m_mutex);
+            if (!victim.m_tasks.empty())
+            {
+                task = std::move(victim.m_tasks.front());
+                victim.m_tasks.pop_front();
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index)
+    {
+        getCurrentWorker() = { this, index };
+
+        int idleYields = 0;
+        while (!m_shutdown)
+        {
+            Task task;
+            if (takeTask(index, task))
+            {
+                m_queued.fetch_sub(1);
+                idleYields = 0;
+
+                // Consume work and notify the caller when done
+                task.m_work();
+                task.m_promise.set_value();
+                continue;
+            }
+
+            if (++idleYields < IDLE_YIELDS)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            idleYields = 0;
+
+            // Wait for work
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleeping.fetch_add(1);
+            m_cv.wait(lock, [this] {
+                return m_queued.load() > 0 || m_shutdown;
+            });
+            m_sleeping.fetch_sub(1);
+        }
+    }
+
+    std::atomic<bool> m_shutdown;
+    std::vector<std::unique_ptr<PerWorker>> m_vecWorkers;
+    std::mutex m_injectionMutex;
+    std::deque<Task> m_injected;
+    std::atomic<int64_t> m_queued;
+    std::atomic<int> m_sleeping;
+    std::atomic<uint64_t> m_steals;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_cv;
+};
@@ -0,0 +1,287 @@
+//--------------------------------------------------------------------------------------
+// File: BlobStore.cpp
+//
+// Content-addressed store of blobs shared by several captures.
+//--------------------------------------------------------------------------------------
+
+#include "BlobStore.h"
+
+#include "DatabaseHash.h"
+#include "DatabaseLayout.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace Serialization {
+
+namespace {
+
+const uint64_t STORE_BLOB_ALIGNMENT = 16;
+
+struct BlobStoreMapHeader
+{
+    static const uint32_t MAGIC = 0x4D44564E; // "NVDM"
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t handleCount;
+    uint64_t storeBlobCount; // Blobs in the store when the map was written
+};
+
+//------------------------------------------------------------------------------
+// SeekFile - 64-bit seek, since the store is usually larger than 2GB
+//------------------------------------------------------------------------------
+bool SeekFile(FILE* pFile, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(pFile, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(pFile, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// ReadAt
+//------------------------------------------------------------------------------
+bool ReadAt(FILE* pFile, uint64_t offset, uint64_t size, std::vector<uint8_t>& data)
+{
+    data.resize(static_cast<size_t>(size));
+    return size == 0 || (SeekFile(pFile, offset) && fread(data.data(), 1, data.size(), pFile) == data.size());
+}
+
+//------------------------------------------------------------------------------
+// ReadArrayFile - reads a file which is a flat array of T
+//------------------------------------------------------------------------------
+template <typename T>
+bool ReadArrayFile(const char* pFileName, std::vector<T>& elements)
+{
+    uint64_t fileSize = 0;
+    if (!DatabaseLayout::GetFileSize(pFileName, fileSize) || fileSize % sizeof(T) != 0)
+    {
+        return false;
+    }
+
+    elements.resize(static_cast<size_t>(fileSize / sizeof(T)));
+    if (elements.empty())
+    {
+        return true;
+    }
+
+    FILE* pFile = fopen(pFileName, "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+    const bool success = fread(elements.data(), sizeof(T), elements.size(), pFile) == elements.size();
+    fclose(pFile);
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// WriteFile
+//------------------------------------------------------------------------------
+bool WriteFile(const char* pFileName, const void* pHeader, size_t headerSize, const void* pData, size_t dataSize)
+{
+    FILE* pFile = fopen(pFileName, "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+    bool success = (headerSize == 0 || fwrite(pHeader, 1, headerSize, pFile) == headerSize)
+        && (dataSize == 0 || fwrite(pData, 1, dataSize, pFile) == dataSize);
+    success = (fclose(pFile) == 0) && success;
+    return success;
+}
+
+std::string GetHashesFileName(const char* pStoreFileName)
+{
+    return std::string(pStoreFileName) + ".hash";
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// GetBlobStoreMapFileName
+//------------------------------------------------------------------------------
+std::string GetBlobStoreMapFileName(const char* pDatabaseFileName)
+{
+    return std::string(pDatabaseFileName) + ".map";
+}
+
+//------------------------------------------------------------------------------
+// AddCaptureToBlobStore
+//------------------------------------------------------------------------------
+bool AddCaptureToBlobStore(const char* pDatabaseFileName, const char* pStoreFileName, const char* pMapFileName, BlobStoreStats& stats)
+{
+    stats = {};
+    if (!pDatabaseFileName || !pStoreFileName || !pMapFileName)
+    {
+        return false;
+    }
+
+    // The page size threshold is irrelevant here; only the blob records are used
+    DatabaseLayout layout;
+    if (layout.Load(pDatabaseFileName, UINT64_MAX) != ReadOnlyDatabase::InitResult::Ok)
+    {
+        return false;
+    }
+
+    // Load the existing store, if any.  The records and hashes must agree.
+    const std::string recordsFileName = DatabaseLayout::GetRecordsFileName(pStoreFileName);
+    const std::string hashesFileName = GetHashesFileName(pStoreFileName);
+    std::vector<DatabaseBlobRecord> storeBlobs;
+    std::vector<uint64_t> storeHashes;
+    uint64_t storeSize = 0;
+    const bool storeExists = DatabaseLayout::GetFileSize(pStoreFileName, storeSize);
+    if (storeExists && (!ReadArrayFile(recordsFileName.c_str(), storeBlobs) || !ReadArrayFile(hashesFileName.c_str(), storeHashes) || storeBlobs.size() != storeHashes.size()))
+    {
+        return false;
+    }
+
+    std::unordered_multimap<uint64_t, uint32_t> storeIndex;
+    storeIndex.reserve(storeBlobs.size() + layout.GetBlobCount());
+    for (size_t i = 0; i < storeHashes.size(); ++i)
+    {
+        storeIndex.emplace(storeHashes[i], static_cast<uint32_t>(i));
+    }
+
+    FILE* pInput = fopen(pDatabaseFileName, "rb");
+    FILE* pStore = pInput ? fopen(pStoreFileName, storeExists ? "r+b" : "w+b") : nullptr;
+    if (!pStore)
+    {
+        if (pInput)
+        {
+            fclose(pInput);
+        }
+        return false;
+    }
+
+    std::vector<uint32_t> storeHandles(layout.GetBlobCount());
+    std::vector<uint8_t> blob;
+    std::vector<uint8_t> candidate;
+    const uint8_t padding[STORE_BLOB_ALIGNMENT] = {};
+    bool success = true;
+
+    for (size_t i = 0; success && i < layout.GetBlobCount(); ++i)
+    {
+        const DatabaseBlobRecord* pBlob = layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(i)));
+        if (!ReadAt(pInput, pBlob->Offset, pBlob->Size, blob))
+        {
+            success = false;
+            break;
+        }
+
+        ++stats.Blobs;
+        stats.Bytes += pBlob->Size;
+
+        // Equal hashes are confirmed by comparing bytes
+        const uint64_t hash = HashBlob(blob.data(), blob.size());
+        bool found = false;
+        const auto range = storeIndex.equal_range(hash);
+        for (auto it = range.first; success && !found && it != range.second; ++it)
+        {
+            const DatabaseBlobRecord& storeBlob = storeBlobs[it->second];
+            if (storeBlob.Size != blob.size())
+            {
+                continue;
+            }
+            success = ReadAt(pStore, storeBlob.Offset, storeBlob.Size, candidate);
+            if (success && memcmp(candidate.data(), blob.data(), blob.size()) == 0)
+            {
+                storeHandles[i] = it->second;
+                found = true;
+            }
+        }
+        if (!success || found)
+        {
+            continue;
+        }
+
+        if (storeBlobs.size() >= static_cast<size_t>(INT32_MAX))
+        {
+            success = false;
+            break;
+        }
+
+        const uint64_t paddingSize = (STORE_BLOB_ALIGNMENT - storeSize % STORE_BLOB_ALIGNMENT) % STORE_BLOB_ALIGNMENT;
+        const DatabaseBlobRecord storeBlob = { blob.size(), storeSize + paddingSize };
+        success = SeekFile(pStore, storeSize)
+            && (paddingSize == 0 || fwrite(padding, 1, static_cast<size_t>(paddingSize), pStore) == paddingSize)
+            && (blob.empty() || fwrite(blob.data(), 1, blob.size(), pStore) == blob.size());
+        storeSize = storeBlob.Offset + storeBlob.Size;
+
+        storeHandles[i] = static_cast<uint32_t>(storeBlobs.size());
+        storeIndex.emplace(hash, storeHandles[i]);
+        storeBlobs.push_back(storeBlob);
+        storeHashes.push_back(hash);
+        ++stats.NewBlobs;
+        stats.NewBytes += storeBlob.Size;
+    }
+
+    fclose(pInput);
+    success = (fclose(pStore) == 0) && success;
+
+    // The store's records are written before the map which refers to them, so an
+    // interrupted add never leaves a map pointing past the end of the store
+    if (success)
+    {
+        const BlobStoreMapHeader header = { BlobStoreMapHeader::MAGIC, BlobStoreMapHeader::CURRENT_VERSION, storeHandles.size(), storeBlobs.size() };
+        success = WriteFile(recordsFileName.c_str(), nullptr, 0, storeBlobs.data(), storeBlobs.size() * sizeof(DatabaseBlobRecord))
+            && WriteFile(hashesFileName.c_str(), nullptr, 0, storeHashes.data(), storeHashes.size() * sizeof(uint64_t))
+            && WriteFile(pMapFileName, &header, sizeof(header), storeHandles.data(), storeHandles.size() * sizeof(uint32_t));
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// LoadBlobStoreMap
+//------------------------------------------------------------------------------
+bool LoadBlobStoreMap(const char* pMapFileName, const char* pStoreFileName, std::vector<uint32_t>& storeHandles)
+{
+    storeHandles.clear();
+
+    uint64_t fileSize = 0;
+    uint64_t recordsSize = 0;
+    BlobStoreMapHeader header = {};
+    if (!pMapFileName || !pStoreFileName
+        || !DatabaseLayout::GetFileSize(pMapFileName, fileSize)
+        || !DatabaseLayout::GetFileSize(DatabaseLayout::GetRecordsFileName(pStoreFileName).c_str(), recordsSize)
+        || fileSize < sizeof(header))
+    {
+        return false;
+    }
+
+    FILE* pFile = fopen(pMapFileName, "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bool success = fread(&header, sizeof(header), 1, pFile) == 1
+        && header.magic == BlobStoreMapHeader::MAGIC
+        && header.version == BlobStoreMapHeader::CURRENT_VERSION
+        && header.handleCount == (fileSize - sizeof(header)) / sizeof(uint32_t)
+        && header.storeBlobCount <= recordsSize / sizeof(DatabaseBlobRecord);
+
+    if (success)
+    {
+        storeHandles.resize(static_cast<size_t>(header.handleCount));
+        success = storeHandles.empty() || fread(storeHandles.data(), sizeof(uint32_t), storeHandles.size(), pFile) == storeHandles.size();
+    }
+    fclose(pFile);
+
+    for (size_t i = 0; success && i < storeHandles.size(); ++i)
+    {
+        success = storeHandles[i] < header.storeBlobCount;
+    }
+
+    if (!success)
+    {
+        storeHandles.clear();
+    }
+    return success;
+}
+
+} // namespace Serialization
@@ -155,6 +155,10 @@ void NvMessage(const char* format, Targs... fArgs)
 NV_REPLAY_EXPORT void InitializeDatabase();
 NV_REPLAY_EXPORT Serialization::ReadOnlyDatabase& GetDatabase();
 
+// The database which the replay reads blobs from.  This is GetDatabase() unless
+// another backend was selected on the command line (see DatabaseBackend.h).
+NV_REPLAY_EXPORT Serialization::IReadOnlyDatabase& GetActiveDatabase();
+
 #if !defined(DATABASE_BIN_FILE)
 #define DATABASE_BIN_FILE "data.bin"
 #endif
@@ -164,7 +168,7 @@ NV_REPLAY_EXPORT Serialization::ReadOnlyDatabase& GetDatabase();
 template <typename T, typename DataScopeTrackerType>
 T GetResources(DataScopeTrackerType& dataScopeTracker, Serialization::DATABASE_HANDLE handle)
 {
-    std::shared_ptr<Serialization::BlobProxyBase> spBlobProxy = GetDatabase().ReadShared<T>(handle);
+    std::shared_ptr<Serialization::BlobProxyBase> spBlobProxy = GetActiveDatabase().ReadShared<T>(handle);
     dataScopeTracker.AddBlobProxyToCurrentDataScope(spBlobProxy);
     return (std::static_pointer_cast<Serialization::BlobProxy<T>>(spBlobProxy))->Get();
 }
@@ -174,21 +178,21 @@ T GetResources(DataScopeTrackerType& dataScopeTracker, Serialization::DATABASE_H
 #define NV_GET_RESOURCE_CHECKED(T, handle, size) GetResources<T>(dataScopeTracker, handle)
 #define NV_GET_RESOURCE_CHECKED_NOSCOPETRACKER(T, handle, size) NV_GET_RESOURCE(T, handle)
 #else
-#define NV_GET_RESOURCE(T, handle) GetDatabase().Read<T>(handle, dataScopeTracker).Get()
-#define NV_GET_RESOURCE_NOSCOPETRACKER(T, handle) GetDatabase().Read<T>(handle).Get()
-#define NV_GET_BYTECODE(T, handle) GetDatabase().Read<T>(handle, dataScopeTracker).Get()
+#define NV_GET_RESOURCE(T, handle) GetActiveDatabase().Read<T>(handle, dataScopeTracker).Get()
+#define NV_GET_RESOURCE_NOSCOPETRACKER(T, handle) GetActiveDatabase().Read<T>(handle).Get()
+#define NV_GET_BYTECODE(T, handle) GetActiveDatabase().Read<T>(handle, dataScopeTracker).Get()
 template <typename T, typename DataScopeTrackerType>
 T GetResourceChecked(Serialization::DATABASE_HANDLE handle, size_t size, DataScopeTrackerType& dataScopeTracker)
 {
-    NV_THROW_IF(size != 0 && GetDatabase().GetSize(handle) != size, "Database size mismatch")
-    return GetDatabase().Read<T>(handle, dataScopeTracker).Get();
+    NV_THROW_IF(size != 0 && GetActiveDatabase().GetSize(handle) != size, "Database size mismatch")
+    return GetActiveDatabase().Read<T>(handle, dataScopeTracker).Get();
 }
 #define NV_GET_RESOURCE_CHECKED(T, handle, size) GetResourceChecked<T>(handle, size, dataScopeTracker)
 template <typename T>
 T GetResourceChecked_NoScopeTracker(Serialization::DATABASE_HANDLE handle, size_t size)
 {
-    NV_THROW_IF(size != 0 && GetDatabase().GetSize(handle) != size, "Database size mismatch");
-    return GetDatabase().Read<T>(handle).Get();
+    NV_THROW_IF(size != 0 && GetActiveDatabase().GetSize(handle) != size, "Database size mismatch");
+    return GetActiveDatabase().Read<T>(handle).Get();
 }
 #define NV_GET_RESOURCE_CHECKED_NOSCOPETRACKER(T, handle, size) GetResourceChecked_NoScopeTracker<T>(handle, size)
 #endif // defined(__arm__)
@@ -202,14 +206,22 @@ T GetResourceChecked_NoScopeTracker(Serialization::DATABASE_HANDLE handle, size_
 
 inline void* DoGetStaticDatabaseEntry(Serialization::DATABASE_HANDLE handle)
 {
-    const auto size = GetDatabase().GetSize(handle);
+    const auto size = GetActiveDatabase().GetSize(handle);
     if (size == 0)
     {
         return nullptr;
     }
+
+    // Backends which can pin the blob's page return it in place; otherwise it is
+    // copied so that the pointer survives the page being evicted
+    void* pinned = GetActiveDatabase().DoReadStatic(handle);
+    if (pinned)
+    {
+        return pinned;
+    }
     void* dst = malloc(size);
     NV_THROW_IF(!dst, "Failed to allocate memory for database read");
-    const void* src = GetDatabase().Read<const void*>(handle).Get();
+    const void* src = GetActiveDatabase().Read<const void*>(handle).Get();
     NV_THROW_IF(!src, "Failed to read database entry");
     memcpy(dst, src, size);
     return dst;
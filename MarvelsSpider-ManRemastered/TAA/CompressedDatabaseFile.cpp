@@ -0,0 +1,530 @@
+//--------------------------------------------------------------------------------------
+// File: CompressedDatabaseFile.cpp
+//
+// Compressed, seekable container for the pages of a database file.
+//--------------------------------------------------------------------------------------
+
+#include "CompressedDatabaseFile.h"
+
+#include "CommonReplay.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <future>
+
+#if defined(NV_USE_LZ4)
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#if defined(NV_USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Serialization {
+
+namespace {
+
+struct CompressedDatabaseHeader
+{
+    static const uint32_t MAGIC = 0x5A44564E; // "NVDZ"
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t databaseSize;
+    uint64_t pageSizeThreshold;
+    uint64_t frameCount;
+    uint64_t indexOffset;
+};
+
+//------------------------------------------------------------------------------
+// SkipInput - advance a sequentially read file without seeking, which is limited
+// to 32-bit offsets on some platforms
+//------------------------------------------------------------------------------
+bool SkipInput(FILE* pFile, uint64_t size)
+{
+    uint8_t discard[4096];
+    while (size > 0)
+    {
+        const size_t count = static_cast<size_t>(std::min<uint64_t>(size, sizeof(discard)));
+        if (fread(discard, 1, count, pFile) != count)
+        {
+            return false;
+        }
+        size -= count;
+    }
+    return true;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// CompressedDatabaseFile
+//------------------------------------------------------------------------------
+CompressedDatabaseFile::CompressedDatabaseFile()
+    : m_Frames()
+    , m_DatabaseSize()
+    , m_PageSizeThreshold()
+    , m_CompressedSize()
+#if defined(_WIN32)
+    , m_hFile(INVALID_HANDLE_VALUE)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+//------------------------------------------------------------------------------
+// ~CompressedDatabaseFile
+//------------------------------------------------------------------------------
+CompressedDatabaseFile::~CompressedDatabaseFile()
+{
+    Close();
+}
+
+//------------------------------------------------------------------------------
+// IsCodecAvailable
+//------------------------------------------------------------------------------
+bool CompressedDatabaseFile::IsCodecAvailable(CompressionCodec codec)
+{
+    switch (codec)
+    {
+    case CompressionCodec::Stored:
+        return true;
+    case CompressionCodec::Lz4:
+#if defined(NV_USE_LZ4)
+        return true;
+#else
+        return false;
+#endif
+    case CompressionCodec::Zstd:
+#if defined(NV_USE_ZSTD)
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// CodecToString
+//------------------------------------------------------------------------------
+const char* CompressedDatabaseFile::CodecToString(CompressionCodec codec)
+{
+    switch (codec)
+    {
+    case CompressionCodec::Stored:
+        return "stored";
+    case CompressionCodec::Lz4:
+        return "lz4";
+    case CompressionCodec::Zstd:
+        return "zstd";
+    }
+    return "unknown";
+}
+
+//------------------------------------------------------------------------------
+// CompressFrame - falls back to storing the frame when the codec fails or the
+// frame does not get smaller
+//------------------------------------------------------------------------------
+void CompressedDatabaseFile::CompressFrame(CompressionCodec codec, int level, const uint8_t* pSource, size_t size, std::vector<uint8_t>& compressed, CompressionCodec& usedCodec)
+{
+    switch (codec)
+    {
+#if defined(NV_USE_LZ4)
+    case CompressionCodec::Lz4:
+    {
+        compressed.resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(size))));
+        const char* pSourceChars = reinterpret_cast<const char*>(pSource);
+        char* pCompressedChars = reinterpret_cast<char*>(compressed.data());
+        const int compressedSize = level > 0
+            ? LZ4_compress_HC(pSourceChars, pCompressedChars, static_cast<int>(size), static_cast<int>(compressed.size()), level)
+            : LZ4_compress_default(pSourceChars, pCompressedChars, static_cast<int>(size), static_cast<int>(compressed.size()));
+        if (compressedSize > 0 && static_cast<size_t>(compressedSize) < size)
+        {
+            compressed.resize(static_cast<size_t>(compressedSize));
+            usedCodec = CompressionCodec::Lz4;
+            return;
+        }
+        break;
+    }
+#endif
+
+#if defined(NV_USE_ZSTD)
+    case CompressionCodec::Zstd:
+    {
+        compressed.resize(ZSTD_compressBound(size));
+        const size_t compressedSize = ZSTD_compress(compressed.data(), compressed.size(), pSource, size, level);
+        if (!ZSTD_isError(compressedSize) && compressedSize < size)
+        {
+            compressed.resize(compressedSize);
+            usedCodec = CompressionCodec::Zstd;
+            return;
+        }
+        break;
+    }
+#endif
+
+    default:
+        break;
+    }
+
+#if !defined(NV_USE_LZ4) && !defined(NV_USE_ZSTD)
+    (void)level;
+#endif
+
+    compressed.assign(pSource, pSource + size);
+    usedCodec = CompressionCodec::Stored;
+}
+
+//------------------------------------------------------------------------------
+// Write
+//------------------------------------------------------------------------------
+bool CompressedDatabaseFile::Write(const char* pDatabaseFileName, const char* pFileName, uint64_t pageSizeThreshold, CompressionCodec codec, int level)
+{
+    if (!pDatabaseFileName || !pFileName || !IsCodecAvailable(codec))
+    {
+        return false;
+    }
+
+    uint64_t databaseSize = 0;
+    DatabaseLayout layout;
+    if (!DatabaseLayout::GetFileSize(pDatabaseFileName, databaseSize) || layout.Load(pDatabaseFileName, databaseSize, pageSizeThreshold) != ReadOnlyDatabase::InitResult::Ok)
+    {
+        return false;
+    }
+
+    std::vector<Frame> frames;
+    for (size_t i = 0; i < layout.GetPageCount(); ++i)
+    {
+        const DatabasePageRecord& page = layout.GetPage(i);
+        for (uint64_t offset = 0; offset < page.PageSize; offset += FRAME_SIZE)
+        {
+            Frame frame = {};
+            frame.Offset = page.PageOffset + offset;
+            frame.Size = static_cast<uint32_t>(std::min<uint64_t>(FRAME_SIZE, page.PageSize - offset));
+            frames.push_back(frame);
+        }
+    }
+
+    FILE* pInput = fopen(pDatabaseFileName, "rb");
+    FILE* pOutput = pInput ? fopen(pFileName, "wb") : nullptr;
+    if (!pOutput)
+    {
+        if (pInput)
+        {
+            fclose(pInput);
+        }
+        return false;
+    }
+
+    // The header is rewritten once the index offset is known
+    CompressedDatabaseHeader header = { CompressedDatabaseHeader::MAGIC, CompressedDatabaseHeader::CURRENT_VERSION, databaseSize, pageSizeThreshold, frames.size(), 0 };
+    bool success = fwrite(&header, sizeof(header), 1, pOutput) == 1;
+
+    // Frames are compressed in batches; each batch is read sequentially, compressed
+    // on the thread pool and then written out in order
+    const size_t taskCount = std::max<size_t>(g_threadPoolThreadCount, 1);
+    const size_t batchSize = taskCount * 16;
+    std::vector<uint8_t> input(batchSize * FRAME_SIZE);
+    std::vector<std::vector<uint8_t>> compressed(batchSize);
+    uint64_t inputPosition = 0;
+    uint64_t outputPosition = sizeof(header);
+
+    for (size_t batchStart = 0; success && batchStart < frames.size(); batchStart += batchSize)
+    {
+        const size_t batchEnd = std::min(batchStart + batchSize, frames.size());
+        for (size_t i = batchStart; success && i < batchEnd; ++i)
+        {
+            const Frame& frame = frames[i];
+            uint8_t* pFrameInput = input.data() + (i - batchStart) * FRAME_SIZE;
+            success = SkipInput(pInput, frame.Offset - inputPosition) && fread(pFrameInput, 1, frame.Size, pInput) == frame.Size;
+            inputPosition = frame.Offset + frame.Size;
+        }
+        if (!success)
+        {
+            break;
+        }
+
+        std::atomic<size_t> nextFrame(batchStart);
+        auto compressFrames = [&]() {
+            for (size_t i = nextFrame++; i < batchEnd; i = nextFrame++)
+            {
+                const uint8_t* pFrameInput = input.data() + (i - batchStart) * FRAME_SIZE;
+                CompressFrame(codec, level, pFrameInput, frames[i].Size, compressed[i - batchStart], frames[i].Codec);
+            }
+        };
+
+        if (g_threadPoolThreadCount > 0)
+        {
+            std::vector<std::future<void>> tasks;
+            for (size_t i = 0; i < taskCount; ++i)
+            {
+                tasks.push_back(NvExecuteOnThreadPool(compressFrames));
+            }
+            for (auto& task : tasks)
+            {
+                task.wait();
+            }
+        }
+        else
+        {
+            compressFrames();
+        }
+
+        for (size_t i = batchStart; success && i < batchEnd; ++i)
+        {
+            const std::vector<uint8_t>& frameOutput = compressed[i - batchStart];
+            frames[i].CompressedOffset = outputPosition;
+            frames[i].CompressedSize = static_cast<uint32_t>(frameOutput.size());
+            success = fwrite(frameOutput.data(), 1, frameOutput.size(), pOutput) == frameOutput.size();
+            outputPosition += frameOutput.size();
+        }
+    }
+
+    header.indexOffset = outputPosition;
+    if (success && !frames.empty())
+    {
+        success = fwrite(frames.data(), sizeof(Frame), frames.size(), pOutput) == frames.size();
+    }
+    if (success)
+    {
+        success = fseek(pOutput, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, pOutput) == 1;
+    }
+
+    fclose(pInput);
+    success = (fclose(pOutput) == 0) && success;
+    if (!success)
+    {
+        remove(pFileName);
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// Open
+//------------------------------------------------------------------------------
+bool CompressedDatabaseFile::Open(const char* pFileName)
+{
+    Close();
+
+    uint64_t fileSize = 0;
+    if (!pFileName || !DatabaseLayout::GetFileSize(pFileName, fileSize))
+    {
+        return false;
+    }
+
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_hFile = hFile;
+#else
+    m_fd = open(pFileName, O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+#endif
+
+    CompressedDatabaseHeader header = {};
+    bool success = fileSize >= sizeof(header)
+        && ReadFromFile(0, sizeof(header), reinterpret_cast<uint8_t*>(&header))
+        && header.magic == CompressedDatabaseHeader::MAGIC
+        && header.version == CompressedDatabaseHeader::CURRENT_VERSION
+        && header.indexOffset <= fileSize
+        && header.frameCount <= (fileSize - header.indexOffset) / sizeof(Frame);
+
+    if (success)
+    {
+        m_Frames.resize(static_cast<size_t>(header.frameCount));
+        success = ReadFromFile(header.indexOffset, header.frameCount * sizeof(Frame), reinterpret_cast<uint8_t*>(m_Frames.data()));
+    }
+
+    // Validate the index so that reads never need to
+    for (size_t i = 0; success && i < m_Frames.size(); ++i)
+    {
+        const Frame& frame = m_Frames[i];
+        success = frame.Size > 0 && frame.Size <= FRAME_SIZE
+            && frame.Offset <= header.databaseSize && frame.Size <= header.databaseSize - frame.Offset
+            && frame.CompressedOffset <= header.indexOffset && frame.CompressedSize <= header.indexOffset - frame.CompressedOffset
+            && (i == 0 || frame.Offset >= m_Frames[i - 1].Offset + m_Frames[i - 1].Size);
+
+        if (success && !IsCodecAvailable(frame.Codec))
+        {
+            NV_MESSAGE("'%s' uses the %s codec, which this build does not support", pFileName, CodecToString(frame.Codec));
+            success = false;
+        }
+    }
+
+    if (!success)
+    {
+        Close();
+        return false;
+    }
+
+    m_DatabaseSize = header.databaseSize;
+    m_PageSizeThreshold = header.pageSizeThreshold;
+    m_CompressedSize = fileSize;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Close
+//------------------------------------------------------------------------------
+void CompressedDatabaseFile::Close()
+{
+#if defined(_WIN32)
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+
+    m_Frames.clear();
+    m_DatabaseSize = 0;
+    m_PageSizeThreshold = 0;
+    m_CompressedSize = 0;
+}
+
+//------------------------------------------------------------------------------
+// ReadFromFile - positional read, safe to call from several threads at once
+//------------------------------------------------------------------------------
+bool CompressedDatabaseFile::ReadFromFile(uint64_t offset, uint64_t size, uint8_t* pDestination) const
+{
+    while (size > 0)
+    {
+#if defined(_WIN32)
+        const DWORD chunkSize = static_cast<DWORD>(std::min<uint64_t>(size, 1u << 30));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD bytesRead = 0;
+        if (!ReadFile(m_hFile, pDestination, chunkSize, &bytesRead, &overlapped) || bytesRead == 0)
+        {
+            return false;
+        }
+#else
+        const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(size, 1u << 30));
+        const ssize_t bytesRead = pread(m_fd, pDestination, chunkSize, static_cast<off_t>(offset));
+        if (bytesRead <= 0)
+        {
+            return false;
+        }
+#endif
+
+        offset += static_cast<uint64_t>(bytesRead);
+        size -= static_cast<uint64_t>(bytesRead);
+        pDestination += bytesRead;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// DecompressFrame - pDestination receives the whole frame
+//------------------------------------------------------------------------------
+bool CompressedDatabaseFile::DecompressFrame(const Frame& frame, uint8_t* pDestination) const
+{
+    if (frame.Codec == CompressionCodec::Stored)
+    {
+        return frame.CompressedSize == frame.Size && ReadFromFile(frame.CompressedOffset, frame.Size, pDestination);
+    }
+
+    static thread_local std::vector<uint8_t> t_compressed;
+    t_compressed.resize(frame.CompressedSize);
+    if (!ReadFromFile(frame.CompressedOffset, frame.CompressedSize, t_compressed.data()))
+    {
+        return false;
+    }
+
+    switch (frame.Codec)
+    {
+#if defined(NV_USE_LZ4)
+    case CompressionCodec::Lz4:
+        return LZ4_decompress_safe(reinterpret_cast<const char*>(t_compressed.data()), reinterpret_cast<char*>(pDestination), static_cast<int>(frame.CompressedSize), static_cast<int>(frame.Size)) == static_cast<int>(frame.Size);
+#endif
+
+#if defined(NV_USE_ZSTD)
+    case CompressionCodec::Zstd:
+        return ZSTD_decompress(pDestination, frame.Size, t_compressed.data(), frame.CompressedSize) == frame.Size;
+#endif
+
+    default:
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Read
+//------------------------------------------------------------------------------
+bool CompressedDatabaseFile::Read(uint64_t offset, uint64_t size, uint8_t* pDestination) const
+{
+    auto it = std::upper_bound(m_Frames.begin(), m_Frames.end(), offset, [](uint64_t value, const Frame& frame) {
+        return value < frame.Offset;
+    });
+    if (it == m_Frames.begin())
+    {
+        return size == 0;
+    }
+    --it;
+
+    static thread_local std::vector<uint8_t> t_frame;
+    while (size > 0)
+    {
+        if (it == m_Frames.end() || offset < it->Offset || offset >= it->Offset + it->Size)
+        {
+            return false;
+        }
+
+        // Whole frames are decompressed in place; partial ones through a copy
+        const uint64_t frameBegin = offset - it->Offset;
+        const uint64_t count = std::min<uint64_t>(size, it->Size - frameBegin);
+        if (frameBegin == 0 && count == it->Size)
+        {
+            if (!DecompressFrame(*it, pDestination))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            t_frame.resize(it->Size);
+            if (!DecompressFrame(*it, t_frame.data()))
+            {
+                return false;
+            }
+            memcpy(pDestination, t_frame.data() + frameBegin, static_cast<size_t>(count));
+        }
+
+        offset += count;
+        size -= count;
+        pDestination += count;
+        ++it;
+    }
+
+    return true;
+}
+
+} // namespace Serialization
@@ -0,0 +1,167 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseChecksums.h
+//
+// Checksums of the blobs of a database file, kept in a sidecar file.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DatabaseLayout.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// Crc32c - CRC-32C (Castagnoli) of a buffer, continuing from crc, which is zero
+// for the first buffer.  Uses the SSE4.2 or ARMv8 CRC instructions when the CPU
+// has them, over three interleaved streams to hide their latency.
+//------------------------------------------------------------------------------
+uint32_t Crc32c(uint32_t crc, const void* pData, size_t size);
+bool IsCrc32cHardwareAccelerated();
+
+// Crc32 - CRC-32 as zip archives record it, continuing from crc.  Software only;
+// it checks whole archive entries offline.
+uint32_t Crc32(uint32_t crc, const void* pData, size_t size);
+
+//----------------------------------------------------------------------------------
+// DatabaseChecksums
+//
+// A CRC-32C per block of the blobs listed in a records file, checked as the blobs
+// are read so that a truncated or corrupt database file is caught when the damaged
+// bytes are loaded rather than by what the replay does with them.
+//
+// - Blocks are the blobs of the records file, split from the start of each blob
+//   into BLOCK_SIZE pieces, so that a large blob is hashed in parallel.  Blocks do
+//   not depend on the page size threshold, so one sidecar serves every backend
+//   setting.
+// - The sidecar (<database>.sum) holds the checksums, the hash of the records file
+//   they were computed for, and the identity (see DatabaseLayout::GetFileIdentity)
+//   of the file the last complete verification passed on.  A file whose identity
+//   matches the sidecar's has been verified already and is not checked again.
+// - The checksums are reference values, written when the capture is packaged by
+//   DatabaseChecksumTool from a copy of the database known to be good, such as
+//   the entry of data.zip once it matches the CRC the archive records.  The replay
+//   never computes them from the file it is checking, so a missing sidecar, or one
+//   written for other records, leaves the file unverified.
+// - Each block is checked once, the first time a read covers it.  Later reads of
+//   the same bytes after an eviction are not hashed again.
+//----------------------------------------------------------------------------------
+class DatabaseChecksums
+{
+public:
+    // Largest block
+    static constexpr uint64_t BLOCK_SIZE = 1 << 20;
+
+    // Reads size bytes at offset of the database into pDestination
+    using ReadFunction = std::function<bool(uint64_t offset, uint64_t size, uint8_t* pDestination)>;
+
+    enum class LoadResult
+    {
+        Loaded,
+        Missing,
+        Stale, // Written for other records, or unreadable
+    };
+
+    struct Stats
+    {
+        uint64_t VerifiedBlocks; // Blocks checked, passed or not
+        uint64_t VerifiedBytes;
+        uint64_t FailedBlocks; // Blocks which did not match their checksum
+        uint64_t HashNanoseconds; // Time spent computing checksums
+    };
+
+    DatabaseChecksums();
+
+    //------------------------------------------------------------------------------
+    // Init - Divides the blobs of layout into blocks.  pFileName is the database
+    // file, whose name the sidecar is derived from and which messages refer to.
+    //------------------------------------------------------------------------------
+    void Init(const char* pFileName, const DatabaseLayout& layout, uint64_t databaseSize);
+
+    // Loads the sidecar's checksums for the blocks from Init
+    LoadResult Load();
+
+    //------------------------------------------------------------------------------
+    // Compute - Computes every checksum from a trusted copy of the database, reading
+    // runs of blocks in parallel on the thread pool.  Must be called from the thread
+    // which submits work to the thread pool.
+    //------------------------------------------------------------------------------
+    bool Compute(const ReadFunction& read);
+
+    // Writes the sidecar, recording that the file with verifiedIdentity matches it;
+    // an identity of zeros records no verification
+    bool Save(const uint64_t (&verifiedIdentity)[4]) const;
+
+    // Whether the sidecar records a verification of the file with this identity
+    bool IsVerified(const uint64_t (&identity)[4]) const;
+
+    //------------------------------------------------------------------------------
+    // Verify - Checks the blocks lying entirely within [offset, offset + size) of the
+    // database, whose bytes are at pData, which have not been checked yet.  Reports
+    // and returns false on a mismatch.  Safe to call from several threads at once.
+    //------------------------------------------------------------------------------
+    bool Verify(uint64_t offset, uint64_t size, const uint8_t* pData);
+
+    // Whether every block has been checked and passed
+    bool IsComplete() const;
+
+    size_t GetBlockCount() const
+    {
+        return m_Blocks.size();
+    }
+
+    const std::string& GetFileName() const
+    {
+        return m_SidecarFileName;
+    }
+
+    Stats GetStats() const;
+
+    // Name of the sidecar which accompanies a database file
+    static std::string GetSidecarFileName(const char* pFileName);
+
+private:
+    struct Block
+    {
+        uint64_t Offset;
+        uint32_t Size;
+        uint32_t BlobIndex; // First blob the block belongs to, for messages
+    };
+
+    // This class is non-copyable
+    DatabaseChecksums(const DatabaseChecksums&) = delete;
+    DatabaseChecksums& operator=(const DatabaseChecksums&) = delete;
+
+    // Marks a block checked, returning false if another thread already has
+    bool MarkVerified(size_t block)
+    {
+        const uint64_t bit = uint64_t(1) << (block % 64);
+        return (m_Verified[block / 64].fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+    }
+
+    std::string m_DatabaseFileName;
+    std::string m_SidecarFileName;
+    uint64_t m_DatabaseSize;
+    uint64_t m_RecordsHash;
+    uint64_t m_VerifiedIdentity[4];
+
+    std::vector<Block> m_Blocks; // Sorted by offset; blobs stored at the same offset share blocks
+    std::vector<uint32_t> m_Checksums; // Indexed like m_Blocks
+
+    // Bit per block, set once it has been checked
+    std::unique_ptr<std::atomic<uint64_t>[]> m_Verified;
+
+    std::atomic<uint64_t> m_VerifiedBlocks;
+    std::atomic<uint64_t> m_VerifiedBytes;
+    std::atomic<uint64_t> m_FailedBlocks;
+    std::atomic<uint64_t> m_HashNanoseconds;
+};
+
+} // namespace Serialization
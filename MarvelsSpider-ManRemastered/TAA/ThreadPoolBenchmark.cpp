@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// File: ThreadPoolBenchmark.cpp
+//
+// Throughput and latency of fine-grained tasks on the work-stealing thread pool.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "WorkStealingThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Tasks per throughput run, where a fan-out run has FAN_OUT_ROOTS tasks which each
+// run the rest of their share from a worker, and tasks waited for one at a time
+// to time the round trip through the pool
+constexpr size_t TASK_COUNT = 1 << 17;
+constexpr size_t FAN_OUT_ROOTS = 64;
+constexpr size_t ROUND_TRIP_COUNT = 20000;
+constexpr size_t THREAD_COUNTS[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+// Rounds of the work done by each task, a few hundred nanoseconds
+constexpr uint32_t TASK_ROUNDS = 256;
+
+std::atomic<uint64_t> s_sink(0);
+
+void DoTaskWork(uint64_t seed)
+{
+    uint64_t x = seed | 1;
+    for (uint32_t i = 0; i < TASK_ROUNDS; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    s_sink.fetch_add(x & 1, std::memory_order_relaxed);
+}
+
+uint64_t GetNanoseconds(Clock::time_point start, Clock::time_point end)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+//------------------------------------------------------------------------------
+// RunBurst - the caller runs every task through the injection queue and waits
+// for their futures, as the replay does, and returns the tasks per second
+//------------------------------------------------------------------------------
+double RunBurst(WorkStealingThreadPool& pool)
+{
+    std::vector<std::future<void>> futures;
+    futures.reserve(TASK_COUNT);
+
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < TASK_COUNT; ++i)
+    {
+        futures.push_back(pool.Run([i]() {
+            DoTaskWork(i);
+        }));
+    }
+    for (auto& future : futures)
+    {
+        future.wait();
+    }
+    return TASK_COUNT / (GetNanoseconds(start, Clock::now()) / 1.0e9);
+}
+
+//------------------------------------------------------------------------------
+// RunFanOut - a few tasks run the rest from the workers, which queues them on
+// the workers' own deques for the others to steal, and returns the tasks per
+// second
+//------------------------------------------------------------------------------
+double RunFanOut(WorkStealingThreadPool& pool)
+{
+    const size_t childrenPerRoot = TASK_COUNT / FAN_OUT_ROOTS - 1;
+    std::atomic<size_t> remaining(TASK_COUNT);
+
+    const Clock::time_point start = Clock::now();
+    for (size_t root = 0; root < FAN_OUT_ROOTS; ++root)
+    {
+        pool.Run([&pool, &remaining, root, childrenPerRoot]() {
+            for (size_t child = 1; child <= childrenPerRoot; ++child)
+            {
+                pool.Run([&remaining, child]() {
+                    DoTaskWork(child);
+                    remaining.fetch_sub(1);
+                });
+            }
+            DoTaskWork(root);
+            remaining.fetch_sub(1);
+        });
+    }
+    while (remaining.load() > 0)
+    {
+        std::this_thread::yield();
+    }
+    return TASK_COUNT / (GetNanoseconds(start, Clock::now()) / 1.0e9);
+}
+
+struct Latencies
+{
+    double P50Microseconds;
+    double P99Microseconds;
+    double P999Microseconds;
+    double MaxMicroseconds;
+};
+
+//------------------------------------------------------------------------------
+// RunRoundTrips - runs tasks one at a time and times each from the Run call to
+// its future becoming ready, which includes waking a worker that went to sleep
+//------------------------------------------------------------------------------
+Latencies RunRoundTrips(WorkStealingThreadPool& pool)
+{
+    std::vector<uint64_t> roundTrips(ROUND_TRIP_COUNT);
+    for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i)
+    {
+        const Clock::time_point start = Clock::now();
+        pool.Run([i]() {
+            DoTaskWork(i);
+        }).wait();
+        roundTrips[i] = GetNanoseconds(start, Clock::now());
+    }
+
+    std::sort(roundTrips.begin(), roundTrips.end());
+    auto percentile = [&](double fraction) {
+        return roundTrips[std::min(roundTrips.size() - 1, static_cast<size_t>(fraction * roundTrips.size()))] / 1000.0;
+    };
+    return { percentile(0.5), percentile(0.99), percentile(0.999), roundTrips.back() / 1000.0 };
+}
+
+//------------------------------------------------------------------------------
+// RunThreadPoolBenchmark
+//------------------------------------------------------------------------------
+void RunThreadPoolBenchmark()
+{
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < TASK_COUNT; ++i)
+    {
+        DoTaskWork(i);
+    }
+    const double taskNanoseconds = GetNanoseconds(start, Clock::now()) / static_cast<double>(TASK_COUNT);
+
+    NV_MESSAGE("Thread pool benchmark: %zu tasks of %.0f ns per throughput run and %zu round trips on %u hardware threads",
+        TASK_COUNT, taskNanoseconds, ROUND_TRIP_COUNT, std::thread::hardware_concurrency());
+    NV_MESSAGE("%8s %12s %12s %10s | %13s %9s %9s %9s",
+        "threads", "burst M/s", "fan-out M/s", "steals", "round trip us", "p99", "p99.9", "max");
+
+    for (const size_t threadCount : THREAD_COUNTS)
+    {
+        WorkStealingThreadPool pool(threadCount);
+        const double burst = RunBurst(pool);
+        const double fanOut = RunFanOut(pool);
+        const Latencies roundTrips = RunRoundTrips(pool);
+        NV_MESSAGE("%8zu %12.2f %12.2f %10llu | %13.1f %9.1f %9.1f %9.1f",
+            threadCount,
+            burst / 1.0e6,
+            fanOut / 1.0e6,
+            static_cast<unsigned long long>(pool.GetStealCount()),
+            roundTrips.P50Microseconds,
+            roundTrips.P99Microseconds,
+            roundTrips.P999Microseconds,
+            roundTrips.MaxMicroseconds);
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Times throughput and latency of fine-grained tasks on the thread pool with 1 to 64 threads", []() {
+        RunThreadPoolBenchmark();
+        return true;
+    });
+}
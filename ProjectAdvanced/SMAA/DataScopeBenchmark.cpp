@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// File: DataScopeBenchmark.cpp
+//
+// Microbenchmark of the per-call cost of data scopes in small helpers.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DataScopeArena.h"
+#include "DatabaseBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Descriptors written per pass, and calls made per measurement so that each runs
+// long enough to time
+constexpr size_t DESCRIPTOR_COUNT = 4096;
+constexpr size_t MIN_CALLS = 20000000;
+
+// Shaped like D3D12_CONSTANT_BUFFER_VIEW_DESC
+struct Descriptor
+{
+    uint64_t BufferLocation;
+    uint32_t SizeInBytes;
+};
+
+// The descriptor writers of D3D12Replay.h, in a namespace per way of opening their
+// scopes.  AlignedWriteAndIncrement opens four nested scopes per call.
+#define NV_DEFINE_DESCRIPTOR_HELPERS(NAMESPACE, BEGIN_SCOPE)                 \
+    namespace NAMESPACE {                                                    \
+    template <typename T_Struct, typename T_Ptr>                             \
+    void WriteAndIncrement(T_Ptr& inout, const T_Struct& value)              \
+    {                                                                        \
+        BEGIN_SCOPE;                                                         \
+        *(T_Struct*)inout = value;                                           \
+        inout = T_Ptr((T_Struct*)inout + 1);                                 \
+    }                                                                        \
+    template <typename T_Ptr>                                                \
+    void AlignToSize(T_Ptr& inout, size_t alignment)                         \
+    {                                                                        \
+        BEGIN_SCOPE;                                                         \
+        auto mask = alignment - 1;                                           \
+        inout = (T_Ptr)((uintptr_t(inout) + mask) & ~mask);                  \
+    }                                                                        \
+    template <typename T_AlignStruct, typename T_Ptr>                        \
+    void AlignToStruct(T_Ptr& inout)                                         \
+    {                                                                        \
+        BEGIN_SCOPE;                                                         \
+        AlignToSize(inout, sizeof(T_AlignStruct));                           \
+    }                                                                        \
+    template <typename T_AlignStruct, typename T_Ptr>                        \
+    void AlignedWriteAndIncrement(T_Ptr& inout, const T_AlignStruct&& value) \
+    {                                                                        \
+        BEGIN_SCOPE;                                                         \
+        AlignToStruct<T_AlignStruct>(inout);                                 \
+        WriteAndIncrement(inout, value);                                     \
+    }                                                                        \
+    }
+
+NV_DEFINE_DESCRIPTOR_HELPERS(Unscoped, (void)0)
+NV_DEFINE_DESCRIPTOR_HELPERS(Scoped, BEGIN_DATA_SCOPE_FUNCTION())
+NV_DEFINE_DESCRIPTOR_HELPERS(NoScope, BEGIN_NO_DATA_SCOPE_FUNCTION())
+
+#undef NV_DEFINE_DESCRIPTOR_HELPERS
+
+//------------------------------------------------------------------------------
+// MeasureNanosecondsPerCall - fills the descriptors with write until at least
+// MIN_CALLS have been made, and returns the mean time of one call
+//------------------------------------------------------------------------------
+template <typename Write>
+double MeasureNanosecondsPerCall(std::vector<Descriptor>& descriptors, Write write)
+{
+    const size_t passes = std::max<size_t>(MIN_CALLS / DESCRIPTOR_COUNT, 1);
+
+    // The sum keeps the writes from being optimized away
+    uint64_t checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < passes; ++pass)
+    {
+        uint8_t* pDescriptor = reinterpret_cast<uint8_t*>(descriptors.data());
+        for (size_t i = 0; i < DESCRIPTOR_COUNT; ++i)
+        {
+            write(pDescriptor, Descriptor{ pass * DESCRIPTOR_COUNT + i, 256 });
+        }
+        checksum += descriptors[pass % DESCRIPTOR_COUNT].BufferLocation;
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    static volatile uint64_t s_sink = 0;
+    s_sink = s_sink + checksum;
+    return elapsed / static_cast<double>(passes * DESCRIPTOR_COUNT);
+}
+
+//------------------------------------------------------------------------------
+// MeasureSpilledScopeNanoseconds - fills the page lists of nested scopes the way
+// a DataScope spills them, and returns the mean time of one scope
+//------------------------------------------------------------------------------
+template <typename Allocator>
+double MeasureSpilledScopeNanoseconds(size_t depth, size_t pagesPerScope)
+{
+    const size_t scopes = MIN_CALLS / 10;
+
+    uint64_t checksum = 0;
+    std::function<void(size_t)> scope;
+    scope = [&](size_t level) {
+        std::vector<void*, Allocator> pages;
+        for (size_t page = 0; page < pagesPerScope; ++page)
+        {
+            pages.push_back(reinterpret_cast<void*>(level * pagesPerScope + page + 1));
+        }
+        if (level + 1 < depth)
+        {
+            scope(level + 1);
+        }
+        checksum += reinterpret_cast<uintptr_t>(pages.back());
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scopes; i += depth)
+    {
+        scope(0);
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    static volatile uint64_t s_sink = 0;
+    s_sink = s_sink + checksum;
+    return elapsed / static_cast<double>(scopes);
+}
+
+//------------------------------------------------------------------------------
+// RunDataScopeBenchmark
+//------------------------------------------------------------------------------
+void RunDataScopeBenchmark()
+{
+    using namespace Serialization;
+
+    std::vector<Descriptor> descriptors(DESCRIPTOR_COUNT);
+
+    NV_MESSAGE("Data scope benchmark: %zu descriptors written per pass, ns per helper call", DESCRIPTOR_COUNT);
+    NV_MESSAGE("%-26s %12s %14s %14s", "helper", "no scope", "data scope", "no-data scope");
+
+    const double writeTimes[] = {
+        MeasureNanosecondsPerCall(descriptors, [](uint8_t*& p, const Descriptor& value) { Unscoped::WriteAndIncrement(p, value); }),
+        MeasureNanosecondsPerCall(descriptors, [](uint8_t*& p, const Descriptor& value) { Scoped::WriteAndIncrement(p, value); }),
+        MeasureNanosecondsPerCall(descriptors, [](uint8_t*& p, const Descriptor& value) { NoScope::WriteAndIncrement(p, value); }),
+    };
+    NV_MESSAGE("%-26s %12.2f %14.2f %14.2f", "WriteAndIncrement", writeTimes[0], writeTimes[1], writeTimes[2]);
+
+    const double alignedWriteTimes[] = {
+        MeasureNanosecondsPerCall(descriptors, [](uint8_t*& p, const Descriptor& value) { Unscoped::AlignedWriteAndIncrement(p, Descriptor(value)); }),
+        MeasureNanosecondsPerCall(descriptors, [](uint8_t*& p, const Descriptor& value) { Scoped::AlignedWriteAndIncrement(p, Descriptor(value)); }),
+        MeasureNanosecondsPerCall(descriptors, [](uint8_t*& p, const Descriptor& value) { NoScope::AlignedWriteAndIncrement(p, Descriptor(value)); }),
+    };
+    NV_MESSAGE("%-26s %12.2f %14.2f %14.2f", "AlignedWriteAndIncrement", alignedWriteTimes[0], alignedWriteTimes[1], alignedWriteTimes[2]);
+
+    // Page lists past the inline slots of a DataScope, from the heap and from the
+    // arena, warmed up once so that only steady-state allocations are counted
+    NV_MESSAGE("Spilled page lists, ns per scope, heap allocations by the arena after warm-up");
+    NV_MESSAGE("%-26s %12s %14s %14s", "nesting", "heap", "arena", "allocations");
+    const size_t shapes[][2] = { { 1, 3 }, { 4, 4 }, { 8, 16 } };
+    for (const auto& shape : shapes)
+    {
+        MeasureSpilledScopeNanoseconds<DataScopeArenaAllocator<void*>>(shape[0], shape[1]);
+
+        DataScopeArenaStats before;
+        GetDataScopeArenaStats(before);
+        const double heapTime = MeasureSpilledScopeNanoseconds<std::allocator<void*>>(shape[0], shape[1]);
+        const double arenaTime = MeasureSpilledScopeNanoseconds<DataScopeArenaAllocator<void*>>(shape[0], shape[1]);
+        DataScopeArenaStats after;
+        GetDataScopeArenaStats(after);
+
+        char name[64] = {};
+        snprintf(name, sizeof(name), "%zu deep, %zu pages each", shape[0], shape[1]);
+        NV_MESSAGE("%-26s %12.2f %14.2f %14llu", name, heapTime, arenaTime,
+            static_cast<unsigned long long>(after.ChunkAllocations - before.ChunkAllocations));
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Times the descriptor writers of D3D12Replay.h with no scope, with a data scope and with a no-data scope, and spilled page lists from the heap and from the arena", []() {
+        RunDataScopeBenchmark();
+        return true;
+    });
+}
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// File: DatabasePhase.cpp
+//
+// The part of the replay which is reading from the database.
+//--------------------------------------------------------------------------------------
+
+#include "DatabasePhase.h"
+
+#include <atomic>
+
+namespace Serialization {
+
+namespace {
+
+#if defined(NV_REPLAY_LIB_SHARED)
+thread_local DatabasePhase t_phase = DatabasePhase::ResourceInit;
+thread_local uint32_t t_framePart = DATABASE_FRAME_PART_NONE;
+#endif
+
+// Frames started by the frame loop so far
+std::atomic<uint64_t> s_frameCount(0);
+
+} // namespace
+
+#if defined(NV_REPLAY_LIB_SHARED)
+//------------------------------------------------------------------------------
+// GetDatabasePhase
+//------------------------------------------------------------------------------
+DatabasePhase GetDatabasePhase()
+{
+    return t_phase;
+}
+
+//------------------------------------------------------------------------------
+// SetDatabasePhase
+//------------------------------------------------------------------------------
+void SetDatabasePhase(DatabasePhase phase)
+{
+    t_phase = phase;
+}
+
+//------------------------------------------------------------------------------
+// GetDatabaseFramePart
+//------------------------------------------------------------------------------
+uint32_t GetDatabaseFramePart()
+{
+    return t_framePart;
+}
+
+//------------------------------------------------------------------------------
+// SetDatabaseFramePart
+//------------------------------------------------------------------------------
+void SetDatabaseFramePart(uint32_t part)
+{
+    t_framePart = part;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// BeginDatabaseFrame
+//------------------------------------------------------------------------------
+void BeginDatabaseFrame()
+{
+    s_frameCount.fetch_add(1);
+}
+
+//------------------------------------------------------------------------------
+// GetDatabaseFrameCount
+//------------------------------------------------------------------------------
+uint64_t GetDatabaseFrameCount()
+{
+    return s_frameCount.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// DatabasePhaseToString
+//------------------------------------------------------------------------------
+const char* DatabasePhaseToString(DatabasePhase phase)
+{
+    switch (phase)
+    {
+    case DatabasePhase::ResourceInit:
+        return "resource init";
+    case DatabasePhase::FrameSetup:
+        return "frame setup";
+    case DatabasePhase::Frame:
+        return "frame";
+    case DatabasePhase::FrameReset:
+        return "frame reset";
+    case DatabasePhase::COUNT:
+        break;
+    }
+    return "unknown";
+}
+
+} // namespace Serialization
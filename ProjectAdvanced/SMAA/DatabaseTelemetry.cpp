@@ -0,0 +1,289 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseTelemetry.cpp
+//
+// Counters of database activity by the part of the replay which caused it.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseTelemetry.h"
+
+#include "CommonReplay.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+namespace {
+
+const size_t COUNTER_COUNT = static_cast<size_t>(DatabaseCounter::COUNT);
+
+//------------------------------------------------------------------------------
+// ThreadCounters - written only by the thread which owns them, with plain loads
+// and stores, and read by any thread summing them
+//------------------------------------------------------------------------------
+struct ThreadCounters
+{
+    std::atomic<uint64_t> Counters[DATABASE_TELEMETRY_ROW_COUNT][COUNTER_COUNT];
+    std::atomic<uint64_t> MissHistogram[DATABASE_TELEMETRY_ROW_COUNT][DATABASE_MISS_HISTOGRAM_BUCKETS];
+};
+
+bool s_enabled = false;
+
+thread_local ThreadCounters* t_pCounters = nullptr;
+thread_local bool t_prefetching = false;
+
+// Every thread's counters, kept after the thread exits
+std::mutex& GetThreadsMutex()
+{
+    static std::mutex s_mutex;
+    return s_mutex;
+}
+
+std::vector<std::unique_ptr<ThreadCounters>>& GetThreads()
+{
+    static std::vector<std::unique_ptr<ThreadCounters>> s_threads;
+    return s_threads;
+}
+
+ThreadCounters& GetThreadCounters()
+{
+    if (!t_pCounters)
+    {
+        std::unique_ptr<ThreadCounters> spCounters(new ThreadCounters());
+        t_pCounters = spCounters.get();
+
+        std::lock_guard<std::mutex> lock(GetThreadsMutex());
+        GetThreads().push_back(std::move(spCounters));
+    }
+    return *t_pCounters;
+}
+
+size_t GetRow()
+{
+    return t_prefetching ? DATABASE_TELEMETRY_PREFETCH_ROW : static_cast<size_t>(GetDatabasePhase());
+}
+
+void Add(std::atomic<uint64_t>& counter, uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+size_t GetMissBucket(uint64_t nanoseconds)
+{
+    uint64_t microseconds = nanoseconds / 1000;
+    size_t bucket = 0;
+    while (microseconds > 0 && bucket + 1 < DATABASE_MISS_HISTOGRAM_BUCKETS)
+    {
+        microseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+// Upper bound of a bucket in microseconds
+uint64_t GetMissBucketLimit(size_t bucket)
+{
+    return uint64_t(1) << bucket;
+}
+
+const char* GetRowName(size_t row)
+{
+    switch (row)
+    {
+    case static_cast<size_t>(DatabasePhase::ResourceInit):
+        return "resource init";
+    case static_cast<size_t>(DatabasePhase::FrameSetup):
+        return "frame setup";
+    case static_cast<size_t>(DatabasePhase::Frame):
+        return "frames (SUBMIT)";
+    case static_cast<size_t>(DatabasePhase::FrameReset):
+        return "frame resets (RESET)";
+    case DATABASE_TELEMETRY_PREFETCH_ROW:
+        return "prefetch";
+    }
+    return "unknown";
+}
+
+//------------------------------------------------------------------------------
+// GetMissPercentile - upper bound in microseconds of the bucket holding the
+// given fraction of the misses of a row
+//------------------------------------------------------------------------------
+uint64_t GetMissPercentile(const uint64_t (&histogram)[DATABASE_MISS_HISTOGRAM_BUCKETS], uint64_t misses, double fraction)
+{
+    const uint64_t target = static_cast<uint64_t>(misses * fraction + 0.5);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < DATABASE_MISS_HISTOGRAM_BUCKETS; ++bucket)
+    {
+        seen += histogram[bucket];
+        if (seen >= target && seen > 0)
+        {
+            return GetMissBucketLimit(bucket);
+        }
+    }
+    return GetMissBucketLimit(DATABASE_MISS_HISTOGRAM_BUCKETS - 1);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// EnableDatabaseTelemetry
+//------------------------------------------------------------------------------
+void EnableDatabaseTelemetry(bool enable)
+{
+    s_enabled = enable;
+}
+
+//------------------------------------------------------------------------------
+// IsDatabaseTelemetryEnabled
+//------------------------------------------------------------------------------
+bool IsDatabaseTelemetryEnabled()
+{
+    return s_enabled;
+}
+
+//------------------------------------------------------------------------------
+// CountDatabaseEvent
+//------------------------------------------------------------------------------
+void CountDatabaseEvent(DatabaseCounter counter, uint64_t amount)
+{
+    if (s_enabled)
+    {
+        Add(GetThreadCounters().Counters[GetRow()][static_cast<size_t>(counter)], amount);
+    }
+}
+
+//------------------------------------------------------------------------------
+// CountDatabaseMiss
+//------------------------------------------------------------------------------
+void CountDatabaseMiss(uint64_t bytes, uint64_t nanoseconds)
+{
+    if (!s_enabled)
+    {
+        return;
+    }
+
+    ThreadCounters& counters = GetThreadCounters();
+    const size_t row = GetRow();
+    Add(counters.Counters[row][static_cast<size_t>(DatabaseCounter::Misses)], 1);
+    Add(counters.Counters[row][static_cast<size_t>(DatabaseCounter::MissBytes)], bytes);
+    Add(counters.Counters[row][static_cast<size_t>(DatabaseCounter::MissNanoseconds)], nanoseconds);
+    Add(counters.MissHistogram[row][GetMissBucket(nanoseconds)], 1);
+}
+
+//------------------------------------------------------------------------------
+// GetDatabaseTelemetry
+//------------------------------------------------------------------------------
+void GetDatabaseTelemetry(DatabaseTelemetry& telemetry)
+{
+    telemetry = {};
+
+    std::lock_guard<std::mutex> lock(GetThreadsMutex());
+    for (const auto& spCounters : GetThreads())
+    {
+        for (size_t row = 0; row < DATABASE_TELEMETRY_ROW_COUNT; ++row)
+        {
+            for (size_t counter = 0; counter < COUNTER_COUNT; ++counter)
+            {
+                telemetry.Counters[row][counter] += spCounters->Counters[row][counter].load(std::memory_order_relaxed);
+            }
+            for (size_t bucket = 0; bucket < DATABASE_MISS_HISTOGRAM_BUCKETS; ++bucket)
+            {
+                telemetry.MissHistogram[row][bucket] += spCounters->MissHistogram[row][bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// ReportDatabaseTelemetry
+//------------------------------------------------------------------------------
+void ReportDatabaseTelemetry()
+{
+    DatabaseTelemetry telemetry;
+    GetDatabaseTelemetry(telemetry);
+
+    const uint64_t frames = GetDatabaseFrameCount();
+    const double megabyte = 1024.0 * 1024.0;
+    for (size_t row = 0; row < DATABASE_TELEMETRY_ROW_COUNT; ++row)
+    {
+        const uint64_t(&counters)[COUNTER_COUNT] = telemetry.Counters[row];
+        auto get = [&](DatabaseCounter counter) {
+            return counters[static_cast<size_t>(counter)];
+        };
+
+        const uint64_t locks = get(DatabaseCounter::Locks);
+        const uint64_t misses = get(DatabaseCounter::Misses);
+        if (get(DatabaseCounter::Reads) == 0 && locks == 0 && misses == 0 && get(DatabaseCounter::Evictions) == 0)
+        {
+            continue;
+        }
+
+        char perFrame[128] = {};
+        if (frames > 0 && row != DATABASE_TELEMETRY_PREFETCH_ROW && (DatabasePhaseBit(static_cast<DatabasePhase>(row)) & DATABASE_PHASE_MASK_PER_FRAME))
+        {
+            snprintf(perFrame, sizeof(perFrame), "; per frame %.1f misses, %.3f ms waiting",
+                static_cast<double>(misses) / frames,
+                get(DatabaseCounter::MissNanoseconds) / 1.0e6 / frames);
+        }
+
+        NV_MESSAGE("Database telemetry, %s: %llu reads, %llu locks (%.1f%% hits), %llu unlocks, %llu misses of %.1f KB average waiting %.3f ms (p50 < %llu us, p99 < %llu us), %llu evictions of %.1f MB taking %.3f ms%s",
+            GetRowName(row),
+            static_cast<unsigned long long>(get(DatabaseCounter::Reads)),
+            static_cast<unsigned long long>(locks),
+            locks > 0 ? 100.0 * get(DatabaseCounter::Hits) / locks : 0.0,
+            static_cast<unsigned long long>(get(DatabaseCounter::Unlocks)),
+            static_cast<unsigned long long>(misses),
+            misses > 0 ? get(DatabaseCounter::MissBytes) / 1024.0 / misses : 0.0,
+            get(DatabaseCounter::MissNanoseconds) / 1.0e6,
+            static_cast<unsigned long long>(GetMissPercentile(telemetry.MissHistogram[row], misses, 0.5)),
+            static_cast<unsigned long long>(GetMissPercentile(telemetry.MissHistogram[row], misses, 0.99)),
+            static_cast<unsigned long long>(get(DatabaseCounter::Evictions)),
+            get(DatabaseCounter::EvictedBytes) / megabyte,
+            get(DatabaseCounter::EvictionNanoseconds) / 1.0e6,
+            perFrame);
+
+        if (misses > 0 && Application::VerboseOutput())
+        {
+            std::string histogram;
+            for (size_t bucket = 0; bucket < DATABASE_MISS_HISTOGRAM_BUCKETS; ++bucket)
+            {
+                if (telemetry.MissHistogram[row][bucket] == 0)
+                {
+                    continue;
+                }
+
+                char entry[64] = {};
+                snprintf(entry, sizeof(entry), "%s%s%llu us: %llu",
+                    histogram.empty() ? "" : ", ",
+                    bucket + 1 < DATABASE_MISS_HISTOGRAM_BUCKETS ? "< " : ">= ",
+                    static_cast<unsigned long long>(bucket + 1 < DATABASE_MISS_HISTOGRAM_BUCKETS ? GetMissBucketLimit(bucket) : GetMissBucketLimit(bucket - 1)),
+                    static_cast<unsigned long long>(telemetry.MissHistogram[row][bucket]));
+                histogram += entry;
+            }
+            NV_MESSAGE("Database telemetry, %s miss latency: %s", GetRowName(row), histogram.c_str());
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// DatabaseTelemetryPrefetchScope
+//------------------------------------------------------------------------------
+DatabaseTelemetryPrefetchScope::DatabaseTelemetryPrefetchScope()
+    : m_Previous(t_prefetching)
+{
+    t_prefetching = true;
+}
+
+//------------------------------------------------------------------------------
+// ~DatabaseTelemetryPrefetchScope
+//------------------------------------------------------------------------------
+DatabaseTelemetryPrefetchScope::~DatabaseTelemetryPrefetchScope()
+{
+    t_prefetching = m_Previous;
+}
+
+} // namespace Serialization
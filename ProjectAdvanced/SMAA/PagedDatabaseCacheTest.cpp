@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// File: PagedDatabaseCacheTest.cpp
+//
+// Eviction order of the paged database cache under each kind of residency limit.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DatabaseBackend.h"
+#include "DatabaseLayout.h"
+#include "DatabasePhase.h"
+#include "PagedReadOnlyDatabase.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Database written for the test: blobs of one page each, and a budget of a few
+// of them
+const char* const CACHE_TEST_DATABASE_FILE = "PagedDatabaseCacheTest.bin";
+constexpr size_t CACHE_TEST_PAGE_COUNT = 64;
+constexpr uint64_t CACHE_TEST_PAGE_SIZE = 16 * 1024;
+constexpr uint64_t CACHE_TEST_RESIDENT_PAGES = 4;
+
+//------------------------------------------------------------------------------
+// WriteCacheTestDatabase
+//------------------------------------------------------------------------------
+bool WriteCacheTestDatabase(const char* pFileName)
+{
+    std::vector<Serialization::DatabaseBlobRecord> records;
+    for (size_t i = 0; i < CACHE_TEST_PAGE_COUNT; ++i)
+    {
+        records.push_back({ CACHE_TEST_PAGE_SIZE, i * CACHE_TEST_PAGE_SIZE });
+    }
+    const std::vector<uint8_t> data(CACHE_TEST_PAGE_COUNT * CACHE_TEST_PAGE_SIZE, 0);
+
+    const std::string recordsFileName = std::string(pFileName) + ".rec";
+    FILE* pData = fopen(pFileName, "wb");
+    FILE* pRecords = fopen(recordsFileName.c_str(), "wb");
+    bool success = pData && pRecords;
+    success = success && fwrite(data.data(), 1, data.size(), pData) == data.size();
+    success = success && fwrite(records.data(), sizeof(records[0]), records.size(), pRecords) == records.size();
+    if (pData)
+    {
+        success = fclose(pData) == 0 && success;
+    }
+    if (pRecords)
+    {
+        success = fclose(pRecords) == 0 && success;
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// RunHotPageTest - locks a hot page between loads of every other page, with room
+// for only a few pages.  An eviction order by recency keeps the hot page resident.
+// CLOCK may still take it once, on its first sweep, when every page is still
+// marked as referenced by its load.
+//------------------------------------------------------------------------------
+bool RunHotPageTest(const char* pName, const Serialization::PagedReadOnlyDatabase::CacheSettings& settings, Serialization::DatabasePhase phase)
+{
+    using namespace Serialization;
+
+    PagedReadOnlyDatabase database(settings);
+    NV_THROW_IF(database.Init(CACHE_TEST_DATABASE_FILE) != ReadOnlyDatabase::InitResult::Ok, "Failed to open the database for the paged database cache test");
+
+    const DatabasePhase previousPhase = GetDatabasePhase();
+    SetDatabasePhase(phase);
+
+    const uint64_t hotPageOffset = 0;
+    database.Unlock(database.Lock(hotPageOffset));
+
+    uint64_t hotPageReloads = 0;
+    for (size_t i = 1; i < CACHE_TEST_PAGE_COUNT; ++i)
+    {
+        database.Unlock(database.Lock(i * CACHE_TEST_PAGE_SIZE));
+
+        const uint64_t misses = database.GetCacheStats().Misses;
+        database.Unlock(database.Lock(hotPageOffset));
+        hotPageReloads += database.GetCacheStats().Misses - misses;
+    }
+
+    SetDatabasePhase(previousPhase);
+
+    const auto stats = database.GetCacheStats();
+    const bool passed = hotPageReloads <= 1 && stats.Evictions > 0;
+    NV_MESSAGE("Paged database cache test, %s, %s: %llu evictions, hot page reloaded %llu times, %s",
+        pName,
+        PagedReadOnlyDatabase::EvictionPolicyToString(settings.Policy),
+        static_cast<unsigned long long>(stats.Evictions),
+        static_cast<unsigned long long>(hotPageReloads),
+        passed ? "passed" : "FAILED");
+    return passed;
+}
+
+//------------------------------------------------------------------------------
+// RunPagedDatabaseCacheTest
+//------------------------------------------------------------------------------
+bool RunPagedDatabaseCacheTest()
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+    const uint64_t budgetBytes = CACHE_TEST_RESIDENT_PAGES * CACHE_TEST_PAGE_SIZE;
+
+    bool passed = true;
+    for (const auto policy : { PagedReadOnlyDatabase::EvictionPolicy::Clock, PagedReadOnlyDatabase::EvictionPolicy::LeastRecentlyUsed })
+    {
+        const PagedReadOnlyDatabase::CacheSettings pageBudget = { CACHE_TEST_PAGE_SIZE, CACHE_TEST_RESIDENT_PAGES, 0, options.CacheShardCount, policy, options.ReadEngine, options.ReadQueueDepth, 0, false, 0, false, DatabasePageAllocator::HugePages::None, 0, false };
+        passed = RunHotPageTest("page budget", pageBudget, DatabasePhase::ResourceInit) && passed;
+
+        const PagedReadOnlyDatabase::CacheSettings byteBudget = { CACHE_TEST_PAGE_SIZE, 0, budgetBytes, options.CacheShardCount, policy, options.ReadEngine, options.ReadQueueDepth, 0, false, 0, false, DatabasePageAllocator::HugePages::None, 0, false };
+        passed = RunHotPageTest("byte budget", byteBudget, DatabasePhase::ResourceInit) && passed;
+
+        // Pages read by frames go to the frame pool, which has a budget of its own
+        const PagedReadOnlyDatabase::CacheSettings frameBudget = { CACHE_TEST_PAGE_SIZE, 0, 0, options.CacheShardCount, policy, options.ReadEngine, options.ReadQueueDepth, budgetBytes, false, 0, false, DatabasePageAllocator::HugePages::None, 0, false };
+        passed = RunHotPageTest("frame pool budget", frameBudget, DatabasePhase::Frame) && passed;
+    }
+    return passed;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Checks that the paged database cache keeps a hot page resident under each kind of residency limit and eviction policy", []() {
+        NV_THROW_IF(!WriteCacheTestDatabase(CACHE_TEST_DATABASE_FILE), "Failed to write the database for the paged database cache test");
+        const bool passed = RunPagedDatabaseCacheTest();
+        std::remove(CACHE_TEST_DATABASE_FILE);
+        std::remove((std::string(CACHE_TEST_DATABASE_FILE) + ".rec").c_str());
+        return passed;
+    });
+}
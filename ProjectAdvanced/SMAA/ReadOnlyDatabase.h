@@ -11,6 +11,7 @@
 #include "DllCommon.h"
 
 #include "DataScope.h"
+#include "DatabasePhase.h"
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
@@ -18,9 +19,18 @@
 #include <mutex>
 #include <vector>
 
-#define BEGIN_DATA_SCOPE_FUNCTION() BEGIN_DATA_SCOPE_FUNCTION_EX(Serialization::ReadOnlyDatabase)
+// Generated functions also mark the phase of the replay they belong to (see DatabasePhase.h)
+#define BEGIN_DATA_SCOPE_FUNCTION() \
+    NV_DATABASE_PHASE_SCOPE();      \
+    BEGIN_DATA_SCOPE_FUNCTION_EX(Serialization::ReadOnlyDatabase)
 #define BEGIN_DATA_SCOPE() BEGIN_DATA_SCOPE_EX(Serialization::ReadOnlyDatabase)
 
+// For helpers which never read from the database, such as the descriptor writers
+// of D3D12Replay.h: no tracker lookup, no DataScope and no phase, which only
+// matters to reads, so the macro expands to nothing.  NV_GET_RESOURCE in such a
+// function does not compile, as there is no dataScopeTracker to pass.
+#define BEGIN_NO_DATA_SCOPE_FUNCTION() (void)0
+
 #if !defined(GTI_PROJECT) && defined(__ANDROID__) && !defined(__MINKE__)
 #define NV_ANDROID_EXTERNAL() 1
 #else
@@ -190,6 +200,42 @@ public:
     virtual void Unlock(DataScope::LockedPageHandle pPageHandle) = 0;
     virtual void* DoRead(const DATABASE_HANDLE& handle) = 0;
     virtual void* DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker) = 0;
+
+    //------------------------------------------------------------------------------
+    // Prefetch - Make the page containing pageOffset resident ahead of its first
+    // use.  May be called from any thread.
+    //------------------------------------------------------------------------------
+    virtual void Prefetch(uint64_t pageOffset)
+    {
+        DataScope::LockedPageHandle pPageHandle = Lock(pageOffset);
+        if (pPageHandle)
+        {
+            Unlock(pPageHandle);
+        }
+    }
+
+    //------------------------------------------------------------------------------
+    // PrefetchPages - Prefetch for a batch of pages, which implementations may read
+    // with a single submission.  May be called from any thread.
+    //------------------------------------------------------------------------------
+    virtual void PrefetchPages(const uint64_t* pPageOffsets, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Prefetch(pPageOffsets[i]);
+        }
+    }
+
+    //------------------------------------------------------------------------------
+    // DoReadStatic - Helper for NV_GET_RESOURCE_STATIC: returns the blob at an
+    // address which stays valid until the database is destroyed, by keeping the
+    // page holding it resident.  Returns null if the implementation cannot pin
+    // pages, in which case the caller keeps a copy of the blob instead.
+    //------------------------------------------------------------------------------
+    virtual void* DoReadStatic(const DATABASE_HANDLE& /*handle*/)
+    {
+        return nullptr;
+    }
 };
 
 //----------------------------------------------------------------------------------
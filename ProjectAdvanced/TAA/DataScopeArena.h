@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// File: DataScopeArena.h
+//
+// Per-thread bump arena for the page lists of data scopes.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DllCommon.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// Data scope arena
+//
+// A DataScope keeps its first few locked pages inline and spills the rest into a
+// list.  Spilled lists are carved from chunks owned by the calling thread, and
+// since scopes nest on the stack, the list freed is usually the last one carved
+// and simply moves the arena back.  Once no spilled list of the thread is alive,
+// that is when its scope stack has unwound past every scope that spilled, the
+// arena starts again from its first chunk.  Chunks are kept until the thread
+// exits, so once the arena has grown to the deepest nesting of a frame, replaying
+// further frames does not allocate.
+//
+// DataScope does not use it yet: DataScope.cpp is prebuilt in this tree, and
+// changing the allocator type of its list in DataScope.h would change the layout
+// of DataScope under code compiled against the old one.  Switch the list to
+// DataScopeArenaAllocator when DataScope.cpp is rebuilt with it; until then only
+// DataScopeBenchmark measures it.
+//----------------------------------------------------------------------------------
+NV_REPLAY_EXPORT void* AllocateDataScopeSpill(size_t bytes);
+NV_REPLAY_EXPORT void FreeDataScopeSpill(void* p, size_t bytes);
+
+struct DataScopeArenaStats
+{
+    uint64_t Spills; // Lists carved from the arena
+    uint64_t SpillBytes;
+    uint64_t ChunkAllocations; // Chunks allocated from the heap
+    uint64_t ChunkBytes;
+    uint64_t LastChunkAllocationFrame; // GetDatabaseFrameCount() when the last chunk was allocated
+};
+
+// Sums the counters of every thread
+NV_REPLAY_EXPORT void GetDataScopeArenaStats(DataScopeArenaStats& stats);
+
+//------------------------------------------------------------------------------
+// DataScopeArenaAllocator - allocator of spilled page lists, stateless since
+// every allocation goes to the arena of the calling thread
+//------------------------------------------------------------------------------
+template <typename T>
+class DataScopeArenaAllocator
+{
+public:
+    using value_type = T;
+
+    DataScopeArenaAllocator() = default;
+
+    template <typename U>
+    DataScopeArenaAllocator(const DataScopeArenaAllocator<U>&)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(AllocateDataScopeSpill(count * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t count)
+    {
+        FreeDataScopeSpill(p, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const DataScopeArenaAllocator<U>&) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const DataScopeArenaAllocator<U>&) const
+    {
+        return false;
+    }
+};
+
+} // namespace Serialization
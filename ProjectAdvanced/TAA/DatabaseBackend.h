@@ -0,0 +1,119 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseBackend.h
+//
+// Selection of the IReadOnlyDatabase implementation used by the replay.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DllCommon.h"
+#include "PagedReadOnlyDatabase.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Serialization {
+
+enum class DatabaseBackend
+{
+    File, // ReadOnlyDatabase: pages are read into heap memory
+    Mapped, // MappedReadOnlyDatabase: blobs are read in place from a file mapping
+    Paged, // PagedReadOnlyDatabase: pages are read into heap memory through a sharded cache
+};
+
+//------------------------------------------------------------------------------
+// DatabaseOptions - populated from the command line before the database is
+// first accessed
+//------------------------------------------------------------------------------
+struct DatabaseOptions
+{
+    DatabaseBackend Backend = DatabaseBackend::File;
+
+    // Fault in the whole database at startup (mapped backend)
+    bool Prefault = false;
+
+    // Blobs smaller than this are grouped into shared pages (mapped and paged backends)
+    uint64_t PageSizeThreshold = 4 * 1024 * 1024;
+
+    // Pages kept resident before the least recently used are evicted, zero for no
+    // limit (paged backend)
+    size_t MaxResidentPages = 0;
+
+    // Bytes of page memory kept resident before pages are evicted, zero for no
+    // limit (paged backend)
+    uint64_t MaxResidentBytes = 0;
+
+    // Number of independently locked shards in the page cache (paged backend)
+    size_t CacheShardCount = 16;
+
+    // How the page cache chooses pages to evict (paged backend)
+    PagedReadOnlyDatabase::EvictionPolicy EvictionPolicy = PagedReadOnlyDatabase::EvictionPolicy::Clock;
+
+    // Write the order in which pages are first used to this file on exit
+    std::string TraceRecordFile;
+
+    // Prefetch pages on the thread pool in the order recorded in this file
+    std::string TraceReplayFile;
+
+    // How far ahead of the replay pages are prefetched, in bytes
+    uint64_t PrefetchWindowSize = 256 * 1024 * 1024;
+
+    // Read pages from this CompressedDatabaseFile rather than the database file
+    // (paged backend)
+    std::string CompressedFile;
+
+    // Load pages on the thread pool at startup, up to the residency limits (paged
+    // backend)
+    bool Preload = false;
+
+    // Read blobs from this blob store (see BlobStore.h), resolving handles through
+    // the capture's handle map (mapped and paged backends)
+    std::string StoreFile;
+
+    // Read the database file from an entry of the same name in this zip archive
+    // rather than from disk (mapped and paged backends; mapped needs a stored entry)
+    std::string ArchiveFile;
+
+    // How pages are read from the database file, and how many reads are kept in
+    // flight at once (paged backend)
+    DatabaseReadQueue::Engine ReadEngine = DatabaseReadQueue::Engine::IoUring;
+    size_t ReadQueueDepth = 32;
+
+    // Bytes of pages of small blobs read by frames and frame resets kept in a pool
+    // of their own, outside the other limits, zero for no pool (paged backend)
+    uint64_t MaxFrameResidentBytes = 0;
+
+    // Evict pages used only by resource init and frame setup when the first frame
+    // starts (paged backend)
+    bool ReleaseInitPages = false;
+
+    // Frames over which the working set is recorded before it is kept resident,
+    // zero to not pin it, and whether to also mlock it (paged backend)
+    uint64_t PinWarmupFrames = 0;
+    bool PinWithMlock = false;
+
+    // Hold pages in shared memory with other replay processes reading the same
+    // file (paged backend)
+    bool SharedCache = false;
+
+    // Backing of large pages, and megabytes of evicted large pages kept for reuse
+    // (paged backend)
+    DatabasePageAllocator::HugePages HugePages = DatabasePageAllocator::HugePages::None;
+    uint64_t MaxCachedBufferBytes = 64 * 1024 * 1024;
+
+    // Check pages against the checksums in the database's sidecar as they are read,
+    // computing the sidecar if there is none (paged backend)
+    bool Verify = false;
+
+    // Count database activity by replay phase and report it on exit (paged backend)
+    bool Telemetry = false;
+
+    // Hold pages locked by frames and frame resets until the next frame starts
+    // instead of unlocking them at the end of each data scope (paged backend)
+    bool EpochUnlock = false;
+};
+
+NV_REPLAY_EXPORT DatabaseOptions& GetDatabaseOptions();
+NV_REPLAY_EXPORT const char* DatabaseBackendToString(DatabaseBackend backend);
+
+} // namespace Serialization
@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseCompressTool.cpp
+//
+// Compresses the capture's database file, or its blob store, into a
+// CompressedDatabaseFile.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "CompressedDatabaseFile.h"
+#include "DatabaseBackend.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+std::string s_outputFileName;
+Serialization::CompressionCodec s_codec = Serialization::CompressionCodec::Zstd;
+int s_level = 0;
+
+//------------------------------------------------------------------------------
+// CompressDatabase - writes a CompressedDatabaseFile for the file the backend
+// reads blobs from: the blob store given with --database-store if there is one,
+// otherwise the capture's own database file
+//------------------------------------------------------------------------------
+bool CompressDatabase()
+{
+    using namespace Serialization;
+
+    if (!CompressedDatabaseFile::IsCodecAvailable(s_codec))
+    {
+        NV_MESSAGE("The %s codec is not available in this build", CompressedDatabaseFile::CodecToString(s_codec));
+        return false;
+    }
+
+    const auto& options = GetDatabaseOptions();
+    const char* pFileName = options.StoreFile.empty() ? DATABASE_BIN_FILE : options.StoreFile.c_str();
+
+    const auto start = std::chrono::steady_clock::now();
+    if (!CompressedDatabaseFile::Write(pFileName, s_outputFileName.c_str(), options.PageSizeThreshold, s_codec, s_level))
+    {
+        NV_MESSAGE("Failed to compress '%s' into '%s'", pFileName, s_outputFileName.c_str());
+        return false;
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CompressedDatabaseFile file;
+    NV_THROW_IF(!file.Open(s_outputFileName.c_str()), "Failed to reopen the compressed database");
+    const double megabyte = 1024.0 * 1024.0;
+    NV_MESSAGE("Compressed '%s' (%.1f MB) into '%s' (%.1f MB, %.2fx) with %s in %.1f s",
+        pFileName,
+        file.GetDatabaseSize() / megabyte,
+        s_outputFileName.c_str(),
+        file.GetCompressedSize() / megabyte,
+        file.GetCompressedSize() > 0 ? static_cast<double>(file.GetDatabaseSize()) / static_cast<double>(file.GetCompressedSize()) : 0.0,
+        CompressedDatabaseFile::CodecToString(s_codec),
+        elapsed);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+FnParseResults AddCompressArguments(args::ArgumentParser& parser)
+{
+    using Serialization::CompressionCodec;
+
+    const std::unordered_map<std::string, CompressionCodec> codecs = {
+        { "lz4", CompressionCodec::Lz4 },
+        { "zstd", CompressionCodec::Zstd },
+        { "stored", CompressionCodec::Stored },
+    };
+
+    // The lz4 and zstd codecs are built in when CMake finds their headers and
+    // libraries.  Every page is split into 1 MB frames compressed on their own.
+    auto spOutput = std::make_shared<args::Positional<std::string>>(parser, "output", "Container to write, read by the replay with --database-compressed", args::Options::Required);
+    auto spCodec = std::make_shared<args::MapFlag<std::string, CompressionCodec>>(parser, "codec", "Codec: 'zstd' (default), 'lz4' or 'stored'", args::Matcher{ "codec" }, codecs, CompressionCodec::Zstd);
+    auto spLevel = std::make_shared<args::ValueFlag<int>>(parser, "level", "Compression level, 0 for the codec's default.  Levels above 0 select LZ4 HC.", args::Matcher{ "level" }, 0);
+
+    return [=]() {
+        s_outputFileName = args::get(*spOutput);
+        s_codec = args::get(*spCodec);
+        s_level = args::get(*spLevel);
+    };
+}
+REGISTER_ARGUMENTS(AddCompressArguments);
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Compresses " DATABASE_BIN_FILE " into a container of independently compressed frames for --database-compressed", []() {
+        return CompressDatabase();
+    });
+}
@@ -0,0 +1,762 @@
+//--------------------------------------------------------------------------------------
+// File: PagedDatabasePolicies.cpp
+//
+// Optional policies of the paged database cache.
+//--------------------------------------------------------------------------------------
+
+#include "PagedDatabasePolicies.h"
+
+#include "CommonReplay.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Timed page-ins reported one by one; further ones are only counted
+const uint64_t MAX_REPORTED_TIMED_PAGE_INS = 32;
+
+// Source of PagedEpochUnlock::m_InstanceId
+std::atomic<uint64_t> s_nextInstanceId(0);
+
+const double MEGABYTE = 1024.0 * 1024.0;
+
+//------------------------------------------------------------------------------
+// AddOwned - for counters written only by one thread
+//------------------------------------------------------------------------------
+void AddOwned(std::atomic<uint64_t>& counter, uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+uint64_t ElapsedNanoseconds(std::chrono::steady_clock::time_point start)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+//------------------------------------------------------------------------------
+// LockMemory - locks a range of memory in physical memory
+//------------------------------------------------------------------------------
+bool LockMemory(const void* pMemory, uint64_t size)
+{
+#if defined(_WIN32)
+    return VirtualLock(const_cast<void*>(pMemory), static_cast<SIZE_T>(size)) != 0;
+#else
+    return mlock(pMemory, static_cast<size_t>(size)) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// UnlockMemory - unlocking a range which was never locked is harmless
+//------------------------------------------------------------------------------
+void UnlockMemory(const void* pMemory, uint64_t size)
+{
+#if defined(_WIN32)
+    VirtualUnlock(const_cast<void*>(pMemory), static_cast<SIZE_T>(size));
+#else
+    munlock(pMemory, static_cast<size_t>(size));
+#endif
+}
+
+//------------------------------------------------------------------------------
+// GetResidentSetSize - bytes of physical memory used by the process, zero if it
+// cannot be queried
+//------------------------------------------------------------------------------
+uint64_t GetResidentSetSize()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = {};
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+    FILE* pFile = fopen("/proc/self/statm", "r");
+    if (!pFile)
+    {
+        return 0;
+    }
+    unsigned long long totalPages = 0;
+    unsigned long long residentPages = 0;
+    const bool success = fscanf(pFile, "%llu %llu", &totalPages, &residentPages) == 2;
+    fclose(pFile);
+    return success ? residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
+
+} // namespace
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// PagedFramePool
+//------------------------------------------------------------------------------
+PagedFramePool::PagedFramePool(uint64_t maxResidentBytes, uint64_t pageSizeThreshold)
+    : m_MaxResidentBytes(maxResidentBytes)
+    , m_PageSizeThreshold(pageSizeThreshold)
+    , m_ResidentPages()
+    , m_ResidentBytes()
+    , m_ResidentBytesHighWater()
+    , m_Promotions()
+{
+}
+
+//------------------------------------------------------------------------------
+// PagedFramePool::Reserve
+//------------------------------------------------------------------------------
+void PagedFramePool::Reserve(uint64_t pages, uint64_t bytes)
+{
+    m_ResidentPages.fetch_add(pages);
+    const uint64_t residentBytes = m_ResidentBytes.fetch_add(bytes) + bytes;
+    if (residentBytes > m_ResidentBytesHighWater.load(std::memory_order_relaxed))
+    {
+        m_ResidentBytesHighWater.store(residentBytes, std::memory_order_relaxed);
+    }
+}
+
+//------------------------------------------------------------------------------
+// PagedFramePool::Release
+//------------------------------------------------------------------------------
+void PagedFramePool::Release(uint64_t pages, uint64_t bytes)
+{
+    m_ResidentPages.fetch_sub(pages);
+    m_ResidentBytes.fetch_sub(bytes);
+}
+
+//------------------------------------------------------------------------------
+// PagedFramePool::Report
+//------------------------------------------------------------------------------
+void PagedFramePool::Report() const
+{
+    if (IsEnabled())
+    {
+        NV_MESSAGE("Database page cache: frame pool high-water mark %.1f MB of %.1f MB budget, %llu resident pages moved to it",
+            m_ResidentBytesHighWater.load() / MEGABYTE,
+            m_MaxResidentBytes / MEGABYTE,
+            static_cast<unsigned long long>(m_Promotions.load()));
+    }
+}
+
+//------------------------------------------------------------------------------
+// PagedFramePool::Reset
+//------------------------------------------------------------------------------
+void PagedFramePool::Reset()
+{
+    m_ResidentPages = 0;
+    m_ResidentBytes = 0;
+    m_ResidentBytesHighWater = 0;
+    m_Promotions = 0;
+}
+
+//------------------------------------------------------------------------------
+// PagedInitRelease
+//------------------------------------------------------------------------------
+PagedInitRelease::PagedInitRelease(bool enabled)
+    : m_Enabled(enabled)
+    , m_SetupFinished(false)
+    , m_ResidentSetBefore()
+{
+}
+
+//------------------------------------------------------------------------------
+// PagedInitRelease::IsInitPage
+//------------------------------------------------------------------------------
+bool PagedInitRelease::IsInitPage(const PagedPage& page)
+{
+    const uint8_t setupPhases = DatabasePhaseBit(DatabasePhase::ResourceInit) | DatabasePhaseBit(DatabasePhase::FrameSetup);
+    const uint8_t phases = page.Phases.load(std::memory_order_relaxed);
+    return phases != 0 && (phases & ~setupPhases) == 0;
+}
+
+//------------------------------------------------------------------------------
+// PagedInitRelease::BeginRelease
+//------------------------------------------------------------------------------
+void PagedInitRelease::BeginRelease()
+{
+    m_ResidentSetBefore = GetResidentSetSize();
+}
+
+//------------------------------------------------------------------------------
+// PagedInitRelease::EndRelease
+//------------------------------------------------------------------------------
+void PagedInitRelease::EndRelease(uint64_t pages, uint64_t bytes)
+{
+    // Freed pages are mostly returned to the OS by free itself, but glibc keeps
+    // smaller ones in its arenas until asked
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+
+    NV_MESSAGE("Database page cache: released %llu pages (%.1f MB) used only during setup; process resident set %.1f MB -> %.1f MB",
+        static_cast<unsigned long long>(pages),
+        bytes / MEGABYTE,
+        m_ResidentSetBefore / MEGABYTE,
+        GetResidentSetSize() / MEGABYTE);
+}
+
+//------------------------------------------------------------------------------
+// PagedInitRelease::Reset
+//------------------------------------------------------------------------------
+void PagedInitRelease::Reset()
+{
+    m_SetupFinished = false;
+}
+
+//------------------------------------------------------------------------------
+// PagedWorkingSetPin
+//------------------------------------------------------------------------------
+PagedWorkingSetPin::PagedWorkingSetPin(uint64_t warmupFrames, bool withMlock)
+    : m_WarmupFrames(warmupFrames)
+    , m_WithMlock(withMlock)
+    , m_Started(false)
+    , m_Pinned(false)
+    , m_MlockFailed(false)
+    , m_Mutex()
+    , m_Pages()
+    , m_PinnedBytes()
+    , m_TimedPageIns()
+    , m_TimedPageInBytes()
+{
+}
+
+//------------------------------------------------------------------------------
+// PagedWorkingSetPin::Pin
+//------------------------------------------------------------------------------
+bool PagedWorkingSetPin::Pin(PagedPage& page, uint32_t pageIndex)
+{
+    bool locked = true;
+    if (m_WithMlock)
+    {
+        locked = LockMemory(page.pMemory.load(std::memory_order_acquire), PagedPage::GetCapacity(*page.pRecord));
+        if (!locked && !m_MlockFailed.exchange(true) && IsPinned())
+        {
+            NV_MESSAGE("Database page cache: a page which joined the pinned working set could not be locked in physical memory");
+        }
+    }
+
+    m_PinnedBytes.fetch_add(PagedPage::GetCapacity(*page.pRecord), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pages.push_back(pageIndex);
+    return locked;
+}
+
+//------------------------------------------------------------------------------
+// PagedWorkingSetPin::OnPinned
+//------------------------------------------------------------------------------
+void PagedWorkingSetPin::OnPinned(uint64_t pages, uint64_t mlockFailedPages, uint64_t pagesReadBack, double seconds)
+{
+    m_Pinned = true;
+
+    NV_MESSAGE("Database page cache: pinned the frame working set of %llu warm-up frames, %llu pages (%.1f MB, %llu read back) in %.3f s%s",
+        static_cast<unsigned long long>(m_WarmupFrames),
+        static_cast<unsigned long long>(pages),
+        m_PinnedBytes.load() / MEGABYTE,
+        static_cast<unsigned long long>(pagesReadBack),
+        seconds,
+        m_WithMlock ? " with mlock" : "");
+    if (mlockFailedPages > 0)
+    {
+        NV_MESSAGE("Database page cache: %llu pinned pages could not be locked in physical memory and may still be paged out by the OS; raise the locked memory limit (ulimit -l) to lock them",
+            static_cast<unsigned long long>(mlockFailedPages));
+    }
+}
+
+//------------------------------------------------------------------------------
+// PagedWorkingSetPin::OnTimedPageIn
+//------------------------------------------------------------------------------
+void PagedWorkingSetPin::OnTimedPageIn(const PagedPage& page)
+{
+    const uint64_t bytes = page.pRecord->PageSize;
+    const uint64_t count = m_TimedPageIns.fetch_add(1, std::memory_order_relaxed) + 1;
+    m_TimedPageInBytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (count <= MAX_REPORTED_TIMED_PAGE_INS)
+    {
+        // The thread's own part of the frame, which frame code running on other
+        // threads does not change
+        char partName[32] = "";
+        const uint32_t part = GetDatabaseFramePart();
+        if (part < DATABASE_FRAME_PART_RESET)
+        {
+            snprintf(partName, sizeof(partName), " in Frame%uPart%02u", part / DATABASE_FRAME_PARTS_PER_FRAME, part % DATABASE_FRAME_PARTS_PER_FRAME);
+        }
+
+        NV_MESSAGE("Database page cache: measurement contaminated - frame %llu read %llu bytes at database offset %llu during %s%s after the working set was pinned%s",
+            static_cast<unsigned long long>(GetDatabaseFrameCount()),
+            static_cast<unsigned long long>(bytes),
+            static_cast<unsigned long long>(page.pRecord->PageOffset),
+            DatabasePhaseToString(GetDatabasePhase()),
+            partName,
+            count == MAX_REPORTED_TIMED_PAGE_INS ? "; further page-ins are only counted" : "");
+    }
+}
+
+//------------------------------------------------------------------------------
+// PagedWorkingSetPin::Report
+//------------------------------------------------------------------------------
+void PagedWorkingSetPin::Report() const
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    size_t pinnedPages = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        pinnedPages = m_Pages.size();
+    }
+    NV_MESSAGE("Database page cache: %llu pages (%.1f MB) pinned after %llu warm-up frames, %llu page-ins (%.1f MB) during timed frames",
+        static_cast<unsigned long long>(pinnedPages),
+        m_PinnedBytes.load() / MEGABYTE,
+        static_cast<unsigned long long>(m_WarmupFrames),
+        static_cast<unsigned long long>(m_TimedPageIns.load()),
+        m_TimedPageInBytes.load() / MEGABYTE);
+}
+
+//------------------------------------------------------------------------------
+// PagedWorkingSetPin::Reset
+//------------------------------------------------------------------------------
+void PagedWorkingSetPin::Reset(PagedPage* pPages)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (uint32_t pageIndex : m_Pages)
+        {
+            PagedPage& page = pPages[pageIndex];
+            if (m_WithMlock)
+            {
+                UnlockMemory(page.pMemory.load(std::memory_order_acquire), PagedPage::GetCapacity(*page.pRecord));
+            }
+            page.LockCount.fetch_sub(1);
+        }
+        m_Pages.clear();
+    }
+
+    m_Started = false;
+    m_Pinned = false;
+    m_MlockFailed = false;
+    m_PinnedBytes = 0;
+    m_TimedPageIns = 0;
+    m_TimedPageInBytes = 0;
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock
+//------------------------------------------------------------------------------
+PagedEpochUnlock::PagedEpochUnlock(bool enabled)
+    : m_Enabled(enabled)
+    , m_pPages()
+    , m_PageCount()
+    , m_InstanceId(s_nextInstanceId.fetch_add(1) + 1)
+    , m_Mutex()
+    , m_Buffers()
+    , m_Releases()
+    , m_Epochs()
+{
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::Init
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::Init(PagedPage* pPages, size_t pageCount)
+{
+    m_pPages = pPages;
+    m_PageCount = pageCount;
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::IsHeld
+//------------------------------------------------------------------------------
+bool PagedEpochUnlock::IsHeld(size_t pageIndex)
+{
+    EpochBuffer& buffer = GetBuffer();
+    AddOwned(buffer.Locks, 1);
+
+    // An open scope may still use any page the thread holds, so the thread stays
+    // in its epoch until all of them have closed
+    if (buffer.OpenHandles == 0)
+    {
+        const uint64_t epoch = GetDatabaseFrameCount();
+        if (buffer.Epoch < epoch)
+        {
+            std::lock_guard<std::mutex> lock(buffer.Mutex);
+            ReleaseBuffer(buffer, epoch);
+            m_Epochs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Already held in this epoch: nothing shared is touched
+    if (buffer.Held[pageIndex / 64] & (uint64_t(1) << (pageIndex % 64)))
+    {
+        AddOwned(buffer.Hits, 1);
+        return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::Hold
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::Hold(size_t pageIndex)
+{
+    EpochBuffer& buffer = GetBuffer();
+
+    std::lock_guard<std::mutex> lock(buffer.Mutex);
+    buffer.Held[pageIndex / 64] |= uint64_t(1) << (pageIndex % 64);
+    buffer.Pages.push_back(static_cast<uint32_t>(pageIndex));
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::OnHandleLocked
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::OnHandleLocked()
+{
+    ++GetBuffer().OpenHandles;
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::OnHandleUnlocked - data scopes unlock their pages on the
+// thread which opened them
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::OnHandleUnlocked()
+{
+    EpochBuffer& buffer = GetBuffer();
+    NV_DATABASE_WARN(buffer.OpenHandles > 0, "Unlocking an epoch handle on a thread which holds none");
+    if (buffer.OpenHandles > 0)
+    {
+        --buffer.OpenHandles;
+    }
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::GetBuffer
+//------------------------------------------------------------------------------
+PagedEpochUnlock::EpochBuffer& PagedEpochUnlock::GetBuffer()
+{
+    // One cached buffer per thread, for the database it last locked through
+    static thread_local uint64_t t_instanceId = 0;
+    static thread_local EpochBuffer* t_pBuffer = nullptr;
+
+    const uint64_t instanceId = m_InstanceId.load(std::memory_order_relaxed);
+    if (t_instanceId == instanceId)
+    {
+        return *t_pBuffer;
+    }
+
+    // Threads which switch between databases get a buffer in each
+    static thread_local std::vector<std::pair<uint64_t, EpochBuffer*>> t_buffers;
+    auto it = std::find_if(t_buffers.begin(), t_buffers.end(), [&](const std::pair<uint64_t, EpochBuffer*>& entry) {
+        return entry.first == instanceId;
+    });
+    if (it == t_buffers.end())
+    {
+        std::unique_ptr<EpochBuffer> spBuffer(new EpochBuffer());
+        const size_t wordCount = (m_PageCount + 63) / 64;
+        spBuffer->Held.reset(new uint64_t[wordCount]());
+        spBuffer->Epoch = GetDatabaseFrameCount();
+        spBuffer->OpenHandles = 0;
+        spBuffer->Locks = 0;
+        spBuffer->Hits = 0;
+
+        t_buffers.emplace_back(instanceId, spBuffer.get());
+        it = t_buffers.end() - 1;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Buffers.push_back(std::move(spBuffer));
+    }
+
+    t_instanceId = instanceId;
+    t_pBuffer = it->second;
+    return *t_pBuffer;
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::ReleaseBuffer
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::ReleaseBuffer(EpochBuffer& buffer, uint64_t epoch)
+{
+    for (uint32_t pageIndex : buffer.Pages)
+    {
+        buffer.Held[pageIndex / 64] = 0;
+        m_pPages[pageIndex].LockCount.fetch_sub(1);
+    }
+    m_Releases.fetch_add(buffer.Pages.size(), std::memory_order_relaxed);
+    buffer.Pages.clear();
+    buffer.Epoch = epoch;
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::Report
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::Report() const
+{
+    if (!m_Enabled)
+    {
+        return;
+    }
+
+    uint64_t locks = 0;
+    uint64_t hits = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (const auto& spBuffer : m_Buffers)
+        {
+            locks += spBuffer->Locks.load(std::memory_order_relaxed);
+            hits += spBuffer->Hits.load(std::memory_order_relaxed);
+        }
+    }
+    NV_MESSAGE_VERBOSE("Database page cache: %llu locks by frames and resets, %.1f%% of pages already held in the frame, %llu pages unlocked as threads moved to %llu new epochs",
+        static_cast<unsigned long long>(locks),
+        locks > 0 ? 100.0 * hits / locks : 0.0,
+        static_cast<unsigned long long>(m_Releases.load()),
+        static_cast<unsigned long long>(m_Epochs.load()));
+}
+
+//------------------------------------------------------------------------------
+// PagedEpochUnlock::Reset - the thread-local caches of the buffers are
+// invalidated by the new instance id
+//------------------------------------------------------------------------------
+void PagedEpochUnlock::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (const auto& spBuffer : m_Buffers)
+    {
+        NV_DATABASE_WARN(spBuffer->OpenHandles == 0, "Freeing the database with a data scope still open");
+        std::lock_guard<std::mutex> bufferLock(spBuffer->Mutex);
+        ReleaseBuffer(*spBuffer, UINT64_MAX);
+    }
+    m_Buffers.clear();
+    m_InstanceId = s_nextInstanceId.fetch_add(1) + 1;
+    m_pPages = nullptr;
+    m_PageCount = 0;
+    m_Releases = 0;
+    m_Epochs = 0;
+}
+
+//------------------------------------------------------------------------------
+// PagedStaticPin
+//------------------------------------------------------------------------------
+PagedStaticPin::PagedStaticPin()
+    : m_Mutex()
+    , m_Pages()
+    , m_PinnedBytes()
+    , m_Blobs()
+    , m_BlobBytes()
+{
+}
+
+//------------------------------------------------------------------------------
+// PagedStaticPin::Pin
+//------------------------------------------------------------------------------
+bool PagedStaticPin::Pin(PagedPage& page, uint32_t pageIndex, uint64_t blobSize)
+{
+    m_Blobs.fetch_add(1, std::memory_order_relaxed);
+    m_BlobBytes.fetch_add(blobSize, std::memory_order_relaxed);
+    if (page.StaticPinned.exchange(true))
+    {
+        return false;
+    }
+
+    m_PinnedBytes.fetch_add(PagedPage::GetCapacity(*page.pRecord), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pages.push_back(pageIndex);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// PagedStaticPin::Report - what the static entries would have taken as copies,
+// against what pinning their pages keeps resident
+//------------------------------------------------------------------------------
+void PagedStaticPin::Report() const
+{
+    if (m_Blobs == 0)
+    {
+        return;
+    }
+
+    size_t pinnedPages = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        pinnedPages = m_Pages.size();
+    }
+    NV_MESSAGE("Database page cache: %llu static entries (%.1f MB) read in place from %llu pinned pages (%.1f MB)",
+        static_cast<unsigned long long>(m_Blobs.load()),
+        m_BlobBytes.load() / MEGABYTE,
+        static_cast<unsigned long long>(pinnedPages),
+        m_PinnedBytes.load() / MEGABYTE);
+}
+
+//------------------------------------------------------------------------------
+// PagedStaticPin::Reset
+//------------------------------------------------------------------------------
+void PagedStaticPin::Reset(PagedPage* pPages)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (uint32_t pageIndex : m_Pages)
+        {
+            pPages[pageIndex].StaticPinned = false;
+            pPages[pageIndex].LockCount.fetch_sub(1);
+        }
+        m_Pages.clear();
+    }
+
+    m_PinnedBytes = 0;
+    m_Blobs = 0;
+    m_BlobBytes = 0;
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification
+//------------------------------------------------------------------------------
+PagedVerification::PagedVerification()
+    : m_spChecksums()
+    , m_Identity()
+    , m_ReadNanoseconds()
+    , m_QueueNanoseconds()
+    , m_PendingMutex()
+    , m_PendingCondition()
+    , m_PendingChecks()
+{
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification::Enable
+//------------------------------------------------------------------------------
+bool PagedVerification::Enable(const char* pFileName, const char* pSourceFileName, const DatabaseLayout& layout, uint64_t databaseSize)
+{
+    if (!DatabaseLayout::GetFileIdentity(pSourceFileName, m_Identity))
+    {
+        return false;
+    }
+
+    // Checksums computed here would come from the file they are meant to check,
+    // and pass whatever it holds
+    std::unique_ptr<DatabaseChecksums> spChecksums(new DatabaseChecksums());
+    spChecksums->Init(pFileName, layout, databaseSize);
+    const DatabaseChecksums::LoadResult result = spChecksums->Load();
+    if (result != DatabaseChecksums::LoadResult::Loaded)
+    {
+        NV_MESSAGE("Database verification: '%s' %s; write it with DatabaseChecksumTool when packaging the capture",
+            spChecksums->GetFileName().c_str(),
+            result == DatabaseChecksums::LoadResult::Missing ? "does not exist" : "was written for other records or is damaged");
+        return false;
+    }
+
+    if (spChecksums->IsVerified(m_Identity))
+    {
+        NV_MESSAGE_VERBOSE("Database verification: '%s' records that '%s' has been verified; skipping", spChecksums->GetFileName().c_str(), pSourceFileName);
+        return true;
+    }
+
+    m_ReadNanoseconds = 0;
+    m_QueueNanoseconds = 0;
+    m_spChecksums = std::move(spChecksums);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification::Check
+//------------------------------------------------------------------------------
+void PagedVerification::Check(PagedPage& page, const uint8_t* pData)
+{
+    if (g_threadPoolThreadCount == 0)
+    {
+        RunCheck(page, pData);
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_PendingMutex);
+        ++m_PendingChecks;
+    }
+    NvExecuteOnThreadPool([this, &page, pData]() {
+        RunCheck(page, pData);
+
+        std::lock_guard<std::mutex> lock(m_PendingMutex);
+        if (--m_PendingChecks == 0)
+        {
+            m_PendingCondition.notify_all();
+        }
+    });
+    m_QueueNanoseconds.fetch_add(ElapsedNanoseconds(start), std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification::RunCheck
+//------------------------------------------------------------------------------
+void PagedVerification::RunCheck(PagedPage& page, const uint8_t* pData)
+{
+    m_spChecksums->Verify(page.pRecord->PageOffset, page.pRecord->PageSize, pData);
+    page.LockCount.fetch_sub(1);
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification::Drain
+//------------------------------------------------------------------------------
+void PagedVerification::Drain()
+{
+    std::unique_lock<std::mutex> lock(m_PendingMutex);
+    m_PendingCondition.wait(lock, [this]() {
+        return m_PendingChecks == 0;
+    });
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification::Report
+//------------------------------------------------------------------------------
+void PagedVerification::Report()
+{
+    if (!m_spChecksums)
+    {
+        return;
+    }
+
+    Drain();
+    const DatabaseChecksums::Stats checksumStats = m_spChecksums->GetStats();
+    NV_MESSAGE_VERBOSE("Database verification: %llu of %zu blocks (%.1f MB) checked, %.3f s hashing on %s (CRC-32C, %s) and %.3f s queueing checks against %.3f s reading",
+        static_cast<unsigned long long>(checksumStats.VerifiedBlocks),
+        m_spChecksums->GetBlockCount(),
+        checksumStats.VerifiedBytes / MEGABYTE,
+        checksumStats.HashNanoseconds / 1.0e9,
+        g_threadPoolThreadCount > 0 ? "the thread pool" : "the reading threads",
+        IsCrc32cHardwareAccelerated() ? "hardware" : "software",
+        m_QueueNanoseconds.load() / 1.0e9,
+        m_ReadNanoseconds.load() / 1.0e9);
+    if (checksumStats.FailedBlocks > 0)
+    {
+        NV_MESSAGE("Database verification: %llu blocks of the database do not match '%s'",
+            static_cast<unsigned long long>(checksumStats.FailedBlocks),
+            m_spChecksums->GetFileName().c_str());
+    }
+    else if (m_spChecksums->IsComplete())
+    {
+        // Every block matched the reference checksums, so later launches on this
+        // file skip the checks
+        if (!m_spChecksums->Save(m_Identity))
+        {
+            NV_MESSAGE("Database verification: could not record the verification in '%s'", m_spChecksums->GetFileName().c_str());
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// PagedVerification::Reset
+//------------------------------------------------------------------------------
+void PagedVerification::Reset()
+{
+    Drain();
+    m_spChecksums.reset();
+}
+
+} // namespace Serialization
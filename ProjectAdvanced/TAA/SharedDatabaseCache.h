@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// File: SharedDatabaseCache.h
+//
+// Database pages held in named shared memory for every replay process reading them.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// SharedDatabaseCache
+//
+// A copy of a database file in a named shared memory object (shm_open, or a
+// pagefile-backed file mapping on Windows), filled in as replay processes read it.
+// Processes replaying captures which read the same file, such as the TAA and SMAA
+// captures of one game sharing a blob store, attach to the same object and only
+// one of them reads each part of the file; the others use its pages, so the file's
+// pages are held in memory once rather than once per process.
+//
+// - The object is named after the identity of the source file (device, inode,
+//   size and modification time) and the size of the database it holds, so a
+//   rewritten file gets a new object.
+// - The file is loaded in CHUNK_SIZE chunks of file offsets, independently of how
+//   each process divides it into pages.  A chunk is claimed by compare-and-swap
+//   before it is read, so only one process reads it; others wait for it.  A chunk
+//   left claimed by a process which has died is claimed again.
+// - Each attached process holds a slot with its process id.  The last process to
+//   detach unlinks the object, and slots of processes which died without detaching
+//   are reclaimed by the next process to attach.  A process which attaches while
+//   the last one is detaching may keep an object which is then unlinked; it goes
+//   on using it, just no longer shared with later processes.
+// - The object is sparse: only chunks which have been read use memory.  On Linux
+//   it is only created if /dev/shm has room for the whole database, since running
+//   out of room while writing to it would raise SIGBUS.
+//----------------------------------------------------------------------------------
+class SharedDatabaseCache
+{
+public:
+    // Granularity at which the file is shared and loaded
+    static constexpr uint64_t CHUNK_SIZE = 64 * 1024;
+
+    // Most processes attached at once; later ones fail to attach
+    static constexpr size_t MAX_PROCESSES = 64;
+
+    // Reads size bytes at offset of the database into pDestination
+    using ReadFunction = std::function<bool(uint64_t offset, uint64_t size, uint8_t* pDestination)>;
+
+    struct Stats
+    {
+        uint64_t ChunksRead; // Chunks this process read into the cache
+        uint64_t ChunkWaits; // Chunks this process waited for another to read
+        uint64_t ReclaimedChunks; // Chunks claimed again after their reader died
+        uint64_t LoadedBytes; // Bytes of the database in the cache, read by any process
+        size_t AttachedProcesses;
+    };
+
+    SharedDatabaseCache();
+    ~SharedDatabaseCache();
+
+    //------------------------------------------------------------------------------
+    // Attach - Opens or creates the shared cache of a database of databaseSize
+    // bytes read from pSourceFileName, the file which identifies it.  Returns false
+    // if shared memory is not available or all slots are taken.
+    //------------------------------------------------------------------------------
+    bool Attach(const char* pSourceFileName, uint64_t databaseSize);
+    void Detach();
+    bool IsAttached() const
+    {
+        return m_pMapping != nullptr;
+    }
+
+    const std::string& GetName() const
+    {
+        return m_Name;
+    }
+
+    // The database; ranges are only valid once Load has returned true for them
+    uint8_t* GetData() const
+    {
+        return m_pData;
+    }
+
+    //------------------------------------------------------------------------------
+    // Load - Makes [offset, offset + size) of the database valid, reading the
+    // chunks no process has read yet with read, in runs of adjacent chunks, and
+    // waiting for chunks another thread or process is reading.  read writes to
+    // GetData() + offset.  Safe to call from several threads at once.
+    //------------------------------------------------------------------------------
+    bool Load(uint64_t offset, uint64_t size, const ReadFunction& read);
+
+    Stats GetStats() const;
+
+private:
+    struct Header;
+
+    // This class is non-copyable
+    SharedDatabaseCache(const SharedDatabaseCache&) = delete;
+    SharedDatabaseCache& operator=(const SharedDatabaseCache&) = delete;
+
+    bool Map(uint64_t mappingSize, bool& created);
+    void Unmap();
+
+    // Waits for a chunk another thread or process is reading, returning once it is
+    // no longer being read
+    void WaitForChunk(size_t chunk);
+
+    std::string m_Name;
+#if defined(_WIN32)
+    void* m_hMapping;
+#endif
+    void* m_pMapping;
+    uint64_t m_MappingSize;
+    Header* m_pHeader;
+    std::atomic<uint64_t>* m_pChunkStates;
+    uint8_t* m_pData;
+    uint64_t m_DatabaseSize;
+    size_t m_ChunkCount;
+    size_t m_Slot;
+    uint64_t m_ProcessId;
+
+    std::atomic<uint64_t> m_ChunksRead;
+    std::atomic<uint64_t> m_ChunkWaits;
+    std::atomic<uint64_t> m_ReclaimedChunks;
+};
+
+} // namespace Serialization
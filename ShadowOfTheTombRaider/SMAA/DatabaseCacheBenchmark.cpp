@@ -0,0 +1,188 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseCacheBenchmark.cpp
+//
+// Synthetic benchmark of the paged database's eviction policies.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DatabaseBackend.h"
+#include "DatabaseLayout.h"
+#include "PagedReadOnlyDatabase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+enum class AccessPattern
+{
+    Loop, // Repeated sequential sweeps, the worst case for recency-based policies
+    Skewed, // Zipf-distributed random accesses
+    Frames, // A hot set used every frame plus a window streaming through the rest
+};
+
+const char* AccessPatternToString(AccessPattern pattern)
+{
+    switch (pattern)
+    {
+    case AccessPattern::Loop:
+        return "loop";
+    case AccessPattern::Skewed:
+        return "skewed";
+    case AccessPattern::Frames:
+        return "frames";
+    }
+    return "unknown";
+}
+
+//------------------------------------------------------------------------------
+// GenerateAccesses - a sequence of indices into pages
+//------------------------------------------------------------------------------
+std::vector<uint32_t> GenerateAccesses(AccessPattern pattern, size_t pageCount, size_t accessCount)
+{
+    std::vector<uint32_t> accesses;
+    accesses.reserve(accessCount);
+
+    std::mt19937 random(12345);
+    switch (pattern)
+    {
+    case AccessPattern::Loop:
+    {
+        for (size_t i = 0; i < accessCount; ++i)
+        {
+            accesses.push_back(static_cast<uint32_t>(i % pageCount));
+        }
+        break;
+    }
+
+    case AccessPattern::Skewed:
+    {
+        std::vector<uint32_t> permutation(pageCount);
+        for (size_t i = 0; i < pageCount; ++i)
+        {
+            permutation[i] = static_cast<uint32_t>(i);
+        }
+        std::shuffle(permutation.begin(), permutation.end(), random);
+
+        std::vector<double> cumulative(pageCount);
+        double total = 0.0;
+        for (size_t i = 0; i < pageCount; ++i)
+        {
+            total += 1.0 / static_cast<double>(i + 1);
+            cumulative[i] = total;
+        }
+
+        std::uniform_real_distribution<double> distribution(0.0, total);
+        for (size_t i = 0; i < accessCount; ++i)
+        {
+            const auto it = std::lower_bound(cumulative.begin(), cumulative.end(), distribution(random));
+            const size_t rank = std::min(static_cast<size_t>(it - cumulative.begin()), pageCount - 1);
+            accesses.push_back(permutation[rank]);
+        }
+        break;
+    }
+
+    case AccessPattern::Frames:
+    {
+        const size_t hotCount = std::max<size_t>(pageCount / 10, 1);
+        const size_t coldCount = std::max<size_t>(pageCount - hotCount, 1);
+        const size_t windowSize = std::max<size_t>(pageCount / 20, 1);
+        size_t windowStart = 0;
+        while (accesses.size() < accessCount)
+        {
+            for (size_t i = 0; i < hotCount && accesses.size() < accessCount; ++i)
+            {
+                accesses.push_back(static_cast<uint32_t>(i));
+            }
+            for (size_t i = 0; i < windowSize && accesses.size() < accessCount; ++i)
+            {
+                accesses.push_back(static_cast<uint32_t>(std::min(hotCount + (windowStart + i) % coldCount, pageCount - 1)));
+            }
+            windowStart += windowSize / 2 + 1;
+        }
+        break;
+    }
+    }
+
+    return accesses;
+}
+
+//------------------------------------------------------------------------------
+// RunDatabaseCacheBenchmark
+//------------------------------------------------------------------------------
+void RunDatabaseCacheBenchmark()
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+
+    DatabaseLayout layout;
+    const auto result = layout.Load(DATABASE_BIN_FILE, options.PageSizeThreshold);
+    NV_THROW_IF(result != ReadOnlyDatabase::InitResult::Ok, "Failed to load the database records for the cache benchmark");
+
+    // Pages holding a single blob over the threshold would make the benchmark
+    // measure disk bandwidth rather than the cache, so only shared pages are used
+    std::vector<uint64_t> pageOffsets;
+    for (size_t i = 0; i < layout.GetPageCount(); ++i)
+    {
+        if (layout.GetPage(i).PageSize <= options.PageSizeThreshold)
+        {
+            pageOffsets.push_back(layout.GetPage(i).PageOffset);
+        }
+    }
+    NV_THROW_IF(pageOffsets.empty(), "The database has no pages to run the cache benchmark on");
+
+    const size_t accessCount = std::max<size_t>(pageOffsets.size() * 20, 100000);
+    NV_MESSAGE("Database cache benchmark: %zu pages, %zu accesses per run", pageOffsets.size(), accessCount);
+    NV_MESSAGE("%-8s %10s %-6s %10s %12s %14s", "pattern", "capacity", "policy", "miss rate", "eviction ms", "ns/eviction");
+
+    const AccessPattern patterns[] = { AccessPattern::Loop, AccessPattern::Skewed, AccessPattern::Frames };
+    const size_t capacityDivisors[] = { 10, 2 };
+    const PagedReadOnlyDatabase::EvictionPolicy policies[] = { PagedReadOnlyDatabase::EvictionPolicy::LeastRecentlyUsed, PagedReadOnlyDatabase::EvictionPolicy::Clock };
+
+    for (const auto pattern : patterns)
+    {
+        const std::vector<uint32_t> accesses = GenerateAccesses(pattern, pageOffsets.size(), accessCount);
+        for (const size_t divisor : capacityDivisors)
+        {
+            const size_t capacity = std::max<size_t>(pageOffsets.size() / divisor, 1);
+            for (const auto policy : policies)
+            {
+                const PagedReadOnlyDatabase::CacheSettings settings = { options.PageSizeThreshold, capacity, 0, options.CacheShardCount, policy, options.ReadEngine, options.ReadQueueDepth, 0, false, 0, false, options.HugePages, options.MaxCachedBufferBytes, false };
+                PagedReadOnlyDatabase database(settings);
+                NV_THROW_IF(database.Init(DATABASE_BIN_FILE) != ReadOnlyDatabase::InitResult::Ok, "Failed to open the database for the cache benchmark");
+
+                for (const uint32_t access : accesses)
+                {
+                    database.Unlock(database.Lock(pageOffsets[access]));
+                }
+
+                const auto stats = database.GetCacheStats();
+                NV_MESSAGE("%-8s %10zu %-6s %9.2f%% %12.3f %14.1f",
+                    AccessPatternToString(pattern),
+                    capacity,
+                    PagedReadOnlyDatabase::EvictionPolicyToString(policy),
+                    100.0 * static_cast<double>(stats.Misses) / static_cast<double>(accesses.size()),
+                    stats.EvictionNanoseconds / 1.0e6,
+                    stats.Evictions > 0 ? static_cast<double>(stats.EvictionNanoseconds) / static_cast<double>(stats.Evictions) : 0.0);
+            }
+        }
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Compares the eviction policies of the paged database backend on synthetic access patterns over the pages of " DATABASE_BIN_FILE "", []() {
+        RunDatabaseCacheBenchmark();
+        return true;
+    });
+}
@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseChecksumTool.cpp
+//
+// Writes the reference checksums which --database-verify checks the database
+// against, when the capture is packaged.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DatabaseBackend.h"
+#include "DatabaseChecksums.h"
+#include "DatabaseLayout.h"
+#include "ZipDatabaseArchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Bytes of the archive entry hashed at once when checking its CRC
+const uint64_t ENTRY_CHUNK_SIZE = 8 * 1024 * 1024;
+
+//------------------------------------------------------------------------------
+// SeekFile - 64-bit seek, since databases are usually larger than 2GB
+//------------------------------------------------------------------------------
+bool SeekFile(FILE* pFile, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(pFile, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(pFile, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// GetEntryName - the database is read from the entry of the archive with the
+// same file name
+//------------------------------------------------------------------------------
+const char* GetEntryName(const char* pFileName)
+{
+    const char* pEntryName = pFileName;
+    for (const char* pCharacter = pFileName; *pCharacter; ++pCharacter)
+    {
+        if (*pCharacter == '/' || *pCharacter == '\\')
+        {
+            pEntryName = pCharacter + 1;
+        }
+    }
+    return pEntryName;
+}
+
+//------------------------------------------------------------------------------
+// IsEntryIntact - whether the entry's data matches the CRC-32 the archive
+// recorded for it when it was packaged
+//------------------------------------------------------------------------------
+bool IsEntryIntact(const Serialization::ZipDatabaseArchive& archive)
+{
+    std::vector<uint8_t> buffer(static_cast<size_t>(std::min(ENTRY_CHUNK_SIZE, archive.GetDatabaseSize())));
+    uint32_t crc = 0;
+    for (uint64_t offset = 0; offset < archive.GetDatabaseSize(); offset += ENTRY_CHUNK_SIZE)
+    {
+        const uint64_t size = std::min(ENTRY_CHUNK_SIZE, archive.GetDatabaseSize() - offset);
+        if (!archive.Read(offset, size, buffer.data()))
+        {
+            return false;
+        }
+        crc = Serialization::Crc32(crc, buffer.data(), static_cast<size_t>(size));
+    }
+    return crc == archive.GetEntryCrc();
+}
+
+//------------------------------------------------------------------------------
+// WriteChecksums - writes the sidecar of the file the backend reads blobs from,
+// from the entry of the archive given with --database-zip once it matches its
+// CRC, or otherwise from the file as it is
+//------------------------------------------------------------------------------
+bool WriteChecksums()
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+    const char* pFileName = options.StoreFile.empty() ? DATABASE_BIN_FILE : options.StoreFile.c_str();
+
+    std::unique_ptr<ZipDatabaseArchive> spArchive;
+    uint64_t databaseSize = 0;
+    if (!options.ArchiveFile.empty())
+    {
+        spArchive.reset(new ZipDatabaseArchive());
+        if (!spArchive->Open(options.ArchiveFile.c_str(), GetEntryName(pFileName)))
+        {
+            NV_MESSAGE("Failed to open '%s' in the zip archive '%s'", GetEntryName(pFileName), options.ArchiveFile.c_str());
+            return false;
+        }
+        if (!IsEntryIntact(*spArchive))
+        {
+            NV_MESSAGE("'%s' in '%s' does not match the CRC the archive records for it; no checksums were written", GetEntryName(pFileName), options.ArchiveFile.c_str());
+            return false;
+        }
+        databaseSize = spArchive->GetDatabaseSize();
+    }
+    else if (!DatabaseLayout::GetFileSize(pFileName, databaseSize))
+    {
+        NV_MESSAGE("Failed to open '%s'", pFileName);
+        return false;
+    }
+
+    DatabaseLayout layout;
+    if (layout.Load(pFileName, databaseSize, options.PageSizeThreshold) != ReadOnlyDatabase::InitResult::Ok)
+    {
+        NV_MESSAGE("Failed to load the records of '%s'", pFileName);
+        return false;
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE*)> spFile(nullptr, fclose);
+    if (!spArchive)
+    {
+        spFile.reset(fopen(pFileName, "rb"));
+        if (!spFile)
+        {
+            NV_MESSAGE("Failed to open '%s'", pFileName);
+            return false;
+        }
+    }
+
+    // Runs of blocks are read from the thread pool, which shares the one file
+    std::mutex fileMutex;
+    DatabaseChecksums checksums;
+    checksums.Init(pFileName, layout, databaseSize);
+    const auto start = std::chrono::steady_clock::now();
+    const bool computed = checksums.Compute([&](uint64_t offset, uint64_t size, uint8_t* pDestination) {
+        if (spArchive)
+        {
+            return spArchive->Read(offset, size, pDestination);
+        }
+        std::lock_guard<std::mutex> lock(fileMutex);
+        return SeekFile(spFile.get(), offset) && fread(pDestination, 1, static_cast<size_t>(size), spFile.get()) == size;
+    });
+    const uint64_t noVerification[4] = {};
+    if (!computed || !checksums.Save(noVerification))
+    {
+        NV_MESSAGE("Failed to write the checksums of '%s' to '%s'", pFileName, checksums.GetFileName().c_str());
+        return false;
+    }
+
+    NV_MESSAGE("Wrote the checksums of %zu blocks of '%s' to '%s' in %.1f s, from %s%s",
+        checksums.GetBlockCount(),
+        pFileName,
+        checksums.GetFileName().c_str(),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+        spArchive ? "its CRC-checked entry in " : "the file as it is",
+        spArchive ? options.ArchiveFile.c_str() : "");
+    return true;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Writes the reference checksums --database-verify checks " DATABASE_BIN_FILE " against.  With --database-zip they are computed from the entry of the archive once it matches the CRC the archive records; otherwise from " DATABASE_BIN_FILE " as it is, so run it where the file is known to be good, such as when packaging the capture.", []() {
+        return WriteChecksums();
+    });
+}
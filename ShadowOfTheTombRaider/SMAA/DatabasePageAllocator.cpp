@@ -0,0 +1,233 @@
+//--------------------------------------------------------------------------------------
+// File: DatabasePageAllocator.cpp
+//
+// Memory for database pages, optionally backed by huge pages.
+//--------------------------------------------------------------------------------------
+
+#include "DatabasePageAllocator.h"
+
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// DatabasePageAllocator
+//------------------------------------------------------------------------------
+DatabasePageAllocator::DatabasePageAllocator(HugePages hugePages, uint64_t maxCachedBytes)
+    : m_HugePages(hugePages)
+    , m_MaxCachedBytes(maxCachedBytes)
+    , m_Mutex()
+    , m_FreeBuffers()
+    , m_CachedBytes()
+    , m_LargeAllocations()
+    , m_HugePageAllocations()
+    , m_HugePageFallbacks()
+    , m_Reuses()
+{
+}
+
+//------------------------------------------------------------------------------
+// ~DatabasePageAllocator
+//------------------------------------------------------------------------------
+DatabasePageAllocator::~DatabasePageAllocator()
+{
+    for (auto& freeBuffers : m_FreeBuffers)
+    {
+        for (uint8_t* pMemory : freeBuffers.second)
+        {
+            Unmap(pMemory, freeBuffers.first);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Allocate
+//------------------------------------------------------------------------------
+uint8_t* DatabasePageAllocator::Allocate(uint64_t size)
+{
+    if (size < LARGE_ALLOCATION_SIZE)
+    {
+        return new (std::nothrow) uint8_t[size > 0 ? size : 1];
+    }
+
+    const uint64_t mappingSize = GetMappingSize(size);
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = m_FreeBuffers.find(mappingSize);
+        if (it != m_FreeBuffers.end() && !it->second.empty())
+        {
+            uint8_t* pMemory = it->second.back();
+            it->second.pop_back();
+            m_CachedBytes -= mappingSize;
+            m_Reuses.fetch_add(1, std::memory_order_relaxed);
+            return pMemory;
+        }
+    }
+
+    return Map(mappingSize);
+}
+
+//------------------------------------------------------------------------------
+// Free
+//------------------------------------------------------------------------------
+void DatabasePageAllocator::Free(uint8_t* pMemory, uint64_t size)
+{
+    if (!pMemory)
+    {
+        return;
+    }
+    if (size < LARGE_ALLOCATION_SIZE)
+    {
+        delete[] pMemory;
+        return;
+    }
+
+    const uint64_t mappingSize = GetMappingSize(size);
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_CachedBytes + mappingSize <= m_MaxCachedBytes)
+        {
+            m_FreeBuffers[mappingSize].push_back(pMemory);
+            m_CachedBytes += mappingSize;
+            return;
+        }
+    }
+
+    Unmap(pMemory, mappingSize);
+}
+
+//------------------------------------------------------------------------------
+// Map
+//------------------------------------------------------------------------------
+uint8_t* DatabasePageAllocator::Map(uint64_t mappingSize)
+{
+    m_LargeAllocations.fetch_add(1, std::memory_order_relaxed);
+
+#if defined(_WIN32)
+    if (m_HugePages == HugePages::Explicit)
+    {
+        const SIZE_T largePageSize = GetLargePageMinimum();
+        if (largePageSize > 0 && mappingSize % largePageSize == 0)
+        {
+            void* pMemory = VirtualAlloc(nullptr, static_cast<SIZE_T>(mappingSize), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (pMemory)
+            {
+                m_HugePageAllocations.fetch_add(1, std::memory_order_relaxed);
+                return static_cast<uint8_t*>(pMemory);
+            }
+        }
+        m_HugePageFallbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Windows has no transparent huge pages
+    return static_cast<uint8_t*>(VirtualAlloc(nullptr, static_cast<SIZE_T>(mappingSize), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+#if defined(MAP_HUGETLB)
+    if (m_HugePages == HugePages::Explicit)
+    {
+        void* pMemory = mmap(nullptr, static_cast<size_t>(mappingSize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pMemory != MAP_FAILED)
+        {
+            m_HugePageAllocations.fetch_add(1, std::memory_order_relaxed);
+            return static_cast<uint8_t*>(pMemory);
+        }
+        m_HugePageFallbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+#else
+    if (m_HugePages == HugePages::Explicit)
+    {
+        m_HugePageFallbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+
+#if defined(MADV_HUGEPAGE)
+    if (m_HugePages == HugePages::Transparent)
+    {
+        // Huge pages can only back ranges aligned to their size, so map one more
+        // and trim the ends
+        const size_t paddedSize = static_cast<size_t>(mappingSize + LARGE_ALLOCATION_SIZE);
+        void* pPadded = mmap(nullptr, paddedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pPadded == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        uint8_t* pBegin = static_cast<uint8_t*>(pPadded);
+        uint8_t* pMemory = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(pBegin) + LARGE_ALLOCATION_SIZE - 1) & ~static_cast<uintptr_t>(LARGE_ALLOCATION_SIZE - 1));
+        uint8_t* pEnd = pBegin + paddedSize;
+        if (pMemory > pBegin)
+        {
+            munmap(pBegin, static_cast<size_t>(pMemory - pBegin));
+        }
+        if (pEnd > pMemory + mappingSize)
+        {
+            munmap(pMemory + mappingSize, static_cast<size_t>(pEnd - (pMemory + mappingSize)));
+        }
+
+        if (madvise(pMemory, static_cast<size_t>(mappingSize), MADV_HUGEPAGE) == 0)
+        {
+            m_HugePageAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pMemory;
+    }
+#endif
+
+    void* pMemory = mmap(nullptr, static_cast<size_t>(mappingSize), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return pMemory != MAP_FAILED ? static_cast<uint8_t*>(pMemory) : nullptr;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Unmap
+//------------------------------------------------------------------------------
+void DatabasePageAllocator::Unmap(uint8_t* pMemory, uint64_t mappingSize)
+{
+#if defined(_WIN32)
+    (void)mappingSize;
+    VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+    munmap(pMemory, static_cast<size_t>(mappingSize));
+#endif
+}
+
+//------------------------------------------------------------------------------
+// GetStats
+//------------------------------------------------------------------------------
+DatabasePageAllocator::Stats DatabasePageAllocator::GetStats() const
+{
+    Stats stats = {};
+    stats.LargeAllocations = m_LargeAllocations;
+    stats.HugePageAllocations = m_HugePageAllocations;
+    stats.HugePageFallbacks = m_HugePageFallbacks;
+    stats.Reuses = m_Reuses;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        stats.CachedBytes = m_CachedBytes;
+    }
+    return stats;
+}
+
+//------------------------------------------------------------------------------
+// HugePagesToString
+//------------------------------------------------------------------------------
+const char* DatabasePageAllocator::HugePagesToString(HugePages hugePages)
+{
+    switch (hugePages)
+    {
+    case HugePages::None:
+        return "none";
+    case HugePages::Transparent:
+        return "transparent";
+    case HugePages::Explicit:
+        return "explicit";
+    }
+    return "unknown";
+}
+
+} // namespace Serialization
@@ -0,0 +1,580 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseReadQueue.cpp
+//
+// Batched positional reads of the database file.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseReadQueue.h"
+
+#include "CommonReplay.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(NV_USE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace Serialization {
+
+#if defined(NV_USE_IO_URING)
+//----------------------------------------------------------------------------------
+// Ring
+//
+// A minimal io_uring made with the raw system calls, so that liburing is not
+// needed.  Only used by one thread at a time.
+//----------------------------------------------------------------------------------
+class DatabaseReadQueue::Ring
+{
+public:
+    Ring()
+        : m_fd(-1)
+        , m_pSqRing(MAP_FAILED)
+        , m_SqRingSize()
+        , m_pCqRing(MAP_FAILED)
+        , m_CqRingSize()
+        , m_pSqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+        , m_SqesSize()
+        , m_pSqTail()
+        , m_SqMask()
+        , m_pSqArray()
+        , m_pCqHead()
+        , m_pCqTail()
+        , m_CqMask()
+        , m_pCqes()
+        , m_Entries()
+    {
+    }
+
+    ~Ring()
+    {
+        if (m_pSqes != MAP_FAILED)
+        {
+            munmap(m_pSqes, m_SqesSize);
+        }
+        if (m_pCqRing != MAP_FAILED && m_pCqRing != m_pSqRing)
+        {
+            munmap(m_pCqRing, m_CqRingSize);
+        }
+        if (m_pSqRing != MAP_FAILED)
+        {
+            munmap(m_pSqRing, m_SqRingSize);
+        }
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    bool Init(unsigned entries)
+    {
+        io_uring_params params = {};
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping)
+        {
+            m_SqRingSize = m_CqRingSize = std::max(m_SqRingSize, m_CqRingSize);
+        }
+
+        m_pSqRing = mmap(nullptr, m_SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_pSqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        m_pCqRing = singleMapping ? m_pSqRing : mmap(nullptr, m_CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_pCqRing == MAP_FAILED)
+        {
+            return false;
+        }
+        m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_pSqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        if (m_pSqes == MAP_FAILED)
+        {
+            return false;
+        }
+
+        uint8_t* pSq = static_cast<uint8_t*>(m_pSqRing);
+        uint8_t* pCq = static_cast<uint8_t*>(m_pCqRing);
+        m_pSqTail = reinterpret_cast<unsigned*>(pSq + params.sq_off.tail);
+        m_SqMask = *reinterpret_cast<unsigned*>(pSq + params.sq_off.ring_mask);
+        m_pSqArray = reinterpret_cast<unsigned*>(pSq + params.sq_off.array);
+        m_pCqHead = reinterpret_cast<unsigned*>(pCq + params.cq_off.head);
+        m_pCqTail = reinterpret_cast<unsigned*>(pCq + params.cq_off.tail);
+        m_CqMask = *reinterpret_cast<unsigned*>(pCq + params.cq_off.ring_mask);
+        m_pCqes = reinterpret_cast<io_uring_cqe*>(pCq + params.cq_off.cqes);
+        m_Entries = params.sq_entries;
+        return true;
+    }
+
+    unsigned GetEntries() const
+    {
+        return m_Entries;
+    }
+
+    // Queues a vectored read; the iovec must stay valid until it completes
+    void QueueRead(int fd, const iovec* pVector, uint64_t offset, uint64_t userData)
+    {
+        const unsigned tail = *m_pSqTail;
+        const unsigned index = tail & m_SqMask;
+        io_uring_sqe& sqe = m_pSqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(pVector);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        m_pSqArray[index] = index;
+        __atomic_store_n(m_pSqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Submits queued reads and waits until at least minComplete have completed
+    bool Submit(unsigned toSubmit, unsigned minComplete)
+    {
+        for (;;)
+        {
+            const long result = syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (result >= 0)
+            {
+                return static_cast<unsigned>(result) == toSubmit;
+            }
+            if (errno != EINTR)
+            {
+                return false;
+            }
+
+            // Submission already happened if the wait was interrupted
+            toSubmit = 0;
+        }
+    }
+
+    bool PopCompletion(uint64_t& userData, int32_t& result)
+    {
+        const unsigned head = *m_pCqHead;
+        if (head == __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+
+        const io_uring_cqe& cqe = m_pCqes[head & m_CqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(m_pCqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int m_fd;
+    void* m_pSqRing;
+    size_t m_SqRingSize;
+    void* m_pCqRing;
+    size_t m_CqRingSize;
+    io_uring_sqe* m_pSqes;
+    size_t m_SqesSize;
+
+    unsigned* m_pSqTail;
+    unsigned m_SqMask;
+    unsigned* m_pSqArray;
+    unsigned* m_pCqHead;
+    unsigned* m_pCqTail;
+    unsigned m_CqMask;
+    io_uring_cqe* m_pCqes;
+    unsigned m_Entries;
+};
+#else
+class DatabaseReadQueue::Ring
+{
+};
+#endif
+
+//------------------------------------------------------------------------------
+// DatabaseReadQueue
+//------------------------------------------------------------------------------
+DatabaseReadQueue::DatabaseReadQueue()
+#if defined(_WIN32)
+    : m_hFile(INVALID_HANDLE_VALUE)
+#else
+    : m_fd(-1)
+#endif
+    , m_Engine(Engine::Synchronous)
+    , m_QueueDepth(1)
+    , m_RingMutex()
+    , m_FreeRings()
+    , m_Reads()
+    , m_Submissions()
+{
+}
+
+//------------------------------------------------------------------------------
+// ~DatabaseReadQueue
+//------------------------------------------------------------------------------
+DatabaseReadQueue::~DatabaseReadQueue()
+{
+    Reset();
+}
+
+//------------------------------------------------------------------------------
+// IsEngineAvailable - whether the engine is built in; IoUring can still fall
+// back at run time
+//------------------------------------------------------------------------------
+bool DatabaseReadQueue::IsEngineAvailable(Engine engine)
+{
+    switch (engine)
+    {
+    case Engine::Synchronous:
+        return true;
+    case Engine::IoUring:
+#if defined(NV_USE_IO_URING)
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// EngineToString
+//------------------------------------------------------------------------------
+const char* DatabaseReadQueue::EngineToString(Engine engine)
+{
+    switch (engine)
+    {
+    case Engine::Synchronous:
+        return "pread";
+    case Engine::IoUring:
+        return "io_uring";
+    }
+    return "unknown";
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+#if defined(_WIN32)
+void DatabaseReadQueue::Init(void* hFile, Engine engine, size_t queueDepth)
+#else
+void DatabaseReadQueue::Init(int fd, Engine engine, size_t queueDepth)
+#endif
+{
+    Reset();
+
+#if defined(_WIN32)
+    m_hFile = hFile;
+#else
+    m_fd = fd;
+#endif
+    m_QueueDepth = std::max<size_t>(queueDepth, 1);
+    m_Engine = IsEngineAvailable(engine) ? engine : Engine::Synchronous;
+
+    // Set up one ring now so that an unusable io_uring is found before the replay
+    // starts rather than on the first miss
+    if (m_Engine == Engine::IoUring)
+    {
+        std::unique_ptr<Ring> spRing = AcquireRing();
+        if (spRing)
+        {
+            ReleaseRing(std::move(spRing));
+        }
+        else
+        {
+            NV_MESSAGE("io_uring is not available (%s); database reads fall back to pread", strerror(errno));
+            m_Engine = Engine::Synchronous;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Reset
+//------------------------------------------------------------------------------
+void DatabaseReadQueue::Reset()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_RingMutex);
+        m_FreeRings.clear();
+    }
+
+#if defined(_WIN32)
+    m_hFile = INVALID_HANDLE_VALUE;
+#else
+    m_fd = -1;
+#endif
+    m_Engine = Engine::Synchronous;
+    m_QueueDepth = 1;
+    m_Reads = 0;
+    m_Submissions = 0;
+}
+
+//------------------------------------------------------------------------------
+// GetStats
+//------------------------------------------------------------------------------
+DatabaseReadQueue::Stats DatabaseReadQueue::GetStats() const
+{
+    Stats stats = {};
+    stats.Reads = m_Reads;
+    stats.Submissions = m_Submissions;
+    return stats;
+}
+
+//------------------------------------------------------------------------------
+// AcquireRing - a free ring, or a new one; null if none can be created
+//------------------------------------------------------------------------------
+std::unique_ptr<DatabaseReadQueue::Ring> DatabaseReadQueue::AcquireRing()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_RingMutex);
+        if (!m_FreeRings.empty())
+        {
+            std::unique_ptr<Ring> spRing = std::move(m_FreeRings.back());
+            m_FreeRings.pop_back();
+            return spRing;
+        }
+    }
+
+#if defined(NV_USE_IO_URING)
+    std::unique_ptr<Ring> spRing(new Ring());
+    if (spRing->Init(static_cast<unsigned>(std::min<size_t>(m_QueueDepth, 4096))))
+    {
+        return spRing;
+    }
+#endif
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// ReleaseRing
+//------------------------------------------------------------------------------
+void DatabaseReadQueue::ReleaseRing(std::unique_ptr<Ring> spRing)
+{
+    std::lock_guard<std::mutex> lock(m_RingMutex);
+    m_FreeRings.push_back(std::move(spRing));
+}
+
+//------------------------------------------------------------------------------
+// Read
+//------------------------------------------------------------------------------
+bool DatabaseReadQueue::Read(uint64_t offset, uint64_t size, uint8_t* pDestination)
+{
+    DatabaseReadRequest request = { offset, size, pDestination, false };
+    return Read(&request, 1);
+}
+
+//------------------------------------------------------------------------------
+// Read
+//------------------------------------------------------------------------------
+bool DatabaseReadQueue::Read(DatabaseReadRequest* pRequests, size_t count)
+{
+    // A single chunk gains nothing from a ring
+    const bool singleChunk = count == 1 && pRequests[0].Size <= CHUNK_SIZE;
+    if (m_Engine == Engine::IoUring && !singleChunk)
+    {
+        std::unique_ptr<Ring> spRing = AcquireRing();
+        if (spRing)
+        {
+            const bool success = ReadWithRing(*spRing, pRequests, count);
+            ReleaseRing(std::move(spRing));
+            return success;
+        }
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        DatabaseReadRequest& request = pRequests[i];
+        request.Succeeded = ReadSynchronous(request.Offset, request.Size, request.pDestination);
+        success = success && request.Succeeded;
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// ReadSynchronous - positional read, safe to call from several threads at once
+//------------------------------------------------------------------------------
+bool DatabaseReadQueue::ReadSynchronous(uint64_t offset, uint64_t size, uint8_t* pDestination)
+{
+    while (size > 0)
+    {
+#if defined(_WIN32)
+        const DWORD chunkSize = static_cast<DWORD>(std::min<uint64_t>(size, 1u << 30));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD bytesRead = 0;
+        if (!ReadFile(m_hFile, pDestination, chunkSize, &bytesRead, &overlapped) || bytesRead == 0)
+        {
+            return false;
+        }
+#else
+        const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(size, 1u << 30));
+        const ssize_t bytesRead = pread(m_fd, pDestination, chunkSize, static_cast<off_t>(offset));
+        if (bytesRead <= 0)
+        {
+            return false;
+        }
+#endif
+
+        offset += static_cast<uint64_t>(bytesRead);
+        size -= static_cast<uint64_t>(bytesRead);
+        pDestination += bytesRead;
+        m_Reads.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// ReadWithRing
+//------------------------------------------------------------------------------
+bool DatabaseReadQueue::ReadWithRing(Ring& ring, DatabaseReadRequest* pRequests, size_t count)
+{
+#if defined(NV_USE_IO_URING)
+    struct Chunk
+    {
+        iovec Vector;
+        uint64_t Offset;
+        size_t Request;
+    };
+
+    static thread_local std::vector<Chunk> t_chunks;
+    static thread_local std::vector<size_t> t_pending;
+    std::vector<Chunk>& chunks = t_chunks;
+    std::vector<size_t>& pending = t_pending;
+    chunks.clear();
+    pending.clear();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        DatabaseReadRequest& request = pRequests[i];
+        request.Succeeded = true;
+        for (uint64_t begin = 0; begin < request.Size; begin += CHUNK_SIZE)
+        {
+            Chunk chunk = {};
+            chunk.Vector.iov_base = request.pDestination + begin;
+            chunk.Vector.iov_len = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, request.Size - begin));
+            chunk.Offset = request.Offset + begin;
+            chunk.Request = i;
+            chunks.push_back(chunk);
+        }
+    }
+
+    // Chunks are issued in file order
+    for (size_t i = chunks.size(); i-- > 0;)
+    {
+        pending.push_back(i);
+    }
+
+    const size_t depth = std::min<size_t>(m_QueueDepth, ring.GetEntries());
+    size_t inFlight = 0;
+    bool ringFailed = false;
+    while (!ringFailed && (!pending.empty() || inFlight > 0))
+    {
+        unsigned queued = 0;
+        while (inFlight + queued < depth && !pending.empty())
+        {
+            const size_t index = pending.back();
+            pending.pop_back();
+            ring.QueueRead(m_fd, &chunks[index].Vector, chunks[index].Offset, index);
+            ++queued;
+        }
+
+        m_Submissions.fetch_add(1, std::memory_order_relaxed);
+        if (!ring.Submit(queued, 1))
+        {
+            ringFailed = true;
+            break;
+        }
+        inFlight += queued;
+
+        uint64_t index = 0;
+        int32_t result = 0;
+        while (ring.PopCompletion(index, result))
+        {
+            --inFlight;
+            Chunk& chunk = chunks[static_cast<size_t>(index)];
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                pending.push_back(static_cast<size_t>(index));
+            }
+            else if (result <= 0)
+            {
+                pRequests[chunk.Request].Succeeded = false;
+            }
+            else
+            {
+                m_Reads.fetch_add(1, std::memory_order_relaxed);
+
+                // Short reads are continued with the rest of the chunk
+                const size_t bytesRead = static_cast<size_t>(result);
+                if (bytesRead < chunk.Vector.iov_len)
+                {
+                    chunk.Vector.iov_base = static_cast<uint8_t*>(chunk.Vector.iov_base) + bytesRead;
+                    chunk.Vector.iov_len -= bytesRead;
+                    chunk.Offset += bytesRead;
+                    pending.push_back(static_cast<size_t>(index));
+                }
+            }
+        }
+    }
+
+    // A ring which failed may still own reads into the destinations, so it cannot
+    // be reused; the requests are read synchronously instead
+    if (ringFailed)
+    {
+        NV_MESSAGE("io_uring submission failed (%s); database reads fall back to pread", strerror(errno));
+        while (inFlight > 0)
+        {
+            uint64_t index = 0;
+            int32_t result = 0;
+            if (ring.PopCompletion(index, result))
+            {
+                --inFlight;
+            }
+            else if (!ring.Submit(0, 1))
+            {
+                // The kernel is not completing reads; nothing safe can be done with
+                // the destinations
+                ThrowErrorWithMessage("io_uring reads can no longer be completed", __FILE__, __LINE__);
+            }
+        }
+        m_Engine = Engine::Synchronous;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        DatabaseReadRequest& request = pRequests[i];
+        if (ringFailed)
+        {
+            request.Succeeded = ReadSynchronous(request.Offset, request.Size, request.pDestination);
+        }
+        success = success && request.Succeeded;
+    }
+    return success;
+#else
+    (void)ring;
+    (void)pRequests;
+    (void)count;
+    return false;
+#endif
+}
+
+} // namespace Serialization
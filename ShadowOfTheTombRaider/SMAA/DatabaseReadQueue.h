@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseReadQueue.h
+//
+// Batched positional reads of the database file.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Serialization {
+
+struct DatabaseReadRequest
+{
+    uint64_t Offset;
+    uint64_t Size;
+    uint8_t* pDestination;
+    bool Succeeded; // Set by DatabaseReadQueue::Read
+};
+
+//----------------------------------------------------------------------------------
+// DatabaseReadQueue
+//
+// Reads batches of ranges of a file.  Ranges are split into CHUNK_SIZE reads, and
+// with the IoUring engine up to the queue depth of them are kept in flight with
+// one system call per submission, so a batch of page misses is read at the
+// device's queue depth rather than one request at a time.
+//
+// The Synchronous engine reads each range with pread (ReadFile on Windows).  It is
+// used where io_uring is not available: other platforms, builds without
+// linux/io_uring.h, and kernels or sandboxes which refuse io_uring_setup.
+//
+// Each concurrent Read uses a ring of its own, taken from a pool, so reads can be
+// issued from several threads at once.
+//----------------------------------------------------------------------------------
+class DatabaseReadQueue
+{
+public:
+    enum class Engine
+    {
+        Synchronous,
+        IoUring,
+    };
+
+    static constexpr uint64_t CHUNK_SIZE = 512 * 1024;
+
+    struct Stats
+    {
+        uint64_t Reads; // Chunks read from the file
+        uint64_t Submissions; // System calls which submitted or waited for reads
+    };
+
+    DatabaseReadQueue();
+    ~DatabaseReadQueue();
+
+    //------------------------------------------------------------------------------
+    // Init - Reads are issued against the given file, which stays owned by the
+    // caller.  The IoUring engine falls back to Synchronous if no ring can be set up.
+    //------------------------------------------------------------------------------
+#if defined(_WIN32)
+    void Init(void* hFile, Engine engine, size_t queueDepth);
+#else
+    void Init(int fd, Engine engine, size_t queueDepth);
+#endif
+    void Reset();
+
+    Engine GetEngine() const
+    {
+        return m_Engine;
+    }
+
+    size_t GetQueueDepth() const
+    {
+        return m_QueueDepth;
+    }
+
+    Stats GetStats() const;
+
+    //------------------------------------------------------------------------------
+    // Read - Performs every request, setting each one's Succeeded.  Returns true if
+    // all of them succeeded.  Safe to call from several threads at once.
+    //------------------------------------------------------------------------------
+    bool Read(DatabaseReadRequest* pRequests, size_t count);
+    bool Read(uint64_t offset, uint64_t size, uint8_t* pDestination);
+
+    static bool IsEngineAvailable(Engine engine);
+    static const char* EngineToString(Engine engine);
+
+private:
+    class Ring;
+
+    // This class is non-copyable
+    DatabaseReadQueue(const DatabaseReadQueue&) = delete;
+    DatabaseReadQueue& operator=(const DatabaseReadQueue&) = delete;
+
+    bool ReadSynchronous(uint64_t offset, uint64_t size, uint8_t* pDestination);
+    bool ReadWithRing(Ring& ring, DatabaseReadRequest* pRequests, size_t count);
+
+    std::unique_ptr<Ring> AcquireRing();
+    void ReleaseRing(std::unique_ptr<Ring> spRing);
+
+#if defined(_WIN32)
+    void* m_hFile;
+#else
+    int m_fd;
+#endif
+    Engine m_Engine;
+    size_t m_QueueDepth;
+
+    // Rings which are not in use by a Read
+    std::mutex m_RingMutex;
+    std::vector<std::unique_ptr<Ring>> m_FreeRings;
+
+    std::atomic<uint64_t> m_Reads;
+    std::atomic<uint64_t> m_Submissions;
+};
+
+} // namespace Serialization
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseSource.h
+//
+// Random-access source of database bytes other than the database file itself.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// IDatabaseSource
+//
+// Implemented by containers which hold a database file, such as a
+// CompressedDatabaseFile or a zip archive, so the paged backend can read pages
+// from them in place of the database file.
+//----------------------------------------------------------------------------------
+class IDatabaseSource
+{
+public:
+    virtual ~IDatabaseSource() = default;
+
+    // Size of the database file held by the container
+    virtual uint64_t GetDatabaseSize() const = 0;
+
+    //------------------------------------------------------------------------------
+    // Read - Reads size bytes at offset in the database file into pDestination.
+    // Must be safe to call from several threads at once.
+    //------------------------------------------------------------------------------
+    virtual bool Read(uint64_t offset, uint64_t size, uint8_t* pDestination) const = 0;
+};
+
+} // namespace Serialization
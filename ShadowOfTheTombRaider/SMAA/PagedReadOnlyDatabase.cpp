@@ -0,0 +1,1337 @@
+//--------------------------------------------------------------------------------------
+// File: PagedReadOnlyDatabase.cpp
+//
+// Heap-paged implementation of IReadOnlyDatabase with a sharded page cache.
+//--------------------------------------------------------------------------------------
+
+#include "PagedReadOnlyDatabase.h"
+
+#include "CommonReplay.h"
+#include "DatabaseTelemetry.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Serialization {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// ScopeLockHandoff - a lock taken by a read for its data scope, which Lock hands
+// over when the scope asks for the page
+//------------------------------------------------------------------------------
+struct ScopeLockHandoff
+{
+    const PagedReadOnlyDatabase* pDatabase;
+    size_t PageIndex;
+    DataScope::LockedPageHandle pPageHandle;
+};
+
+thread_local ScopeLockHandoff t_scopeLockHandoff = {};
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// PagedReadOnlyDatabase
+//------------------------------------------------------------------------------
+PagedReadOnlyDatabase::PagedReadOnlyDatabase(const CacheSettings& settings)
+    : m_Layout()
+    , m_Pages()
+    , m_DatabaseSize()
+    , m_Shards(new Shard[std::max<size_t>(settings.ShardCount, 1)])
+    , m_ShardCount(std::max<size_t>(settings.ShardCount, 1))
+    , m_EvictionMutex()
+    , m_ResidentRing()
+    , m_ClockHand()
+#if defined(_WIN32)
+    , m_hFile(INVALID_HANDLE_VALUE)
+#else
+    , m_fd(-1)
+#endif
+    , m_spSource()
+    , m_spSharedCache()
+    , m_Allocator(settings.HugePages, settings.MaxCachedBufferBytes)
+    , m_ReadQueue()
+    , m_ReadEngine(settings.ReadEngine)
+    , m_ReadQueueDepth(std::max<size_t>(settings.ReadQueueDepth, 1))
+    , m_PageSizeThreshold(settings.PageSizeThreshold)
+    , m_MaxResidentPages(settings.MaxResidentPages)
+    , m_MaxResidentBytes(settings.MaxResidentBytes)
+    , m_Policy(settings.Policy)
+    , m_FramePool(settings.MaxFrameResidentBytes, settings.PageSizeThreshold)
+    , m_InitRelease(settings.ReleaseInitPages)
+    , m_WorkingSetPin(settings.PinWarmupFrames, settings.PinWithMlock)
+    , m_EpochUnlock(settings.EpochUnlock)
+    , m_StaticPin()
+    , m_Verification()
+    , m_TrackPhases(m_FramePool.IsEnabled() || m_InitRelease.IsEnabled() || m_WorkingSetPin.IsEnabled())
+    , m_PageAccessCounter()
+    , m_ResidentPages()
+    , m_ResidentBytes()
+    , m_ResidentBytesHighWater()
+    , m_Misses()
+    , m_Evictions()
+    , m_EvictionNanoseconds()
+    , m_ContendedLocks()
+    , m_OverBudgetLoads()
+    , m_lastInitResult(InitResult::NeverInitialized)
+{
+}
+
+//------------------------------------------------------------------------------
+// ~PagedReadOnlyDatabase
+//------------------------------------------------------------------------------
+PagedReadOnlyDatabase::~PagedReadOnlyDatabase()
+{
+    if (m_lastInitResult == InitResult::Ok)
+    {
+        const CacheStats stats = GetCacheStats();
+        NV_MESSAGE_VERBOSE("Database page cache: %llu misses, %llu evictions (%s, %.3f ms), %llu contended shard locks (%zu shards)",
+            static_cast<unsigned long long>(stats.Misses),
+            static_cast<unsigned long long>(stats.Evictions),
+            EvictionPolicyToString(m_Policy),
+            stats.EvictionNanoseconds / 1.0e6,
+            static_cast<unsigned long long>(stats.ContendedLocks),
+            m_ShardCount);
+
+        // The high-water mark is what a memory budget has to be sized against, so
+        // always report it when one is set
+        const double megabyte = 1024.0 * 1024.0;
+        if (m_MaxResidentBytes > 0)
+        {
+            NV_MESSAGE("Database page cache: resident high-water mark %.1f MB of %.1f MB budget, %llu loads over budget",
+                stats.ResidentBytesHighWater / megabyte,
+                m_MaxResidentBytes / megabyte,
+                static_cast<unsigned long long>(stats.OverBudgetLoads));
+        }
+        else
+        {
+            NV_MESSAGE_VERBOSE("Database page cache: resident high-water mark %.1f MB", stats.ResidentBytesHighWater / megabyte);
+        }
+
+        m_FramePool.Report();
+        m_WorkingSetPin.Report();
+        m_StaticPin.Report();
+        m_EpochUnlock.Report();
+
+        const DatabasePageAllocator::Stats allocatorStats = m_Allocator.GetStats();
+        NV_MESSAGE_VERBOSE("Database page memory: %llu large buffers mapped, %llu with %s huge pages, %llu reused after eviction",
+            static_cast<unsigned long long>(allocatorStats.LargeAllocations),
+            static_cast<unsigned long long>(allocatorStats.HugePageAllocations),
+            DatabasePageAllocator::HugePagesToString(m_Allocator.GetHugePages()),
+            static_cast<unsigned long long>(allocatorStats.Reuses));
+        if (allocatorStats.HugePageFallbacks > 0)
+        {
+            NV_MESSAGE("Database page memory: %llu of %llu large buffers could not get explicit huge pages and used ordinary pages; reserve more with vm.nr_hugepages",
+                static_cast<unsigned long long>(allocatorStats.HugePageFallbacks),
+                static_cast<unsigned long long>(allocatorStats.LargeAllocations));
+        }
+
+        if (m_spSharedCache)
+        {
+            const SharedDatabaseCache::Stats sharedStats = m_spSharedCache->GetStats();
+            NV_MESSAGE("Database shared cache '%s': %llu chunks read by this process, %llu waits for other readers, %.1f MB loaded by %zu attached processes",
+                m_spSharedCache->GetName().c_str(),
+                static_cast<unsigned long long>(sharedStats.ChunksRead),
+                static_cast<unsigned long long>(sharedStats.ChunkWaits),
+                sharedStats.LoadedBytes / megabyte,
+                sharedStats.AttachedProcesses);
+        }
+
+        PagedCacheTelemetry::Report();
+        m_Verification.Report();
+
+        if (!m_spSource)
+        {
+            const DatabaseReadQueue::Stats readStats = m_ReadQueue.GetStats();
+            NV_MESSAGE_VERBOSE("Database reads: %llu chunks in %llu submissions (%s, queue depth %zu)",
+                static_cast<unsigned long long>(readStats.Reads),
+                static_cast<unsigned long long>(readStats.Submissions),
+                DatabaseReadQueue::EngineToString(m_ReadQueue.GetEngine()),
+                m_ReadQueue.GetQueueDepth());
+        }
+    }
+
+    FreePages();
+    CloseFile();
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+PagedReadOnlyDatabase::InitResult PagedReadOnlyDatabase::Init(const char* pFileName, const char* pCompressedFileName)
+{
+    if (!pFileName)
+    {
+        m_lastInitResult = InitResult::BadArgument;
+        return m_lastInitResult;
+    }
+
+    if (pCompressedFileName)
+    {
+        std::unique_ptr<CompressedDatabaseFile> spCompressedFile(new CompressedDatabaseFile());
+        if (!spCompressedFile->Open(pCompressedFileName))
+        {
+            m_lastInitResult = InitResult::FailedToOpenDatabase;
+            return m_lastInitResult;
+        }
+        return Init(pFileName, std::move(spCompressedFile));
+    }
+
+    FreePages();
+    CloseFile();
+
+    if (!OpenFile(pFileName) || !DatabaseLayout::GetFileSize(pFileName, m_DatabaseSize))
+    {
+        CloseFile();
+        m_lastInitResult = InitResult::FailedToOpenDatabase;
+        return m_lastInitResult;
+    }
+
+    return InitPages(pFileName);
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+PagedReadOnlyDatabase::InitResult PagedReadOnlyDatabase::Init(const char* pFileName, std::unique_ptr<IDatabaseSource> spSource)
+{
+    if (!pFileName || !spSource)
+    {
+        m_lastInitResult = InitResult::BadArgument;
+        return m_lastInitResult;
+    }
+
+    FreePages();
+    CloseFile();
+
+    m_spSource = std::move(spSource);
+    m_DatabaseSize = m_spSource->GetDatabaseSize();
+    return InitPages(pFileName);
+}
+
+//------------------------------------------------------------------------------
+// InitPages - loads the layout and builds the page table once the file is open
+//------------------------------------------------------------------------------
+PagedReadOnlyDatabase::InitResult PagedReadOnlyDatabase::InitPages(const char* pFileName)
+{
+    m_lastInitResult = m_Layout.Load(pFileName, m_DatabaseSize, m_PageSizeThreshold);
+    if (m_lastInitResult != InitResult::Ok)
+    {
+        CloseFile();
+        return m_lastInitResult;
+    }
+
+    m_Pages.reset(new PagedPage[m_Layout.GetPageCount()]);
+    for (size_t i = 0; i < m_Layout.GetPageCount(); ++i)
+    {
+        m_Pages[i].pRecord = &m_Layout.GetPage(i);
+    }
+    m_ResidentRing.reserve(m_MaxResidentPages > 0 ? std::min(m_MaxResidentPages + 1, m_Layout.GetPageCount()) : m_Layout.GetPageCount());
+
+    m_EpochUnlock.Init(m_Pages.get(), m_Layout.GetPageCount());
+
+    m_Misses = 0;
+    m_Evictions = 0;
+    m_EvictionNanoseconds = 0;
+    m_ContendedLocks = 0;
+    m_OverBudgetLoads = 0;
+    m_ResidentBytesHighWater = 0;
+    return m_lastInitResult;
+}
+
+//------------------------------------------------------------------------------
+// GetCacheStats
+//------------------------------------------------------------------------------
+PagedReadOnlyDatabase::CacheStats PagedReadOnlyDatabase::GetCacheStats() const
+{
+    CacheStats stats = {};
+    stats.Misses = m_Misses;
+    stats.Evictions = m_Evictions;
+    stats.EvictionNanoseconds = m_EvictionNanoseconds;
+    stats.ContendedLocks = m_ContendedLocks;
+    stats.ResidentPages = m_ResidentPages;
+    stats.ResidentBytes = m_ResidentBytes;
+    stats.ResidentBytesHighWater = m_ResidentBytesHighWater;
+    stats.OverBudgetLoads = m_OverBudgetLoads;
+    return stats;
+}
+
+//------------------------------------------------------------------------------
+// EvictionPolicyToString
+//------------------------------------------------------------------------------
+const char* PagedReadOnlyDatabase::EvictionPolicyToString(EvictionPolicy policy)
+{
+    switch (policy)
+    {
+    case EvictionPolicy::Clock:
+        return "clock";
+    case EvictionPolicy::LeastRecentlyUsed:
+        return "lru";
+    }
+    return "unknown";
+}
+
+//------------------------------------------------------------------------------
+// OpenFile
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::OpenFile(const char* pFileName)
+{
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_hFile = hFile;
+    m_ReadQueue.Init(m_hFile, m_ReadEngine, m_ReadQueueDepth);
+#else
+    m_fd = open(pFileName, O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+    m_ReadQueue.Init(m_fd, m_ReadEngine, m_ReadQueueDepth);
+#endif
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// CloseFile
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::CloseFile()
+{
+    m_ReadQueue.Reset();
+    m_spSource.reset();
+    m_spSharedCache.reset();
+    m_Verification.Reset();
+    m_DatabaseSize = 0;
+
+#if defined(_WIN32)
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+//------------------------------------------------------------------------------
+// ReadFromFile - positional read, safe to call from several threads at once
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::ReadFromFile(uint64_t offset, uint64_t size, uint8_t* pDestination)
+{
+    if (m_spSource)
+    {
+        return m_spSource->Read(offset, size, pDestination);
+    }
+
+    return m_ReadQueue.Read(offset, size, pDestination);
+}
+
+//------------------------------------------------------------------------------
+// AttachSharedCache
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::AttachSharedCache(const char* pSourceFileName)
+{
+    if (!m_Pages || m_ResidentPages > 0)
+    {
+        return false;
+    }
+
+    std::unique_ptr<SharedDatabaseCache> spSharedCache(new SharedDatabaseCache());
+    if (!spSharedCache->Attach(pSourceFileName, m_DatabaseSize))
+    {
+        return false;
+    }
+
+    const SharedDatabaseCache::Stats sharedStats = spSharedCache->GetStats();
+    NV_MESSAGE("Database shared cache '%s': attached with %zu other processes, %.1f MB already loaded",
+        spSharedCache->GetName().c_str(),
+        sharedStats.AttachedProcesses - 1,
+        sharedStats.LoadedBytes / (1024.0 * 1024.0));
+    m_spSharedCache = std::move(spSharedCache);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// EnableVerification
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::EnableVerification(const char* pFileName, const char* pSourceFileName)
+{
+    if (!m_Pages || m_ResidentPages > 0)
+    {
+        return false;
+    }
+
+    return m_Verification.Enable(pFileName, pSourceFileName, m_Layout, m_DatabaseSize);
+}
+
+//------------------------------------------------------------------------------
+// AllocatePage
+//------------------------------------------------------------------------------
+uint8_t* PagedReadOnlyDatabase::AllocatePage(const DatabasePageRecord& record)
+{
+    if (m_spSharedCache)
+    {
+        return m_spSharedCache->GetData() + record.PageOffset;
+    }
+
+    return m_Allocator.Allocate(PagedPage::GetCapacity(record));
+}
+
+//------------------------------------------------------------------------------
+// FreePage
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::FreePage(uint8_t* pMemory, const DatabasePageRecord& record)
+{
+    if (!m_spSharedCache)
+    {
+        m_Allocator.Free(pMemory, PagedPage::GetCapacity(record));
+    }
+}
+
+//------------------------------------------------------------------------------
+// ReadPageData - pDestination is where the range lives in the shared cache when
+// one is attached
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::ReadPageData(uint64_t offset, uint64_t size, uint8_t* pDestination)
+{
+    const bool timed = m_Verification.IsEnabled() || PagedCacheTelemetry::IsEnabled();
+    const auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    bool success = false;
+    if (m_spSharedCache)
+    {
+        success = m_spSharedCache->Load(offset, size, [this](uint64_t chunkOffset, uint64_t chunkSize, uint8_t* pChunk) {
+            return ReadFromFile(chunkOffset, chunkSize, pChunk);
+        });
+    }
+    else
+    {
+        success = ReadFromFile(offset, size, pDestination);
+    }
+
+    if (!success || !timed)
+    {
+        return success;
+    }
+
+    const uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    CountDatabaseMiss(size, nanoseconds);
+
+    if (m_Verification.IsEnabled())
+    {
+        m_Verification.OnRead(nanoseconds);
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// LockShard
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::LockShard(Shard& shard)
+{
+    if (!shard.Mutex.try_lock())
+    {
+        m_ContendedLocks.fetch_add(1, std::memory_order_relaxed);
+        shard.Mutex.lock();
+    }
+}
+
+//------------------------------------------------------------------------------
+// GetSize
+//------------------------------------------------------------------------------
+uint64_t PagedReadOnlyDatabase::GetSize(const DATABASE_HANDLE& handle)
+{
+    const DatabaseBlobLocation* pLocation = m_Layout.GetBlobLocation(handle);
+    return pLocation ? pLocation->Size : 0;
+}
+
+//------------------------------------------------------------------------------
+// Lock
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle PagedReadOnlyDatabase::Lock(uint64_t pageOffset)
+{
+    const size_t pageIndex = m_Layout.FindPageStart(pageOffset);
+    if (pageIndex >= m_Layout.GetPageCount())
+    {
+        return nullptr;
+    }
+
+    ScopeLockHandoff& handoff = t_scopeLockHandoff;
+    if (handoff.pPageHandle && handoff.pDatabase == this && handoff.PageIndex == pageIndex)
+    {
+        DataScope::LockedPageHandle pPageHandle = handoff.pPageHandle;
+        handoff = {};
+        return pPageHandle;
+    }
+
+    return LockForScope(m_Pages[pageIndex]);
+}
+
+//------------------------------------------------------------------------------
+// LockForScope
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle PagedReadOnlyDatabase::LockForScope(PagedPage& page)
+{
+    if (m_EpochUnlock.Applies())
+    {
+        return LockInEpoch(page);
+    }
+    return LockPage(page);
+}
+
+//------------------------------------------------------------------------------
+// LockInEpoch
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle PagedReadOnlyDatabase::LockInEpoch(PagedPage& page)
+{
+    const size_t pageIndex = GetPageIndex(page);
+    if (m_EpochUnlock.IsHeld(pageIndex))
+    {
+        PagedCacheTelemetry::OnLock(true);
+    }
+    else
+    {
+        if (!LockPage(page))
+        {
+            return nullptr;
+        }
+        m_EpochUnlock.Hold(pageIndex);
+    }
+    m_EpochUnlock.OnHandleLocked();
+    return PagedEpochUnlock::TagHandle(page);
+}
+
+//------------------------------------------------------------------------------
+// LockPage
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle PagedReadOnlyDatabase::LockPage(PagedPage& page, bool replayUse)
+{
+    // Recency orders eviction under any of the limits, and costs nothing without one
+    if (m_MaxResidentPages > 0 || m_MaxResidentBytes > 0 || m_FramePool.IsEnabled())
+    {
+        if (m_Policy == EvictionPolicy::Clock)
+        {
+            // Avoid dirtying the cache line when the bit is already set
+            if (!page.Referenced.load(std::memory_order_relaxed))
+            {
+                page.Referenced.store(true, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            page.LastAccessCounter.store(m_PageAccessCounter.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+
+    // Fast path: the page is resident and not being evicted.  Holding a lock count
+    // keeps it resident from here on.
+    const bool resident = page.LockCount.fetch_add(1) >= 0 && page.pMemory.load(std::memory_order_acquire);
+    if (!resident && !LoadPage(page))
+    {
+        page.LockCount.fetch_sub(1);
+        return nullptr;
+    }
+
+    PagedCacheTelemetry::OnLock(resident);
+
+    if (m_TrackPhases && replayUse)
+    {
+        const DatabasePhase phase = GetDatabasePhase();
+        const uint8_t phaseBit = DatabasePhaseBit(phase);
+        if (!(page.Phases.load(std::memory_order_relaxed) & phaseBit))
+        {
+            OnFirstUseInPhase(page, phaseBit);
+        }
+
+        // The page is tagged first, so the release keeps it
+        if (m_InitRelease.TakeFirstFrameLock(phase))
+        {
+            ReleaseInitPages();
+        }
+
+        // Pinning may load pages, so it is done before the frame goes on to use them
+        if (m_WorkingSetPin.TakePinStart(phase))
+        {
+            PinWorkingSet();
+        }
+    }
+
+    return &page;
+}
+
+//------------------------------------------------------------------------------
+// OnFirstUseInPhase
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::OnFirstUseInPhase(PagedPage& page, uint8_t phaseBit)
+{
+    const uint8_t previousPhases = page.Phases.fetch_or(phaseBit);
+    if ((phaseBit & DATABASE_PHASE_MASK_PER_FRAME) && !(previousPhases & DATABASE_PHASE_MASK_PER_FRAME))
+    {
+        PromotePage(page);
+
+        // A page the warm-up frames never used joins the working set
+        if (m_WorkingSetPin.IsPinned())
+        {
+            page.LockCount.fetch_add(1);
+            m_WorkingSetPin.Pin(page, static_cast<uint32_t>(GetPageIndex(page)));
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// PinWorkingSet
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::PinWorkingSet()
+{
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t missesBefore = m_Misses;
+
+    // Pages used by the warm-up frames may have been evicted since, in which case
+    // they are read back here rather than by the timed frames
+    uint64_t pinnedPages = 0;
+    uint64_t mlockFailedPages = 0;
+    for (size_t i = 0; i < m_Layout.GetPageCount(); ++i)
+    {
+        PagedPage& page = m_Pages[i];
+        if (!(page.Phases.load(std::memory_order_relaxed) & DATABASE_PHASE_MASK_PER_FRAME) || !LockPage(page, false))
+        {
+            continue;
+        }
+        if (!m_WorkingSetPin.Pin(page, static_cast<uint32_t>(i)))
+        {
+            ++mlockFailedPages;
+        }
+        ++pinnedPages;
+    }
+
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_WorkingSetPin.OnPinned(pinnedPages, mlockFailedPages, m_Misses - missesBefore, elapsed);
+}
+
+//------------------------------------------------------------------------------
+// PromotePage
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::PromotePage(PagedPage& page)
+{
+    // Large pages are bounded by the general limits; only pages of small blobs are
+    // kept for the frames
+    if (!m_FramePool.Accepts(page))
+    {
+        return;
+    }
+
+    // The caller's lock count keeps the page resident, and it can only have been
+    // published into the frame pool if it was already used by a frame
+    std::lock_guard<std::mutex> lock(m_EvictionMutex);
+    if (page.InFramePool.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    const uint64_t capacity = PagedPage::GetCapacity(*page.pRecord);
+    page.InFramePool.store(true, std::memory_order_relaxed);
+    ReleaseResidency(ResidencyPool::General, 1, capacity);
+    ReserveResidency(ResidencyPool::Frame, 1, capacity);
+    m_FramePool.OnPromotion();
+}
+
+//------------------------------------------------------------------------------
+// LoadPage
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::LoadPage(PagedPage& page)
+{
+    const size_t pageIndex = GetPageIndex(page);
+    const DatabasePageRecord& record = *page.pRecord;
+    const uint64_t capacity = PagedPage::GetCapacity(record);
+    const ResidencyPool pool = GetLoadPool(page);
+    Shard& shard = GetShard(pageIndex);
+
+    // Any eviction of this page has completed once its shard has been held, and no
+    // new one can start while we hold a lock count
+    {
+        LockShard(shard);
+        std::lock_guard<std::mutex> lock(shard.Mutex, std::adopt_lock);
+        if (page.pMemory.load(std::memory_order_acquire))
+        {
+            return true;
+        }
+    }
+
+    // Make room before allocating so that the residency limits are never exceeded
+    // by pages which could have been evicted.  Eviction takes shard locks, so this
+    // must not be done while holding one.
+    {
+        std::lock_guard<std::mutex> lock(m_EvictionMutex);
+        ReserveResidency(pool, 1, capacity);
+    }
+
+    bool loaded = false;
+    bool success = true;
+    uint8_t* pLoaded = nullptr;
+    {
+        LockShard(shard);
+        std::lock_guard<std::mutex> lock(shard.Mutex, std::adopt_lock);
+
+        // Another thread may have loaded the page while we were evicting
+        if (!page.pMemory.load(std::memory_order_acquire))
+        {
+            uint8_t* pMemory = AllocatePage(record);
+            if (pMemory && ReadPageData(record.PageOffset, record.PageSize, pMemory))
+            {
+                page.InFramePool.store(pool == ResidencyPool::Frame, std::memory_order_relaxed);
+                page.pMemory.store(pMemory, std::memory_order_release);
+                m_Misses.fetch_add(1, std::memory_order_relaxed);
+                loaded = true;
+                pLoaded = pMemory;
+
+                if (m_WorkingSetPin.IsTimedPageIn())
+                {
+                    m_WorkingSetPin.OnTimedPageIn(page);
+                }
+            }
+            else
+            {
+                FreePage(pMemory, record);
+                success = false;
+            }
+        }
+    }
+
+    // The caller's lock count keeps the page resident until the check takes its own
+    if (loaded && m_Verification.IsEnabled())
+    {
+        page.LockCount.fetch_add(1);
+        m_Verification.Check(page, pLoaded);
+    }
+
+    std::lock_guard<std::mutex> lock(m_EvictionMutex);
+    if (loaded)
+    {
+        m_ResidentRing.push_back(static_cast<uint32_t>(pageIndex));
+    }
+    else
+    {
+        ReleaseResidency(pool, 1, capacity);
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// NeedsEviction
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::NeedsEviction(ResidencyPool pool, uint64_t pages, uint64_t bytes) const
+{
+    if (pool == ResidencyPool::Frame)
+    {
+        return m_FramePool.NeedsEviction(bytes);
+    }
+
+    return (m_MaxResidentPages > 0 && m_ResidentPages - m_FramePool.GetResidentPages() + pages > m_MaxResidentPages)
+        || (m_MaxResidentBytes > 0 && m_ResidentBytes - m_FramePool.GetResidentBytes() + bytes > m_MaxResidentBytes);
+}
+
+//------------------------------------------------------------------------------
+// ReserveResidency
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::ReserveResidency(ResidencyPool pool, uint64_t pages, uint64_t bytes)
+{
+    if (NeedsEviction(pool, pages, bytes))
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (m_Policy == EvictionPolicy::Clock)
+        {
+            EvictClock(pool, pages, bytes);
+        }
+        else
+        {
+            EvictLeastRecentlyUsed(pool, pages, bytes);
+        }
+        const auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        m_EvictionNanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+        CountDatabaseEvent(DatabaseCounter::EvictionNanoseconds, elapsed);
+
+        // Everything left is locked; the page is loaded regardless since the
+        // replay cannot continue without it
+        if (NeedsEviction(pool, pages, bytes))
+        {
+            m_OverBudgetLoads.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    m_ResidentPages.fetch_add(pages);
+    const uint64_t residentBytes = m_ResidentBytes.fetch_add(bytes) + bytes;
+    if (residentBytes > m_ResidentBytesHighWater.load(std::memory_order_relaxed))
+    {
+        m_ResidentBytesHighWater.store(residentBytes, std::memory_order_relaxed);
+    }
+
+    if (pool == ResidencyPool::Frame)
+    {
+        m_FramePool.Reserve(pages, bytes);
+    }
+}
+
+//------------------------------------------------------------------------------
+// ReleaseResidency
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::ReleaseResidency(ResidencyPool pool, uint64_t pages, uint64_t bytes)
+{
+    if (pool == ResidencyPool::Frame)
+    {
+        m_FramePool.Release(pages, bytes);
+    }
+    m_ResidentPages.fetch_sub(pages);
+    m_ResidentBytes.fetch_sub(bytes);
+}
+
+//------------------------------------------------------------------------------
+// EvictClock
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::EvictClock(ResidencyPool pool, uint64_t pages, uint64_t bytes)
+{
+    // Each pass of the hand clears reference bits, so a victim is found within two
+    // sweeps unless every resident page of the pool is locked
+    const bool framePool = pool == ResidencyPool::Frame;
+    size_t stepsWithoutEviction = 0;
+    while (NeedsEviction(pool, pages, bytes) && stepsWithoutEviction < 2 * m_ResidentRing.size())
+    {
+        if (m_ClockHand >= m_ResidentRing.size())
+        {
+            m_ClockHand = 0;
+        }
+
+        const uint32_t pageIndex = m_ResidentRing[m_ClockHand];
+        PagedPage& page = m_Pages[pageIndex];
+        if (page.InFramePool.load(std::memory_order_relaxed) != framePool || page.LockCount.load(std::memory_order_relaxed) != 0
+            || page.Referenced.exchange(false, std::memory_order_relaxed) || !TryEvictPage(pageIndex))
+        {
+            ++m_ClockHand;
+            ++stepsWithoutEviction;
+            continue;
+        }
+
+        // Fill the hole with the last entry; the hand then examines it next
+        m_ResidentRing[m_ClockHand] = m_ResidentRing.back();
+        m_ResidentRing.pop_back();
+        stepsWithoutEviction = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+// EvictLeastRecentlyUsed
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::EvictLeastRecentlyUsed(ResidencyPool pool, uint64_t pages, uint64_t bytes)
+{
+    const bool framePool = pool == ResidencyPool::Frame;
+    std::sort(m_ResidentRing.begin(), m_ResidentRing.end(), [this](uint32_t a, uint32_t b) {
+        return m_Pages[a].LastAccessCounter.load(std::memory_order_relaxed) < m_Pages[b].LastAccessCounter.load(std::memory_order_relaxed);
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < m_ResidentRing.size(); ++i)
+    {
+        const uint32_t pageIndex = m_ResidentRing[i];
+        if (m_Pages[pageIndex].InFramePool.load(std::memory_order_relaxed) == framePool && NeedsEviction(pool, pages, bytes) && TryEvictPage(pageIndex))
+        {
+            continue;
+        }
+        m_ResidentRing[kept++] = pageIndex;
+    }
+    m_ResidentRing.resize(kept);
+}
+
+//------------------------------------------------------------------------------
+// ReleaseInitPages
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::ReleaseInitPages()
+{
+    m_InitRelease.BeginRelease();
+
+    uint64_t releasedPages = 0;
+    uint64_t releasedBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_EvictionMutex);
+        const uint64_t residentBytes = m_ResidentBytes;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < m_ResidentRing.size(); ++i)
+        {
+            const uint32_t pageIndex = m_ResidentRing[i];
+            if (PagedInitRelease::IsInitPage(m_Pages[pageIndex]) && TryEvictPage(pageIndex))
+            {
+                ++releasedPages;
+                continue;
+            }
+            m_ResidentRing[kept++] = pageIndex;
+        }
+        m_ResidentRing.resize(kept);
+        m_ClockHand = 0;
+        releasedBytes = residentBytes - m_ResidentBytes;
+    }
+
+    m_InitRelease.EndRelease(releasedPages, releasedBytes);
+}
+
+//------------------------------------------------------------------------------
+// TryEvictPage
+//------------------------------------------------------------------------------
+bool PagedReadOnlyDatabase::TryEvictPage(size_t pageIndex)
+{
+    PagedPage& page = m_Pages[pageIndex];
+    Shard& shard = GetShard(pageIndex);
+
+    uint8_t* pMemory = nullptr;
+    uint64_t residentBytes = 0;
+    ResidencyPool pool = ResidencyPool::General;
+    {
+        LockShard(shard);
+        std::lock_guard<std::mutex> lock(shard.Mutex, std::adopt_lock);
+
+        int32_t expected = 0;
+        if (!page.LockCount.compare_exchange_strong(expected, EVICTING))
+        {
+            return false;
+        }
+
+        pMemory = page.pMemory.exchange(nullptr);
+        if (pMemory)
+        {
+            residentBytes = PagedPage::GetCapacity(*page.pRecord);
+            pool = page.InFramePool.load(std::memory_order_relaxed) ? ResidencyPool::Frame : ResidencyPool::General;
+        }
+        page.LockCount.fetch_sub(EVICTING);
+    }
+
+    if (!pMemory)
+    {
+        return false;
+    }
+
+    FreePage(pMemory, *page.pRecord);
+    ReleaseResidency(pool, 1, residentBytes);
+    m_Evictions.fetch_add(1, std::memory_order_relaxed);
+    PagedCacheTelemetry::OnEviction(residentBytes);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// FreePages
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::FreePages()
+{
+    // Locks the policies still hold
+    m_Verification.Drain();
+    m_WorkingSetPin.Reset(m_Pages.get());
+    m_StaticPin.Reset(m_Pages.get());
+    m_EpochUnlock.Reset();
+    m_InitRelease.Reset();
+
+    for (size_t i = 0; m_Pages && i < m_Layout.GetPageCount(); ++i)
+    {
+        NV_DATABASE_WARN(m_Pages[i].LockCount == 0, "Freeing a page which is still locked");
+        FreePage(m_Pages[i].pMemory.exchange(nullptr), *m_Pages[i].pRecord);
+    }
+
+    m_Pages.reset();
+    m_ResidentRing.clear();
+    m_ClockHand = 0;
+    m_ResidentPages = 0;
+    m_ResidentBytes = 0;
+    m_FramePool.Reset();
+}
+
+//------------------------------------------------------------------------------
+// Unlock
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::Unlock(DataScope::LockedPageHandle pPageHandle)
+{
+    PagedPage* pPage = static_cast<PagedPage*>(pPageHandle);
+    if (!pPage)
+    {
+        return;
+    }
+
+    // Locks held by an epoch are released when the thread moves to the next one
+    if (PagedEpochUnlock::IsTagged(pPageHandle))
+    {
+        m_EpochUnlock.OnHandleUnlocked();
+        CountDatabaseEvent(DatabaseCounter::Unlocks);
+        return;
+    }
+
+    NV_DATABASE_WARN(pPage->LockCount > 0, "Unlocking a page which is not locked");
+    pPage->LockCount.fetch_sub(1);
+    CountDatabaseEvent(DatabaseCounter::Unlocks);
+}
+
+//------------------------------------------------------------------------------
+// FindBlobPage
+//------------------------------------------------------------------------------
+PagedPage* PagedReadOnlyDatabase::FindBlobPage(const DATABASE_HANDLE& handle, const DatabaseBlobLocation*& pLocation)
+{
+    pLocation = m_Layout.GetBlobLocation(handle);
+    if (!pLocation || pLocation->PageIndex == DatabaseBlobLocation::NO_PAGE || !m_Pages)
+    {
+        return nullptr;
+    }
+
+    return &m_Pages[pLocation->PageIndex];
+}
+
+//------------------------------------------------------------------------------
+// Prefetch
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::Prefetch(uint64_t pageOffset)
+{
+    DatabaseTelemetryPrefetchScope telemetryScope;
+    const size_t pageIndex = m_Layout.FindPageStart(pageOffset);
+    if (pageIndex >= m_Layout.GetPageCount())
+    {
+        return;
+    }
+
+    Unlock(LockPage(m_Pages[pageIndex], false));
+}
+
+//------------------------------------------------------------------------------
+// PrefetchPages
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::PrefetchPages(const uint64_t* pPageOffsets, size_t count)
+{
+    if (!m_Pages)
+    {
+        return;
+    }
+
+    DatabaseTelemetryPrefetchScope telemetryScope;
+
+    // Sources read one range at a time and the shared cache reads into its own
+    // memory, so only pages of the file read into the heap are batched
+    static thread_local std::vector<uint32_t> t_pageIndices;
+    std::vector<uint32_t>& pageIndices = t_pageIndices;
+    pageIndices.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t pageIndex = m_Layout.FindPageStart(pPageOffsets[i]);
+        if (pageIndex >= m_Layout.GetPageCount())
+        {
+            continue;
+        }
+
+        const PagedPage& page = m_Pages[pageIndex];
+        if (m_spSource || m_spSharedCache)
+        {
+            Prefetch(pPageOffsets[i]);
+        }
+        else if (!page.pMemory.load(std::memory_order_acquire))
+        {
+            pageIndices.push_back(static_cast<uint32_t>(pageIndex));
+        }
+    }
+
+    std::sort(pageIndices.begin(), pageIndices.end());
+    pageIndices.erase(std::unique(pageIndices.begin(), pageIndices.end()), pageIndices.end());
+    if (pageIndices.empty())
+    {
+        return;
+    }
+
+    // Pages are reserved in the pool they will be published to
+    static thread_local std::vector<ResidencyPool> t_pools;
+    std::vector<ResidencyPool>& pools = t_pools;
+    pools.clear();
+    uint64_t batchPages[2] = {};
+    uint64_t batchBytes[2] = {};
+    for (uint32_t pageIndex : pageIndices)
+    {
+        const ResidencyPool pool = GetLoadPool(m_Pages[pageIndex]);
+        pools.push_back(pool);
+        batchPages[static_cast<size_t>(pool)] += 1;
+        batchBytes[static_cast<size_t>(pool)] += PagedPage::GetCapacity(*m_Pages[pageIndex].pRecord);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_EvictionMutex);
+        for (const ResidencyPool pool : { ResidencyPool::General, ResidencyPool::Frame })
+        {
+            if (batchPages[static_cast<size_t>(pool)] > 0)
+            {
+                ReserveResidency(pool, batchPages[static_cast<size_t>(pool)], batchBytes[static_cast<size_t>(pool)]);
+            }
+        }
+    }
+
+    // The pages are read into buffers of our own and only published afterwards,
+    // so no shard lock is held across the read
+    static thread_local std::vector<DatabaseReadRequest> t_requests;
+    std::vector<DatabaseReadRequest>& requests = t_requests;
+    requests.clear();
+    for (uint32_t pageIndex : pageIndices)
+    {
+        const DatabasePageRecord& record = *m_Pages[pageIndex].pRecord;
+        DatabaseReadRequest request = { record.PageOffset, record.PageSize, AllocatePage(record), false };
+
+        // Pages whose allocation failed are read as empty and discarded below
+        if (!request.pDestination)
+        {
+            request.Size = 0;
+        }
+        requests.push_back(request);
+    }
+    const bool timed = m_Verification.IsEnabled() || PagedCacheTelemetry::IsEnabled();
+    const auto readStart = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    m_ReadQueue.Read(requests.data(), requests.size());
+    if (timed)
+    {
+        // Every page of the batch waited for the whole batch
+        const uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - readStart).count());
+        if (m_Verification.IsEnabled())
+        {
+            m_Verification.OnRead(nanoseconds);
+        }
+        for (const DatabaseReadRequest& request : requests)
+        {
+            if (request.pDestination && request.Succeeded)
+            {
+                CountDatabaseMiss(request.Size, nanoseconds);
+            }
+        }
+    }
+
+    uint64_t unusedPages[2] = {};
+    uint64_t unusedBytes[2] = {};
+    for (size_t i = 0; i < pageIndices.size(); ++i)
+    {
+        const uint32_t pageIndex = pageIndices[i];
+        PagedPage& page = m_Pages[pageIndex];
+        DatabaseReadRequest& request = requests[i];
+
+        bool published = false;
+        if (request.pDestination && request.Succeeded)
+        {
+            Shard& shard = GetShard(pageIndex);
+            LockShard(shard);
+            std::lock_guard<std::mutex> lock(shard.Mutex, std::adopt_lock);
+
+            // Lock may have loaded the page while it was being read
+            if (!page.pMemory.load(std::memory_order_acquire))
+            {
+                page.Referenced.store(true, std::memory_order_relaxed);
+                page.LastAccessCounter.store(m_PageAccessCounter.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+                page.InFramePool.store(pools[i] == ResidencyPool::Frame, std::memory_order_relaxed);
+                page.pMemory.store(request.pDestination, std::memory_order_release);
+                m_Misses.fetch_add(1, std::memory_order_relaxed);
+                published = true;
+
+                // Nothing keeps a preloaded page from eviction once its shard is
+                // released, so the check is given its lock count here
+                if (m_Verification.IsEnabled())
+                {
+                    page.LockCount.fetch_add(1);
+                }
+            }
+        }
+
+        if (!published)
+        {
+            FreePage(request.pDestination, *page.pRecord);
+            pageIndices[i] = UINT32_MAX;
+            unusedPages[static_cast<size_t>(pools[i])] += 1;
+            unusedBytes[static_cast<size_t>(pools[i])] += PagedPage::GetCapacity(*page.pRecord);
+        }
+    }
+
+    for (size_t i = 0; m_Verification.IsEnabled() && i < pageIndices.size(); ++i)
+    {
+        if (pageIndices[i] != UINT32_MAX)
+        {
+            m_Verification.Check(m_Pages[pageIndices[i]], requests[i].pDestination);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_EvictionMutex);
+    for (uint32_t pageIndex : pageIndices)
+    {
+        if (pageIndex != UINT32_MAX)
+        {
+            m_ResidentRing.push_back(pageIndex);
+        }
+    }
+    ReleaseResidency(ResidencyPool::General, unusedPages[0], unusedBytes[0]);
+    ReleaseResidency(ResidencyPool::Frame, unusedPages[1], unusedBytes[1]);
+}
+
+//------------------------------------------------------------------------------
+// Preload
+//------------------------------------------------------------------------------
+void PagedReadOnlyDatabase::Preload()
+{
+    if (!m_Pages)
+    {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t pageCount = m_Layout.GetPageCount();
+    const size_t batchSize = m_ReadQueueDepth;
+    std::atomic<size_t> nextPage(0);
+    auto preloadPages = [&]() {
+        std::vector<uint64_t> batch;
+        for (size_t first = nextPage.fetch_add(batchSize); first < pageCount; first = nextPage.fetch_add(batchSize))
+        {
+            // Stop at the limits rather than evicting pages which were just loaded
+            batch.clear();
+            uint64_t batchBytes = 0;
+            const size_t last = std::min(first + batchSize, pageCount);
+            for (size_t i = first; i < last; ++i)
+            {
+                const DatabasePageRecord& record = *m_Pages[i].pRecord;
+                batchBytes += PagedPage::GetCapacity(record);
+                if (NeedsEviction(ResidencyPool::General, batch.size() + 1, batchBytes))
+                {
+                    nextPage = pageCount;
+                    break;
+                }
+                batch.push_back(record.PageOffset);
+            }
+            PrefetchPages(batch.data(), batch.size());
+        }
+    };
+
+    if (g_threadPoolThreadCount > 0)
+    {
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 0; i < g_threadPoolThreadCount; ++i)
+        {
+            tasks.push_back(NvExecuteOnThreadPool(preloadPages));
+        }
+        for (auto& task : tasks)
+        {
+            task.wait();
+        }
+    }
+    else
+    {
+        preloadPages();
+    }
+
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    NV_MESSAGE_VERBOSE("Database preload: %llu pages, %.1f MB in %.3f s",
+        static_cast<unsigned long long>(m_ResidentPages.load()),
+        m_ResidentBytes.load() / (1024.0 * 1024.0),
+        elapsed);
+}
+
+//------------------------------------------------------------------------------
+// ReadBlob - with a scope tracker the page is locked here and the lock handed to
+// the scope, which releases it when it ends.  Without one the page is not kept
+// locked, so the memory is only valid until the page is next evicted.
+//------------------------------------------------------------------------------
+void* PagedReadOnlyDatabase::ReadBlob(const DATABASE_HANDLE& handle, DataScopeTracker* pScopeTracker)
+{
+    static uint8_t s_emptyBlob = 0;
+
+    CountDatabaseEvent(DatabaseCounter::Reads);
+
+    const DatabaseBlobLocation* pLocation = nullptr;
+    PagedPage* pPage = FindBlobPage(handle, pLocation);
+    if (!pPage)
+    {
+        return (pLocation && pLocation->Size == 0) ? &s_emptyBlob : nullptr;
+    }
+
+    DataScope::LockedPageHandle pPageHandle = pScopeTracker ? LockForScope(*pPage) : LockPage(*pPage);
+    if (!pPageHandle)
+    {
+        return nullptr;
+    }
+
+    const uint64_t begin = pLocation->OffsetInPage;
+    uint8_t* pMemory = pPage->pMemory.load(std::memory_order_acquire);
+    if (pScopeTracker && pMemory)
+    {
+        // SetUsesPage asks Lock for the page and gets the lock taken above.  A scope
+        // which did not ask holds no lock of its own, so the read fails rather than
+        // returning memory which may be evicted.
+        t_scopeLockHandoff = { this, GetPageIndex(*pPage), pPageHandle };
+        pScopeTracker->SetUsesPage(pPage->pRecord->PageOffset, *this);
+        if (!t_scopeLockHandoff.pPageHandle)
+        {
+            return pMemory + begin;
+        }
+        t_scopeLockHandoff = {};
+        NV_DATABASE_WARN(false, "The data scope did not lock the page it uses");
+        pMemory = nullptr;
+    }
+
+    Unlock(pPageHandle);
+    return pMemory ? pMemory + begin : nullptr;
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* PagedReadOnlyDatabase::DoRead(const DATABASE_HANDLE& handle)
+{
+    return ReadBlob(handle, nullptr);
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* PagedReadOnlyDatabase::DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker)
+{
+    return ReadBlob(handle, &scopeTracker);
+}
+
+//------------------------------------------------------------------------------
+// DoReadStatic
+//------------------------------------------------------------------------------
+void* PagedReadOnlyDatabase::DoReadStatic(const DATABASE_HANDLE& handle)
+{
+    CountDatabaseEvent(DatabaseCounter::Reads);
+
+    const DatabaseBlobLocation* pLocation = nullptr;
+    PagedPage* pPage = FindBlobPage(handle, pLocation);
+    if (!pPage)
+    {
+        return nullptr;
+    }
+
+    DataScope::LockedPageHandle pPageHandle = LockPage(*pPage);
+    if (!pPageHandle)
+    {
+        return nullptr;
+    }
+
+    uint8_t* pMemory = pPage->pMemory.load(std::memory_order_acquire);
+
+    // The first static entry of a page keeps its lock count until FreePages; the
+    // others share it
+    if (!m_StaticPin.Pin(*pPage, static_cast<uint32_t>(GetPageIndex(*pPage)), pLocation->Size))
+    {
+        Unlock(pPageHandle);
+    }
+    return pMemory + pLocation->OffsetInPage;
+}
+
+} // namespace Serialization
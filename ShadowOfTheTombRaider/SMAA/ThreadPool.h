@@ -23,7 +23,7 @@
 
 #define NV_THREAD_BEGIN(_ThreadId) \
     NvExecuteOnThread(_ThreadId, NV_EXECUTE_ON_THREAD_FLAGS_NONE, std::move([=]{     \
-    auto& dataScopeTracker = Serialization::DataScopeTracker::Instance(); \
+    auto& dataScopeTracker = Serialization::DataScopeTracker::ForCurrentThread(); \
     ((void)0);
 
 #define NV_THREAD_END(_ThreadId) \
@@ -31,7 +31,7 @@
 
 #define NV_THREAD_NON_BLOCKING_BEGIN(_ThreadId) \
     NvExecuteOnThread(_ThreadId, NV_EXECUTE_ON_THREAD_FLAGS_NON_BLOCKING, std::move([=]{     \
-    auto& dataScopeTracker = Serialization::DataScopeTracker::Instance(); \
+    auto& dataScopeTracker = Serialization::DataScopeTracker::ForCurrentThread(); \
     ((void)0);
 
 #define NV_THREAD_NON_BLOCKING_END(_ThreadId) \
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "ThreadPool.h"
+#include "WorkStealingThreadPool.h"
 #include <array>
 #include <atomic>
 #include <condition_variable>
@@ -18,7 +19,7 @@
 extern size_t g_threadPoolThreadCount;
 
 //--------------------------------------------------------------------------------------
-// ThreadPool
+// ThreadPool - a worker per original thread id, for NvExecuteOnThread
 //--------------------------------------------------------------------------------------
 class ThreadPool
 {
@@ -26,21 +27,9 @@ public:
     ThreadPool()
         : m_shutdown(false)
         , m_vecWorkers()
-        , m_nextWorkerId()
     {
     }
 
-    ThreadPool(size_t threadCount)
-        : m_shutdown(false)
-        , m_vecWorkers(threadCount)
-        , m_nextWorkerId()
-    {
-        for (auto& spWorker : m_vecWorkers)
-        {
-            spWorker = createWorker();
-        }
-    }
-
     ~ThreadPool()
     {
         m_shutdown = true;
@@ -103,34 +92,6 @@ public:
         return future;
     }
 
-    std::future<void> Run(std::function<void()>&& fn)
-    {
-        // Get the next idle worker thread
-        for (;;)
-        {
-            if (!m_vecWorkers[m_nextWorkerId]->m_work)
-            {
-                break;
-            }
-            m_nextWorkerId = (m_nextWorkerId + 1) % g_threadPoolThreadCount;
-        }
-        auto& worker = *m_vecWorkers[m_nextWorkerId];
-        m_nextWorkerId = (m_nextWorkerId + 1) % g_threadPoolThreadCount;
-
-        // Supply work
-        std::future<void> future;
-        {
-            std::unique_lock<std::mutex> lock(worker.m_mutex);
-            worker.m_promise = std::promise<void>();
-            future = worker.m_promise.get_future();
-            std::swap(worker.m_work, fn);
-        }
-
-        // Notify worker
-        worker.cv.notify_one();
-        return future;
-    }
-
 private:
     struct PerWorker
     {
@@ -182,7 +143,6 @@ private:
 
     bool m_shutdown;
     std::vector<std::unique_ptr<PerWorker>> m_vecWorkers;
-    size_t m_nextWorkerId;
 };
 
 //--------------------------------------------------------------------------------------
@@ -215,6 +175,6 @@ std::future<void> NvExecuteOnThread(uint32_t threadId, NvExecuteOnThreadFlags fl
 //------------------------------------------------------------------------------
 std::future<void> NvExecuteOnThreadPool(std::function<void()>&& fn)
 {
-    static ThreadPool s_pool(g_threadPoolThreadCount);
+    static WorkStealingThreadPool s_pool(g_threadPoolThreadCount);
     return s_pool.Run(std::move(fn));
 }
\ No newline at end of file
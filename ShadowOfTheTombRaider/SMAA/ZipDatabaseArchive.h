@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// File: ZipDatabaseArchive.h
+//
+// Random access to a database file inside a zip archive, without extracting it.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DatabaseSource.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// ZipDatabaseArchive
+//
+// Opens one entry of a zip archive (zip64 included) as a database source.  The
+// central directory is parsed once by Open.
+//
+// Stored entries are read directly from the archive, and can be mapped in place
+// by MappedReadOnlyDatabase using GetEntryOffset.
+//
+// Deflate streams can only be decoded from the start, so deflated entries are
+// indexed with checkpoints every CHECKPOINT_SPAN bytes of output, each holding
+// the bit position of a deflate block boundary and the 32KB window preceding it.
+// A read starts inflating at the closest checkpoint before it, unless the thread's
+// previous read ended where it begins, in which case that stream carries on, so
+// reading consecutive pages inflates the entry once.  Building the
+// index takes one pass over the entry, which also checks its CRC; the index is
+// saved next to the archive so later runs load it instead.
+//----------------------------------------------------------------------------------
+class ZipDatabaseArchive : public IDatabaseSource
+{
+public:
+    static constexpr uint64_t CHECKPOINT_SPAN = 4 << 20;
+    static constexpr uint32_t WINDOW_SIZE = 32768;
+
+    ZipDatabaseArchive();
+    virtual ~ZipDatabaseArchive();
+
+    //------------------------------------------------------------------------------
+    // Open - Opens the archive and finds the entry named pEntryName, in any
+    // directory.  Only stored and deflated entries are supported.
+    //------------------------------------------------------------------------------
+    bool Open(const char* pFileName, const char* pEntryName);
+    void Close();
+
+    bool IsStored() const
+    {
+        return m_Method == METHOD_STORED;
+    }
+
+    // Offset of the entry's data in the archive
+    uint64_t GetEntryOffset() const
+    {
+        return m_EntryOffset;
+    }
+
+    // CRC-32 of the entry's uncompressed data, as the archive records it
+    uint32_t GetEntryCrc() const
+    {
+        return m_Crc;
+    }
+
+    // Name of the file holding the checkpoint index of a deflated entry
+    static std::string GetIndexFileName(const char* pFileName);
+
+    //------------------------------------------------------------------------------
+    // IDatabaseSource
+    //------------------------------------------------------------------------------
+    virtual uint64_t GetDatabaseSize() const override
+    {
+        return m_Size;
+    }
+    virtual bool Read(uint64_t offset, uint64_t size, uint8_t* pDestination) const override;
+
+private:
+    static const uint16_t METHOD_STORED = 0;
+    static const uint16_t METHOD_DEFLATED = 8;
+
+    struct Checkpoint
+    {
+        uint64_t Offset; // In the entry's uncompressed data
+        uint64_t CompressedOffset; // Of the next unread byte, relative to the entry's data
+        uint32_t Bits; // Unused bits of the byte before it, which start the next block
+        uint32_t Reserved;
+    };
+
+    // This class is non-copyable
+    ZipDatabaseArchive(const ZipDatabaseArchive&) = delete;
+    ZipDatabaseArchive& operator=(const ZipDatabaseArchive&) = delete;
+
+    bool FindEntry(const char* pEntryName, uint64_t archiveSize);
+    bool BuildCheckpoints();
+    bool LoadCheckpoints(const std::string& fileName);
+    bool SaveCheckpoints(const std::string& fileName) const;
+    bool Inflate(uint64_t offset, uint64_t size, uint8_t* pDestination) const;
+    bool ReadFromFile(uint64_t offset, uint64_t size, uint8_t* pDestination) const;
+
+    uint16_t m_Method;
+    uint32_t m_Crc;
+    uint64_t m_EntryOffset;
+    uint64_t m_CompressedSize;
+    uint64_t m_Size;
+    uint64_t m_ArchiveSize;
+    uint64_t m_Id; // Identifies this archive to the per-thread inflate cursors
+
+    // Deflated entries
+    std::vector<Checkpoint> m_Checkpoints; // Sorted by offset
+    std::vector<uint8_t> m_Windows; // WINDOW_SIZE bytes per checkpoint
+
+#if defined(_WIN32)
+    void* m_hFile;
+#else
+    int m_fd;
+#endif
+};
+
+} // namespace Serialization
@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// File: BlobStore.h
+//
+// Content-addressed store of blobs shared by several captures.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// A blob store is a database file like data.bin, with its own records file, plus
+// a file of blob hashes:
+//
+//   <store>       blob contents, each blob 16-byte aligned
+//   <store>.rec   DatabaseBlobRecord per store blob, as for data.bin
+//   <store>.hash  HashBlob of each store blob
+//
+// Every blob is stored once however many captures contain it.  A capture is added
+// with AddCaptureToBlobStore, which writes a handle map from the capture's
+// DATABASE_HANDLEs to store blobs.  Blobs are only ever appended, so maps written
+// earlier stay valid as more captures are added.
+//----------------------------------------------------------------------------------
+
+struct BlobStoreStats
+{
+    uint64_t Blobs; // Blobs in the capture
+    uint64_t NewBlobs; // Blobs appended to the store
+    uint64_t Bytes; // Bytes of blobs in the capture
+    uint64_t NewBytes; // Bytes appended to the store
+};
+
+//------------------------------------------------------------------------------
+// GetBlobStoreMapFileName - Name of the handle map which accompanies a database file
+//------------------------------------------------------------------------------
+std::string GetBlobStoreMapFileName(const char* pDatabaseFileName);
+
+//------------------------------------------------------------------------------
+// AddCaptureToBlobStore - Adds every blob of a capture's database file to the
+// store, creating the store if needed, and writes the capture's handle map.  Blobs
+// already in the store (equal hashes and bytes) are shared rather than copied.
+//------------------------------------------------------------------------------
+bool AddCaptureToBlobStore(const char* pDatabaseFileName, const char* pStoreFileName, const char* pMapFileName, BlobStoreStats& stats);
+
+//------------------------------------------------------------------------------
+// LoadBlobStoreMap - Reads a capture's handle map.  Fails if the store holds fewer
+// blobs than the map refers to.
+//------------------------------------------------------------------------------
+bool LoadBlobStoreMap(const char* pMapFileName, const char* pStoreFileName, std::vector<uint32_t>& storeHandles);
+
+} // namespace Serialization
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// File: BlobStoreTool.cpp
+//
+// Adds the capture's blobs to a blob store shared with other captures.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "BlobStore.h"
+#include "CommonReplay.h"
+
+#include <memory>
+#include <string>
+
+namespace {
+
+std::string s_storeFileName;
+
+//------------------------------------------------------------------------------
+// AddToBlobStore - adds the capture's blobs to a blob store and writes its handle map
+//------------------------------------------------------------------------------
+bool AddToBlobStore()
+{
+    using namespace Serialization;
+
+    const std::string mapFileName = GetBlobStoreMapFileName(DATABASE_BIN_FILE);
+    BlobStoreStats stats = {};
+    if (!AddCaptureToBlobStore(DATABASE_BIN_FILE, s_storeFileName.c_str(), mapFileName.c_str(), stats))
+    {
+        NV_MESSAGE("Failed to add '%s' to the blob store '%s'", DATABASE_BIN_FILE, s_storeFileName.c_str());
+        return false;
+    }
+
+    const double megabyte = 1024.0 * 1024.0;
+    NV_MESSAGE("Added '%s' to '%s': %llu of %llu blobs (%.1f of %.1f MB) were new, the rest are shared.  Wrote '%s'.",
+        DATABASE_BIN_FILE,
+        s_storeFileName.c_str(),
+        static_cast<unsigned long long>(stats.NewBlobs),
+        static_cast<unsigned long long>(stats.Blobs),
+        stats.NewBytes / megabyte,
+        stats.Bytes / megabyte,
+        mapFileName.c_str());
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+FnParseResults AddBlobStoreArguments(args::ArgumentParser& parser)
+{
+    // Blobs are matched by hash and then compared byte for byte.  The store's
+    // records and hashes are written next to it.
+    auto spStore = std::make_shared<args::Positional<std::string>>(parser, "store", "Blob store to add the blobs of " DATABASE_BIN_FILE " to, created if needed.  " DATABASE_BIN_FILE ".map is written for --database-store.", args::Options::Required);
+
+    return [=]() {
+        s_storeFileName = args::get(*spStore);
+    };
+}
+REGISTER_ARGUMENTS(AddBlobStoreArguments);
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Adds the blobs of " DATABASE_BIN_FILE " which a blob store does not hold yet to it, and writes the handle map the replay reads the store through", []() {
+        return AddToBlobStore();
+    });
+}
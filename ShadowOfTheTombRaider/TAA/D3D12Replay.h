@@ -463,7 +463,7 @@ D3D12_SHADER_RESOURCE_VIEW_DESC* D3D12InitSRVAccelStruct(D3D12_SHADER_RESOURCE_V
 template <typename T_Struct, typename T_Ptr>
 void WriteAndIncrement(T_Ptr& inout, const T_Struct& value)
 {
-    BEGIN_DATA_SCOPE_FUNCTION();
+    BEGIN_NO_DATA_SCOPE_FUNCTION();
 
     *(T_Struct*)inout = value;
     inout = T_Ptr((T_Struct*)inout + 1);
@@ -475,7 +475,7 @@ void WriteAndIncrement(T_Ptr& inout, const T_Struct& value)
 template <typename T_Ptr>
 void AlignToSize(T_Ptr& inout, size_t alignment)
 {
-    BEGIN_DATA_SCOPE_FUNCTION();
+    BEGIN_NO_DATA_SCOPE_FUNCTION();
 
     auto mask = alignment - 1;
     inout = (T_Ptr)((UINT_PTR(inout) + mask) & ~mask);
@@ -487,7 +487,7 @@ void AlignToSize(T_Ptr& inout, size_t alignment)
 template <typename T_AlignStruct, typename T_Ptr>
 void AlignToStruct(T_Ptr& inout)
 {
-    BEGIN_DATA_SCOPE_FUNCTION();
+    BEGIN_NO_DATA_SCOPE_FUNCTION();
 
     AlignToSize(inout, sizeof(T_AlignStruct));
 }
@@ -498,7 +498,7 @@ void AlignToStruct(T_Ptr& inout)
 template <typename T_AlignStruct, typename T_Ptr>
 void AlignedWriteAndIncrement(T_Ptr& inout, const T_AlignStruct&& value)
 {
-    BEGIN_DATA_SCOPE_FUNCTION();
+    BEGIN_NO_DATA_SCOPE_FUNCTION();
 
     AlignToStruct<T_AlignStruct>(inout);
     WriteAndIncrement(inout, value);
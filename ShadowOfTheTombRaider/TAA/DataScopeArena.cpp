@@ -0,0 +1,250 @@
+//--------------------------------------------------------------------------------------
+// File: DataScopeArena.cpp
+//
+// Per-thread bump arena for the page lists of data scopes.
+//--------------------------------------------------------------------------------------
+
+#include "DataScopeArena.h"
+
+#include "DatabasePhase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace Serialization {
+
+namespace {
+
+// Enough for a few hundred pages locked by nested scopes
+const size_t CHUNK_SIZE = 16 * 1024;
+const size_t SPILL_ALIGNMENT = alignof(std::max_align_t);
+
+size_t AlignSpill(size_t bytes)
+{
+    return (bytes + SPILL_ALIGNMENT - 1) & ~(SPILL_ALIGNMENT - 1);
+}
+
+//------------------------------------------------------------------------------
+// ThreadCounters - written only by the thread which owns them, and read by any
+// thread summing them
+//------------------------------------------------------------------------------
+struct ThreadCounters
+{
+    std::atomic<uint64_t> Spills;
+    std::atomic<uint64_t> SpillBytes;
+    std::atomic<uint64_t> ChunkAllocations;
+    std::atomic<uint64_t> ChunkBytes;
+    std::atomic<uint64_t> LastChunkAllocationFrame;
+};
+
+struct Chunk
+{
+    Chunk* pNext;
+    size_t Size;
+
+    uint8_t* GetData()
+    {
+        return reinterpret_cast<uint8_t*>(this) + AlignSpill(sizeof(Chunk));
+    }
+};
+
+//------------------------------------------------------------------------------
+// ThreadArena - the chunks of a thread, freed when it exits, and its counters,
+// which outlive it
+//------------------------------------------------------------------------------
+class ThreadArena
+{
+public:
+    ThreadArena();
+    ~ThreadArena();
+
+    void* Allocate(size_t bytes);
+    void Free(void* p, size_t bytes);
+
+private:
+    Chunk* AllocateChunk(size_t bytes);
+
+    Chunk* m_pFirst;
+    Chunk* m_pCurrent;
+    size_t m_Offset;
+    size_t m_LiveSpills;
+    ThreadCounters* m_pCounters;
+};
+
+std::mutex& GetThreadsMutex()
+{
+    static std::mutex s_mutex;
+    return s_mutex;
+}
+
+std::vector<std::unique_ptr<ThreadCounters>>& GetThreads()
+{
+    static std::vector<std::unique_ptr<ThreadCounters>> s_threads;
+    return s_threads;
+}
+
+ThreadArena& GetThreadArena()
+{
+    thread_local ThreadArena t_arena;
+    return t_arena;
+}
+
+void Add(std::atomic<uint64_t>& counter, uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// ThreadArena::ThreadArena
+//------------------------------------------------------------------------------
+ThreadArena::ThreadArena()
+    : m_pFirst(nullptr)
+    , m_pCurrent(nullptr)
+    , m_Offset(0)
+    , m_LiveSpills(0)
+    , m_pCounters(nullptr)
+{
+    std::unique_ptr<ThreadCounters> spCounters(new ThreadCounters());
+    m_pCounters = spCounters.get();
+
+    std::lock_guard<std::mutex> lock(GetThreadsMutex());
+    GetThreads().push_back(std::move(spCounters));
+}
+
+//------------------------------------------------------------------------------
+// ThreadArena::~ThreadArena
+//------------------------------------------------------------------------------
+ThreadArena::~ThreadArena()
+{
+    assert(m_LiveSpills == 0);
+    while (m_pFirst)
+    {
+        Chunk* pNext = m_pFirst->pNext;
+        std::free(m_pFirst);
+        m_pFirst = pNext;
+    }
+}
+
+//------------------------------------------------------------------------------
+// ThreadArena::AllocateChunk
+//------------------------------------------------------------------------------
+Chunk* ThreadArena::AllocateChunk(size_t bytes)
+{
+    const size_t size = std::max(CHUNK_SIZE, bytes);
+    Chunk* pChunk = static_cast<Chunk*>(std::malloc(AlignSpill(sizeof(Chunk)) + size));
+    if (!pChunk)
+    {
+        throw std::bad_alloc();
+    }
+    pChunk->pNext = nullptr;
+    pChunk->Size = size;
+
+    Add(m_pCounters->ChunkAllocations, 1);
+    Add(m_pCounters->ChunkBytes, size);
+    m_pCounters->LastChunkAllocationFrame.store(GetDatabaseFrameCount(), std::memory_order_relaxed);
+    return pChunk;
+}
+
+//------------------------------------------------------------------------------
+// ThreadArena::Allocate
+//------------------------------------------------------------------------------
+void* ThreadArena::Allocate(size_t bytes)
+{
+    bytes = AlignSpill(bytes);
+
+    if (!m_pCurrent)
+    {
+        m_pFirst = AllocateChunk(bytes);
+        m_pCurrent = m_pFirst;
+        m_Offset = 0;
+    }
+    else if (m_Offset + bytes > m_pCurrent->Size)
+    {
+        // Move on to the next chunk kept from an earlier frame, or put a new one
+        // in front of it if it is too small
+        if (!m_pCurrent->pNext || m_pCurrent->pNext->Size < bytes)
+        {
+            Chunk* pChunk = AllocateChunk(bytes);
+            pChunk->pNext = m_pCurrent->pNext;
+            m_pCurrent->pNext = pChunk;
+        }
+        m_pCurrent = m_pCurrent->pNext;
+        m_Offset = 0;
+    }
+
+    void* p = m_pCurrent->GetData() + m_Offset;
+    m_Offset += bytes;
+    ++m_LiveSpills;
+
+    Add(m_pCounters->Spills, 1);
+    Add(m_pCounters->SpillBytes, bytes);
+    return p;
+}
+
+//------------------------------------------------------------------------------
+// ThreadArena::Free
+//------------------------------------------------------------------------------
+void ThreadArena::Free(void* p, size_t bytes)
+{
+    assert(m_LiveSpills > 0);
+    if (--m_LiveSpills == 0)
+    {
+        m_pCurrent = m_pFirst;
+        m_Offset = 0;
+        return;
+    }
+
+    // The last list carved gives its space back; any other waits for the reset
+    bytes = AlignSpill(bytes);
+    if (m_Offset >= bytes && static_cast<uint8_t*>(p) == m_pCurrent->GetData() + m_Offset - bytes)
+    {
+        m_Offset -= bytes;
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// AllocateDataScopeSpill
+//------------------------------------------------------------------------------
+void* AllocateDataScopeSpill(size_t bytes)
+{
+    return GetThreadArena().Allocate(bytes);
+}
+
+//------------------------------------------------------------------------------
+// FreeDataScopeSpill
+//------------------------------------------------------------------------------
+void FreeDataScopeSpill(void* p, size_t bytes)
+{
+    if (p)
+    {
+        GetThreadArena().Free(p, bytes);
+    }
+}
+
+//------------------------------------------------------------------------------
+// GetDataScopeArenaStats
+//------------------------------------------------------------------------------
+void GetDataScopeArenaStats(DataScopeArenaStats& stats)
+{
+    stats = {};
+
+    std::lock_guard<std::mutex> lock(GetThreadsMutex());
+    for (const auto& spCounters : GetThreads())
+    {
+        stats.Spills += spCounters->Spills.load(std::memory_order_relaxed);
+        stats.SpillBytes += spCounters->SpillBytes.load(std::memory_order_relaxed);
+        stats.ChunkAllocations += spCounters->ChunkAllocations.load(std::memory_order_relaxed);
+        stats.ChunkBytes += spCounters->ChunkBytes.load(std::memory_order_relaxed);
+        stats.LastChunkAllocationFrame = std::max(stats.LastChunkAllocationFrame, spCounters->LastChunkAllocationFrame.load(std::memory_order_relaxed));
+    }
+}
+
+} // namespace Serialization
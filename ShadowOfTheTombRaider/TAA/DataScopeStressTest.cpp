@@ -0,0 +1,283 @@
+//--------------------------------------------------------------------------------------
+// File: DataScopeStressTest.cpp
+//
+// Concurrent nesting of data scopes over the paged backend.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DatabaseBackend.h"
+#include "DatabaseLayout.h"
+#include "DatabasePhase.h"
+#include "PagedReadOnlyDatabase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Outermost scopes opened by each thread, the depth they nest to and the blobs
+// each scope reads.  Three reads spill past the inline pages of a DataScope.
+constexpr size_t ITERATIONS_PER_THREAD = 200;
+constexpr size_t SCOPE_DEPTH = 6;
+constexpr size_t READS_PER_SCOPE = 3;
+constexpr size_t MIN_THREADS = 8;
+constexpr size_t MAX_BLOBS = 4096;
+
+// Database written for the test: blobs of up to a few pages, grouped into pages
+// small enough that there are hundreds of them
+const char* const STRESS_DATABASE_FILE = "DataScopeStressTest.bin";
+constexpr size_t STRESS_BLOB_COUNT = 6000;
+constexpr uint64_t STRESS_MAX_BLOB_SIZE = 20000;
+constexpr uint64_t STRESS_PAGE_SIZE = 64 * 1024;
+
+uint64_t HashBlob(const uint8_t* pData, uint64_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ pData[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct StressBlob
+{
+    Serialization::DATABASE_HANDLE Handle;
+    uint64_t Size;
+    uint64_t Hash;
+};
+
+struct StressThread
+{
+    std::mt19937 Random;
+    uint64_t Scopes = 0;
+    uint64_t Reads = 0;
+    uint64_t Failures = 0;
+};
+
+//------------------------------------------------------------------------------
+// WriteStressDatabase - random blobs and their records file
+//------------------------------------------------------------------------------
+bool WriteStressDatabase(const char* pFileName)
+{
+    std::mt19937_64 random(12345);
+    std::vector<Serialization::DatabaseBlobRecord> records;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < STRESS_BLOB_COUNT; ++i)
+    {
+        const uint64_t size = 16 + random() % STRESS_MAX_BLOB_SIZE;
+        records.push_back({ size, offset });
+        offset += size;
+    }
+    std::vector<uint8_t> data(offset);
+    for (auto& value : data)
+    {
+        value = static_cast<uint8_t>(random());
+    }
+
+    const std::string recordsFileName = std::string(pFileName) + ".rec";
+    FILE* pData = fopen(pFileName, "wb");
+    FILE* pRecords = fopen(recordsFileName.c_str(), "wb");
+    bool success = pData && pRecords;
+    success = success && fwrite(data.data(), 1, data.size(), pData) == data.size();
+    success = success && fwrite(records.data(), sizeof(records[0]), records.size(), pRecords) == records.size();
+    if (pData)
+    {
+        success = fclose(pData) == 0 && success;
+    }
+    if (pRecords)
+    {
+        success = fclose(pRecords) == 0 && success;
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// RunNestedScopes - opens a scope the way generated code does, reads blobs in it
+// and checks that they are unchanged once the scopes nested inside it, which
+// lock and evict pages of their own, have closed
+//------------------------------------------------------------------------------
+void RunNestedScopes(Serialization::PagedReadOnlyDatabase& database, const std::vector<StressBlob>& blobs, StressThread& thread, size_t depth)
+{
+    BEGIN_DATA_SCOPE_FUNCTION();
+    ++thread.Scopes;
+
+    const StressBlob* pBlobs[READS_PER_SCOPE] = {};
+    const uint8_t* pData[READS_PER_SCOPE] = {};
+    for (size_t i = 0; i < READS_PER_SCOPE; ++i)
+    {
+        pBlobs[i] = &blobs[thread.Random() % blobs.size()];
+        pData[i] = database.Read<const uint8_t*>(pBlobs[i]->Handle, dataScopeTracker).Get();
+        ++thread.Reads;
+        if (!pData[i] || HashBlob(pData[i], pBlobs[i]->Size) != pBlobs[i]->Hash)
+        {
+            ++thread.Failures;
+            pData[i] = nullptr;
+        }
+    }
+
+    if (depth + 1 < SCOPE_DEPTH)
+    {
+        const size_t children = 1 + thread.Random() % 2;
+        for (size_t i = 0; i < children; ++i)
+        {
+            RunNestedScopes(database, blobs, thread, depth + 1);
+        }
+    }
+
+    for (size_t i = 0; i < READS_PER_SCOPE; ++i)
+    {
+        if (pData[i] && HashBlob(pData[i], pBlobs[i]->Size) != pBlobs[i]->Hash)
+        {
+            ++thread.Failures;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// RunDataScopeStressTest - with epochUnlock the threads run as frame code under
+// PagedEpochUnlock, and frames start all the while, so that threads move to new
+// epochs with scopes still open
+//------------------------------------------------------------------------------
+bool RunDataScopeStressTest(const char* pFileName, Serialization::PagedReadOnlyDatabase::EvictionPolicy policy, bool epochUnlock)
+{
+    using namespace Serialization;
+
+    const auto& options = GetDatabaseOptions();
+
+    DatabaseLayout layout;
+    const auto result = layout.Load(pFileName, STRESS_PAGE_SIZE);
+    NV_THROW_IF(result != ReadOnlyDatabase::InitResult::Ok, "Failed to load the database records for the data scope stress test");
+
+    // Blobs in shared pages, so that evicting one page invalidates several blobs
+    std::vector<DATABASE_HANDLE> handles;
+    for (size_t i = 0; i < layout.GetBlobCount(); ++i)
+    {
+        const DATABASE_HANDLE handle(static_cast<int32_t>(i));
+        const uint64_t size = layout.GetBlob(handle)->Size;
+        if (size > 0 && size <= STRESS_PAGE_SIZE)
+        {
+            handles.push_back(handle);
+        }
+    }
+    NV_THROW_IF(handles.empty(), "The database has no blobs to run the data scope stress test on");
+
+    std::shuffle(handles.begin(), handles.end(), std::mt19937(12345));
+    handles.resize(std::min(handles.size(), MAX_BLOBS));
+
+    // Expected contents, read through an unlimited cache which never evicts
+    std::vector<StressBlob> blobs;
+    {
+        const PagedReadOnlyDatabase::CacheSettings settings = { STRESS_PAGE_SIZE, 0, 0, options.CacheShardCount, policy, options.ReadEngine, options.ReadQueueDepth, 0, false, 0, false, options.HugePages, options.MaxCachedBufferBytes, false };
+        PagedReadOnlyDatabase database(settings);
+        NV_THROW_IF(database.Init(pFileName) != ReadOnlyDatabase::InitResult::Ok, "Failed to open the database for the data scope stress test");
+        for (const auto& handle : handles)
+        {
+            const uint8_t* pData = database.Read<const uint8_t*>(handle).Get();
+            NV_THROW_IF(!pData, "Failed to read a blob for the data scope stress test");
+            const uint64_t size = layout.GetBlob(handle)->Size;
+            blobs.push_back({ handle, size, HashBlob(pData, size) });
+        }
+    }
+
+    // Room for at most half of the pages, and no more than the threads can hold at
+    // once, so that every scope competes with the others for pages
+    const size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), MIN_THREADS);
+    const size_t maxPages = std::max<size_t>(std::min(layout.GetPageCount() / 2, threadCount * SCOPE_DEPTH * READS_PER_SCOPE), 1);
+    const PagedReadOnlyDatabase::CacheSettings settings = { STRESS_PAGE_SIZE, maxPages, 0, options.CacheShardCount, policy, options.ReadEngine, options.ReadQueueDepth, 0, false, 0, false, options.HugePages, options.MaxCachedBufferBytes, epochUnlock };
+    PagedReadOnlyDatabase database(settings);
+    NV_THROW_IF(database.Init(pFileName) != ReadOnlyDatabase::InitResult::Ok, "Failed to open the database for the data scope stress test");
+
+    std::vector<StressThread> threads(threadCount);
+    std::vector<std::thread> workers;
+    std::atomic<size_t> ready(0);
+    std::atomic<size_t> finished(0);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads[i].Random.seed(static_cast<uint32_t>(i + 1));
+        workers.emplace_back([&, i]() {
+            if (epochUnlock)
+            {
+                SetDatabasePhase(DatabasePhase::Frame);
+            }
+
+            // Start together so that the scopes of every thread overlap
+            ready.fetch_add(1);
+            while (ready.load() < threadCount)
+            {
+                std::this_thread::yield();
+            }
+            for (size_t iteration = 0; iteration < ITERATIONS_PER_THREAD; ++iteration)
+            {
+                RunNestedScopes(database, blobs, threads[i], 0);
+            }
+            finished.fetch_add(1);
+        });
+    }
+    while (epochUnlock && finished.load() < threadCount)
+    {
+        BeginDatabaseFrame();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    StressThread total;
+    for (const auto& thread : threads)
+    {
+        total.Scopes += thread.Scopes;
+        total.Reads += thread.Reads;
+        total.Failures += thread.Failures;
+    }
+
+    const auto stats = database.GetCacheStats();
+    NV_MESSAGE("Data scope stress test, %s%s: %zu threads opened %llu scopes up to %zu deep and read %llu of %zu blobs in %.3f s, with %llu misses and %llu evictions",
+        PagedReadOnlyDatabase::EvictionPolicyToString(policy),
+        epochUnlock ? " with epoch unlock" : "",
+        threadCount,
+        static_cast<unsigned long long>(total.Scopes),
+        SCOPE_DEPTH,
+        static_cast<unsigned long long>(total.Reads),
+        blobs.size(),
+        seconds,
+        static_cast<unsigned long long>(stats.Misses),
+        static_cast<unsigned long long>(stats.Evictions));
+    if (total.Failures > 0)
+    {
+        NV_MESSAGE("Data scope stress test: %llu reads were missing or changed while their scope was open",
+            static_cast<unsigned long long>(total.Failures));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Nests data scopes on many threads at once over a paged database which evicts constantly, with each eviction policy and with epoch unlocking, and fails if a blob changes while a scope holding it is open", []() {
+        using EvictionPolicy = Serialization::PagedReadOnlyDatabase::EvictionPolicy;
+
+        NV_THROW_IF(!WriteStressDatabase(STRESS_DATABASE_FILE), "Failed to write the database for the data scope stress test");
+        const bool clockPassed = RunDataScopeStressTest(STRESS_DATABASE_FILE, EvictionPolicy::Clock, false);
+        const bool lruPassed = RunDataScopeStressTest(STRESS_DATABASE_FILE, EvictionPolicy::LeastRecentlyUsed, false);
+        const bool epochPassed = RunDataScopeStressTest(STRESS_DATABASE_FILE, EvictionPolicy::Clock, true);
+        std::remove(STRESS_DATABASE_FILE);
+        std::remove((std::string(STRESS_DATABASE_FILE) + ".rec").c_str());
+        return clockPassed && lruPassed && epochPassed;
+    });
+}
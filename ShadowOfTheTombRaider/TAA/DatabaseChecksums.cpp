@@ -0,0 +1,619 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseChecksums.cpp
+//
+// Checksums of the blobs of a database file, kept in a sidecar file.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseChecksums.h"
+
+#include "CommonReplay.h"
+#include "DatabaseHash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define NV_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define NV_TARGET_SSE42
+#else
+#define NV_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define NV_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace Serialization {
+
+namespace {
+
+const uint64_t SIDECAR_MAGIC = 0x4D55534B48434456ull; // "VDCHKSUM"
+
+// Sidecars of version 1 were computed by the replay from the file they then
+// checked, so they are not trusted
+const uint32_t SIDECAR_VERSION = 2;
+
+// Mismatches reported one by one; further ones are only counted
+const uint64_t MAX_REPORTED_FAILURES = 32;
+
+// Bytes Compute reads at once
+const uint64_t COMPUTE_RUN_SIZE = 8 * 1024 * 1024;
+
+struct SidecarHeader
+{
+    uint64_t Magic;
+    uint32_t Version;
+    uint32_t Reserved;
+    uint64_t BlockSize;
+    uint64_t DatabaseSize;
+    uint64_t RecordsHash;
+    uint64_t BlockCount;
+    uint64_t ChecksumsHash;
+    uint64_t VerifiedIdentity[4];
+};
+
+// Reflected CRC-32C polynomial, and the CRC-32 polynomial of zip archives
+const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+const uint32_t CRC32_POLYNOMIAL = 0xEDB88320;
+
+// Bytes in each of the three streams the hardware CRC is interleaved over
+const size_t CRC32C_LANE_SIZE = 4096;
+
+//------------------------------------------------------------------------------
+// CrcTables - slice-by-8 tables for the software CRC, and tables which advance
+// a CRC over CRC32C_LANE_SIZE zero bytes to combine interleaved streams
+//------------------------------------------------------------------------------
+struct CrcTables
+{
+    explicit CrcTables(uint32_t polynomial)
+    {
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t crc = n;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+            }
+            Slice[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            for (size_t k = 1; k < 8; ++k)
+            {
+                Slice[k][n] = (Slice[k - 1][n] >> 8) ^ Slice[0][Slice[k - 1][n] & 0xFF];
+            }
+        }
+
+        // The CRC of zero bytes is linear in the starting CRC, so advancing each
+        // bit of it gives the advance of any CRC
+        uint32_t bitShifts[32];
+        for (int bit = 0; bit < 32; ++bit)
+        {
+            uint32_t crc = uint32_t(1) << bit;
+            for (size_t i = 0; i < CRC32C_LANE_SIZE; i += 8)
+            {
+                crc = Slice[7][crc & 0xFF] ^ Slice[6][(crc >> 8) & 0xFF] ^ Slice[5][(crc >> 16) & 0xFF] ^ Slice[4][crc >> 24];
+            }
+            bitShifts[bit] = crc;
+        }
+        for (size_t k = 0; k < 4; ++k)
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t shift = 0;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    if (n & (1u << bit))
+                    {
+                        shift ^= bitShifts[k * 8 + bit];
+                    }
+                }
+                LaneShift[k][n] = shift;
+            }
+        }
+    }
+
+    // Advances a CRC over CRC32C_LANE_SIZE zero bytes
+    uint32_t ShiftLane(uint32_t crc) const
+    {
+        return LaneShift[0][crc & 0xFF] ^ LaneShift[1][(crc >> 8) & 0xFF] ^ LaneShift[2][(crc >> 16) & 0xFF] ^ LaneShift[3][crc >> 24];
+    }
+
+    uint32_t Slice[8][256];
+    uint32_t LaneShift[4][256];
+};
+
+const CrcTables& GetCrc32cTables()
+{
+    static const CrcTables s_tables(CRC32C_POLYNOMIAL);
+    return s_tables;
+}
+
+const CrcTables& GetCrc32Tables()
+{
+    static const CrcTables s_tables(CRC32_POLYNOMIAL);
+    return s_tables;
+}
+
+uint64_t Load64(const uint8_t* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+//------------------------------------------------------------------------------
+// UpdateCrcSoftware - slice-by-8.  The CRC is not inverted before or after.
+//------------------------------------------------------------------------------
+uint32_t UpdateCrcSoftware(const CrcTables& tables, uint32_t crc, const uint8_t* p, size_t size)
+{
+    while (size >= 8)
+    {
+        const uint64_t value = Load64(p) ^ crc;
+        crc = tables.Slice[7][value & 0xFF] ^ tables.Slice[6][(value >> 8) & 0xFF] ^ tables.Slice[5][(value >> 16) & 0xFF] ^ tables.Slice[4][(value >> 24) & 0xFF]
+            ^ tables.Slice[3][(value >> 32) & 0xFF] ^ tables.Slice[2][(value >> 40) & 0xFF] ^ tables.Slice[1][(value >> 48) & 0xFF] ^ tables.Slice[0][value >> 56];
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0)
+    {
+        crc = (crc >> 8) ^ tables.Slice[0][(crc ^ *p) & 0xFF];
+        ++p;
+        --size;
+    }
+    return crc;
+}
+
+uint32_t UpdateCrc32cSoftware(uint32_t crc, const uint8_t* p, size_t size)
+{
+    return UpdateCrcSoftware(GetCrc32cTables(), crc, p, size);
+}
+
+#if defined(NV_CRC32C_SSE42)
+//------------------------------------------------------------------------------
+// UpdateCrc32cSse42 - the crc32 instruction has a latency of three cycles and a
+// throughput of one, so three independent streams are run and combined
+//------------------------------------------------------------------------------
+NV_TARGET_SSE42 uint32_t UpdateCrc32cSse42(uint32_t crc, const uint8_t* p, size_t size)
+{
+    const CrcTables& tables = GetCrc32cTables();
+    while (size >= 3 * CRC32C_LANE_SIZE)
+    {
+        uint64_t crcA = crc;
+        uint64_t crcB = 0;
+        uint64_t crcC = 0;
+        for (size_t i = 0; i < CRC32C_LANE_SIZE; i += 8)
+        {
+            crcA = _mm_crc32_u64(crcA, Load64(p + i));
+            crcB = _mm_crc32_u64(crcB, Load64(p + CRC32C_LANE_SIZE + i));
+            crcC = _mm_crc32_u64(crcC, Load64(p + 2 * CRC32C_LANE_SIZE + i));
+        }
+        crc = tables.ShiftLane(tables.ShiftLane(static_cast<uint32_t>(crcA)) ^ static_cast<uint32_t>(crcB)) ^ static_cast<uint32_t>(crcC);
+        p += 3 * CRC32C_LANE_SIZE;
+        size -= 3 * CRC32C_LANE_SIZE;
+    }
+
+    uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        crc64 = _mm_crc32_u64(crc64, Load64(p));
+        p += 8;
+        size -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (size > 0)
+    {
+        crc = _mm_crc32_u8(crc, *p);
+        ++p;
+        --size;
+    }
+    return crc;
+}
+
+bool HasSse42()
+{
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
+
+#if defined(NV_CRC32C_ARM)
+//------------------------------------------------------------------------------
+// UpdateCrc32cArm - as UpdateCrc32cSse42, with the ARMv8 CRC instructions
+//------------------------------------------------------------------------------
+uint32_t UpdateCrc32cArm(uint32_t crc, const uint8_t* p, size_t size)
+{
+    const CrcTables& tables = GetCrc32cTables();
+    while (size >= 3 * CRC32C_LANE_SIZE)
+    {
+        uint32_t crcA = crc;
+        uint32_t crcB = 0;
+        uint32_t crcC = 0;
+        for (size_t i = 0; i < CRC32C_LANE_SIZE; i += 8)
+        {
+            crcA = __crc32cd(crcA, Load64(p + i));
+            crcB = __crc32cd(crcB, Load64(p + CRC32C_LANE_SIZE + i));
+            crcC = __crc32cd(crcC, Load64(p + 2 * CRC32C_LANE_SIZE + i));
+        }
+        crc = tables.ShiftLane(tables.ShiftLane(crcA) ^ crcB) ^ crcC;
+        p += 3 * CRC32C_LANE_SIZE;
+        size -= 3 * CRC32C_LANE_SIZE;
+    }
+
+    while (size >= 8)
+    {
+        crc = __crc32cd(crc, Load64(p));
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0)
+    {
+        crc = __crc32cb(crc, *p);
+        ++p;
+        --size;
+    }
+    return crc;
+}
+#endif
+
+using UpdateCrc32cFunction = uint32_t (*)(uint32_t crc, const uint8_t* p, size_t size);
+
+UpdateCrc32cFunction SelectUpdateCrc32c()
+{
+#if defined(NV_CRC32C_SSE42)
+    if (HasSse42())
+    {
+        return UpdateCrc32cSse42;
+    }
+#elif defined(NV_CRC32C_ARM)
+    return UpdateCrc32cArm;
+#endif
+    return UpdateCrc32cSoftware;
+}
+
+UpdateCrc32cFunction GetUpdateCrc32c()
+{
+    static const UpdateCrc32cFunction s_update = SelectUpdateCrc32c();
+    return s_update;
+}
+
+uint64_t ElapsedNanoseconds(std::chrono::steady_clock::time_point start)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// Crc32c
+//------------------------------------------------------------------------------
+uint32_t Crc32c(uint32_t crc, const void* pData, size_t size)
+{
+    return ~GetUpdateCrc32c()(~crc, static_cast<const uint8_t*>(pData), size);
+}
+
+//------------------------------------------------------------------------------
+// Crc32
+//------------------------------------------------------------------------------
+uint32_t Crc32(uint32_t crc, const void* pData, size_t size)
+{
+    return ~UpdateCrcSoftware(GetCrc32Tables(), ~crc, static_cast<const uint8_t*>(pData), size);
+}
+
+//------------------------------------------------------------------------------
+// IsCrc32cHardwareAccelerated
+//------------------------------------------------------------------------------
+bool IsCrc32cHardwareAccelerated()
+{
+    return GetUpdateCrc32c() != UpdateCrc32cSoftware;
+}
+
+//------------------------------------------------------------------------------
+// DatabaseChecksums
+//------------------------------------------------------------------------------
+DatabaseChecksums::DatabaseChecksums()
+    : m_DatabaseFileName()
+    , m_SidecarFileName()
+    , m_DatabaseSize()
+    , m_RecordsHash()
+    , m_VerifiedIdentity()
+    , m_Blocks()
+    , m_Checksums()
+    , m_Verified()
+    , m_VerifiedBlocks()
+    , m_VerifiedBytes()
+    , m_FailedBlocks()
+    , m_HashNanoseconds()
+{
+}
+
+//------------------------------------------------------------------------------
+// GetSidecarFileName
+//------------------------------------------------------------------------------
+std::string DatabaseChecksums::GetSidecarFileName(const char* pFileName)
+{
+    return std::string(pFileName) + ".sum";
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+void DatabaseChecksums::Init(const char* pFileName, const DatabaseLayout& layout, uint64_t databaseSize)
+{
+    m_DatabaseFileName = pFileName;
+    m_SidecarFileName = GetSidecarFileName(pFileName);
+    m_DatabaseSize = databaseSize;
+    memset(m_VerifiedIdentity, 0, sizeof(m_VerifiedIdentity));
+
+    // The blocks depend on every record, empty ones included through the handles
+    // they shift, so the sidecar is tied to the whole records file
+    m_RecordsHash = 0;
+    m_Blocks.clear();
+    for (size_t i = 0; i < layout.GetBlobCount(); ++i)
+    {
+        const DatabaseBlobRecord& blob = *layout.GetBlob(DATABASE_HANDLE(static_cast<int32_t>(i)));
+        m_RecordsHash = HashBlob(&blob, sizeof(blob), m_RecordsHash);
+        for (uint64_t offset = 0; offset < blob.Size; offset += BLOCK_SIZE)
+        {
+            const Block block = { blob.Offset + offset, static_cast<uint32_t>(std::min(BLOCK_SIZE, blob.Size - offset)), static_cast<uint32_t>(i) };
+            m_Blocks.push_back(block);
+        }
+    }
+
+    std::sort(m_Blocks.begin(), m_Blocks.end(), [](const Block& a, const Block& b) {
+        return a.Offset != b.Offset ? a.Offset < b.Offset : a.Size < b.Size;
+    });
+    m_Blocks.erase(std::unique(m_Blocks.begin(), m_Blocks.end(), [](const Block& a, const Block& b) {
+        return a.Offset == b.Offset && a.Size == b.Size;
+    }),
+        m_Blocks.end());
+
+    m_Checksums.assign(m_Blocks.size(), 0);
+    m_Verified.reset(new std::atomic<uint64_t>[(m_Blocks.size() + 63) / 64]());
+    m_VerifiedBlocks = 0;
+    m_VerifiedBytes = 0;
+    m_FailedBlocks = 0;
+    m_HashNanoseconds = 0;
+}
+
+//------------------------------------------------------------------------------
+// Load
+//------------------------------------------------------------------------------
+DatabaseChecksums::LoadResult DatabaseChecksums::Load()
+{
+    FILE* pFile = fopen(m_SidecarFileName.c_str(), "rb");
+    if (!pFile)
+    {
+        return LoadResult::Missing;
+    }
+
+    SidecarHeader header = {};
+    bool valid = fread(&header, sizeof(header), 1, pFile) == 1
+        && header.Magic == SIDECAR_MAGIC
+        && header.Version == SIDECAR_VERSION
+        && header.BlockSize == BLOCK_SIZE
+        && header.DatabaseSize == m_DatabaseSize
+        && header.RecordsHash == m_RecordsHash
+        && header.BlockCount == m_Blocks.size();
+    if (valid && !m_Checksums.empty())
+    {
+        valid = fread(m_Checksums.data(), sizeof(uint32_t), m_Checksums.size(), pFile) == m_Checksums.size()
+            && HashBlob(m_Checksums.data(), m_Checksums.size() * sizeof(uint32_t)) == header.ChecksumsHash;
+    }
+    fclose(pFile);
+
+    if (!valid)
+    {
+        m_Checksums.assign(m_Blocks.size(), 0);
+        return LoadResult::Stale;
+    }
+
+    memcpy(m_VerifiedIdentity, header.VerifiedIdentity, sizeof(m_VerifiedIdentity));
+    return LoadResult::Loaded;
+}
+
+//------------------------------------------------------------------------------
+// Compute
+//------------------------------------------------------------------------------
+bool DatabaseChecksums::Compute(const ReadFunction& read)
+{
+    // Runs of adjacent blocks read at once; the gaps between blobs are read too
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t first = 0; first < m_Blocks.size();)
+    {
+        const uint64_t begin = m_Blocks[first].Offset;
+        uint64_t end = begin + m_Blocks[first].Size;
+        size_t last = first + 1;
+        while (last < m_Blocks.size() && std::max(end, m_Blocks[last].Offset + m_Blocks[last].Size) - begin <= COMPUTE_RUN_SIZE)
+        {
+            end = std::max(end, m_Blocks[last].Offset + m_Blocks[last].Size);
+            ++last;
+        }
+        runs.emplace_back(first, last);
+        first = last;
+    }
+
+    std::atomic<size_t> nextRun(0);
+    std::atomic<bool> failed(false);
+    auto computeRuns = [&]() {
+        std::vector<uint8_t> buffer;
+        for (size_t run = nextRun.fetch_add(1); run < runs.size() && !failed; run = nextRun.fetch_add(1))
+        {
+            const size_t first = runs[run].first;
+            const size_t last = runs[run].second;
+            const uint64_t begin = m_Blocks[first].Offset;
+            uint64_t end = begin;
+            for (size_t i = first; i < last; ++i)
+            {
+                end = std::max(end, m_Blocks[i].Offset + m_Blocks[i].Size);
+            }
+
+            buffer.resize(static_cast<size_t>(end - begin));
+            if (!read(begin, end - begin, buffer.data()))
+            {
+                failed = true;
+                break;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t i = first; i < last; ++i)
+            {
+                m_Checksums[i] = Crc32c(0, buffer.data() + (m_Blocks[i].Offset - begin), m_Blocks[i].Size);
+            }
+            m_HashNanoseconds.fetch_add(ElapsedNanoseconds(start), std::memory_order_relaxed);
+        }
+    };
+
+    if (g_threadPoolThreadCount > 0)
+    {
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 0; i < g_threadPoolThreadCount; ++i)
+        {
+            tasks.push_back(NvExecuteOnThreadPool(computeRuns));
+        }
+        for (auto& task : tasks)
+        {
+            task.wait();
+        }
+    }
+    else
+    {
+        computeRuns();
+    }
+
+    return !failed;
+}
+
+//------------------------------------------------------------------------------
+// Save
+//------------------------------------------------------------------------------
+bool DatabaseChecksums::Save(const uint64_t (&verifiedIdentity)[4]) const
+{
+    SidecarHeader header = {};
+    header.Magic = SIDECAR_MAGIC;
+    header.Version = SIDECAR_VERSION;
+    header.BlockSize = BLOCK_SIZE;
+    header.DatabaseSize = m_DatabaseSize;
+    header.RecordsHash = m_RecordsHash;
+    header.BlockCount = m_Blocks.size();
+    header.ChecksumsHash = HashBlob(m_Checksums.data(), m_Checksums.size() * sizeof(uint32_t));
+    memcpy(header.VerifiedIdentity, verifiedIdentity, sizeof(header.VerifiedIdentity));
+
+    FILE* pFile = fopen(m_SidecarFileName.c_str(), "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bool success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    if (success && !m_Checksums.empty())
+    {
+        success = fwrite(m_Checksums.data(), sizeof(uint32_t), m_Checksums.size(), pFile) == m_Checksums.size();
+    }
+    success = fclose(pFile) == 0 && success;
+
+    // A partial sidecar would fail its checksums hash and be recomputed, but remove
+    // it rather than leave it for the next launch to trip over
+    if (!success)
+    {
+        remove(m_SidecarFileName.c_str());
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// IsVerified
+//------------------------------------------------------------------------------
+bool DatabaseChecksums::IsVerified(const uint64_t (&identity)[4]) const
+{
+    return memcmp(m_VerifiedIdentity, identity, sizeof(m_VerifiedIdentity)) == 0;
+}
+
+//------------------------------------------------------------------------------
+// Verify
+//------------------------------------------------------------------------------
+bool DatabaseChecksums::Verify(uint64_t offset, uint64_t size, const uint8_t* pData)
+{
+    const uint64_t end = offset + size;
+    auto it = std::lower_bound(m_Blocks.begin(), m_Blocks.end(), offset, [](const Block& block, uint64_t blockOffset) {
+        return block.Offset < blockOffset;
+    });
+
+    bool success = true;
+    bool hashed = false;
+    std::chrono::steady_clock::time_point start;
+    for (size_t i = static_cast<size_t>(it - m_Blocks.begin()); i < m_Blocks.size() && m_Blocks[i].Offset < end; ++i)
+    {
+        const Block& block = m_Blocks[i];
+        if (block.Offset + block.Size > end || !MarkVerified(i))
+        {
+            continue;
+        }
+
+        // Only time calls which hash something, so that reads of verified pages
+        // cost one search
+        if (!hashed)
+        {
+            start = std::chrono::steady_clock::now();
+            hashed = true;
+        }
+
+        m_VerifiedBlocks.fetch_add(1, std::memory_order_relaxed);
+        m_VerifiedBytes.fetch_add(block.Size, std::memory_order_relaxed);
+        if (Crc32c(0, pData + (block.Offset - offset), block.Size) != m_Checksums[i])
+        {
+            success = false;
+            if (m_FailedBlocks.fetch_add(1, std::memory_order_relaxed) < MAX_REPORTED_FAILURES)
+            {
+                NV_MESSAGE("Database verification: bytes %llu-%llu of '%s' (blob %u) do not match their checksum in '%s'; the file is corrupt or was extracted incompletely",
+                    static_cast<unsigned long long>(block.Offset),
+                    static_cast<unsigned long long>(block.Offset + block.Size),
+                    m_DatabaseFileName.c_str(),
+                    block.BlobIndex,
+                    m_SidecarFileName.c_str());
+            }
+        }
+    }
+
+    if (hashed)
+    {
+        m_HashNanoseconds.fetch_add(ElapsedNanoseconds(start), std::memory_order_relaxed);
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// IsComplete
+//------------------------------------------------------------------------------
+bool DatabaseChecksums::IsComplete() const
+{
+    return m_VerifiedBlocks.load() == m_Blocks.size() && m_FailedBlocks.load() == 0;
+}
+
+//------------------------------------------------------------------------------
+// GetStats
+//------------------------------------------------------------------------------
+DatabaseChecksums::Stats DatabaseChecksums::GetStats() const
+{
+    Stats stats = {};
+    stats.VerifiedBlocks = m_VerifiedBlocks;
+    stats.VerifiedBytes = m_VerifiedBytes;
+    stats.FailedBlocks = m_FailedBlocks;
+    stats.HashNanoseconds = m_HashNanoseconds;
+    return stats;
+}
+
+} // namespace Serialization
@@ -0,0 +1,307 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseLayout.cpp
+//
+// Blob and page records shared by the ReadOnlyDatabase backends.
+//--------------------------------------------------------------------------------------
+
+#include "DatabaseLayout.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// DatabaseLayout
+//------------------------------------------------------------------------------
+DatabaseLayout::DatabaseLayout()
+    : m_Blobs()
+    , m_BlobLocations()
+    , m_Pages()
+    , m_PageSizeThreshold()
+    , m_PageStartTable(1, DatabaseBlobLocation::NO_PAGE)
+    , m_PageStartShift(63)
+{
+}
+
+//------------------------------------------------------------------------------
+// GetRecordsFileName
+//------------------------------------------------------------------------------
+std::string DatabaseLayout::GetRecordsFileName(const char* pFileName)
+{
+    return std::string(pFileName) + ".rec";
+}
+
+//------------------------------------------------------------------------------
+// GetFileSize
+//------------------------------------------------------------------------------
+bool DatabaseLayout::GetFileSize(const char* pFileName, uint64_t& fileSize)
+{
+#if defined(_WIN32)
+    struct _stat64 fileStat = {};
+    if (_stat64(pFileName, &fileStat) != 0)
+    {
+        return false;
+    }
+#else
+    struct stat fileStat = {};
+    if (stat(pFileName, &fileStat) != 0)
+    {
+        return false;
+    }
+#endif
+
+    fileSize = static_cast<uint64_t>(fileStat.st_size);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// GetFileIdentity
+//------------------------------------------------------------------------------
+bool DatabaseLayout::GetFileIdentity(const char* pFileName, uint64_t (&identity)[4])
+{
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(pFileName, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION info = {};
+    const bool success = GetFileInformationByHandle(hFile, &info) != 0;
+    CloseHandle(hFile);
+    identity[0] = info.dwVolumeSerialNumber;
+    identity[1] = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    identity[2] = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    identity[3] = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    return success;
+#else
+    struct stat fileStat = {};
+    if (stat(pFileName, &fileStat) != 0)
+    {
+        return false;
+    }
+    identity[0] = static_cast<uint64_t>(fileStat.st_dev);
+    identity[1] = static_cast<uint64_t>(fileStat.st_ino);
+    identity[2] = static_cast<uint64_t>(fileStat.st_size);
+#if defined(__APPLE__)
+    identity[3] = static_cast<uint64_t>(fileStat.st_mtimespec.tv_sec) * 1000000000ull + static_cast<uint64_t>(fileStat.st_mtimespec.tv_nsec);
+#else
+    identity[3] = static_cast<uint64_t>(fileStat.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(fileStat.st_mtim.tv_nsec);
+#endif
+    return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Load
+//------------------------------------------------------------------------------
+ReadOnlyDatabase::InitResult DatabaseLayout::Load(const char* pFileName, uint64_t pageSizeThreshold)
+{
+    uint64_t fileSize = 0;
+    if (!pFileName || !GetFileSize(pFileName, fileSize))
+    {
+        return ReadOnlyDatabase::InitResult::FailedToOpenDatabase;
+    }
+
+    return Load(pFileName, fileSize, pageSizeThreshold);
+}
+
+//------------------------------------------------------------------------------
+// Load
+//------------------------------------------------------------------------------
+ReadOnlyDatabase::InitResult DatabaseLayout::Load(const char* pFileName, uint64_t fileSize, uint64_t pageSizeThreshold)
+{
+    using InitResult = ReadOnlyDatabase::InitResult;
+
+    if (!pFileName || pageSizeThreshold == 0)
+    {
+        return InitResult::BadArgument;
+    }
+
+    m_Blobs.clear();
+    m_BlobLocations.clear();
+    m_Pages.clear();
+    m_PageSizeThreshold = pageSizeThreshold;
+    m_PageStartTable.assign(1, DatabaseBlobLocation::NO_PAGE);
+    m_PageStartShift = 63;
+
+    const std::string recordsFileName = GetRecordsFileName(pFileName);
+    FILE* pFile = fopen(recordsFileName.c_str(), "rb");
+    if (!pFile)
+    {
+        return InitResult::FailedToOpenDatabaseRecords;
+    }
+
+    // The records file is small (16 bytes per blob), so read it in one pass
+    DatabaseBlobRecord records[1024];
+    size_t count = 0;
+    while ((count = fread(records, sizeof(DatabaseBlobRecord), 1024, pFile)) > 0)
+    {
+        m_Blobs.insert(m_Blobs.end(), records, records + count);
+    }
+    const bool readError = ferror(pFile) != 0;
+    fclose(pFile);
+
+    if (readError)
+    {
+        return InitResult::FailedToOpenDatabaseRecords;
+    }
+
+    // Reject records which point outside of the database file
+    for (const auto& blob : m_Blobs)
+    {
+        if (blob.Offset > fileSize || blob.Size > fileSize - blob.Offset)
+        {
+            m_Blobs.clear();
+            return InitResult::FailedToOpenDatabaseRecords;
+        }
+    }
+
+    BuildPages();
+
+    // Page indices are stored in 32 bits
+    if (m_Pages.size() >= DatabaseBlobLocation::NO_PAGE)
+    {
+        m_Blobs.clear();
+        m_BlobLocations.clear();
+        m_Pages.clear();
+        return InitResult::FailedToOpenDatabaseRecords;
+    }
+
+    BuildPageStartTable();
+    return InitResult::Ok;
+}
+
+//------------------------------------------------------------------------------
+// BuildPages - groups blobs into pages and records the location of each blob
+//------------------------------------------------------------------------------
+void DatabaseLayout::BuildPages()
+{
+    DatabaseBlobLocation emptyLocation = {};
+    emptyLocation.PageIndex = DatabaseBlobLocation::NO_PAGE;
+    m_BlobLocations.assign(m_Blobs.size(), emptyLocation);
+
+    // Blobs are normally stored in handle order, but don't rely on it
+    std::vector<const DatabaseBlobRecord*> sortedBlobs;
+    sortedBlobs.reserve(m_Blobs.size());
+    for (const auto& blob : m_Blobs)
+    {
+        sortedBlobs.push_back(&blob);
+    }
+    std::sort(sortedBlobs.begin(), sortedBlobs.end(), [](const DatabaseBlobRecord* pA, const DatabaseBlobRecord* pB) {
+        return pA->Offset < pB->Offset;
+    });
+
+    // The open page is the next one to be added, and its offset never changes once
+    // opened, so each blob's location is known as soon as it is placed
+    bool hasOpenPage = false;
+    DatabasePageRecord openPage = {};
+    for (const DatabaseBlobRecord* pBlob : sortedBlobs)
+    {
+        const uint64_t blobEnd = pBlob->Offset + pBlob->Size;
+
+        bool placed = false;
+        if (hasOpenPage)
+        {
+            const uint64_t openPageEnd = openPage.PageOffset + openPage.PageSize;
+
+            // Blobs which are contained within the open page (duplicates, empty blobs) need no new page
+            if (blobEnd <= openPageEnd)
+            {
+                placed = true;
+            }
+
+            // Overlapping blobs must share a page so that every blob is contiguous in memory
+            else if (pBlob->Offset < openPageEnd || blobEnd - openPage.PageOffset <= m_PageSizeThreshold)
+            {
+                openPage.PageSize = blobEnd - openPage.PageOffset;
+                placed = true;
+            }
+            else
+            {
+                m_Pages.push_back(openPage);
+            }
+        }
+
+        if (!placed)
+        {
+            openPage.PageOffset = pBlob->Offset;
+            openPage.PageSize = pBlob->Size;
+            hasOpenPage = true;
+        }
+
+        if (pBlob->Size > 0)
+        {
+            DatabaseBlobLocation& location = m_BlobLocations[static_cast<size_t>(pBlob - m_Blobs.data())];
+            location.Size = pBlob->Size;
+            location.OffsetInPage = pBlob->Offset - openPage.PageOffset;
+            location.PageIndex = static_cast<uint32_t>(m_Pages.size());
+        }
+    }
+
+    if (hasOpenPage)
+    {
+        m_Pages.push_back(openPage);
+    }
+}
+
+//------------------------------------------------------------------------------
+// BuildPageStartTable
+//------------------------------------------------------------------------------
+void DatabaseLayout::BuildPageStartTable()
+{
+    unsigned bits = 1;
+    while ((size_t(1) << bits) < 2 * m_Pages.size())
+    {
+        ++bits;
+    }
+    m_PageStartShift = 64 - bits;
+    m_PageStartTable.assign(size_t(1) << bits, DatabaseBlobLocation::NO_PAGE);
+
+    // Empty pages hold no blobs, and can share their offset with the next page
+    for (size_t i = 0; i < m_Pages.size(); ++i)
+    {
+        if (m_Pages[i].PageSize == 0)
+        {
+            continue;
+        }
+
+        size_t slot = HashPageOffset(m_Pages[i].PageOffset);
+        while (m_PageStartTable[slot] != DatabaseBlobLocation::NO_PAGE)
+        {
+            slot = (slot + 1) & (m_PageStartTable.size() - 1);
+        }
+        m_PageStartTable[slot] = static_cast<uint32_t>(i);
+    }
+}
+
+//------------------------------------------------------------------------------
+// FindPage
+//------------------------------------------------------------------------------
+size_t DatabaseLayout::FindPage(uint64_t offset) const
+{
+    auto it = std::upper_bound(m_Pages.begin(), m_Pages.end(), offset, [](uint64_t value, const DatabasePageRecord& page) {
+        return value < page.PageOffset;
+    });
+    if (it == m_Pages.begin())
+    {
+        return m_Pages.size();
+    }
+
+    --it;
+    if (offset >= it->PageOffset + it->PageSize)
+    {
+        return m_Pages.size();
+    }
+
+    return static_cast<size_t>(it - m_Pages.begin());
+}
+
+} // namespace Serialization
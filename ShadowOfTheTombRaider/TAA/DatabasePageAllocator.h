@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// File: DatabasePageAllocator.h
+//
+// Memory for database pages, optionally backed by huge pages.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// DatabasePageAllocator
+//
+// Allocations below LARGE_ALLOCATION_SIZE come from the heap, which already reuses
+// them.  Larger ones are mapped directly, rounded up to LARGE_ALLOCATION_SIZE, so
+// that they can be backed by huge pages:
+//
+// - Transparent: the mapping is aligned to the huge page size and marked with
+//   MADV_HUGEPAGE, so the kernel backs it with huge pages when it can.
+// - Explicit: the mapping is made with MAP_HUGETLB (MEM_LARGE_PAGES on Windows),
+//   which needs huge pages reserved up front (vm.nr_hugepages, or the Lock Pages in
+//   Memory privilege on Windows).  Allocations which cannot get them fall back to
+//   ordinary pages.
+//
+// Freed large buffers are kept, up to a byte limit, and handed out again to
+// allocations of the same rounded size, so a page loaded after an eviction reuses
+// the evicted page's memory instead of unmapping it and faulting in a new mapping.
+// Kept buffers are in addition to any residency budget of the caller.
+//----------------------------------------------------------------------------------
+class DatabasePageAllocator
+{
+public:
+    enum class HugePages
+    {
+        None,
+        Transparent,
+        Explicit,
+    };
+
+    // Smallest allocation which is mapped directly; the huge page size on x86-64
+    static constexpr uint64_t LARGE_ALLOCATION_SIZE = 2 * 1024 * 1024;
+
+    struct Stats
+    {
+        uint64_t LargeAllocations; // Large buffers mapped
+        uint64_t HugePageAllocations; // Of those, mapped with MAP_HUGETLB or MADV_HUGEPAGE
+        uint64_t HugePageFallbacks; // Explicit huge pages which were not available
+        uint64_t Reuses; // Large allocations served by a freed buffer
+        uint64_t CachedBytes; // Bytes of freed buffers kept for reuse
+    };
+
+    DatabasePageAllocator(HugePages hugePages, uint64_t maxCachedBytes);
+    ~DatabasePageAllocator();
+
+    // Returns null if the memory cannot be allocated
+    uint8_t* Allocate(uint64_t size);
+
+    // size must be the size the memory was allocated with
+    void Free(uint8_t* pMemory, uint64_t size);
+
+    HugePages GetHugePages() const
+    {
+        return m_HugePages;
+    }
+
+    Stats GetStats() const;
+
+    static const char* HugePagesToString(HugePages hugePages);
+
+private:
+    // This class is non-copyable
+    DatabasePageAllocator(const DatabasePageAllocator&) = delete;
+    DatabasePageAllocator& operator=(const DatabasePageAllocator&) = delete;
+
+    static uint64_t GetMappingSize(uint64_t size)
+    {
+        return (size + LARGE_ALLOCATION_SIZE - 1) / LARGE_ALLOCATION_SIZE * LARGE_ALLOCATION_SIZE;
+    }
+
+    uint8_t* Map(uint64_t mappingSize);
+    static void Unmap(uint8_t* pMemory, uint64_t mappingSize);
+
+    const HugePages m_HugePages;
+    const uint64_t m_MaxCachedBytes;
+
+    // Freed large buffers by mapping size
+    mutable std::mutex m_Mutex;
+    std::unordered_map<uint64_t, std::vector<uint8_t*>> m_FreeBuffers;
+    uint64_t m_CachedBytes;
+
+    std::atomic<uint64_t> m_LargeAllocations;
+    std::atomic<uint64_t> m_HugePageAllocations;
+    std::atomic<uint64_t> m_HugePageFallbacks;
+    std::atomic<uint64_t> m_Reuses;
+};
+
+} // namespace Serialization
@@ -0,0 +1,300 @@
+//--------------------------------------------------------------------------------------
+// File: DatabasePhase.h
+//
+// The part of the replay which is reading from the database.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DllCommon.h"
+
+#include <cstdint>
+#include <type_traits>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// DatabasePhase
+//
+// Each thread of the replay has a current phase, set on entry to every generated
+// function by BEGIN_DATA_SCOPE_FUNCTION from the name of the file it is in (see
+// DATABASE_SOURCE_FILES).  Reads made outside any generated function count as
+// ResourceInit.
+//
+// Frames are counted by BeginDatabaseFrame, which My_frame in function_overrides.h
+// calls from the replay's frame loop before each frame.  Frame code is split into
+// FrameNPartMM.cpp files, and each thread also tracks the part it is running.
+//----------------------------------------------------------------------------------
+enum class DatabasePhase : uint8_t
+{
+    ResourceInit,
+    FrameSetup,
+    Frame,
+    FrameReset,
+    COUNT
+};
+
+// Bit of a DatabasePhase in a mask of the phases a blob or page was read in
+constexpr uint8_t DatabasePhaseBit(DatabasePhase phase)
+{
+    return static_cast<uint8_t>(1u << static_cast<unsigned>(phase));
+}
+
+// Phases which run again for every frame, as opposed to once at startup
+constexpr uint8_t DATABASE_PHASE_MASK_PER_FRAME = DatabasePhaseBit(DatabasePhase::Frame) | DatabasePhaseBit(DatabasePhase::FrameReset);
+
+// Order of a file of frame code within a frame.  Resets come after every part, and
+// NONE is code outside the frame loop.
+constexpr uint32_t DATABASE_FRAME_PART_NONE = UINT32_MAX;
+constexpr uint32_t DATABASE_FRAME_PART_RESET = UINT32_MAX - 1;
+
+// FrameNPartMM.cpp is part N * DATABASE_FRAME_PARTS_PER_FRAME + M
+constexpr uint32_t DATABASE_FRAME_PARTS_PER_FRAME = 1024;
+
+NV_REPLAY_EXPORT const char* DatabasePhaseToString(DatabasePhase phase);
+
+// The thread's phase, and the part of the frame it is running from the
+// DatabaseFramePartFromSourceFile of the generated function it is in.  Every
+// generated function sets both, so in a static build they are inline accesses to
+// thread_local variables.  Thread-local data cannot be imported from the shared
+// replay library, which exports them as functions instead.
+#if defined(NV_REPLAY_LIB_SHARED)
+NV_REPLAY_EXPORT DatabasePhase GetDatabasePhase();
+NV_REPLAY_EXPORT void SetDatabasePhase(DatabasePhase phase);
+NV_REPLAY_EXPORT uint32_t GetDatabaseFramePart();
+NV_REPLAY_EXPORT void SetDatabaseFramePart(uint32_t part);
+#else
+namespace Detail {
+
+// Together, so that a phase scope looks up the thread's storage once
+struct ThreadDatabasePhase
+{
+    DatabasePhase Phase = DatabasePhase::ResourceInit;
+    uint32_t FramePart = DATABASE_FRAME_PART_NONE;
+};
+
+inline thread_local ThreadDatabasePhase t_phase;
+
+} // namespace Detail
+
+inline DatabasePhase GetDatabasePhase()
+{
+    return Detail::t_phase.Phase;
+}
+
+inline void SetDatabasePhase(DatabasePhase phase)
+{
+    Detail::t_phase.Phase = phase;
+}
+
+inline uint32_t GetDatabaseFramePart()
+{
+    return Detail::t_phase.FramePart;
+}
+
+inline void SetDatabaseFramePart(uint32_t part)
+{
+    Detail::t_phase.FramePart = part;
+}
+#endif
+
+// Called by the frame loop before each frame it runs
+NV_REPLAY_EXPORT void BeginDatabaseFrame();
+
+// Number of frames the replay has started; zero until the first frame runs
+NV_REPLAY_EXPORT uint64_t GetDatabaseFrameCount();
+
+namespace Detail {
+
+// Whether pName is pPattern, where each '#' of pPattern stands for one or more digits
+constexpr bool SourceFileNameMatches(const char* pName, const char* pPattern)
+{
+    while (*pPattern)
+    {
+        if (*pPattern == '#')
+        {
+            if (*pName < '0' || *pName > '9')
+            {
+                return false;
+            }
+            while (*pName >= '0' && *pName <= '9')
+            {
+                ++pName;
+            }
+        }
+        else if (*pName++ != *pPattern)
+        {
+            return false;
+        }
+        ++pPattern;
+    }
+    return !*pName;
+}
+
+// Value of the digits which follow the first occurrence of pText, zero if none do
+constexpr uint32_t SourceFileNumberAfter(const char* pName, const char* pText)
+{
+    for (; *pName; ++pName)
+    {
+        size_t i = 0;
+        while (pText[i] && pName[i] == pText[i])
+        {
+            ++i;
+        }
+        if (!pText[i])
+        {
+            uint32_t value = 0;
+            for (const char* pDigit = pName + i; *pDigit >= '0' && *pDigit <= '9'; ++pDigit)
+            {
+                value = value * 10 + static_cast<uint32_t>(*pDigit - '0');
+            }
+            return value;
+        }
+    }
+    return 0;
+}
+
+constexpr const char* SourceFileBaseName(const char* pPath)
+{
+    const char* pName = pPath;
+    for (; *pPath; ++pPath)
+    {
+        if (*pPath == '/' || *pPath == '\\')
+        {
+            pName = pPath + 1;
+        }
+    }
+    return pName;
+}
+
+} // namespace Detail
+
+//------------------------------------------------------------------------------
+// DATABASE_SOURCE_FILES - the files of generated code which run in each phase.
+// '#' stands for the number the generator gives a file.  Other generated files,
+// such as CommandList#.cpp, are called from code of every phase and keep the
+// phase of their caller.
+//------------------------------------------------------------------------------
+struct DatabaseSourceFile
+{
+    const char* pPattern;
+    DatabasePhase Phase;
+};
+
+constexpr DatabaseSourceFile DATABASE_SOURCE_FILES[] = {
+    { "Resources#.cpp", DatabasePhase::ResourceInit },
+    { "FrameSetup#.cpp", DatabasePhase::FrameSetup },
+    { "WinResourcesSetup.cpp", DatabasePhase::FrameSetup },
+    { "PerfMarkersSetup.cpp", DatabasePhase::FrameSetup },
+    { "Frame#Part#.cpp", DatabasePhase::Frame },
+    { "FrameReset#.cpp", DatabasePhase::FrameReset },
+    { "WinResourcesReset.cpp", DatabasePhase::FrameReset },
+    { "PerfMarkersReset.cpp", DatabasePhase::FrameReset },
+};
+
+//------------------------------------------------------------------------------
+// DatabasePhaseFromSourceFile - the phase the generated code in a file runs in,
+// or COUNT for files which are not in DATABASE_SOURCE_FILES.  Evaluated at
+// compile time for __FILE__.
+//------------------------------------------------------------------------------
+constexpr DatabasePhase DatabasePhaseFromSourceFile(const char* pPath)
+{
+    const char* pName = Detail::SourceFileBaseName(pPath);
+    for (const auto& file : DATABASE_SOURCE_FILES)
+    {
+        if (Detail::SourceFileNameMatches(pName, file.pPattern))
+        {
+            return file.Phase;
+        }
+    }
+    return DatabasePhase::COUNT;
+}
+
+//------------------------------------------------------------------------------
+// DatabaseFramePartFromSourceFile - where the code of a file runs within a frame:
+// FrameNPartMM.cpp by N and then M, and reset code after every part.
+// DATABASE_FRAME_PART_NONE for code outside the frame loop.
+//------------------------------------------------------------------------------
+constexpr uint32_t DatabaseFramePartFromSourceFile(const char* pPath)
+{
+    const DatabasePhase phase = DatabasePhaseFromSourceFile(pPath);
+    if (phase == DatabasePhase::FrameReset)
+    {
+        return DATABASE_FRAME_PART_RESET;
+    }
+    if (phase != DatabasePhase::Frame)
+    {
+        return DATABASE_FRAME_PART_NONE;
+    }
+
+    const char* pName = Detail::SourceFileBaseName(pPath);
+    return Detail::SourceFileNumberAfter(pName, "Frame") * DATABASE_FRAME_PARTS_PER_FRAME + Detail::SourceFileNumberAfter(pName, "Part");
+}
+
+//------------------------------------------------------------------------------
+// DatabasePhaseScope - sets the thread's phase and frame part for the lifetime of
+// the scope and restores the previous ones, so that a reset function called from
+// a frame hands them back when it returns.  COUNT leaves the phase unchanged, and
+// DATABASE_FRAME_PART_NONE the part.
+//------------------------------------------------------------------------------
+class DatabasePhaseScope
+{
+public:
+    explicit DatabasePhaseScope(DatabasePhase phase, uint32_t framePart = DATABASE_FRAME_PART_NONE)
+        : m_Previous(DatabasePhase::COUNT)
+        , m_PreviousFramePart(DATABASE_FRAME_PART_NONE)
+        , m_RestoreFramePart(false)
+    {
+        if (framePart != DATABASE_FRAME_PART_NONE)
+        {
+            const uint32_t currentPart = GetDatabaseFramePart();
+            if (framePart != currentPart)
+            {
+                m_PreviousFramePart = currentPart;
+                m_RestoreFramePart = true;
+                SetDatabaseFramePart(framePart);
+            }
+        }
+        if (phase != DatabasePhase::COUNT)
+        {
+            const DatabasePhase current = GetDatabasePhase();
+            if (phase != current)
+            {
+                m_Previous = current;
+                SetDatabasePhase(phase);
+            }
+        }
+    }
+
+    ~DatabasePhaseScope()
+    {
+        if (m_Previous != DatabasePhase::COUNT)
+        {
+            SetDatabasePhase(m_Previous);
+        }
+        if (m_RestoreFramePart)
+        {
+            SetDatabaseFramePart(m_PreviousFramePart);
+        }
+    }
+
+    DatabasePhaseScope(const DatabasePhaseScope&) = delete;
+    DatabasePhaseScope& operator=(const DatabasePhaseScope&) = delete;
+
+private:
+    DatabasePhase m_Previous;
+    uint32_t m_PreviousFramePart;
+    bool m_RestoreFramePart;
+};
+
+} // namespace Serialization
+
+#define NV_DATABASE_PHASE_SCOPE_NAME_HELPER(X, Y) X##Y
+#define NV_DATABASE_PHASE_SCOPE_NAME(X, Y) NV_DATABASE_PHASE_SCOPE_NAME_HELPER(X, Y)
+
+// Sets the thread's phase from the file the macro is used in until the end of the
+// enclosing scope
+#define NV_DATABASE_PHASE_SCOPE()                                                                           \
+    Serialization::DatabasePhaseScope NV_DATABASE_PHASE_SCOPE_NAME(database_phase_line_no_, __LINE__)(     \
+        std::integral_constant<Serialization::DatabasePhase, Serialization::DatabasePhaseFromSourceFile(__FILE__)>::value, \
+        std::integral_constant<uint32_t, Serialization::DatabaseFramePartFromSourceFile(__FILE__)>::value)
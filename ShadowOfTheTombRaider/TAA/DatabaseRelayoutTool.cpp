@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseRelayoutTool.cpp
+//
+// Rewrites the capture's database file in the order a trace used its blobs.
+//--------------------------------------------------------------------------------------
+
+#include "Arguments.h"
+#include "CommonReplay.h"
+#include "DatabaseBackend.h"
+#include "DatabaseLayout.h"
+#include "DatabaseRelayout.h"
+
+#include <memory>
+#include <string>
+
+namespace {
+
+std::string s_outputFileName;
+Serialization::DatabaseRelayoutOrder s_order = Serialization::DatabaseRelayoutOrder::FirstUse;
+
+//------------------------------------------------------------------------------
+// RelayoutDatabaseFile - rewrites the database file in the order of the trace
+// given with --database-trace-replay
+//------------------------------------------------------------------------------
+bool RelayoutDatabaseFile()
+{
+    using namespace Serialization;
+
+    const std::string& traceFileName = GetDatabaseOptions().TraceReplayFile;
+    if (traceFileName.empty())
+    {
+        NV_MESSAGE("The trace to order blobs by must be given with --database-trace-replay");
+        return false;
+    }
+
+    DatabaseRelayoutStats stats = {};
+    if (!RelayoutDatabase(DATABASE_BIN_FILE, traceFileName.c_str(), s_outputFileName.c_str(), s_order, stats))
+    {
+        NV_MESSAGE("Failed to relayout '%s' into '%s' by '%s'; the trace must be recorded against '%s' by this version",
+            DATABASE_BIN_FILE,
+            s_outputFileName.c_str(),
+            traceFileName.c_str(),
+            DATABASE_BIN_FILE);
+        return false;
+    }
+
+    NV_MESSAGE("Rewrote '%s' into '%s' (%.1f MB): %llu of %llu blobs in trace order, %llu regions, %llu bytes of padding.  Wrote '%s'.",
+        DATABASE_BIN_FILE,
+        s_outputFileName.c_str(),
+        stats.Bytes / (1024.0 * 1024.0),
+        static_cast<unsigned long long>(stats.TracedBlobs),
+        static_cast<unsigned long long>(stats.Blobs),
+        static_cast<unsigned long long>(stats.Regions),
+        static_cast<unsigned long long>(stats.PaddingBytes),
+        DatabaseLayout::GetRecordsFileName(s_outputFileName.c_str()).c_str());
+
+    if (s_order == DatabaseRelayoutOrder::Packed)
+    {
+        const double megabyte = 1024.0 * 1024.0;
+        NV_MESSAGE("Packed %.1f MB read by frames, %.1f MB read only by frame resets and %.1f MB read only at startup",
+            stats.FrameBytes / megabyte,
+            stats.ResetBytes / megabyte,
+            stats.InitBytes / megabyte);
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+FnParseResults AddRelayoutArguments(args::ArgumentParser& parser)
+{
+    // Run in the capture directory, then rename the output and its records file to
+    // data.bin and data.bin.rec.  Handles are unchanged and blobs the trace never
+    // used go last.  --packed needs a trace recorded with phases.
+    auto spOutput = std::make_shared<args::Positional<std::string>>(parser, "output", "File to write the rewritten " DATABASE_BIN_FILE " to; its records file is written next to it", args::Options::Required);
+    auto spPacked = std::make_shared<args::Flag>(parser, "packed", "Group blobs by the phases the trace read them in and then by size, so the small blobs frames read share pages", args::Matcher{ "packed" });
+
+    return [=]() {
+        s_outputFileName = args::get(*spOutput);
+        s_order = args::get(*spPacked) ? Serialization::DatabaseRelayoutOrder::Packed : Serialization::DatabaseRelayoutOrder::FirstUse;
+    };
+}
+REGISTER_ARGUMENTS(AddRelayoutArguments);
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// main
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    return RunWithExternalArguments(argc, argv, "Rewrites " DATABASE_BIN_FILE " and its records file with blobs in the order of the trace given with --database-trace-replay", []() {
+        return RelayoutDatabaseFile();
+    });
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// File: DatabaseTrace.h
+//
+// On-disk record of the order in which database pages and blobs are first used.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Serialization {
+
+//----------------------------------------------------------------------------------
+// DatabaseTraceEntry - a page of the database file, in order of first use
+//----------------------------------------------------------------------------------
+struct DatabaseTraceEntry
+{
+    uint64_t PageOffset;
+    uint64_t PageSize;
+};
+
+//------------------------------------------------------------------------------
+// SaveDatabaseTrace / LoadDatabaseTrace - returns false if the file could not be
+// written, or could not be read and validated.  Along with the pages, a trace holds
+// the DATABASE_HANDLE of each blob in order of first use, and for each of those a
+// mask of DatabasePhaseBit for the phases it was read in.  Traces written before
+// blobs were recorded load with none, and traces written before phases were
+// recorded load with no phase masks.
+//------------------------------------------------------------------------------
+bool SaveDatabaseTrace(const char* pFileName, const std::vector<DatabaseTraceEntry>& entries, const std::vector<uint32_t>& blobs, const std::vector<uint8_t>& blobPhases);
+bool LoadDatabaseTrace(const char* pFileName, std::vector<DatabaseTraceEntry>& entries, std::vector<uint32_t>* pBlobs = nullptr, std::vector<uint8_t>* pBlobPhases = nullptr);
+
+} // namespace Serialization
@@ -0,0 +1,419 @@
+//--------------------------------------------------------------------------------------
+// File: PrefetchingDatabase.cpp
+//
+// Records the order in which database pages are first used, and replays that
+// order to stream pages in ahead of use.
+//--------------------------------------------------------------------------------------
+
+#include "PrefetchingDatabase.h"
+
+#include "CommonReplay.h"
+#include "ThreadPool.h"
+
+namespace Serialization {
+
+//------------------------------------------------------------------------------
+// PrefetchingDatabase
+//------------------------------------------------------------------------------
+PrefetchingDatabase::PrefetchingDatabase(IReadOnlyDatabase& database, uint64_t PageSizeThreshold)
+    : m_Database(database)
+    , m_Layout()
+    , m_PageSizeThreshold(PageSizeThreshold)
+    , m_Mode(Mode::Record)
+    , m_TraceFileName()
+    , m_Finished(false)
+    , m_Used()
+    , m_RecordMutex()
+    , m_Recorded()
+    , m_RecordedBlobs()
+    , m_BlobPhases()
+    , m_TracePages()
+    , m_TraceStart()
+    , m_PageTraceIndex()
+    , m_PrefetchState()
+    , m_WindowSize()
+    , m_NextTraceIndex()
+    , m_Tasks()
+    , m_WindowMutex()
+    , m_WindowCondition()
+    , m_ConsumedBytes()
+    , m_Stopping(false)
+    , m_PrefetchedPages()
+    , m_HitPages()
+    , m_LatePages()
+    , m_UntracedPages()
+{
+}
+
+//------------------------------------------------------------------------------
+// ~PrefetchingDatabase
+//------------------------------------------------------------------------------
+PrefetchingDatabase::~PrefetchingDatabase()
+{
+    Finish();
+}
+
+//------------------------------------------------------------------------------
+// Init
+//------------------------------------------------------------------------------
+PrefetchingDatabase::InitResult PrefetchingDatabase::Init(const char* pFileName, uint64_t fileSize, Mode mode, const char* pTraceFileName, uint64_t windowSize)
+{
+    if (!pFileName || !pTraceFileName || windowSize == 0)
+    {
+        return InitResult::BadArgument;
+    }
+
+    m_Mode = mode;
+    m_TraceFileName = pTraceFileName;
+    m_WindowSize = windowSize;
+
+    const InitResult result = m_Layout.Load(pFileName, fileSize, m_PageSizeThreshold);
+    if (result != InitResult::Ok)
+    {
+        return result;
+    }
+
+    const size_t pageCount = m_Layout.GetPageCount();
+    m_Used.reset(new std::atomic<bool>[pageCount]());
+
+    if (m_Mode == Mode::Record)
+    {
+        m_BlobPhases.reset(new std::atomic<uint8_t>[m_Layout.GetBlobCount()]());
+    }
+    else
+    {
+        std::vector<DatabaseTraceEntry> trace;
+        if (!LoadDatabaseTrace(pTraceFileName, trace))
+        {
+            return InitResult::FailedToOpenDatabaseRecords;
+        }
+
+        // Entries which no longer match a page (the trace was recorded against a
+        // different database or page size) are dropped
+        m_PageTraceIndex.assign(pageCount, NOT_IN_TRACE);
+        uint64_t traceBytes = 0;
+        for (const auto& entry : trace)
+        {
+            const size_t pageIndex = m_Layout.FindPage(entry.PageOffset);
+            if (pageIndex >= pageCount || m_PageTraceIndex[pageIndex] != NOT_IN_TRACE)
+            {
+                continue;
+            }
+
+            m_PageTraceIndex[pageIndex] = m_TracePages.size();
+            m_TracePages.push_back(static_cast<uint32_t>(pageIndex));
+            m_TraceStart.push_back(traceBytes);
+            traceBytes += m_Layout.GetPage(pageIndex).PageSize;
+        }
+
+        m_PrefetchState.reset(new std::atomic<uint8_t>[pageCount]());
+        StartPrefetching();
+    }
+
+    return InitResult::Ok;
+}
+
+//------------------------------------------------------------------------------
+// StartPrefetching
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::StartPrefetching()
+{
+    // The tasks occupy their workers until the trace is exhausted, so leave at
+    // least half of the pool free for the replay's own work
+    const size_t taskCount = g_threadPoolThreadCount / 2;
+    if (taskCount == 0)
+    {
+        NV_MESSAGE("Database prefetch disabled: the thread pool needs at least 2 threads");
+        return;
+    }
+
+    NV_MESSAGE_VERBOSE("Database prefetch: %zu pages in trace, %zu tasks", m_TracePages.size(), taskCount);
+    for (size_t i = 0; i < taskCount; ++i)
+    {
+        m_Tasks.push_back(NvExecuteOnThreadPool([this]() {
+            PrefetchLoop();
+        }));
+    }
+}
+
+//------------------------------------------------------------------------------
+// PrefetchLoop
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::PrefetchLoop()
+{
+    // Pages claimed by this task, handed to the database in batches so that they
+    // can be read with one submission
+    std::vector<uint32_t> batch;
+    std::vector<uint64_t> batchOffsets;
+    auto flushBatch = [&]() {
+        if (batch.empty())
+        {
+            return;
+        }
+
+        batchOffsets.clear();
+        for (uint32_t pageIndex : batch)
+        {
+            batchOffsets.push_back(m_Layout.GetPage(pageIndex).PageOffset);
+        }
+        m_Database.PrefetchPages(batchOffsets.data(), batchOffsets.size());
+
+        for (uint32_t pageIndex : batch)
+        {
+            m_PrefetchState[pageIndex] = Prefetched;
+        }
+        m_PrefetchedPages += batch.size();
+        batch.clear();
+    };
+
+    for (;;)
+    {
+        const size_t traceIndex = m_NextTraceIndex.fetch_add(1);
+        if (traceIndex >= m_TracePages.size())
+        {
+            flushBatch();
+            return;
+        }
+
+        // Wait until this entry falls inside the window ahead of the replay.  The
+        // pages already claimed are read first rather than held back while waiting.
+        {
+            std::unique_lock<std::mutex> lock(m_WindowMutex);
+            auto inWindow = [&]() {
+                return m_Stopping || m_TraceStart[traceIndex] < m_ConsumedBytes + m_WindowSize;
+            };
+            if (!inWindow() && !batch.empty())
+            {
+                lock.unlock();
+                flushBatch();
+                lock.lock();
+            }
+            m_WindowCondition.wait(lock, inWindow);
+            if (m_Stopping)
+            {
+                return;
+            }
+        }
+
+        // Skip pages the replay has already reached
+        const uint32_t pageIndex = m_TracePages[traceIndex];
+        if (m_Used[pageIndex])
+        {
+            continue;
+        }
+
+        uint8_t expected = NotPrefetched;
+        if (!m_PrefetchState[pageIndex].compare_exchange_strong(expected, Prefetching))
+        {
+            continue;
+        }
+
+        batch.push_back(pageIndex);
+        if (batch.size() >= PREFETCH_BATCH_SIZE)
+        {
+            flushBatch();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Finish
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::Finish()
+{
+    if (m_Finished)
+    {
+        return;
+    }
+    m_Finished = true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_WindowMutex);
+        m_Stopping = true;
+    }
+    m_WindowCondition.notify_all();
+    for (auto& task : m_Tasks)
+    {
+        if (task.valid())
+        {
+            task.wait();
+        }
+    }
+    m_Tasks.clear();
+
+    if (!m_Used)
+    {
+        return;
+    }
+
+    if (m_Mode == Mode::Record)
+    {
+        std::lock_guard<std::mutex> lock(m_RecordMutex);
+        std::vector<uint8_t> blobPhases;
+        blobPhases.reserve(m_RecordedBlobs.size());
+        for (uint32_t index : m_RecordedBlobs)
+        {
+            blobPhases.push_back(m_BlobPhases[index].load(std::memory_order_relaxed));
+        }
+
+        if (SaveDatabaseTrace(m_TraceFileName.c_str(), m_Recorded, m_RecordedBlobs, blobPhases))
+        {
+            NV_MESSAGE_VERBOSE("Wrote database trace '%s' (%zu pages, %zu blobs)", m_TraceFileName.c_str(), m_Recorded.size(), m_RecordedBlobs.size());
+        }
+        else
+        {
+            NV_MESSAGE("Failed to write database trace '%s'", m_TraceFileName.c_str());
+        }
+    }
+    else
+    {
+        NV_MESSAGE_VERBOSE("Database prefetch: %llu pages prefetched, %llu ready before first use, %llu late, %llu not in trace",
+            static_cast<unsigned long long>(m_PrefetchedPages),
+            static_cast<unsigned long long>(m_HitPages),
+            static_cast<unsigned long long>(m_LatePages),
+            static_cast<unsigned long long>(m_UntracedPages));
+    }
+}
+
+//------------------------------------------------------------------------------
+// OnRead
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::OnRead(const DATABASE_HANDLE& handle)
+{
+    const DatabaseBlobLocation* pLocation = m_Layout.GetBlobLocation(handle);
+    if (!pLocation || pLocation->PageIndex == DatabaseBlobLocation::NO_PAGE)
+    {
+        return;
+    }
+
+    // Only the first use of each page is interesting; keep the common path to a load
+    std::atomic<bool>& used = m_Used[pLocation->PageIndex];
+    if (!used.load(std::memory_order_relaxed) && !used.exchange(true))
+    {
+        OnFirstUse(pLocation->PageIndex);
+    }
+
+    if (m_Mode == Mode::Record)
+    {
+        // The first phase a blob is read in is also its first use
+        const auto index = static_cast<uint32_t>(handle.value);
+        const uint8_t phaseBit = DatabasePhaseBit(GetDatabasePhase());
+        std::atomic<uint8_t>& blobPhases = m_BlobPhases[index];
+        if (!(blobPhases.load(std::memory_order_relaxed) & phaseBit) && blobPhases.fetch_or(phaseBit) == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_RecordMutex);
+            m_RecordedBlobs.push_back(index);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// OnFirstUse
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::OnFirstUse(size_t pageIndex)
+{
+    if (m_Mode == Mode::Record)
+    {
+        const DatabasePageRecord& page = m_Layout.GetPage(pageIndex);
+        std::lock_guard<std::mutex> lock(m_RecordMutex);
+        m_Recorded.push_back({ page.PageOffset, page.PageSize });
+        return;
+    }
+
+    const size_t traceIndex = m_PageTraceIndex[pageIndex];
+    if (traceIndex == NOT_IN_TRACE)
+    {
+        ++m_UntracedPages;
+        return;
+    }
+
+    if (m_PrefetchState[pageIndex] == Prefetched)
+    {
+        ++m_HitPages;
+    }
+    else
+    {
+        ++m_LatePages;
+    }
+
+    // Advance the window
+    const uint64_t consumedBytes = m_TraceStart[traceIndex] + m_Layout.GetPage(pageIndex).PageSize;
+    {
+        std::lock_guard<std::mutex> lock(m_WindowMutex);
+        if (consumedBytes <= m_ConsumedBytes)
+        {
+            return;
+        }
+        m_ConsumedBytes = consumedBytes;
+    }
+    m_WindowCondition.notify_all();
+}
+
+//------------------------------------------------------------------------------
+// GetSize
+//------------------------------------------------------------------------------
+uint64_t PrefetchingDatabase::GetSize(const DATABASE_HANDLE& handle)
+{
+    return m_Database.GetSize(handle);
+}
+
+//------------------------------------------------------------------------------
+// Lock
+//------------------------------------------------------------------------------
+DataScope::LockedPageHandle PrefetchingDatabase::Lock(uint64_t pageOffset)
+{
+    return m_Database.Lock(pageOffset);
+}
+
+//------------------------------------------------------------------------------
+// Unlock
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::Unlock(DataScope::LockedPageHandle pPageHandle)
+{
+    m_Database.Unlock(pPageHandle);
+}
+
+//------------------------------------------------------------------------------
+// Prefetch
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::Prefetch(uint64_t pageOffset)
+{
+    m_Database.Prefetch(pageOffset);
+}
+
+//------------------------------------------------------------------------------
+// PrefetchPages
+//------------------------------------------------------------------------------
+void PrefetchingDatabase::PrefetchPages(const uint64_t* pPageOffsets, size_t count)
+{
+    m_Database.PrefetchPages(pPageOffsets, count);
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* PrefetchingDatabase::DoRead(const DATABASE_HANDLE& handle)
+{
+    OnRead(handle);
+    return m_Database.DoRead(handle);
+}
+
+//------------------------------------------------------------------------------
+// DoRead
+//------------------------------------------------------------------------------
+void* PrefetchingDatabase::DoRead(const DATABASE_HANDLE& handle, DataScopeTracker& scopeTracker)
+{
+    OnRead(handle);
+    return m_Database.DoRead(handle, scopeTracker);
+}
+
+//------------------------------------------------------------------------------
+// DoReadStatic
+//------------------------------------------------------------------------------
+void* PrefetchingDatabase::DoReadStatic(const DATABASE_HANDLE& handle)
+{
+    OnRead(handle);
+    return m_Database.DoReadStatic(handle);
+}
+
+} // namespace Serialization
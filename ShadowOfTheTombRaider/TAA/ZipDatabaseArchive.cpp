@@ -0,0 +1,786 @@
+//--------------------------------------------------------------------------------------
+// File: ZipDatabaseArchive.cpp
+//
+// Random access to a database file inside a zip archive, without extracting it.
+//--------------------------------------------------------------------------------------
+
+#include "ZipDatabaseArchive.h"
+
+#include "CommonReplay.h"
+#include "DatabaseLayout.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#if defined(NV_USE_ZLIB)
+#include <zlib.h>
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Serialization {
+
+namespace {
+
+const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034B50;
+const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014B50;
+const uint32_t END_OF_DIRECTORY_SIGNATURE = 0x06054B50;
+const uint32_t ZIP64_END_OF_DIRECTORY_SIGNATURE = 0x06064B50;
+const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064B50;
+const uint16_t ZIP64_EXTRA_ID = 0x0001;
+const uint16_t FLAG_ENCRYPTED = 0x0001;
+
+const size_t LOCAL_HEADER_SIZE = 30;
+const size_t CENTRAL_HEADER_SIZE = 46;
+const size_t END_OF_DIRECTORY_SIZE = 22;
+const size_t ZIP64_LOCATOR_SIZE = 20;
+const size_t ZIP64_END_OF_DIRECTORY_SIZE = 56;
+const size_t MAX_COMMENT_SIZE = 0xFFFF;
+
+// Compressed bytes read at a time while inflating
+const size_t INPUT_CHUNK_SIZE = 256 * 1024;
+
+struct CheckpointIndexHeader
+{
+    static const uint32_t MAGIC = 0x585A564E; // "NVZX"
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t archiveSize;
+    uint64_t entryOffset;
+    uint64_t compressedSize;
+    uint64_t size;
+    uint32_t crc;
+    uint32_t windowSize;
+    uint64_t checkpointSpan;
+    uint64_t checkpointCount;
+};
+
+std::atomic<uint64_t> s_nextArchiveId(1);
+
+//------------------------------------------------------------------------------
+// Little-endian fields of the zip headers
+//------------------------------------------------------------------------------
+uint16_t ReadU16(const uint8_t* pData)
+{
+    return static_cast<uint16_t>(pData[0] | (pData[1] << 8));
+}
+
+uint32_t ReadU32(const uint8_t* pData)
+{
+    return static_cast<uint32_t>(pData[0]) | (static_cast<uint32_t>(pData[1]) << 8) | (static_cast<uint32_t>(pData[2]) << 16) | (static_cast<uint32_t>(pData[3]) << 24);
+}
+
+uint64_t ReadU64(const uint8_t* pData)
+{
+    return static_cast<uint64_t>(ReadU32(pData)) | (static_cast<uint64_t>(ReadU32(pData + 4)) << 32);
+}
+
+//------------------------------------------------------------------------------
+// EntryNameMatches - true if the entry is pEntryName, in any directory
+//------------------------------------------------------------------------------
+bool EntryNameMatches(const char* pName, size_t nameLength, const char* pEntryName)
+{
+    const size_t entryNameLength = strlen(pEntryName);
+    if (nameLength < entryNameLength || memcmp(pName + nameLength - entryNameLength, pEntryName, entryNameLength) != 0)
+    {
+        return false;
+    }
+
+    return nameLength == entryNameLength || pName[nameLength - entryNameLength - 1] == '/' || pName[nameLength - entryNameLength - 1] == '\\';
+}
+
+#if defined(NV_USE_ZLIB)
+//------------------------------------------------------------------------------
+// InflateCursor - a raw inflate stream owned by one thread, left wherever its
+// last read ended
+//------------------------------------------------------------------------------
+struct InflateCursor
+{
+    InflateCursor()
+        : Stream()
+        , Initialized(false)
+        , ArchiveId(0)
+        , Offset(0)
+        , CompressedOffset(0)
+        , Input()
+        , Discard()
+    {
+    }
+
+    ~InflateCursor()
+    {
+        if (Initialized)
+        {
+            inflateEnd(&Stream);
+        }
+    }
+
+    z_stream Stream;
+    bool Initialized;
+    uint64_t ArchiveId; // Archive the stream is positioned in, zero if none
+    uint64_t Offset; // In the entry's uncompressed data
+    uint64_t CompressedOffset; // Of the next entry byte to read into Input
+    std::vector<uint8_t> Input;
+    std::vector<uint8_t> Discard; // Output before the start of a read
+};
+
+thread_local InflateCursor t_cursor;
+#endif
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// ZipDatabaseArchive
+//------------------------------------------------------------------------------
+ZipDatabaseArchive::ZipDatabaseArchive()
+    : m_Method()
+    , m_Crc()
+    , m_EntryOffset()
+    , m_CompressedSize()
+    , m_Size()
+    , m_ArchiveSize()
+    , m_Id()
+    , m_Checkpoints()
+    , m_Windows()
+#if defined(_WIN32)
+    , m_hFile(INVALID_HANDLE_VALUE)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+//------------------------------------------------------------------------------
+// ~ZipDatabaseArchive
+//------------------------------------------------------------------------------
+ZipDatabaseArchive::~ZipDatabaseArchive()
+{
+    Close();
+}
+
+//------------------------------------------------------------------------------
+// GetIndexFileName
+//------------------------------------------------------------------------------
+std::string ZipDatabaseArchive::GetIndexFileName(const char* pFileName)
+{
+    return std::string(pFileName) + ".index";
+}
+
+//------------------------------------------------------------------------------
+// Open
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::Open(const char* pFileName, const char* pEntryName)
+{
+    Close();
+
+    uint64_t archiveSize = 0;
+    if (!pFileName || !pEntryName || !DatabaseLayout::GetFileSize(pFileName, archiveSize))
+    {
+        return false;
+    }
+
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    m_hFile = hFile;
+#else
+    m_fd = open(pFileName, O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+#endif
+
+    m_ArchiveSize = archiveSize;
+    m_Id = s_nextArchiveId++;
+
+    bool success = FindEntry(pEntryName, archiveSize);
+    if (!success)
+    {
+        NV_MESSAGE("'%s' does not hold a readable entry named '%s'", pFileName, pEntryName);
+    }
+    else if (m_Method == METHOD_DEFLATED)
+    {
+#if defined(NV_USE_ZLIB)
+        const std::string indexFileName = GetIndexFileName(pFileName);
+        if (!LoadCheckpoints(indexFileName))
+        {
+            NV_MESSAGE("Indexing '%s' in '%s' for random access", pEntryName, pFileName);
+            success = BuildCheckpoints();
+            if (success && !SaveCheckpoints(indexFileName))
+            {
+                NV_MESSAGE("Failed to write '%s'; the archive will be indexed again on the next run", indexFileName.c_str());
+            }
+        }
+#else
+        NV_MESSAGE("'%s' in '%s' is deflated, which this build does not support", pEntryName, pFileName);
+        success = false;
+#endif
+    }
+
+    if (!success)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Close
+//------------------------------------------------------------------------------
+void ZipDatabaseArchive::Close()
+{
+#if defined(_WIN32)
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+
+    m_Method = 0;
+    m_Crc = 0;
+    m_EntryOffset = 0;
+    m_CompressedSize = 0;
+    m_Size = 0;
+    m_ArchiveSize = 0;
+    m_Id = 0;
+    m_Checkpoints.clear();
+    m_Windows.clear();
+}
+
+//------------------------------------------------------------------------------
+// FindEntry - parses the central directory and the entry's local header
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::FindEntry(const char* pEntryName, uint64_t archiveSize)
+{
+    // The end of central directory record is followed only by the archive
+    // comment, and preceded by the zip64 locator if there is one
+    if (archiveSize < END_OF_DIRECTORY_SIZE)
+    {
+        return false;
+    }
+    const size_t tailSize = static_cast<size_t>(std::min<uint64_t>(archiveSize, ZIP64_LOCATOR_SIZE + END_OF_DIRECTORY_SIZE + MAX_COMMENT_SIZE));
+    std::vector<uint8_t> tail(tailSize);
+    if (!ReadFromFile(archiveSize - tailSize, tailSize, tail.data()))
+    {
+        return false;
+    }
+
+    size_t endOfDirectory = tailSize - END_OF_DIRECTORY_SIZE + 1;
+    while (endOfDirectory-- > 0 && ReadU32(tail.data() + endOfDirectory) != END_OF_DIRECTORY_SIGNATURE)
+    {
+    }
+    if (endOfDirectory >= tailSize)
+    {
+        return false;
+    }
+
+    const uint8_t* pEnd = tail.data() + endOfDirectory;
+    uint64_t entryCount = ReadU16(pEnd + 10);
+    uint64_t directorySize = ReadU32(pEnd + 12);
+    uint64_t directoryOffset = ReadU32(pEnd + 16);
+
+    // Saturated fields are held by the zip64 end of central directory record
+    if (entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF)
+    {
+        if (endOfDirectory < ZIP64_LOCATOR_SIZE || ReadU32(pEnd - ZIP64_LOCATOR_SIZE) != ZIP64_LOCATOR_SIGNATURE)
+        {
+            return false;
+        }
+
+        const uint64_t zip64EndOffset = ReadU64(pEnd - ZIP64_LOCATOR_SIZE + 8);
+        uint8_t zip64End[ZIP64_END_OF_DIRECTORY_SIZE] = {};
+        if (archiveSize < sizeof(zip64End) || zip64EndOffset > archiveSize - sizeof(zip64End)
+            || !ReadFromFile(zip64EndOffset, sizeof(zip64End), zip64End)
+            || ReadU32(zip64End) != ZIP64_END_OF_DIRECTORY_SIGNATURE)
+        {
+            return false;
+        }
+
+        entryCount = ReadU64(zip64End + 32);
+        directorySize = ReadU64(zip64End + 40);
+        directoryOffset = ReadU64(zip64End + 48);
+    }
+
+    if (directoryOffset > archiveSize || directorySize > archiveSize - directoryOffset)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> directory(static_cast<size_t>(directorySize));
+    if (!ReadFromFile(directoryOffset, directorySize, directory.data()))
+    {
+        return false;
+    }
+
+    size_t position = 0;
+    for (uint64_t i = 0; i < entryCount; ++i)
+    {
+        if (directory.size() - position < CENTRAL_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        const uint8_t* pHeader = directory.data() + position;
+        const size_t nameLength = ReadU16(pHeader + 28);
+        const size_t extraLength = ReadU16(pHeader + 30);
+        const size_t commentLength = ReadU16(pHeader + 32);
+        const size_t headerSize = CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+        if (ReadU32(pHeader) != CENTRAL_HEADER_SIGNATURE || directory.size() - position < headerSize)
+        {
+            return false;
+        }
+        position += headerSize;
+
+        const char* pName = reinterpret_cast<const char*>(pHeader + CENTRAL_HEADER_SIZE);
+        if (!EntryNameMatches(pName, nameLength, pEntryName))
+        {
+            continue;
+        }
+
+        const uint16_t flags = ReadU16(pHeader + 8);
+        const uint16_t method = ReadU16(pHeader + 10);
+        const uint32_t crc = ReadU32(pHeader + 16);
+        uint64_t compressedSize = ReadU32(pHeader + 20);
+        uint64_t size = ReadU32(pHeader + 24);
+        uint64_t localHeaderOffset = ReadU32(pHeader + 42);
+
+        // The zip64 extra field holds 64-bit values for whichever of these are
+        // saturated, in this order
+        const uint8_t* pExtra = pHeader + CENTRAL_HEADER_SIZE + nameLength;
+        for (size_t extra = 0; extra + 4 <= extraLength;)
+        {
+            const uint16_t id = ReadU16(pExtra + extra);
+            const size_t fieldSize = ReadU16(pExtra + extra + 2);
+            if (extra + 4 + fieldSize > extraLength)
+            {
+                break;
+            }
+
+            if (id == ZIP64_EXTRA_ID)
+            {
+                const uint8_t* pField = pExtra + extra + 4;
+                const uint8_t* pFieldEnd = pField + fieldSize;
+                for (uint64_t* pValue : { &size, &compressedSize, &localHeaderOffset })
+                {
+                    if (*pValue == 0xFFFFFFFF && pFieldEnd - pField >= 8)
+                    {
+                        *pValue = ReadU64(pField);
+                        pField += 8;
+                    }
+                }
+            }
+            extra += 4 + fieldSize;
+        }
+
+        if (flags & FLAG_ENCRYPTED)
+        {
+            NV_MESSAGE("'%.*s' is encrypted", static_cast<int>(nameLength), pName);
+            return false;
+        }
+        if (method != METHOD_STORED && method != METHOD_DEFLATED)
+        {
+            NV_MESSAGE("'%.*s' uses zip compression method %u; only stored and deflated entries are supported", static_cast<int>(nameLength), pName, method);
+            return false;
+        }
+        if (method == METHOD_STORED && compressedSize != size)
+        {
+            return false;
+        }
+
+        // The local header's name and extra field can differ from the central directory's
+        uint8_t localHeader[LOCAL_HEADER_SIZE] = {};
+        if (archiveSize < LOCAL_HEADER_SIZE || localHeaderOffset > archiveSize - LOCAL_HEADER_SIZE
+            || !ReadFromFile(localHeaderOffset, LOCAL_HEADER_SIZE, localHeader)
+            || ReadU32(localHeader) != LOCAL_HEADER_SIGNATURE)
+        {
+            return false;
+        }
+
+        const uint64_t dataOffset = localHeaderOffset + LOCAL_HEADER_SIZE + ReadU16(localHeader + 26) + ReadU16(localHeader + 28);
+        if (dataOffset > archiveSize || compressedSize > archiveSize - dataOffset)
+        {
+            return false;
+        }
+
+        m_Method = method;
+        m_Crc = crc;
+        m_EntryOffset = dataOffset;
+        m_CompressedSize = compressedSize;
+        m_Size = size;
+        return true;
+    }
+
+    return false;
+}
+
+#if defined(NV_USE_ZLIB)
+//------------------------------------------------------------------------------
+// BuildCheckpoints - inflates the whole entry, recording a checkpoint at the
+// first block boundary after every CHECKPOINT_SPAN bytes of output
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::BuildCheckpoints()
+{
+    z_stream stream = {};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+    {
+        return false;
+    }
+
+    // The start of the stream is a block boundary with no history
+    const Checkpoint start = {};
+    m_Checkpoints.assign(1, start);
+    m_Windows.assign(WINDOW_SIZE, 0);
+
+    std::vector<uint8_t> input(INPUT_CHUNK_SIZE);
+    std::vector<uint8_t> window(WINDOW_SIZE); // Circular; output is inflated into it
+    uint64_t compressedPosition = 0;
+    uint64_t totalIn = 0;
+    uint64_t totalOut = 0;
+    uLong crc = crc32(0, Z_NULL, 0);
+
+    int result = Z_OK;
+    while (result != Z_STREAM_END)
+    {
+        // The end of the last block may only be reported once all input is read
+        if (stream.avail_in == 0 && compressedPosition < m_CompressedSize)
+        {
+            const uint64_t count = std::min<uint64_t>(input.size(), m_CompressedSize - compressedPosition);
+            if (!ReadFromFile(m_EntryOffset + compressedPosition, count, input.data()))
+            {
+                result = Z_ERRNO;
+                break;
+            }
+            compressedPosition += count;
+            stream.next_in = input.data();
+            stream.avail_in = static_cast<uInt>(count);
+        }
+
+        if (stream.avail_out == 0)
+        {
+            stream.next_out = window.data();
+            stream.avail_out = WINDOW_SIZE;
+        }
+
+        const Bytef* pOutput = stream.next_out;
+        const uInt availableIn = stream.avail_in;
+        const uInt availableOut = stream.avail_out;
+        result = inflate(&stream, Z_BLOCK);
+        const uInt produced = availableOut - stream.avail_out;
+        totalIn += availableIn - stream.avail_in;
+        totalOut += produced;
+        crc = crc32(crc, pOutput, produced);
+
+        // Z_BUF_ERROR without progress means the entry is truncated
+        if (result != Z_OK && result != Z_STREAM_END && !(result == Z_BUF_ERROR && (produced > 0 || availableIn > stream.avail_in)))
+        {
+            break;
+        }
+
+        // At the end of a block other than the last, once far enough from the
+        // previous checkpoint
+        const bool blockBoundary = (stream.data_type & 128) && !(stream.data_type & 64);
+        if (blockBoundary && totalOut - m_Checkpoints.back().Offset >= CHECKPOINT_SPAN)
+        {
+            const Checkpoint checkpoint = { totalOut, totalIn, static_cast<uint32_t>(stream.data_type & 7), 0 };
+            m_Checkpoints.push_back(checkpoint);
+
+            // Unroll the circular window so it ends with the latest output
+            const size_t windowPosition = WINDOW_SIZE - stream.avail_out;
+            m_Windows.resize(m_Windows.size() + WINDOW_SIZE);
+            uint8_t* pWindow = m_Windows.data() + m_Windows.size() - WINDOW_SIZE;
+            memcpy(pWindow, window.data() + windowPosition, WINDOW_SIZE - windowPosition);
+            memcpy(pWindow + WINDOW_SIZE - windowPosition, window.data(), windowPosition);
+        }
+    }
+    inflateEnd(&stream);
+
+    const bool success = result == Z_STREAM_END && totalOut == m_Size && static_cast<uint32_t>(crc) == m_Crc;
+    if (!success)
+    {
+        NV_MESSAGE("The zip entry is corrupt: %s", result == Z_STREAM_END ? "size or CRC mismatch" : "inflate failed");
+        m_Checkpoints.clear();
+        m_Windows.clear();
+    }
+    return success;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// LoadCheckpoints - false if the index is missing or was built for another
+// archive
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::LoadCheckpoints(const std::string& fileName)
+{
+    FILE* pFile = fopen(fileName.c_str(), "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    CheckpointIndexHeader header = {};
+    bool success = fread(&header, sizeof(header), 1, pFile) == 1
+        && header.magic == CheckpointIndexHeader::MAGIC
+        && header.version == CheckpointIndexHeader::CURRENT_VERSION
+        && header.archiveSize == m_ArchiveSize
+        && header.entryOffset == m_EntryOffset
+        && header.compressedSize == m_CompressedSize
+        && header.size == m_Size
+        && header.crc == m_Crc
+        && header.windowSize == WINDOW_SIZE
+        && header.checkpointSpan == CHECKPOINT_SPAN
+        && header.checkpointCount > 0
+        && header.checkpointCount <= m_Size / CHECKPOINT_SPAN + 1;
+
+    if (success)
+    {
+        const size_t count = static_cast<size_t>(header.checkpointCount);
+        m_Checkpoints.resize(count);
+        m_Windows.resize(count * WINDOW_SIZE);
+        success = fread(m_Checkpoints.data(), sizeof(Checkpoint), count, pFile) == count
+            && fread(m_Windows.data(), WINDOW_SIZE, count, pFile) == count;
+    }
+
+    // Validate the index so that reads never need to
+    for (size_t i = 0; success && i < m_Checkpoints.size(); ++i)
+    {
+        const Checkpoint& checkpoint = m_Checkpoints[i];
+        success = checkpoint.Offset <= m_Size && checkpoint.CompressedOffset <= m_CompressedSize && checkpoint.Bits < 8
+            && (checkpoint.Bits == 0 || checkpoint.CompressedOffset > 0)
+            && (i == 0 ? checkpoint.Offset == 0 && checkpoint.CompressedOffset == 0 : checkpoint.Offset > m_Checkpoints[i - 1].Offset);
+    }
+
+    fclose(pFile);
+    if (!success)
+    {
+        m_Checkpoints.clear();
+        m_Windows.clear();
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// SaveCheckpoints
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::SaveCheckpoints(const std::string& fileName) const
+{
+    FILE* pFile = fopen(fileName.c_str(), "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    const CheckpointIndexHeader header = {
+        CheckpointIndexHeader::MAGIC,
+        CheckpointIndexHeader::CURRENT_VERSION,
+        m_ArchiveSize,
+        m_EntryOffset,
+        m_CompressedSize,
+        m_Size,
+        m_Crc,
+        WINDOW_SIZE,
+        CHECKPOINT_SPAN,
+        m_Checkpoints.size(),
+    };
+
+    bool success = fwrite(&header, sizeof(header), 1, pFile) == 1
+        && fwrite(m_Checkpoints.data(), sizeof(Checkpoint), m_Checkpoints.size(), pFile) == m_Checkpoints.size()
+        && fwrite(m_Windows.data(), 1, m_Windows.size(), pFile) == m_Windows.size();
+
+    success = (fclose(pFile) == 0) && success;
+    if (!success)
+    {
+        remove(fileName.c_str());
+    }
+    return success;
+}
+
+//------------------------------------------------------------------------------
+// ReadFromFile - positional read, safe to call from several threads at once
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::ReadFromFile(uint64_t offset, uint64_t size, uint8_t* pDestination) const
+{
+    while (size > 0)
+    {
+#if defined(_WIN32)
+        const DWORD chunkSize = static_cast<DWORD>(std::min<uint64_t>(size, 1u << 30));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD bytesRead = 0;
+        if (!ReadFile(m_hFile, pDestination, chunkSize, &bytesRead, &overlapped) || bytesRead == 0)
+        {
+            return false;
+        }
+#else
+        const size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(size, 1u << 30));
+        const ssize_t bytesRead = pread(m_fd, pDestination, chunkSize, static_cast<off_t>(offset));
+        if (bytesRead <= 0)
+        {
+            return false;
+        }
+#endif
+
+        offset += static_cast<uint64_t>(bytesRead);
+        size -= static_cast<uint64_t>(bytesRead);
+        pDestination += bytesRead;
+    }
+
+    return true;
+}
+
+#if defined(NV_USE_ZLIB)
+//------------------------------------------------------------------------------
+// Inflate - continues the calling thread's stream if it is positioned at or
+// after the closest checkpoint before offset, otherwise restarts it there
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::Inflate(uint64_t offset, uint64_t size, uint8_t* pDestination) const
+{
+    InflateCursor& cursor = t_cursor;
+    z_stream& stream = cursor.Stream;
+
+    auto it = std::upper_bound(m_Checkpoints.begin(), m_Checkpoints.end(), offset, [](uint64_t value, const Checkpoint& checkpoint) {
+        return value < checkpoint.Offset;
+    });
+    --it;
+
+    if (cursor.ArchiveId != m_Id || cursor.Offset > offset || cursor.Offset < it->Offset)
+    {
+        cursor.ArchiveId = 0;
+        if (!cursor.Initialized)
+        {
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            {
+                return false;
+            }
+            cursor.Initialized = true;
+        }
+        else if (inflateReset(&stream) != Z_OK)
+        {
+            return false;
+        }
+
+        // A block can start part way through a byte
+        if (it->Bits > 0)
+        {
+            uint8_t previous = 0;
+            if (!ReadFromFile(m_EntryOffset + it->CompressedOffset - 1, 1, &previous) || inflatePrime(&stream, static_cast<int>(it->Bits), previous >> (8 - it->Bits)) != Z_OK)
+            {
+                return false;
+            }
+        }
+        if (it->Offset > 0)
+        {
+            const uint8_t* pWindow = m_Windows.data() + static_cast<size_t>(it - m_Checkpoints.begin()) * WINDOW_SIZE;
+            if (inflateSetDictionary(&stream, pWindow, WINDOW_SIZE) != Z_OK)
+            {
+                return false;
+            }
+        }
+
+        stream.avail_in = 0;
+        cursor.ArchiveId = m_Id;
+        cursor.Offset = it->Offset;
+        cursor.CompressedOffset = it->CompressedOffset;
+    }
+
+    cursor.Input.resize(INPUT_CHUNK_SIZE);
+    cursor.Discard.resize(WINDOW_SIZE);
+
+    const uint64_t end = offset + size;
+    while (cursor.Offset < end)
+    {
+        if (stream.avail_in == 0)
+        {
+            const uint64_t count = std::min<uint64_t>(cursor.Input.size(), m_CompressedSize - cursor.CompressedOffset);
+            if (count == 0 || !ReadFromFile(m_EntryOffset + cursor.CompressedOffset, count, cursor.Input.data()))
+            {
+                cursor.ArchiveId = 0;
+                return false;
+            }
+            cursor.CompressedOffset += count;
+            stream.next_in = cursor.Input.data();
+            stream.avail_in = static_cast<uInt>(count);
+        }
+
+        if (cursor.Offset < offset)
+        {
+            stream.next_out = cursor.Discard.data();
+            stream.avail_out = static_cast<uInt>(std::min<uint64_t>(cursor.Discard.size(), offset - cursor.Offset));
+        }
+        else
+        {
+            stream.next_out = pDestination + (cursor.Offset - offset);
+            stream.avail_out = static_cast<uInt>(std::min<uint64_t>(end - cursor.Offset, 1u << 30));
+        }
+
+        const uInt availableOut = stream.avail_out;
+        const int result = inflate(&stream, Z_NO_FLUSH);
+        cursor.Offset += availableOut - stream.avail_out;
+
+        // The stream cannot carry on past its end
+        if (result == Z_STREAM_END)
+        {
+            cursor.ArchiveId = 0;
+            return cursor.Offset >= end;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR)
+        {
+            cursor.ArchiveId = 0;
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Read
+//------------------------------------------------------------------------------
+bool ZipDatabaseArchive::Read(uint64_t offset, uint64_t size, uint8_t* pDestination) const
+{
+    if (offset > m_Size || size > m_Size - offset)
+    {
+        return false;
+    }
+    if (size == 0)
+    {
+        return true;
+    }
+
+    if (m_Method == METHOD_STORED)
+    {
+        return ReadFromFile(m_EntryOffset + offset, size, pDestination);
+    }
+
+#if defined(NV_USE_ZLIB)
+    return Inflate(offset, size, pDestination);
+#else
+    return false;
+#endif
+}
+
+} // namespace Serialization